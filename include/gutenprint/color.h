@@ -73,6 +73,20 @@ extern int stp_color_init(stp_vars_t *v, stp_image_t *image, size_t steps);
 extern int stp_color_get_row(stp_vars_t *v, stp_image_t *image,
 			     int row, unsigned *zero_mask);
 
+/*
+ * Acquire input and perform color conversion for COUNT consecutive rows
+ * starting at ROW.  OUTPUTS[i] is set to the converted row ROW + i, in
+ * the same form as stp_channel_get_output(); it remains valid until the
+ * next call to stp_color_get_row() or stp_color_get_rows().  If
+ * ZERO_MASKS is not NULL, the zero mask of each row is stored in it.
+ * Return value is status; zero is success.  If it fails, none of the
+ * rows should be used.
+ */
+extern int stp_color_get_rows(stp_vars_t *v, stp_image_t *image,
+			      int row, int count,
+			      const unsigned short **outputs,
+			      unsigned *zero_masks);
+
 extern stp_parameter_list_t stp_color_list_parameters(const stp_vars_t *v);
 
 extern void stp_color_describe_parameter(const stp_vars_t *v, const char *name,
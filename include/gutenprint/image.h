@@ -122,6 +122,26 @@ typedef struct stp_image
   void *rep;
 } stp_image_t;
 
+/**
+ * An optional function that transfers COUNT consecutive rows of an
+ * image, starting at ROW, in one call.  Row i of the band is copied to
+ * data + (i * byte_limit), in the same way that the get_row() member
+ * of the image would copy it.  Applications that can deliver several
+ * rows more cheaply than one at a time (for example, because they read
+ * their input in large blocks) may supply one with
+ * stp_set_image_get_rows_func(); if none is supplied, get_row() is
+ * called for each row instead.  Rows are requested in monotonically
+ * ascending order, as with get_row().
+ * @param image the image in use.
+ * @param data a pointer to count * byte_limit bytes of pixel data.
+ * @param byte_limit (image width * number of channels).
+ * @param row the first row.
+ * @param count the number of rows.
+ */
+typedef stp_image_status_t (*stp_image_get_rows_func_t)
+     (struct stp_image *image, unsigned char *data, size_t byte_limit,
+      int row, int count);
+
 extern void stp_image_init(stp_image_t *image);
 extern void stp_image_reset(stp_image_t *image);
 extern int stp_image_width(stp_image_t *image);
@@ -96,6 +96,14 @@ extern void stp_putraw(const stp_raw_t *r, const stp_vars_t *v);
 extern void stp_send_command(const stp_vars_t *v, const char *command,
 			     const char *format, ...);
 
+/*
+ * Output written by the functions above is buffered (the buffer size is
+ * set by the OutputBufferSize parameter, 0 for no buffering).  It is
+ * flushed by stp_start_job(), stp_print() and stp_end_job() before they
+ * return, after each pass of the weave, and by stp_flush_output().
+ */
+extern void stp_flush_output(const stp_vars_t *v);
+
 extern void stp_erputc(int ch);
 
 extern void stp_eprintf(const stp_vars_t *v, const char *format, ...)
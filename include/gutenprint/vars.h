@@ -29,6 +29,7 @@
 
 #include <gutenprint/array.h>
 #include <gutenprint/curve.h>
+#include <gutenprint/image.h>
 #include <gutenprint/string-list.h>
 
 #ifdef __cplusplus
@@ -428,6 +429,47 @@ extern void stp_set_errdata(stp_vars_t *v, void *val);
  */
 extern void *stp_get_errdata(const stp_vars_t *v);
 
+/**
+ * Set the function used to read a band of consecutive rows of IMAGE
+ * in one call.  This is optional; if it is not set (or is set to
+ * NULL), rows are read one at a time with the image's get_row().  It
+ * is kept in the vars rather than in the stp_image_t so that images
+ * built against older versions of the library remain valid.  It is
+ * only used for IMAGE itself, and not for any other image (such as
+ * one that a driver builds on top of IMAGE).
+ * @param v the vars to use.
+ * @param image the image that the function reads.
+ * @param val the value to set.
+ */
+extern void stp_set_image_get_rows_func(stp_vars_t *v, stp_image_t *image,
+					stp_image_get_rows_func_t val);
+
+/**
+ * Get the function used to read a band of rows of IMAGE.
+ * @param v the vars to use.
+ * @param image the image to be read.
+ * @returns the function, or NULL if none has been set for IMAGE.
+ */
+extern stp_image_get_rows_func_t
+stp_get_image_get_rows_func(const stp_vars_t *v, const stp_image_t *image);
+
+/**
+ * Read COUNT consecutive rows of the image, starting at ROW, into
+ * DATA, using the function set with stp_set_image_get_rows_func() if
+ * there is one and the image's get_row() for each row otherwise.
+ * @param v the vars to use.
+ * @param image the image to read.
+ * @param data a pointer to count * limit bytes of pixel data.
+ * @param limit (image width * number of channels).
+ * @param row the first row.
+ * @param count the number of rows.
+ * @returns the status of the image.
+ */
+extern stp_image_status_t stp_image_get_rows(const stp_vars_t *v,
+					     stp_image_t *image,
+					     unsigned char *data,
+					     size_t limit, int row, int count);
+
 /**
  * Merge defaults for a printer with user-chosen settings.
  * @deprecated This is likely to go away.
@@ -1523,6 +1565,91 @@ typedef struct stp_compdata compdata_t;
 
 extern void *stp_get_component_data(const stp_vars_t *v, const char *name);
 
+/**
+ * Opaque handle to a parameter or component data name.  A handle is
+ * obtained once from a name and may then be used to retrieve the value
+ * from any vars without looking the name up again.  Handles are never
+ * freed.
+ */
+typedef struct stp_parameter_handle *stp_parameter_handle_t;
+
+/**
+ * Get the handle of a parameter.  Repeated calls with the same name and
+ * type return the same handle.
+ * @param name the name of the parameter.
+ * @param type the type of the parameter.
+ * @returns the handle.
+ */
+extern stp_parameter_handle_t stp_parameter_handle(const char *name,
+						   stp_parameter_type_t type);
+
+/**
+ * Get the handle of component data.
+ * @param name the name of the component data.
+ * @returns the handle.
+ */
+extern stp_parameter_handle_t stp_component_data_handle(const char *name);
+
+/**
+ * Get a float parameter by handle.  The result is that of
+ * stp_get_float_parameter().
+ * @param v the vars to use.
+ * @param handle a handle of type STP_PARAMETER_TYPE_DOUBLE.
+ * @returns the float value.
+ */
+extern double stp_get_float_parameter_by_handle(const stp_vars_t *v,
+						stp_parameter_handle_t handle);
+
+/**
+ * Get an integer parameter by handle.  The result is that of
+ * stp_get_int_parameter().
+ * @param v the vars to use.
+ * @param handle a handle of type STP_PARAMETER_TYPE_INT.
+ * @returns the integer value.
+ */
+extern int stp_get_int_parameter_by_handle(const stp_vars_t *v,
+					   stp_parameter_handle_t handle);
+
+/**
+ * Get a boolean parameter by handle.  The result is that of
+ * stp_get_boolean_parameter().
+ * @param v the vars to use.
+ * @param handle a handle of type STP_PARAMETER_TYPE_BOOLEAN.
+ * @returns the boolean value.
+ */
+extern int stp_get_boolean_parameter_by_handle(const stp_vars_t *v,
+					       stp_parameter_handle_t handle);
+
+/**
+ * Get a string parameter by handle.  The result is that of
+ * stp_get_string_parameter().
+ * @param v the vars to use.
+ * @param handle a handle of type STP_PARAMETER_TYPE_STRING_LIST.
+ * @returns the string, or NULL if no parameter was found.
+ */
+extern const char *
+stp_get_string_parameter_by_handle(const stp_vars_t *v,
+				   stp_parameter_handle_t handle);
+
+/**
+ * Check if a parameter is set, by handle.
+ * @param v the vars to use.
+ * @param handle the handle of the parameter.
+ * @param active the minimum activity status.
+ */
+extern int stp_check_parameter_by_handle(const stp_vars_t *v,
+					 stp_parameter_handle_t handle,
+					 stp_parameter_activity_t active);
+
+/**
+ * Get component data by handle.
+ * @param v the vars to use.
+ * @param handle a handle from stp_component_data_handle().
+ * @returns the data, or NULL if there is none.
+ */
+extern void *stp_get_component_data_by_handle(const stp_vars_t *v,
+					      stp_parameter_handle_t handle);
+
 extern stp_parameter_verify_t stp_verify_parameter(const stp_vars_t *v,
 						   const char *parameter,
 						   int quiet);
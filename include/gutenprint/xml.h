@@ -47,6 +47,7 @@ extern void stp_unregister_xml_preload(const char *filename);
 
 extern int stp_xml_init_defaults(void);
 extern int stp_xml_parse_file(const char *file);
+extern stp_mxml_node_t *stp_xml_load_file(const char *file);
 
 extern long stp_xmlstrtol(const char *value);
 extern unsigned long stp_xmlstrtoul(const char *value);
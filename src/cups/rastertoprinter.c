@@ -24,6 +24,7 @@
  *   cancel_job()              - Cancel the current job...
  *   Image_get_appname()       - Get the application we are running.
  *   Image_get_row()           - Get one row of the image.
+ *   Image_get_rows()          - Get consecutive rows of the image.
  *   Image_height()            - Return the height of an image.
  *   Image_init()              - Initialize an image.
  *   Image_conclude()          - Close the progress display.
@@ -97,6 +98,10 @@ typedef struct
   int			last_percent;
   int			shrink_to_fit;
   CUPS_HEADER_T		header;		/* Page header from file */
+  unsigned char		*band;		/* Raster lines read ahead */
+  int			band_size;	/* Lines the band can hold */
+  int			band_row;	/* First line in the band */
+  int			band_count;	/* Lines in the band */
 } cups_image_t;
 
 static void	cups_writefunc(void *file, const char *buf, size_t bytes);
@@ -106,10 +111,15 @@ static const char *Image_get_appname(stp_image_t *image);
 static stp_image_status_t Image_get_row(stp_image_t *image,
 					unsigned char *data,
 					size_t byte_limit, int row);
+static stp_image_status_t Image_get_rows(stp_image_t *image,
+					 unsigned char *data,
+					 size_t byte_limit, int row,
+					 int count);
 static int	Image_height(stp_image_t *image);
 static int	Image_width(stp_image_t *image);
 static void	Image_conclude(stp_image_t *image);
 static void	Image_init(stp_image_t *image);
+static void	release_band(cups_image_t *cups);
 
 static stp_image_t theImage =
 {
@@ -350,6 +360,7 @@ initialize_page(cups_image_t *cups, const stp_vars_t *default_settings,
   stp_set_errfunc(v, cups_errfunc);
   stp_set_outdata(v, stdout);
   stp_set_errdata(v, stderr);
+  stp_set_image_get_rows_func(v, &theImage, Image_get_rows);
 
   if (cups->header.cupsBitsPerColor == 16)
     set_string_parameter(v, "ChannelBitDepth", "16");
@@ -1308,6 +1319,8 @@ main(int  argc,				/* I - Number of command-line arguments */
   */
 
   cups.page = 0;
+  cups.band = NULL;
+  release_band(&cups);
 
   if (! suppress_messages)
     fprintf(stderr, "DEBUG: Gutenprint: About to start printing loop.\n");
@@ -1398,6 +1411,7 @@ main(int  argc,				/* I - Number of command-line arguments */
        */
       if (cups.row < cups.header.cupsHeight)
 	purge_excess_data(&cups);
+      release_band(&cups);
       if (! suppress_messages)
 	fprintf(stderr, "DEBUG: Gutenprint: ================ Done printing page %d ================\n", cups.page + 1);
       cups.page ++;
@@ -1411,6 +1425,7 @@ main(int  argc,				/* I - Number of command-line arguments */
       fflush(stdout);
       stp_vars_destroy(v);
     }
+  release_band(&cups);
   cupsRasterClose(cups.ras);
   (void) times(&tms);
   (void) gettimeofday(&t2, NULL);
@@ -1500,83 +1515,94 @@ Image_get_appname(stp_image_t *image)		/* I - Image */
 
 
 /*
- * 'Image_get_row()' - Get one row of the image.
+ * 'read_ahead()' - Read raster lines until ROW has been read.
+ *
+ * Lines are read a band of whole lines at a time, each band with a
+ * single call to cupsRasterReadPixels(), into a buffer that lasts for
+ * the page.  Rows are handed out of the band, so the margins never have
+ * to be read separately.
  */
 
-static void
-throwaway_data(int amount, cups_image_t *cups)
+#define READ_AHEAD_BYTES	(4 * 1024 * 1024)
+#define READ_AHEAD_ROWS		256
+
+static int
+read_ahead(cups_image_t *cups, int row)
 {
-  unsigned char trash[4096];	/* Throwaway */
-  int block_count = amount / 4096;
-  int leftover = amount % 4096;
-  while (block_count > 0)
+  unsigned bytes_per_line = cups->header.cupsBytesPerLine;
+  if (!cups->band)
     {
-      cupsRasterReadPixels(cups->ras, trash, 4096);
-      block_count--;
+      cups->band_size = READ_AHEAD_BYTES / bytes_per_line;
+      if (cups->band_size > READ_AHEAD_ROWS)
+	cups->band_size = READ_AHEAD_ROWS;
+      else if (cups->band_size < 1)
+	cups->band_size = 1;
+      cups->band = stp_malloc((size_t) cups->band_size * bytes_per_line);
+      cups->band_row = cups->row;
+      cups->band_count = 0;
     }
-  if (leftover)
-    cupsRasterReadPixels(cups->ras, trash, leftover);
+  while (cups->row <= row && cups->row < cups->header.cupsHeight)
+    {
+      int count = cups->header.cupsHeight - cups->row;
+      if (count > cups->band_size)
+	count = cups->band_size;
+      if (! suppress_messages && ! suppress_verbose_messages)
+	fprintf(stderr, "DEBUG2: Gutenprint: Reading %d row%s from %d\n",
+		count, count == 1 ? "" : "s", cups->row);
+      cupsRasterReadPixels(cups->ras, cups->band, count * bytes_per_line);
+      cups->band_row = cups->row;
+      cups->band_count = count;
+      cups->row += count;
+    }
+  return row >= cups->band_row && row < cups->band_row + cups->band_count;
+}
+
+/*
+ * 'release_band()' - Free the read ahead buffer at the end of a page.
+ */
+
+static void
+release_band(cups_image_t *cups)
+{
+  STP_SAFE_FREE(cups->band);
+  cups->band_size = 0;
+  cups->band_row = 0;
+  cups->band_count = 0;
 }
 
+/*
+ * 'copy_row()' - Copy one row, less its trimmed margins, into DATA.
+ *
+ * The stp_image_t interface has the caller supply the buffer that each
+ * row is written to (the color converter's input band), so a row cannot
+ * be handed out as a pointer into the read ahead band.  When nothing is
+ * trimmed, Image_get_rows() reads the rows straight into that buffer
+ * and this copy is skipped; it remains for trimmed pages, for 1-bit
+ * rasters, and for Image_get_row(), which is asked for one row at a
+ * time and would otherwise call cupsRasterReadPixels() for every row.
+ */
+
 static stp_image_status_t
-Image_get_row(stp_image_t   *image,	/* I - Image */
-	      unsigned char *data,	/* O - Row */
-	      size_t	    byte_limit,	/* I - how many bytes in data */
-	      int           row)	/* I - Row number (unused) */
+copy_row(cups_image_t *cups, unsigned char *data, int row)
 {
-  cups_image_t	*cups;			/* CUPS image */
   int		i;			/* Looping var */
   int 		bytes_per_line;
-  int		margin;
-  stp_image_status_t tmp_image_status = Image_status;
-  unsigned char *orig = data;           /* Temporary pointer */
+  int		left_margin;
   static int warned = 0;                /* Error warning printed? */
-  int new_percent;
-  int left_margin, right_margin;
 
-  if ((cups = (cups_image_t *)(image->rep)) == NULL)
-    {
-      stp_i18n_printf(po, _("ERROR: Gutenprint image is not initialized!  "
-                            "Please report this bug to "
-			    "gimp-print-devel@lists.sourceforge.net\n"));
-      return STP_IMAGE_STATUS_ABORT;
-    }
   bytes_per_line =
     ((cups->adjusted_width * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
     CHAR_BIT;
-
   left_margin = ((cups->left_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
     CHAR_BIT;
-  right_margin = ((cups->right_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
-    CHAR_BIT;
-  margin = cups->header.cupsBytesPerLine - left_margin - bytes_per_line -
-    right_margin;
 
-  if (cups->row < cups->header.cupsHeight)
-  {
-    if (! suppress_messages && ! suppress_verbose_messages)
-      fprintf(stderr, "DEBUG2: Gutenprint: Reading %d %d\n",
-	      bytes_per_line, cups->row);
-    while (cups->row <= row && cups->row < cups->header.cupsHeight)
-      {
-	if (left_margin > 0)
-	  {
-	    if (! suppress_messages && ! suppress_verbose_messages)
-	      fprintf(stderr, "DEBUG2: Gutenprint: Tossing left %d (%d)\n",
-		      left_margin, cups->left_trim);
-	    throwaway_data(left_margin, cups);
-	  }
-	cupsRasterReadPixels(cups->ras, data, bytes_per_line);
-	cups->row ++;
-	if (margin + right_margin > 0)
-	  {
-	    if (! suppress_messages && ! suppress_verbose_messages)
-	      fprintf(stderr, "DEBUG2: Gutenprint: Tossing right %d (%d) + %d\n",
-		      right_margin, cups->right_trim, margin);
-	    throwaway_data(margin + right_margin, cups);
-	  }
-      }
-  }
+  if (row < cups->header.cupsHeight)
+    {
+      if (read_ahead(cups, row))
+	memcpy(data, cups->band +
+	       (size_t) (row - cups->band_row) * cups->header.cupsBytesPerLine +
+	       left_margin, bytes_per_line);
+    }
   else
     {
       switch (cups->header.cupsColorSpace)
@@ -1603,7 +1629,6 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
    * input, such as that generated by psnup.  The output is barely
    * legible, but it's better than the garbage output otherwise.
    */
-  data = orig;
   if (cups->header.cupsBitsPerPixel == 1)
     {
       if (warned == 0)
@@ -1621,8 +1646,13 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
 	    data[i]=0;
 	}
     }
+  return STP_IMAGE_STATUS_OK;
+}
 
-  new_percent = (int) (100.0 * cups->row / cups->header.cupsHeight);
+static stp_image_status_t
+report_progress(cups_image_t *cups, stp_image_status_t tmp_image_status)
+{
+  int new_percent = (int) (100.0 * cups->row / cups->header.cupsHeight);
   if (new_percent > cups->last_percent)
     {
       if (! suppress_messages)
@@ -1642,6 +1672,77 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
   return tmp_image_status;
 }
 
+/*
+ * 'Image_get_row()' - Get one row of the image.
+ */
+
+static stp_image_status_t
+Image_get_row(stp_image_t   *image,	/* I - Image */
+	      unsigned char *data,	/* O - Row */
+	      size_t	    byte_limit,	/* I - how many bytes in data */
+	      int           row)	/* I - Row number */
+{
+  cups_image_t	*cups;			/* CUPS image */
+  stp_image_status_t tmp_image_status = Image_status;
+
+  if ((cups = (cups_image_t *)(image->rep)) == NULL)
+    {
+      stp_i18n_printf(po, _("ERROR: Gutenprint image is not initialized!  "
+                            "Please report this bug to "
+			    "gimp-print-devel@lists.sourceforge.net\n"));
+      return STP_IMAGE_STATUS_ABORT;
+    }
+  if (copy_row(cups, data, row) != STP_IMAGE_STATUS_OK)
+    return STP_IMAGE_STATUS_ABORT;
+  return report_progress(cups, tmp_image_status);
+}
+
+/*
+ * 'Image_get_rows()' - Get COUNT consecutive rows of the image.
+ *
+ * If the page has no margins to trim and the rows have not been read
+ * yet, they are read straight into DATA.
+ */
+
+static stp_image_status_t
+Image_get_rows(stp_image_t   *image,	/* I - Image */
+	       unsigned char *data,	/* O - Rows */
+	       size_t	     byte_limit, /* I - how many bytes in each row */
+	       int           row,	/* I - First row number */
+	       int           count)	/* I - Number of rows */
+{
+  cups_image_t	*cups;			/* CUPS image */
+  stp_image_status_t tmp_image_status = Image_status;
+  int		i;			/* Looping var */
+
+  if ((cups = (cups_image_t *)(image->rep)) == NULL)
+    {
+      stp_i18n_printf(po, _("ERROR: Gutenprint image is not initialized!  "
+                            "Please report this bug to "
+			    "gimp-print-devel@lists.sourceforge.net\n"));
+      return STP_IMAGE_STATUS_ABORT;
+    }
+  if (row == cups->row && row + count <= cups->header.cupsHeight &&
+      cups->header.cupsBitsPerPixel % CHAR_BIT == 0 &&
+      cups->left_trim == 0 && cups->adjusted_width == cups->header.cupsWidth &&
+      byte_limit == cups->header.cupsBytesPerLine)
+    {
+      if (! suppress_messages && ! suppress_verbose_messages)
+	fprintf(stderr, "DEBUG2: Gutenprint: Reading %d row%s from %d\n",
+		count, count == 1 ? "" : "s", cups->row);
+      cupsRasterReadPixels(cups->ras, data, count * byte_limit);
+      cups->row += count;
+    }
+  else
+    {
+      for (i = 0; i < count; i++)
+	if (copy_row(cups, data + i * byte_limit, row + i) !=
+	    STP_IMAGE_STATUS_OK)
+	  return STP_IMAGE_STATUS_ABORT;
+    }
+  return report_progress(cups, tmp_image_status);
+}
+
 
 /*
  * 'Image_height()' - Return the height of an image.
@@ -211,12 +211,42 @@ Image_height(stp_image_t *image)
   return im->h;
 }
 
+static void
+mirror_row(Gimp_Image_t *im, unsigned char *data)
+{
+  /* Flip row -- probably inefficiently */
+  int f;
+  int l;
+  int b = im->real_bpp;
+  for (f = 0, l = im->w - 1; f < l; f++, l--)
+    {
+      int c;
+      unsigned char tmp;
+      for (c = 0; c < b; c++)
+	{
+	  tmp = data[f*b+c];
+	  data[f*b+c] = data[l*b+c];
+	  data[l*b+c] = tmp;
+	}
+    }
+}
+
+static void
+update_progress(Gimp_Image_t *im, int row)
+{
+  int last_printed_percent = row * 100 / im->h;
+  if (last_printed_percent > im->last_printed_percent)
+    {
+      gimp_progress_update((double) row / (double) im->h);
+      im->last_printed_percent = last_printed_percent;
+    }
+}
+
 static stp_image_status_t
 Image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
 	      int row)
 {
   Gimp_Image_t *im = (Gimp_Image_t *) (image->rep);
-  int last_printed_percent;
   guchar *inter;
   if (!im->initialized)
     {
@@ -291,29 +321,42 @@ Image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
 	}
     }
   if (im->mirror)
+    mirror_row(im, data);
+  update_progress(im, row);
+  return STP_IMAGE_STATUS_OK;
+}
+
+/*
+ * Rows that need no conversion and are read top to bottom can be fetched
+ * from the drawable as one rectangle; anything else is read a row at a
+ * time.
+ */
+stp_image_status_t
+Image_GimpDrawable_get_rows(stp_image_t *image, unsigned char *data,
+			    size_t byte_limit, int row, int count)
+{
+  Gimp_Image_t *im = (Gimp_Image_t *) (image->rep);
+  int i;
+  if (im->columns || im->increment != 1 || im->cmap || im->alpha_table ||
+      byte_limit != im->w * im->real_bpp)
     {
-      /* Flip row -- probably inefficiently */
-      int f;
-      int l;
-      int b = im->real_bpp;
-      for (f = 0, l = im->w - 1; f < l; f++, l--)
-	{
-	  int c;
-	  unsigned char tmp;
-	  for (c = 0; c < b; c++)
-	    {
-	      tmp = data[f*b+c];
-	      data[f*b+c] = data[l*b+c];
-	      data[l*b+c] = tmp;
-	    }
-	}
+      for (i = 0; i < count; i++)
+	if (Image_get_row(image, data + i * byte_limit, byte_limit, row + i)
+	    != STP_IMAGE_STATUS_OK)
+	  return STP_IMAGE_STATUS_ABORT;
+      return STP_IMAGE_STATUS_OK;
     }
-  last_printed_percent = row * 100 / im->h;
-  if (last_printed_percent > im->last_printed_percent)
+  if (!im->initialized)
     {
-      gimp_progress_update((double) row / (double) im->h);
-      im->last_printed_percent = last_printed_percent;
+      gimp_progress_init(_("Printing..."));
+      im->initialized = 1;
     }
+  gimp_pixel_rgn_get_rect(&(im->rgn), data, im->ox, im->oy + row,
+			  im->w, count);
+  if (im->mirror)
+    for (i = 0; i < count; i++)
+      mirror_row(im, data + i * byte_limit);
+  update_progress(im, row + count - 1);
   return STP_IMAGE_STATUS_OK;
 }
 
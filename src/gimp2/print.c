@@ -509,6 +509,8 @@ run (const char        *name,		/* I - Name of print program. */
       gimp_tile_cache_ntiles ((drawable->width + gimp_tile_width () - 1) /
                               gimp_tile_width () + 1);
 
+    stp_set_image_get_rows_func(gimp_vars.v, &(image->im),
+				Image_GimpDrawable_get_rows);
     if (! stpui_print(&gimp_vars, image))
     {
       values[0].data.d_status = GIMP_PDB_EXECUTION_ERROR;
@@ -43,6 +43,11 @@
 
 /* How to create an Image wrapping a Gimp drawable */
 extern stpui_image_t *Image_GimpDrawable_new(GimpDrawable *drawable, gint32);
+/* Read a band of rows of it (see stp_set_image_get_rows_func()) */
+extern stp_image_status_t Image_GimpDrawable_get_rows(stp_image_t *image,
+						      unsigned char *data,
+						      size_t byte_limit,
+						      int row, int count);
 
 extern void do_gimp_install_procedure(const char *blurb, const char *help,
 				      const char *auth, const char *copy,
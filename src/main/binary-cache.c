@@ -0,0 +1,438 @@
+/*
+ *
+ *   Binary caches of data derived from XML source files.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ *
+ * A cache file consists of a header, the list of source files it was
+ * built from (with their sizes and modification times), and an opaque
+ * payload aligned to 8 bytes.  A cache file is only valid for the
+ * library version and byte order that wrote it, and only while none of
+ * its source files has changed.  Anything unexpected makes the cache
+ * invalid, and callers fall back to reading the XML sources.
+ *
+ * Cache files are kept in the directory named by STP_CACHE_PATH.  The
+ * cache is disabled unless that variable is set to a non-empty string,
+ * so the library never writes files on its own accord.  The _file
+ * variants read and write a cache file at an explicit location instead,
+ * such as the XML snapshot installed with the data files.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#define CACHE_FORMAT_VERSION 1
+#define CACHE_BYTE_ORDER 0x01020304u
+#define FMIN(a, b) ((a) < (b) ? (a) : (b))
+#define CACHE_ALIGN(n) (((n) + 7) & ~((size_t) 7))
+
+typedef struct
+{
+  char magic[8];
+  unsigned byte_order;
+  unsigned format_version;
+  char package_version[32];
+  unsigned source_count;
+  unsigned payload_offset;
+  unsigned long long payload_size;
+} cache_header_t;
+
+typedef struct
+{
+  long long mtime;
+  long long size;
+  unsigned name_length;		/* Including the terminating null */
+  unsigned pad;
+} cache_source_t;
+
+struct stpi_binary_cache
+{
+  void *map;
+  size_t map_size;
+  int mapped;
+  const void *payload;
+  size_t payload_size;
+};
+
+#ifdef HAVE_SYS_STAT_H
+
+static char *
+cache_directory(void)
+{
+  const char *dir = getenv("STP_CACHE_PATH");
+  if (dir && dir[0])
+    return stp_strdup(dir);
+  return NULL;
+}
+
+static char *
+cache_file_name(const char *name)
+{
+  char *dir = cache_directory();
+  char *answer;
+  if (!dir)
+    return NULL;
+  answer = stpi_path_merge(dir, name);
+  stp_free(dir);
+  return answer;
+}
+
+static int
+source_is_current(const cache_source_t *src, const char *name)
+{
+  struct stat st;
+  if (stat(name, &st) != 0)
+    return 0;
+  return (src->mtime == (long long) st.st_mtime &&
+	  src->size == (long long) st.st_size);
+}
+
+/*
+ * Check the header and source list of a cache image.  If sources is
+ * not NULL, the cache must have been built from exactly those files,
+ * in that order.
+ */
+static int
+cache_is_valid(const char *data, size_t size, const char *magic,
+	       const stp_list_t *sources)
+{
+  const cache_header_t *header = (const cache_header_t *) data;
+  stp_list_item_t *item = sources ? stp_list_get_start(sources) : NULL;
+  size_t offset = sizeof(cache_header_t);
+  unsigned i;
+
+  if (size < sizeof(cache_header_t) ||
+      strncmp(header->magic, magic, sizeof(header->magic)) != 0 ||
+      header->byte_order != CACHE_BYTE_ORDER ||
+      header->format_version != CACHE_FORMAT_VERSION ||
+      strncmp(header->package_version, PACKAGE_VERSION,
+	      sizeof(header->package_version)) != 0 ||
+      header->payload_offset > size ||
+      header->payload_size > size - header->payload_offset)
+    return 0;
+  if (sources && stp_list_get_length(sources) != header->source_count)
+    return 0;
+  for (i = 0; i < header->source_count; i++)
+    {
+      const cache_source_t *src = (const cache_source_t *) (data + offset);
+      const char *name = data + offset + sizeof(cache_source_t);
+      if (offset + sizeof(cache_source_t) > header->payload_offset ||
+	  src->name_length == 0 ||
+	  src->name_length > header->payload_offset - offset -
+	  sizeof(cache_source_t) ||
+	  name[src->name_length - 1] != '\0')
+	return 0;
+      if (item)
+	{
+	  if (strcmp(name, (const char *) stp_list_item_get_data(item)) != 0)
+	    return 0;
+	  item = stp_list_item_next(item);
+	}
+      if (!source_is_current(src, name))
+	{
+	  stp_deprintf(STP_DBG_XML, "binary cache: %s has changed\n", name);
+	  return 0;
+	}
+      offset += CACHE_ALIGN(sizeof(cache_source_t) + src->name_length);
+    }
+  return 1;
+}
+
+stpi_binary_cache_t *
+stpi_binary_cache_open_file(const char *filename, const char *magic,
+			    const stp_list_t *sources)
+{
+  stpi_binary_cache_t *cache;
+  struct stat st;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    {
+      stp_deprintf(STP_DBG_XML, "binary cache: no %s\n", filename);
+      return NULL;
+    }
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(cache_header_t))
+    {
+      close(fd);
+      return NULL;
+    }
+  cache = stp_zalloc(sizeof(stpi_binary_cache_t));
+  cache->map_size = st.st_size;
+#ifdef HAVE_SYS_MMAN_H
+  cache->map = mmap(NULL, cache->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (cache->map == MAP_FAILED)
+    cache->map = NULL;
+  else
+    cache->mapped = 1;
+#endif
+  if (!cache->map)
+    {
+      size_t bytes = 0;
+      cache->map = stp_malloc(cache->map_size);
+      while (bytes < cache->map_size)
+	{
+	  ssize_t status = read(fd, (char *) cache->map + bytes,
+				cache->map_size - bytes);
+	  if (status <= 0)
+	    break;
+	  bytes += status;
+	}
+      if (bytes < cache->map_size)
+	{
+	  close(fd);
+	  stpi_binary_cache_close(cache);
+	  return NULL;
+	}
+    }
+  close(fd);
+  if (!cache_is_valid(cache->map, cache->map_size, magic, sources))
+    {
+      stp_deprintf(STP_DBG_XML, "binary cache: %s is stale\n", filename);
+      stpi_binary_cache_close(cache);
+      return NULL;
+    }
+  cache->payload = (const char *) cache->map +
+    ((const cache_header_t *) cache->map)->payload_offset;
+  cache->payload_size = ((const cache_header_t *) cache->map)->payload_size;
+  stp_deprintf(STP_DBG_XML, "binary cache: using %s\n", filename);
+  return cache;
+}
+
+stpi_binary_cache_t *
+stpi_binary_cache_open(const char *name, const char *magic,
+		       const stp_list_t *sources)
+{
+  stpi_binary_cache_t *cache;
+  char *filename = cache_file_name(name);
+  if (!filename)
+    return NULL;
+  cache = stpi_binary_cache_open_file(filename, magic, sources);
+  stp_free(filename);
+  return cache;
+}
+
+void
+stpi_binary_cache_close(stpi_binary_cache_t *cache)
+{
+  if (!cache)
+    return;
+#ifdef HAVE_SYS_MMAN_H
+  if (cache->mapped)
+    munmap(cache->map, cache->map_size);
+  else
+#endif
+    stp_free(cache->map);
+  stp_free(cache);
+}
+
+const void *
+stpi_binary_cache_get_data(const stpi_binary_cache_t *cache, size_t *bytes)
+{
+  *bytes = cache->payload_size;
+  return cache->payload;
+}
+
+static int
+write_all(int fd, const void *data, size_t bytes)
+{
+  while (bytes > 0)
+    {
+      ssize_t status = write(fd, data, bytes);
+      if (status < 0 && errno == EINTR)
+	continue;
+      if (status <= 0)
+	return 0;
+      data = (const char *) data + status;
+      bytes -= status;
+    }
+  return 1;
+}
+
+int
+stpi_binary_cache_write_file(const char *filename, const char *magic,
+			     const stp_list_t *sources,
+			     const void *data, size_t bytes)
+{
+  static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  cache_header_t header;
+  stp_list_item_t *item;
+  char *tmpname;
+  size_t offset = sizeof(cache_header_t);
+  int fd;
+  int status = 1;
+
+  tmpname = stp_malloc(strlen(filename) + 32);
+  (void) sprintf(tmpname, "%s.%ld.tmp", filename, (long) getpid());
+  fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    {
+      stp_deprintf(STP_DBG_XML, "binary cache: cannot create %s: %s\n",
+		   tmpname, strerror(errno));
+      stp_free(tmpname);
+      return 0;
+    }
+
+  for (item = sources ? stp_list_get_start(sources) : NULL; item;
+       item = stp_list_item_next(item))
+    offset += CACHE_ALIGN(sizeof(cache_source_t) +
+			  strlen((const char *) stp_list_item_get_data(item)) + 1);
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, magic, FMIN(strlen(magic), sizeof(header.magic)));
+  header.byte_order = CACHE_BYTE_ORDER;
+  header.format_version = CACHE_FORMAT_VERSION;
+  strncpy(header.package_version, PACKAGE_VERSION,
+	  sizeof(header.package_version) - 1);
+  header.source_count = sources ? stp_list_get_length(sources) : 0;
+  header.payload_offset = offset;
+  header.payload_size = bytes;
+  status = write_all(fd, &header, sizeof(header));
+
+  for (item = sources ? stp_list_get_start(sources) : NULL; status && item;
+       item = stp_list_item_next(item))
+    {
+      const char *source = (const char *) stp_list_item_get_data(item);
+      cache_source_t src;
+      struct stat st;
+      size_t length;
+      if (stat(source, &st) != 0)
+	{
+	  status = 0;
+	  break;
+	}
+      memset(&src, 0, sizeof(src));
+      src.mtime = st.st_mtime;
+      src.size = st.st_size;
+      src.name_length = strlen(source) + 1;
+      length = sizeof(src) + src.name_length;
+      status = (write_all(fd, &src, sizeof(src)) &&
+		write_all(fd, source, src.name_length) &&
+		write_all(fd, zeros, CACHE_ALIGN(length) - length));
+    }
+  if (status)
+    status = write_all(fd, data, bytes);
+  if (close(fd) != 0)
+    status = 0;
+  if (status && rename(tmpname, filename) != 0)
+    status = 0;
+  if (!status)
+    (void) unlink(tmpname);
+  else
+    stp_deprintf(STP_DBG_XML, "binary cache: wrote %s\n", filename);
+  stp_free(tmpname);
+  return status;
+}
+
+int
+stpi_binary_cache_write(const char *name, const char *magic,
+			const stp_list_t *sources,
+			const void *data, size_t bytes)
+{
+  char *dir = cache_directory();
+  char *filename;
+  int status;
+
+  if (!dir)
+    return 0;
+  /* Create the cache directory, and its parent if need be. */
+  if (mkdir(dir, 0755) != 0 && errno == ENOENT)
+    {
+      char *slash = strrchr(dir, '/');
+      if (slash && slash != dir)
+	{
+	  *slash = '\0';
+	  (void) mkdir(dir, 0755);
+	  *slash = '/';
+	  (void) mkdir(dir, 0755);
+	}
+    }
+  filename = stpi_path_merge(dir, name);
+  stp_free(dir);
+  status = stpi_binary_cache_write_file(filename, magic, sources, data, bytes);
+  stp_free(filename);
+  return status;
+}
+
+#else /* !HAVE_SYS_STAT_H */
+
+stpi_binary_cache_t *
+stpi_binary_cache_open_file(const char *filename, const char *magic,
+			    const stp_list_t *sources)
+{
+  return NULL;
+}
+
+stpi_binary_cache_t *
+stpi_binary_cache_open(const char *name, const char *magic,
+		       const stp_list_t *sources)
+{
+  return NULL;
+}
+
+void
+stpi_binary_cache_close(stpi_binary_cache_t *cache)
+{
+}
+
+const void *
+stpi_binary_cache_get_data(const stpi_binary_cache_t *cache, size_t *bytes)
+{
+  *bytes = 0;
+  return NULL;
+}
+
+int
+stpi_binary_cache_write_file(const char *filename, const char *magic,
+			     const stp_list_t *sources,
+			     const void *data, size_t bytes)
+{
+  return 0;
+}
+
+int
+stpi_binary_cache_write(const char *name, const char *magic,
+			const stp_list_t *sources,
+			const void *data, size_t bytes)
+{
+  return 0;
+}
+
+#endif /* HAVE_SYS_STAT_H */
@@ -34,15 +34,135 @@
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
 #endif
+#ifdef STPI_X86_SIMD
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#ifdef STPI_X86_SIMD
+/*
+ * Folding and unpacking are bit gathers and scatters, which PDEP and
+ * PEXT do directly on 64 bits at a time.  They are microcoded and very
+ * slow on AMD processors before family 19h (Zen 3), so they are not used
+ * there.
+ */
+static int
+have_fast_pdep(void)
+{
+  unsigned eax, ebx, ecx, edx;
+  if (!STPI_CPU_HAS_BMI2())
+    return 0;
+  if (__builtin_cpu_is("amd") && __get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+      unsigned family = (eax >> 8) & 0xf;
+      if (family == 0xf)
+	family += (eax >> 20) & 0xff;
+      if (family < 0x19)
+	return 0;
+    }
+  return 1;
+}
+
+static int
+use_pdep(void)
+{
+  static int use = -1;
+  if (use < 0)
+    use = have_fast_pdep();
+  return use;
+}
+
+/*
+ * Fold four bytes of each plane at a time; returns the number of bytes
+ * of each plane done.
+ */
+STPI_TARGET_BMI2 static int
+fold_pdep(const unsigned char *line, int single_length, unsigned char *outbuf)
+{
+  int i;
+  for (i = 0; i + 4 <= single_length; i += 4)
+    {
+      unsigned l0, l1;
+      unsigned long long out;
+      memcpy(&l0, line + i, 4);
+      memcpy(&l1, line + single_length + i, 4);
+      out = (_pdep_u64(__builtin_bswap32(l0), 0x5555555555555555ull) |
+	     _pdep_u64(__builtin_bswap32(l1), 0xaaaaaaaaaaaaaaaaull));
+      out = __builtin_bswap64(out);
+      memcpy(outbuf + 2 * i, &out, 8);
+    }
+  return i;
+}
+
+/*
+ * Unpack eight input bytes at a time into n = 2, 4 or 8 outputs, each of
+ * which receives every n'th pixel.  Returns the number of input bytes
+ * done; the output pointers are advanced.
+ */
+STPI_TARGET_BMI2 static int
+unpack_pext(int length, int bits, int n, const unsigned char *in,
+	    unsigned char **outs)
+{
+  unsigned long long masks[8];
+  int units = 64 / bits;
+  int bytes = length * bits;
+  int i, j;
+  for (j = 0; j < n; j++)
+    {
+      int u;
+      masks[j] = 0;
+      for (u = j; u < units; u += n)
+	masks[j] |= ((1ull << bits) - 1) << (64 - bits * (u + 1));
+    }
+  for (i = 0; i + 8 <= bytes; i += 8)
+    {
+      unsigned long long v;
+      memcpy(&v, in + i, 8);
+      v = __builtin_bswap64(v);
+      switch (n)
+	{
+	case 2:
+	  for (j = 0; j < 2; j++)
+	    {
+	      unsigned out = __builtin_bswap32(_pext_u64(v, masks[j]));
+	      memcpy(outs[j], &out, 4);
+	      outs[j] += 4;
+	    }
+	  break;
+	case 4:
+	  for (j = 0; j < 4; j++)
+	    {
+	      unsigned short out = __builtin_bswap16(_pext_u64(v, masks[j]));
+	      memcpy(outs[j], &out, 2);
+	      outs[j] += 2;
+	    }
+	  break;
+	case 8:
+	  for (j = 0; j < 8; j++)
+	    *outs[j]++ = _pext_u64(v, masks[j]);
+	  break;
+	}
+    }
+  return i;
+}
+#endif
 
 void
 stp_fold(const unsigned char *line,
 	 int single_length,
 	 unsigned char *outbuf)
 {
-  int i;
-  memset(outbuf, 0, single_length * 2);
-  for (i = 0; i < single_length; i++)
+  int i = 0;
+#ifdef STPI_X86_SIMD
+  if (use_pdep())
+    {
+      i = fold_pdep(line, single_length, outbuf);
+      line += i;
+      outbuf += 2 * i;
+    }
+#endif
+  memset(outbuf, 0, (single_length - i) * 2);
+  for (; i < single_length; i++)
     {
       unsigned char l0 = line[0];
       unsigned char l1 = line[single_length];
@@ -1007,6 +1127,15 @@ stp_unpack(int length,
   touts = stp_malloc(sizeof(unsigned char *) * n);
   for (i = 0; i < n; i++)
     touts[i] = outs[i];
+#ifdef STPI_X86_SIMD
+  if ((n == 2 || n == 4 || n == 8) && use_pdep())
+    {
+      int xbits = bits == 1 ? 1 : 2;
+      int done = unpack_pext(length, xbits, n, in, touts);
+      in += done;
+      length -= done / xbits;
+    }
+#endif
   if (bits == 1)
     switch (n)
       {
@@ -1138,29 +1267,115 @@ stp_unpack_16(int length,
   stp_unpack(length, bits, 16, in, outs);
 }
 
+/*
+ * Find the first and last nonzero bytes of the line.  *first is the
+ * number of leading zero bytes and *last the index of the last nonzero
+ * byte (0 if there is none).  Only the leading and trailing zero bytes
+ * need to be examined.
+ */
 static void
 find_first_and_last(const unsigned char *line, int length,
 		    int *first, int *last)
 {
-  int i;
-  int found_first = 0;
+  int i = 0;
+  int j = length;
   if (!first || !last)
     return;
-  *first = 0;
-  *last = 0;
-  for (i = 0; i < length; i++)
+#ifdef STPI_X86_SIMD
+  {
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= length)
+      {
+	__m128i data = _mm_loadu_si128((const __m128i *) (line + i));
+	unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, zero));
+	if (mask != 0xffff)
+	  {
+	    i += __builtin_ctz(~mask);
+	    break;
+	  }
+	i += 16;
+      }
+  }
+#endif
+  while (i < length && line[i] == 0)
+    i++;
+  *first = i;
+  if (i == length)
     {
-      if (line[i] == 0)
-	{
-	  if (!found_first)
-	    (*first)++;
-	}
-      else
-	{
-	  *last = i;
-	  found_first = 1;
-	}
+      *last = 0;
+      return;
     }
+#ifdef STPI_X86_SIMD
+  {
+    const __m128i zero = _mm_setzero_si128();
+    while (j - 16 > i)
+      {
+	__m128i data = _mm_loadu_si128((const __m128i *) (line + j - 16));
+	unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, zero));
+	if (mask != 0xffff)
+	  {
+	    j -= __builtin_clz(~mask & 0xffff) - 16;
+	    break;
+	  }
+	j -= 16;
+      }
+  }
+#endif
+  while (line[j - 1] == 0)
+    j--;
+  *last = j - 1;
+}
+
+/*
+ * Return the smallest j >= pos such that line[j - 2], line[j - 1] and
+ * line[j] are equal, or max(pos, length) if there is none.  pos must be
+ * at least 2.
+ */
+static inline int
+find_triple(const unsigned char *line, int pos, int length)
+{
+#ifdef STPI_X86_SIMD
+  while (pos + 16 <= length)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i *) (line + pos - 2));
+      __m128i b = _mm_loadu_si128((const __m128i *) (line + pos - 1));
+      __m128i c = _mm_loadu_si128((const __m128i *) (line + pos));
+      unsigned mask =
+	_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, b),
+					_mm_cmpeq_epi8(b, c)));
+      if (mask)
+	return pos + __builtin_ctz(mask);
+      pos += 16;
+    }
+#endif
+  while (pos < length &&
+	 (line[pos - 2] != line[pos - 1] || line[pos - 1] != line[pos]))
+    pos++;
+  return pos;
+}
+
+/*
+ * Return the smallest j >= pos such that line[j] != repeat, or length
+ * if there is none.
+ */
+static inline int
+find_end_of_run(const unsigned char *line, int pos, int length,
+		unsigned char repeat)
+{
+#ifdef STPI_X86_SIMD
+  const __m128i rep = _mm_set1_epi8((char) repeat);
+  while (pos + 16 <= length)
+    {
+      __m128i data = _mm_loadu_si128((const __m128i *) (line + pos));
+      unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, rep));
+      if (mask != 0xffff)
+	return pos + __builtin_ctz(~mask);
+      pos += 16;
+    }
+#endif
+  while (pos < length && line[pos] == repeat)
+    pos++;
+  return pos;
 }
 
 int
@@ -1190,12 +1405,11 @@ stp_pack_tiff(stp_vars_t *v,
 	      int *first,
 	      int *last)
 {
-  const unsigned char *start;		/* Start of compressed data */
-  unsigned char repeat;			/* Repeating char */
+  int start;			/* Start of compressed data */
+  unsigned char repeat;		/* Repeating char */
   int count;			/* Count of compressed bytes */
   int tcount;			/* Temporary count < 128 */
-  register const unsigned char *xline = line;
-  register int xlength = length;
+  int pos = 0;
   find_first_and_last(line, length, first, last);
 
   /*
@@ -1204,71 +1418,49 @@ stp_pack_tiff(stp_vars_t *v,
 
   (*comp_ptr) = comp_buf;
 
-  while (xlength > 0)
+  while (pos < length)
     {
       /*
-       * Get a run of non-repeated chars...
+       * Get a run of non-repeated chars, ending where three equal
+       * bytes start (or two bytes before the end of the line)...
        */
 
-      start  = xline;
-      xline   += 2;
-      xlength -= 2;
-
-      while (xlength > 0 && (xline[-2] != xline[-1] || xline[-1] != xline[0]))
-	{
-	  xline ++;
-	  xlength --;
-	}
-
-      xline   -= 2;
-      xlength += 2;
+      start = pos;
+      pos = find_triple(line, pos + 2, length) - 2;
 
       /*
        * Output the non-repeated sequences (max 128 at a time).
        */
 
-      count = xline - start;
+      count = pos - start;
       while (count > 0)
 	{
 	  tcount = count > 128 ? 128 : count;
 
 	  (*comp_ptr)[0] = tcount - 1;
-	  memcpy((*comp_ptr) + 1, start, tcount);
+	  memcpy((*comp_ptr) + 1, line + start, tcount);
 
 	  (*comp_ptr) += tcount + 1;
 	  start    += tcount;
 	  count    -= tcount;
 	}
 
-      if (xlength <= 0)
+      if (pos >= length)
 	break;
 
       /*
        * Find the repeated sequences...
        */
 
-      start  = xline;
-      repeat = xline[0];
-
-      xline ++;
-      xlength --;
-
-      if (xlength > 0)
-	{
-	  int ylength = xlength;
-	  while (ylength && *xline == repeat)
-	    {
-	      xline ++;
-	      ylength --;
-	    }
-	  xlength = ylength;
-	}
+      start  = pos;
+      repeat = line[pos];
+      pos = find_end_of_run(line, pos + 1, length, repeat);
 
       /*
        * Output the repeated sequences (max 128 at a time).
        */
 
-      count = xline - start;
+      count = pos - start;
       while (count > 0)
 	{
 	  tcount = count > 128 ? 128 : count;
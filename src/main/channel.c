@@ -51,17 +51,82 @@ typedef struct
   unsigned short s_density;
 } stpi_subchannel_t;
 
+/*
+ * The amounts of the subchannels of a split channel are piecewise linear
+ * in the value of the channel.  A segment covers the values from BASE up
+ * to and including LAST, and only subchannels FIRST and FIRST + 1 may be
+ * non-zero in it; the amount of subchannel FIRST + K is
+ * (offset[K] + slope[K] * (value - BASE)) >> SPLIT_SHIFT.  The last
+ * segment ends at 65535.
+ *
+ * The amounts used to be looked up in a table with an entry for each
+ * value and subchannel, computed in floating point.  Where the floating
+ * point amount fell just short of an integer the fixed point one is one
+ * more; those few values are marked in FIXUP and computed the way the
+ * table was, from TYPE, RANGE, THIS_VAL and NEXT_VAL, so that the output
+ * does not change.
+ */
+#define SPLIT_SHIFT (32)
+
+/*
+ * The rounding of the offsets and slopes to SPLIT_SHIFT bits is off by
+ * less than this over a whole segment.  Adding it keeps the fixed point
+ * amount from falling below the exact one, so that exact integer amounts
+ * need no fixup.
+ */
+#define SPLIT_BIAS (1ll << 17)
+
+typedef enum
+{
+  SPLIT_LIGHTEST,		/* Only the lightest subchannel */
+  SPLIT_FADE,			/* One subchannel fades into the next */
+  SPLIT_DARKEST			/* Only the darkest subchannel */
+} stpi_split_type_t;
+
+typedef struct
+{
+  unsigned base;
+  unsigned last;
+  int first;
+  unsigned long long offset[2];
+  unsigned long long slope[2];
+  stpi_split_type_t type;
+  int range;
+  double this_val;
+  double next_val;
+} stpi_split_segment_t;
+
 typedef struct
 {
   unsigned subchannel_count;
   stpi_subchannel_t *sc;
-  unsigned short *lut;
+  int split_segments;
+  stpi_split_segment_t *split;
+  unsigned char split_index[256]; /* First segment of each 256 values */
+  unsigned char *split_fixup;	/* Values needing the exact amounts */
   const double *hue_map;
   size_t h_count;
   stp_curve_t *curve;
 } stpi_channel_t;
 
 typedef struct
+{
+  const unsigned short *gcr_lookup;
+  int nz[STP_CHANNEL_LIMIT];	/* Whether each output channel is non-zero */
+  int glossed;			/* Whether any pixel needed gloss */
+} stpi_convert_state_t;
+
+struct stpi_channel_group;
+
+/*
+ * A step of stp_channel_convert(), applied to COUNT pixels from FIRST.
+ */
+typedef void stpi_convert_func_t(struct stpi_channel_group *cg, int first,
+				 int count, stpi_convert_state_t *state);
+
+#define CONVERT_MAX_STEPS (5)
+
+typedef struct stpi_channel_group
 {
   unsigned channel_count;
   unsigned total_channels;
@@ -90,14 +155,36 @@ typedef struct
   double cyan_balance;
   double magenta_balance;
   double yellow_balance;
+  stpi_convert_func_t *convert_steps[CONVERT_MAX_STEPS];
+  int convert_step_count;
+  int convert_block;		/* Pixels converted at a time */
 } stpi_channel_group_t;
 
+/*
+ * The conversion is done one block of pixels at a time, with every step
+ * applied to a block before moving on to the next one, so that the block
+ * stays in the cache rather than the whole row being walked once for each
+ * step.  Each step converts a pixel the same way regardless of the block
+ * it is in.  The caches of the previous pixel do not carry over from one
+ * block to the next, since the steps after the one that filled them will
+ * have changed the output.
+ */
+#define CONVERT_BLOCK_BYTES (8192)
+
+static stpi_convert_func_t generate_special_channels, copy_channels, do_gcr;
+static stpi_convert_func_t split_channels, scale_channels, limit_ink;
+static stpi_convert_func_t generate_gloss;
+
 
 static stpi_channel_group_t *
 get_channel_group(const stp_vars_t *v)
 {
-  stpi_channel_group_t *cg =
-    ((stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
+  static stp_parameter_handle_t channel_handle = NULL;
+  stpi_channel_group_t *cg;
+  if (!channel_handle)
+    channel_handle = stp_component_data_handle("Channel");
+  cg = ((stpi_channel_group_t *)
+	stp_get_component_data_by_handle(v, channel_handle));
   return cg;
 }
 
@@ -107,7 +194,8 @@ clear_a_channel(stpi_channel_group_t *cg, int channel)
   if (channel < cg->channel_count)
     {
       STP_SAFE_FREE(cg->c[channel].sc);
-      STP_SAFE_FREE(cg->c[channel].lut);
+      STP_SAFE_FREE(cg->c[channel].split);
+      STP_SAFE_FREE(cg->c[channel].split_fixup);
       if (cg->c[channel].curve)
 	{
 	  stp_curve_destroy(cg->c[channel].curve);
@@ -424,32 +512,28 @@ stp_channel_get_curve(stp_vars_t *v, int color)
 static int
 input_has_special_channels(const stp_vars_t *v)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
+  const stpi_channel_group_t *cg = get_channel_group(v);
   return (cg->curve_count > 0);
 }
 
 static int
 output_needs_gcr(const stp_vars_t *v)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
+  const stpi_channel_group_t *cg = get_channel_group(v);
   return (cg->gcr_curve && cg->black_channel == 0);
 }
 
 static int
 output_has_gloss(const stp_vars_t *v)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
+  const stpi_channel_group_t *cg = get_channel_group(v);
   return (cg->gloss_channel >= 0);
 }
 
 static int
 input_needs_splitting(const stp_vars_t *v)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
+  const stpi_channel_group_t *cg = get_channel_group(v);
 #if 0
   return cg->total_channels != cg->aux_output_channels;
 #else
@@ -466,6 +550,158 @@ input_needs_splitting(const stp_vars_t *v)
 }
 
 
+/*
+ * The amounts of the two subchannels of SEG at VAL, computed as the
+ * table of amounts was.  A fade over a single value gives all of it to
+ * the lighter subchannel, where the table divided zero by zero.
+ */
+static void
+split_exact_amounts(const stpi_split_segment_t *seg, unsigned val,
+		    unsigned amounts[2])
+{
+  double lower_amount = 0;
+  double upper_amount = 0;
+  switch (seg->type)
+    {
+    case SPLIT_LIGHTEST:
+      lower_amount = (int) ((double) val / seg->this_val);
+      break;
+    case SPLIT_DARKEST:
+      upper_amount = val / seg->next_val;
+      break;
+    case SPLIT_FADE:
+      if (seg->range > 0)
+	{
+	  double where = ((double) val - seg->base) / (double) seg->range;
+	  double lower_val = seg->base * (1.0 - where);
+	  lower_amount = lower_val / seg->this_val;
+	  upper_amount = (val - lower_val) / seg->next_val;
+	}
+      else
+	lower_amount = seg->base / seg->this_val;
+      break;
+    }
+  amounts[0] = upper_amount < 65535.0 ? (unsigned) upper_amount : 65535;
+  amounts[1] = lower_amount < 65535.0 ? (unsigned) lower_amount : 65535;
+}
+
+/*
+ * This is not clamped; a value where it does not give the exact amount is
+ * marked for fixup.
+ */
+static inline unsigned
+split_fixed_amount(const stpi_split_segment_t *seg, int k, unsigned val)
+{
+  return (seg->offset[k] + seg->slope[k] * (val - seg->base)) >> SPLIT_SHIFT;
+}
+
+static long long
+split_fixed(double value)
+{
+  return (long long) floor(value * (double) (1ll << SPLIT_SHIFT) + 0.5);
+}
+
+static stpi_split_segment_t *
+add_split_segment(stpi_channel_t *c, stpi_split_type_t type, int first,
+		  unsigned base, unsigned last, double this_val,
+		  double next_val)
+{
+  stpi_split_segment_t *seg = &(c->split[c->split_segments++]);
+  seg->type = type;
+  seg->first = first;
+  seg->base = base;
+  seg->last = last;
+  seg->range = last - base;
+  seg->this_val = this_val;
+  seg->next_val = next_val;
+  seg->offset[0] = SPLIT_BIAS;
+  seg->offset[1] = SPLIT_BIAS;
+  return seg;
+}
+
+/*
+ * Each subchannel takes over from the next lighter one between the
+ * breakpoints given by the subchannel values and cutoffs.
+ */
+static void
+initialize_split(stpi_channel_t *c)
+{
+  int sc = c->subchannel_count;
+  int val = 0;
+  int next_breakpoint;
+  stpi_split_segment_t *seg;
+  int i, k;
+  c->split = stp_zalloc(sizeof(stpi_split_segment_t) * (sc + 1));
+  c->split_segments = 0;
+  next_breakpoint = c->sc[0].value * 65535 * c->sc[0].cutoff;
+  if (next_breakpoint > 65535)
+    next_breakpoint = 65535;
+  seg = add_split_segment(c, SPLIT_LIGHTEST, sc - 2, 0, next_breakpoint,
+			  c->sc[0].value, 0);
+  seg->slope[1] = split_fixed(1.0 / c->sc[0].value);
+  val = next_breakpoint + 1;
+
+  for (k = 0; k < sc - 1; k++)
+    {
+      double this_val = c->sc[k].value;
+      double next_val = c->sc[k + 1].value;
+      double this_cutoff = c->sc[k].cutoff;
+      double next_cutoff = c->sc[k + 1].cutoff;
+      int base = val;
+      double cutoff = sqrt(this_cutoff * next_cutoff);
+      next_breakpoint = next_val * 65535 * cutoff;
+      if (next_breakpoint > 65535)
+	next_breakpoint = 65535;
+      if (next_breakpoint < val)
+	continue;
+      seg = add_split_segment(c, SPLIT_FADE, sc - k - 2, base,
+			      next_breakpoint, this_val, next_val);
+      seg->offset[1] += split_fixed(base / this_val);
+      if (seg->range > 0)
+	{
+	  /*
+	   * The lighter subchannel fades out linearly from BASE to the
+	   * breakpoint, and the darker one makes up the rest.
+	   */
+	  double fade = (double) base / (double) seg->range;
+	  seg->slope[1] = split_fixed(-fade / this_val);
+	  seg->slope[0] = split_fixed((1.0 + fade) / next_val);
+	}
+      val = next_breakpoint + 1;
+    }
+  if (val <= 65535)
+    {
+      seg = add_split_segment(c, SPLIT_DARKEST, 0, val, 65535, 0,
+			      c->sc[sc - 1].value);
+      seg->offset[0] += split_fixed(val / c->sc[sc - 1].value);
+      seg->slope[0] = split_fixed(1.0 / c->sc[sc - 1].value);
+    }
+
+  k = 0;
+  for (i = 0; i < 256; i++)
+    {
+      while (c->split[k].last < (i << 8))
+	k++;
+      c->split_index[i] = k;
+    }
+  for (k = 0; k < c->split_segments; k++)
+    {
+      seg = &(c->split[k]);
+      for (i = seg->base; i <= seg->last; i++)
+	{
+	  unsigned amounts[2];
+	  split_exact_amounts(seg, i, amounts);
+	  if (amounts[0] != split_fixed_amount(seg, 0, i) ||
+	      amounts[1] != split_fixed_amount(seg, 1, i))
+	    {
+	      if (!c->split_fixup)
+		c->split_fixup = stp_zalloc(65536 / 8);
+	      c->split_fixup[i >> 3] |= 1 << (i & 7);
+	    }
+	}
+    }
+}
+
 void
 stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
 		       int input_channel_count)
@@ -473,7 +709,7 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
   stpi_channel_group_t *cg = get_channel_group(v);
   int width = stp_image_width(image);
   int curve_count = 0;
-  int i, j, k;
+  int i, j;
   if (!cg)
     {
       cg = stp_zalloc(sizeof(stpi_channel_group_t));
@@ -498,52 +734,7 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
 	  cg->curve_count++;
 	}
       if (sc > 1)
-	{
-	  int val = 0;
-	  int next_breakpoint;
-	  c->lut = stp_zalloc(sizeof(unsigned short) * sc * 65536);
-	  next_breakpoint = c->sc[0].value * 65535 * c->sc[0].cutoff;
-	  if (next_breakpoint > 65535)
-	    next_breakpoint = 65535;
-	  while (val <= next_breakpoint)
-	    {
-	      int value = (int) ((double) val / c->sc[0].value);
-	      c->lut[val * sc + sc - 1] = value;
-	      val++;
-	    }
-
-	  for (k = 0; k < sc - 1; k++)
-	    {
-	      double this_val = c->sc[k].value;
-	      double next_val = c->sc[k + 1].value;
-	      double this_cutoff = c->sc[k].cutoff;
-	      double next_cutoff = c->sc[k + 1].cutoff;
-	      int range;
-	      int base = val;
-	      double cutoff = sqrt(this_cutoff * next_cutoff);
-	      next_breakpoint = next_val * 65535 * cutoff;
-	      if (next_breakpoint > 65535)
-		next_breakpoint = 65535;
-	      range = next_breakpoint - val;
-	      while (val <= next_breakpoint)
-		{
-		  double where = ((double) val - base) / (double) range;
-		  double lower_val = base * (1.0 - where);
-		  double lower_amount = lower_val / this_val;
-		  double upper_amount = (val - lower_val) / next_val;
-		  if (lower_amount > 65535.0)
-		    lower_amount = 65535.0;
-		  c->lut[val * sc + sc - k - 2] = upper_amount;
-		  c->lut[val * sc + sc - k - 1] = lower_amount;
-		  val++;
-		}
-	    }
-	  while (val <= 65535)
-	    {
-	      c->lut[val * sc] = val / c->sc[sc - 1].value;
-	      val++;
-	    }
-	}
+	initialize_split(c);
       if (cg->gloss_channel != i && c->subchannel_count > 0)
 	cg->aux_output_channels++;
       cg->total_channels += c->subchannel_count;
@@ -612,6 +803,25 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
 	}
       cg->gcr_channels = cg->aux_output_channels;
     }
+  cg->convert_step_count = 0;
+  if (input_has_special_channels(v))
+    cg->convert_steps[cg->convert_step_count++] = generate_special_channels;
+  else if (output_has_gloss(v) && !input_needs_splitting(v))
+    cg->convert_steps[cg->convert_step_count++] = copy_channels;
+  if (output_needs_gcr(v))
+    cg->convert_steps[cg->convert_step_count++] = do_gcr;
+  if (input_needs_splitting(v))
+    cg->convert_steps[cg->convert_step_count++] = split_channels;
+  else
+    cg->convert_steps[cg->convert_step_count++] = scale_channels;
+  if (cg->ink_limit != 0 && cg->ink_limit < cg->max_density)
+    cg->convert_steps[cg->convert_step_count++] = limit_ink;
+  if (cg->gloss_channel != -1 && cg->gloss_limit > 0)
+    cg->convert_steps[cg->convert_step_count++] = generate_gloss;
+  cg->convert_block =
+    CONVERT_BLOCK_BYTES / (sizeof(unsigned short) * (cg->total_channels + 1));
+  if (cg->convert_block < 16)
+    cg->convert_block = 16;
   cg->cyan_balance = stp_get_float_parameter(v, "CyanBalance");
   cg->magenta_balance = stp_get_float_parameter(v, "MagentaBalance");
   cg->yellow_balance = stp_get_float_parameter(v, "YellowBalance");
@@ -675,12 +885,11 @@ clear_channel(unsigned short *data, unsigned width, unsigned depth)
     data[i] = 0;
 }
 
-static int
+static void
 scale_channel(unsigned short *data, unsigned width, unsigned depth,
-	      unsigned short density)
+	      unsigned short density, int *nz)
 {
   int i;
-  int retval = 0;
   unsigned short previous_data = 0;
   unsigned short previous_value = 0;
   width *= depth;
@@ -691,32 +900,33 @@ scale_channel(unsigned short *data, unsigned width, unsigned depth,
       else if (data[i] == (unsigned short) 65535)
 	{
 	  data[i] = density;
-	  retval = 1;
+	  *nz = 1;
 	}
       else if (data[i] > 0)
 	{
 	  unsigned short tval = (32767u + data[i] * density) / 65535u;
 	  previous_data = data[i];
 	  if (tval)
-	    retval = 1;
+	    *nz = 1;
 	  previous_value = (unsigned short) tval;
 	  data[i] = (unsigned short) tval;
 	}
     }
-  return retval;
 }
 
-static int
-scan_channel(unsigned short *data, unsigned width, unsigned depth)
+static void
+scan_channel(unsigned short *data, unsigned width, unsigned depth, int *nz)
 {
   int i;
   width *= depth;
   for (i = 0; i < width; i += depth)
     {
       if (data[i])
-	return 1;
+	{
+	  *nz = 1;
+	  return;
+	}
     }
-  return 0;
 }
 
 static inline unsigned
@@ -729,17 +939,13 @@ ink_sum(const unsigned short *data, int total_channels)
   return total_ink;
 }
 
-static int
-limit_ink(const stp_vars_t *v)
+static void
+limit_ink(stpi_channel_group_t *cg, int first, int count,
+	  stpi_convert_state_t *state)
 {
   int i;
-  int retval = 0;
-  stpi_channel_group_t *cg = get_channel_group(v);
-  unsigned short *ptr;
-  if (!cg || cg->ink_limit == 0 || cg->ink_limit >= cg->max_density)
-    return 0;
-  ptr = cg->output_data;
-  for (i = 0; i < cg->width; i++)
+  unsigned short *ptr = cg->output_data + first * cg->total_channels;
+  for (i = 0; i < count; i++)
     {
       int total_ink = ink_sum(ptr, cg->total_channels);
       if (total_ink > cg->ink_limit) /* Need to limit ink? */
@@ -751,11 +957,9 @@ limit_ink(const stp_vars_t *v)
 	  double ratio = (double) cg->ink_limit / (double) total_ink;
 	  for (j = 0; j < cg->total_channels; j++)
 	    ptr[j] *= ratio;
-	  retval = 1;
 	}
       ptr += cg->total_channels;
    }
-  return retval;
 }
 
 static inline int
@@ -785,17 +989,13 @@ short_copy(unsigned short *out, const unsigned short *in, size_t count)
 }
 
 static void
-copy_channels(const stp_vars_t *v)
+copy_channels(stpi_channel_group_t *cg, int first, int count,
+	      stpi_convert_state_t *state)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   int i, j, k;
-  const unsigned short *input;
-  unsigned short *output;
-  if (!cg)
-    return;
-  input = cg->input_data;
-  output = cg->output_data;
-  for (i = 0; i < cg->width; i++)
+  const unsigned short *input = cg->input_data + first * cg->input_channels;
+  unsigned short *output = cg->output_data + first * cg->total_channels;
+  for (i = 0; i < count; i++)
     {
       for (j = 0; j < cg->channel_count; j++)
 	{
@@ -842,23 +1042,17 @@ interpolate_value(const double *vec, double val)
 }
 
 static void
-generate_special_channels(const stp_vars_t *v)
+generate_special_channels(stpi_channel_group_t *cg, int first, int count,
+			  stpi_convert_state_t *state)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   int i, j;
   const unsigned short *input_cache = NULL;
   const unsigned short *output_cache = NULL;
-  const unsigned short *input;
-  unsigned short *output;
-  int offset;
-  int outbytes;
-  if (!cg)
-    return;
-  input = cg->input_data;
-  output = cg->multi_tmp;
-  offset = (cg->black_channel >= 0 ? 0 : -1);
-  outbytes = cg->aux_output_channels * sizeof(unsigned short);
-  for (i = 0; i < cg->width;
+  const unsigned short *input = cg->input_data + first * cg->input_channels;
+  unsigned short *output = cg->multi_tmp + first * cg->aux_output_channels;
+  int offset = (cg->black_channel >= 0 ? 0 : -1);
+  int outbytes = cg->aux_output_channels * sizeof(unsigned short);
+  for (i = 0; i < count;
        input += cg->input_channels, output += cg->aux_output_channels, i++)
     {
       if (input_cache && short_eq(input_cache, input, cg->input_channels))
@@ -917,24 +1111,20 @@ generate_special_channels(const stp_vars_t *v)
 }
 
 static void
-split_channels(const stp_vars_t *v, unsigned *zero_mask)
+split_channels(stpi_channel_group_t *cg, int first, int count,
+	       stpi_convert_state_t *state)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   int i, j, k;
   int nz[STP_CHANNEL_LIMIT];
-  int outbytes;
+  int outbytes = cg->total_channels * sizeof(unsigned short);
   const unsigned short *input_cache = NULL;
   const unsigned short *output_cache = NULL;
-  const unsigned short *input;
-  unsigned short *output;
-  if (!cg)
-    return;
-  outbytes = cg->total_channels * sizeof(unsigned short);
-  input = cg->split_input;
-  output = cg->output_data;
+  const unsigned short *input =
+    cg->split_input + first * cg->aux_output_channels;
+  unsigned short *output = cg->output_data + first * cg->total_channels;
   for (i = 0; i < cg->total_channels; i++)
     nz[i] = 0;
-  for (i = 0; i < cg->width; i++)
+  for (i = 0; i < count; i++)
     {
       int zero_ptr = 0;
       if (input_cache && short_eq(input_cache, input, cg->aux_output_channels))
@@ -978,54 +1168,62 @@ split_channels(const stp_vars_t *v, unsigned *zero_mask)
 		  else
 		    {
 		      unsigned l_val = i_val;
-		      unsigned offset;
+		      const stpi_split_segment_t *seg;
+		      unsigned amounts[3];
+		      int s_index;
 		      if (i_val > 0 && black_value && j != cg->black_channel)
 			{
 			  l_val += black_value;
 			  if (l_val > 65535)
 			    l_val = 65535;
 			}
-		      offset = l_val * s_count;
+		      s_index = c->split_index[l_val >> 8];
+		      while (l_val > c->split[s_index].last)
+			s_index++;
+		      seg = &(c->split[s_index]);
+		      if (c->split_fixup &&
+			  (c->split_fixup[l_val >> 3] & (1 << (l_val & 7))))
+			split_exact_amounts(seg, l_val, amounts);
+		      else
+			{
+			  amounts[0] = split_fixed_amount(seg, 0, l_val);
+			  amounts[1] = split_fixed_amount(seg, 1, l_val);
+			}
+		      amounts[2] = 0;	/* For the other subchannels */
+		      for (k = 0; k < 2; k++)
+			{
+			  unsigned s_density = c->sc[seg->first + k].s_density;
+			  if (i_val != l_val)
+			    amounts[k] = amounts[k] * i_val / l_val;
+			  if (s_density < 65535)
+			    amounts[k] = amounts[k] * s_density / 65535;
+			}
 		      for (k = 0; k < s_count; k++)
 			{
-			  unsigned o_val;
-			  if (c->sc[k].s_density > 0)
-			    {
-			      o_val = c->lut[offset + k];
-			      if (i_val != l_val)
-				o_val = o_val * i_val / l_val;
-			      if (c->sc[k].s_density < 65535)
-				o_val = o_val * c->sc[k].s_density / 65535;
-			    }
-			  else
-			    o_val = 0;
-			  *output++ = o_val;
-			  nz[zero_ptr++] |= o_val;
+			  unsigned where = k - seg->first;
+			  unsigned o_val = amounts[where < 2 ? where : 2];
+			  output[k] = o_val;
+			  nz[zero_ptr + k] |= o_val;
 			}
+		      output += s_count;
+		      zero_ptr += s_count;
 		    }
 		}
 	    }
 	}
     }
-  if (zero_mask)
-    {
-      *zero_mask = 0;
-      for (i = 0; i < cg->total_channels; i++)
-	if (!nz[i])
-	  *zero_mask |= 1 << i;
-    }
+  for (i = 0; i < cg->total_channels; i++)
+    state->nz[i] |= nz[i];
 }
 
 static void
-scale_channels(const stp_vars_t *v, unsigned *zero_mask)
+scale_channels(stpi_channel_group_t *cg, int first, int count,
+	       stpi_convert_state_t *state)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
+  int *nz = state->nz;
   int i, j;
   int physical_channel = 0;
-  if (!cg)
-    return;
-  if (zero_mask)
-    *zero_mask = 0;
+  unsigned short *output = cg->output_data + first * cg->total_channels;
   for (i = 0; i < cg->channel_count; i++)
     {
       stpi_channel_t *ch = &(cg->c[i]);
@@ -1036,25 +1234,15 @@ scale_channels(const stp_vars_t *v, unsigned *zero_mask)
 	      {
 		stpi_subchannel_t *sch = &(ch->sc[j]);
 		unsigned density = sch->s_density;
-		unsigned short *output = cg->output_data + physical_channel;
+		unsigned short *data = output + physical_channel;
 		if (density == 0)
-		  {
-		    clear_channel(output, cg->width, cg->total_channels);
-		    if (zero_mask)
-		      *zero_mask |= 1 << physical_channel;
-		  }
+		  clear_channel(data, count, cg->total_channels);
 		else if (density != 65535)
-		  {
-		    if (scale_channel(output, cg->width, cg->total_channels,
-				      density) == 0)
-		      if (zero_mask)
-			*zero_mask |= 1 << physical_channel;
-		  }
-		else if (zero_mask)
-		  {
-		    if (scan_channel(output, cg->width, cg->total_channels)==0)
-		      *zero_mask |= 1 << physical_channel;
-		  }
+		  scale_channel(data, count, cg->total_channels, density,
+				&(nz[physical_channel]));
+		else if (!nz[physical_channel])
+		  scan_channel(data, count, cg->total_channels,
+			       &(nz[physical_channel]));
 	      }
 	    physical_channel++;
 	  }
@@ -1062,17 +1250,12 @@ scale_channels(const stp_vars_t *v, unsigned *zero_mask)
 }
 
 static void
-generate_gloss(const stp_vars_t *v, unsigned *zero_mask)
+generate_gloss(stpi_channel_group_t *cg, int first, int count,
+	       stpi_convert_state_t *state)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
-  unsigned short *output;
-  unsigned gloss_mask;
+  unsigned short *output = cg->output_data + first * cg->total_channels;
   int i, j, k;
-  if (!cg || cg->gloss_channel == -1 || cg->gloss_limit <= 0)
-    return;
-  output = cg->output_data;
-  gloss_mask = ~(1 << cg->gloss_physical_channel);
-  for (i = 0; i < cg->width; i++)
+  for (i = 0; i < count; i++)
     {
       int physical_channel = 0;
       unsigned channel_sum = 0;
@@ -1097,8 +1280,7 @@ generate_gloss(const stp_vars_t *v, unsigned *zero_mask)
 	  if (gloss_required > 65535)
 	    gloss_required = 65535;
 	  output[cg->gloss_physical_channel] = gloss_required;
-	  if (zero_mask)
-	    *zero_mask &= gloss_mask;
+	  state->glossed = 1;
 	}
     next:
       output += cg->total_channels;
@@ -1106,21 +1288,13 @@ generate_gloss(const stp_vars_t *v, unsigned *zero_mask)
 }
 
 static void
-do_gcr(const stp_vars_t *v)
+do_gcr(stpi_channel_group_t *cg, int first, int count,
+       stpi_convert_state_t *state)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
-  const unsigned short *gcr_lookup;
-  unsigned short *output;
-  size_t count;
+  const unsigned short *gcr_lookup = state->gcr_lookup;
+  unsigned short *output = cg->gcr_data + first * cg->gcr_channels;
   int i;
-
-  if (!cg)
-    return;
-
-  output = cg->gcr_data;
-  stp_curve_resample(cg->gcr_curve, 65536);
-  gcr_lookup = stp_curve_get_ushort_data(cg->gcr_curve, &count);
-  for (i = 0; i < cg->width; i++)
+  for (i = 0; i < count; i++)
     {
       unsigned k = output[0];
       if (k > 0)
@@ -1142,18 +1316,51 @@ do_gcr(const stp_vars_t *v)
 void
 stp_channel_convert(const stp_vars_t *v, unsigned *zero_mask)
 {
-  if (input_has_special_channels(v))
-    generate_special_channels(v);
-  else if (output_has_gloss(v) && !input_needs_splitting(v))
-    copy_channels(v);
+  stpi_channel_group_t *cg = get_channel_group(v);
+  stpi_convert_state_t state;
+  int first, i, j;
+  if (!cg)
+    return;
+  state.gcr_lookup = NULL;
   if (output_needs_gcr(v))
-    do_gcr(v);
+    {
+      size_t count;
+      stp_curve_resample(cg->gcr_curve, 65536);
+      state.gcr_lookup = stp_curve_get_ushort_data(cg->gcr_curve, &count);
+    }
+  for (i = 0; i < cg->total_channels; i++)
+    state.nz[i] = 0;
+  state.glossed = 0;
+  for (first = 0; first < cg->width; first += cg->convert_block)
+    {
+      int count = cg->width - first;
+      if (count > cg->convert_block)
+	count = cg->convert_block;
+      for (i = 0; i < cg->convert_step_count; i++)
+	(cg->convert_steps[i])(cg, first, count, &state);
+    }
+  if (!zero_mask)
+    return;
+  *zero_mask = 0;
   if (input_needs_splitting(v))
-    split_channels(v, zero_mask);
+    {
+      for (i = 0; i < cg->total_channels; i++)
+	if (!state.nz[i])
+	  *zero_mask |= 1 << i;
+    }
   else
-    scale_channels(v, zero_mask);
-  (void) limit_ink(v);
-  (void) generate_gloss(v, zero_mask);
+    {
+      int physical_channel = 0;
+      for (i = 0; i < cg->channel_count; i++)
+	for (j = 0; j < cg->c[i].subchannel_count; j++)
+	  {
+	    if (cg->gloss_channel != i && !state.nz[physical_channel])
+	      *zero_mask |= 1 << physical_channel;
+	    physical_channel++;
+	  }
+    }
+  if (state.glossed)
+    *zero_mask &= ~(1 << cg->gloss_physical_channel);
 }
 
 unsigned short *
@@ -1173,3 +1380,12 @@ stp_channel_get_output(const stp_vars_t *v)
     return NULL;
   return cg->output_data;
 }
+
+size_t
+stpi_channel_get_output_size(const stp_vars_t *v)
+{
+  stpi_channel_group_t *cg = get_channel_group(v);
+  if (!cg || !cg->output_data)
+    return 0;
+  return sizeof(unsigned short) * cg->total_channels * cg->width;
+}
@@ -164,6 +164,16 @@ typedef struct
   unsigned short *gray_tmp;	/* Color -> Gray */
   unsigned short *cmy_tmp;	/* CMY -> CMYK */
   unsigned char *in_data;
+  unsigned char *in_band;	/* Input rows for stp_color_get_rows() */
+  unsigned short *out_band;	/* Converted rows for stp_color_get_rows() */
+  int band_rows;		/* Rows in in_band and out_band */
+  unsigned *lut8;		/* Composed 8-bit input -> output tables */
+  const unsigned short *lut8_outer[4]; /* Tables lut8 was composed from */
+  const unsigned short *lut8_inner;
+  unsigned lut8_divisor;
+  int lut8_channels;
+  unsigned short *color_lattice; /* Optional 3D RGB -> RGB color lattice */
+  int lattice_size;		/* Points per axis of color_lattice */
 } lut_t;
 
 extern unsigned stpi_color_convert_to_gray(const stp_vars_t *v,
@@ -178,6 +188,9 @@ extern unsigned stpi_color_convert_to_kcmy(const stp_vars_t *v,
 extern unsigned stpi_color_convert_raw(const stp_vars_t *v,
 				       const unsigned char *,
 				       unsigned short *);
+extern void stpi_color_compute_lattice(const stp_vars_t *v, int size);
+/* The lut_t of the traditional color module, found by handle */
+extern lut_t *stpi_color_get_lut(const stp_vars_t *v);
 
 #ifdef __cplusplus
   }
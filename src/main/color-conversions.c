@@ -38,6 +38,9 @@
 #endif
 #include <string.h>
 #include "color-conversion.h"
+#ifdef STPI_X86_SIMD
+#include <immintrin.h>
+#endif
 
 #ifdef __GNUC__
 #define inline __inline__
@@ -56,6 +59,28 @@
 #define FMAX(a, b) ((a) > (b) ? (a) : (b))
 #define FMIN(a, b) ((a) < (b) ? (a) : (b))
 
+/*
+ * The row functions look these parameters up on every row, so find them
+ * by handle rather than by name.
+ */
+static double
+get_saturation(const stp_vars_t *v)
+{
+  static stp_parameter_handle_t handle = NULL;
+  if (!handle)
+    handle = stp_parameter_handle("Saturation", STP_PARAMETER_TYPE_DOUBLE);
+  return stp_get_float_parameter_by_handle(v, handle);
+}
+
+static double
+get_brightness(const stp_vars_t *v)
+{
+  static stp_parameter_handle_t handle = NULL;
+  if (!handle)
+    handle = stp_parameter_handle("Brightness", STP_PARAMETER_TYPE_DOUBLE);
+  return stp_get_float_parameter_by_handle(v, handle);
+}
+
 static inline void
 calc_rgb_to_hsl(unsigned short *rgb, double *hue, double *sat,
 		double *lightness)
@@ -338,6 +363,72 @@ lookup_rgb(lut_t *lut, unsigned short *rgbout,
     }
 }
 
+/*
+ * Optional 3D color lattice.  The full RGB pipeline of color_*_to_color
+ * (contrast, brightness and saturation, hue/luminosity/saturation maps,
+ * and channel curves) is sampled at size^3 points, and pixels are then
+ * computed by tetrahedral interpolation between the nearest points.
+ * Fractions are kept to LATTICE_FRAC_BITS so that all arithmetic fits
+ * in an int.
+ */
+
+#define LATTICE_FRAC_BITS 12
+#define LATTICE_ONE (1 << LATTICE_FRAC_BITS)
+
+static inline void
+lookup_lattice(const lut_t *lut, unsigned short *rgbout)
+{
+  int size = lut->lattice_size;
+  int sg = 3 * size;
+  int sr = sg * size;
+  int idx[3];
+  int f[3];
+  int o1, o2;
+  int w1, w2, w3;
+  const unsigned short *c0;
+  int i;
+  for (i = 0; i < 3; i++)
+    {
+      unsigned pos = (unsigned) rgbout[i] * (size - 1);
+      idx[i] = pos / 65535;
+      if (idx[i] >= size - 1)
+	{
+	  idx[i] = size - 2;
+	  f[i] = LATTICE_ONE;
+	}
+      else
+	f[i] = ((pos - idx[i] * 65535) << LATTICE_FRAC_BITS) / 65535;
+    }
+  c0 = lut->color_lattice + idx[0] * sr + idx[1] * sg + idx[2] * 3;
+  if (f[0] >= f[1])
+    {
+      if (f[1] >= f[2])
+	{ o1 = sr; o2 = sr + sg; w1 = f[0]; w2 = f[1]; w3 = f[2]; }
+      else if (f[0] >= f[2])
+	{ o1 = sr; o2 = sr + 3; w1 = f[0]; w2 = f[2]; w3 = f[1]; }
+      else
+	{ o1 = 3; o2 = sr + 3; w1 = f[2]; w2 = f[0]; w3 = f[1]; }
+    }
+  else
+    {
+      if (f[0] >= f[2])
+	{ o1 = sg; o2 = sr + sg; w1 = f[1]; w2 = f[0]; w3 = f[2]; }
+      else if (f[1] >= f[2])
+	{ o1 = sg; o2 = sg + 3; w1 = f[1]; w2 = f[2]; w3 = f[0]; }
+      else
+	{ o1 = 3; o2 = sg + 3; w1 = f[2]; w2 = f[1]; w3 = f[0]; }
+    }
+  for (i = 0; i < 3; i++)
+    {
+      int val = c0[i] * LATTICE_ONE +
+	(c0[o1 + i] - c0[i]) * w1 +
+	(c0[o2 + i] - c0[o1 + i]) * w2 +
+	(c0[sr + sg + 3 + i] - c0[o2 + i]) * w3;
+      val = (val + (LATTICE_ONE / 2)) >> LATTICE_FRAC_BITS;
+      rgbout[i] = val < 0 ? 0 : (val > 65535 ? 65535 : val);
+    }
+}
+
 static inline int
 short_eq(const unsigned short *i1, const unsigned short *i2, size_t count)
 {
@@ -364,11 +455,254 @@ short_copy(unsigned short *out, const unsigned short *in, size_t count)
 #endif
 }
 
+/*
+ * Row kernels for 8-bit input.
+ *
+ * When every step of a conversion is a per-channel table lookup, the
+ * chain of lookups can be composed into one 256-entry table per input
+ * channel, and the row becomes a single table lookup per sample.  The
+ * composed tables are stored as unsigned ints so that the AVX2 kernel
+ * can use gather loads on them; the values never exceed 65535.
+ *
+ * Table j of the composed set maps input byte v to
+ * outer[j][inner[v] / divisor].
+ *
+ * Only 8-bit conversions made entirely of table lookups use these
+ * kernels.  16-bit input keeps the scalar path: its 65536-entry tables
+ * are too large to compose, and gathering from them directly measured
+ * slower than scalar loads.  RGB conversions that adjust saturation or
+ * brightness, or apply the hue, luminosity or saturation maps, do
+ * per-pixel floating point HSL work and also stay scalar.
+ */
+
+static const unsigned *
+compose_lut8(lut_t *lut, int channels, const unsigned short *const *outer,
+	     const unsigned short *inner, unsigned divisor)
+{
+  int i, j;
+  if (lut->lut8 && lut->lut8_channels == channels &&
+      lut->lut8_inner == inner && lut->lut8_divisor == divisor)
+    {
+      for (j = 0; j < channels; j++)
+	if (lut->lut8_outer[j] != outer[j])
+	  break;
+      if (j == channels)
+	return lut->lut8;
+    }
+  if (!lut->lut8)
+    lut->lut8 = stp_malloc(sizeof(unsigned) * 256 * 4);
+  for (j = 0; j < channels; j++)
+    {
+      unsigned *table = lut->lut8 + (j << 8);
+      for (i = 0; i < 256; i++)
+	table[i] = outer[j][inner[i] / divisor];
+      lut->lut8_outer[j] = outer[j];
+    }
+  lut->lut8_channels = channels;
+  lut->lut8_inner = inner;
+  lut->lut8_divisor = divisor;
+  stp_deprintf(STP_DBG_COLORFUNC, "Composed %d 8-bit lookup tables\n",
+	       channels);
+  return lut->lut8;
+}
+
+/*
+ * Convert a row of 8-bit samples through composed tables.  Sample j of
+ * each output pixel is looked up in table j.  The input has the same
+ * interleaved channels as the output, or for gray input one sample per
+ * pixel that is looked up in each of the three tables.  Returns a mask
+ * of the output channels that are entirely zero, in the same form as
+ * the conversion functions.
+ */
+typedef unsigned lut8_row_func_t(const unsigned char *in, unsigned short *out,
+				 int width, int channels, int gray,
+				 const unsigned *tables);
+
+static unsigned
+lut8_row_scalar(const unsigned char *in, unsigned short *out, int width,
+		int channels, int gray, const unsigned *tables)
+{
+  unsigned nz[4] = { 0, 0, 0, 0 };
+  unsigned retval = 0;
+  int i, j;
+  for (i = 0; i < width; i++)
+    for (j = 0; j < channels; j++)
+      {
+	unsigned val = tables[(j << 8) + (gray ? in[i] : *in++)];
+	*out++ = val;
+	nz[j] |= val;
+      }
+  for (j = 0; j < channels; j++)
+    if (nz[j] == 0)
+      retval |= (1 << j);
+  return retval;
+}
+
+/*
+ * Mask of the channels of an interleaved 8-bit row that are entirely
+ * zero on input.
+ */
+static unsigned
+input_zero_mask_8(const unsigned char *in, int width, int channels)
+{
+  unsigned char nz[4] = { 0, 0, 0, 0 };
+  unsigned retval = 0;
+  size_t count = (size_t) width * channels;
+  size_t i = 0;
+  int j;
+#ifdef STPI_X86_SIMD
+  if (channels == 4)
+    {
+      __m128i acc = _mm_setzero_si128();
+      for (; i + 16 <= count; i += 16)
+	acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *) (in + i)));
+      acc = _mm_or_si128(acc, _mm_srli_si128(acc, 8));
+      acc = _mm_or_si128(acc, _mm_srli_si128(acc, 4));
+      j = _mm_cvtsi128_si32(acc);
+      nz[0] = j & 0xff;
+      nz[1] = (j >> 8) & 0xff;
+      nz[2] = (j >> 16) & 0xff;
+      nz[3] = (j >> 24) & 0xff;
+    }
+#endif
+  for (; i < count; i++)
+    nz[i % channels] |= in[i];
+  for (j = 0; j < channels; j++)
+    if (nz[j] == 0)
+      retval |= (1 << j);
+  return retval;
+}
+
+/*
+ * Rotate each CMYK group of a row into KCMY order in place.
+ */
+static void
+rotate_cmyk_row(unsigned short *out, int width)
+{
+  int i = 0;
+#ifdef STPI_X86_SIMD
+  for (; i + 2 <= width; i += 2)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) (out + 4 * i));
+      v = _mm_or_si128(_mm_slli_epi64(v, 16), _mm_srli_epi64(v, 48));
+      _mm_storeu_si128((__m128i *) (out + 4 * i), v);
+    }
+#endif
+  for (; i < width; i++)
+    {
+      unsigned short k = out[4 * i + 3];
+      out[4 * i + 3] = out[4 * i + 2];
+      out[4 * i + 2] = out[4 * i + 1];
+      out[4 * i + 1] = out[4 * i];
+      out[4 * i] = k;
+    }
+}
+
+#ifdef STPI_X86_SIMD
+/*
+ * The AVX2 kernel handles eight output samples per step.  The channel
+ * of each lane repeats every lcm(channels, 8) samples, i.e. one phase
+ * for 1, 2 or 4 channels and three phases for 3 channels, so a block
+ * of 8 * phases samples is done at a time.  Gray input is only used
+ * with three channels; a block is then eight input pixels, and each
+ * phase permutes the pixels out to its lanes.
+ */
+static const int gray_lane_pixel[3][8] =
+{
+  { 0, 0, 0, 1, 1, 1, 2, 2 },
+  { 2, 3, 3, 3, 4, 4, 4, 5 },
+  { 5, 5, 6, 6, 6, 7, 7, 7 },
+};
+
+STPI_TARGET_AVX2 static unsigned
+lut8_row_avx2(const unsigned char *in, unsigned short *out, int width,
+	      int channels, int gray, const unsigned *tables)
+{
+  __m256i offsets[3];
+  __m256i perm[3];
+  __m256i nz[3];
+  unsigned lanes[8];
+  unsigned chan_nz[4] = { 0, 0, 0, 0 };
+  unsigned retval = 0;
+  size_t count = (size_t) width * channels;
+  size_t i = 0;
+  int phases = (8 % channels) ? channels : 1;
+  int j, k;
+
+  for (j = 0; j < phases; j++)
+    {
+      int idx[8];
+      for (k = 0; k < 8; k++)
+	idx[k] = ((j * 8 + k) % channels) << 8;
+      offsets[j] = _mm256_loadu_si256((const __m256i *) idx);
+      if (gray)
+	perm[j] = _mm256_loadu_si256((const __m256i *) gray_lane_pixel[j]);
+      nz[j] = _mm256_setzero_si256();
+    }
+  for (; i + 8 * phases <= count; i += 8 * phases)
+    {
+      __m256i pixels = _mm256_setzero_si256();
+      if (gray)
+	pixels = _mm256_cvtepu8_epi32
+	  (_mm_loadl_epi64((const __m128i *) (in + i / channels)));
+      for (j = 0; j < phases; j++)
+	{
+	  __m256i idx = gray ? _mm256_permutevar8x32_epi32(pixels, perm[j]) :
+	    _mm256_cvtepu8_epi32
+	    (_mm_loadl_epi64((const __m128i *) (in + i + 8 * j)));
+	  __m256i val = _mm256_i32gather_epi32
+	    ((const int *) tables, _mm256_add_epi32(idx, offsets[j]), 4);
+	  __m256i packed = _mm256_permute4x64_epi64
+	    (_mm256_packus_epi32(val, val), 0x08);
+	  _mm_storeu_si128((__m128i *) (out + i + 8 * j),
+			   _mm256_castsi256_si128(packed));
+	  nz[j] = _mm256_or_si256(nz[j], val);
+	}
+    }
+  for (j = 0; j < phases; j++)
+    {
+      _mm256_storeu_si256((__m256i *) lanes, nz[j]);
+      for (k = 0; k < 8; k++)
+	chan_nz[(j * 8 + k) % channels] |= lanes[k];
+    }
+  for (k = 0; i < count; i++)
+    {
+      unsigned val = tables[(k << 8) + in[gray ? i / channels : i]];
+      out[i] = val;
+      chan_nz[k] |= val;
+      if (++k == channels)
+	k = 0;
+    }
+  for (j = 0; j < channels; j++)
+    if (chan_nz[j] == 0)
+      retval |= (1 << j);
+  return retval;
+}
+
+#endif
+
+static unsigned
+lut8_row(const unsigned char *in, unsigned short *out, int width,
+	 int channels, int gray, const unsigned *tables)
+{
+  static lut8_row_func_t *row_func = NULL;
+  if (!row_func)
+    {
+#ifdef STPI_X86_SIMD
+      if (STPI_CPU_HAS_AVX2())
+	row_func = lut8_row_avx2;
+      else
+#endif
+	row_func = lut8_row_scalar;
+    }
+  return (row_func)(in, out, width, channels, gray, tables);
+}
+
 static unsigned
 raw_cmy_to_kcmy(const stp_vars_t *vars, const unsigned short *in,
 		unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));
+  lut_t *lut = stpi_color_get_lut(vars);
   int width = lut->image_width;
 
   int i;
@@ -418,7 +752,7 @@ static unsigned								\
 fromname##_to_##toname(const stp_vars_t *vars, const unsigned char *in,	\
 		       unsigned short *out)				\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   if (!lut->printed_colorfunc)						\
     {									\
       lut->printed_colorfunc = 1;					\
@@ -442,8 +776,8 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,     \
 {									     \
   int i;								     \
   double isat = 1.0;							     \
-  double ssat = stp_get_float_parameter(vars, "Saturation");		     \
-  double sbright = stp_get_float_parameter(vars, "Brightness");		     \
+  double ssat = get_saturation(vars);					     \
+  double sbright = get_brightness(vars);				     \
   int i0 = -1;								     \
   int i1 = -1;								     \
   int i2 = -1;								     \
@@ -459,7 +793,7 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,     \
   const unsigned short *brightness;					     \
   const unsigned short *contrast;					     \
   const T *s_in = (const T *) in;					     \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	     \
+  lut_t *lut = stpi_color_get_lut(vars);				     \
   int compute_saturation = ssat <= .99999 || ssat >= 1.00001;		     \
   int split_saturation = ssat > 1.4;					     \
   int bright_color_adjustment = 0;					     \
@@ -494,6 +828,18 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,     \
   (void) stp_curve_cache_get_double_data(&(lut->lum_map));		     \
   (void) stp_curve_cache_get_double_data(&(lut->sat_map));		     \
 									     \
+  if (bits == 8 && !compute_saturation && !split_saturation &&		     \
+      !CURVE_CACHE_FAST_DOUBLE(&(lut->hue_map)) &&			     \
+      !CURVE_CACHE_FAST_DOUBLE(&(lut->lum_map)) &&			     \
+      !CURVE_CACHE_FAST_DOUBLE(&(lut->sat_map)))			     \
+    {									     \
+      const unsigned short *maps[3];					     \
+      maps[0] = red;							     \
+      maps[1] = green;							     \
+      maps[2] = blue;							     \
+      return lut8_row(in, out, lut->image_width, 3, 0,			     \
+		      compose_lut8(lut, 3, maps, contrast, 257));	     \
+    }									     \
   if (split_saturation)							     \
     ssat = sqrt(ssat);							     \
   if (ssat > 1)								     \
@@ -514,13 +860,18 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,     \
 	  out[0] = i0 * (65535u / (unsigned) ((1 << bits) - 1));	     \
 	  out[1] = i1 * (65535u / (unsigned) ((1 << bits) - 1));	     \
 	  out[2] = i2 * (65535u / (unsigned) ((1 << bits) - 1));	     \
-	  lookup_rgb(lut, out, contrast, contrast, contrast, 1 << bits);     \
-	  if ((compute_saturation))					     \
-	    update_saturation_from_rgb(out, brightness, ssat, isat,	     \
-				       do_user_adjustment);		     \
-	  adjust_hsl(out, lut, ssat, isat, split_saturation,		     \
-		     hue_only_color_adjustment, bright_color_adjustment);    \
-	  lookup_rgb(lut, out, red, green, blue, 1 << bits);		     \
+	  if (lut->color_lattice)					     \
+	    lookup_lattice(lut, out);					     \
+	  else								     \
+	    {								     \
+	      lookup_rgb(lut, out, contrast, contrast, contrast, 1 << bits); \
+	      if ((compute_saturation))					     \
+		update_saturation_from_rgb(out, brightness, ssat, isat,	     \
+					   do_user_adjustment);		     \
+	      adjust_hsl(out, lut, ssat, isat, split_saturation,	     \
+			 hue_only_color_adjustment, bright_color_adjustment);\
+	      lookup_rgb(lut, out, red, green, blue, 1 << bits);	     \
+	    }								     \
 	  o0 = out[0];							     \
 	  o1 = out[1];							     \
 	  o2 = out[2];							     \
@@ -538,6 +889,91 @@ COLOR_TO_COLOR_FUNC(unsigned char, 8)
 COLOR_TO_COLOR_FUNC(unsigned short, 16)
 GENERIC_COLOR_FUNC(color, color)
 
+/*
+ * Sample the color_16_to_color pipeline on a size^3 lattice for
+ * lookup_lattice().  This must be called after the lut is computed.
+ */
+void
+stpi_color_compute_lattice(const stp_vars_t *vars, int size)
+{
+  int i, r, g, b;
+  double isat = 1.0;
+  double ssat = get_saturation(vars);
+  double sbright = get_brightness(vars);
+  stp_cached_curve_t *sources[5];
+  stp_cached_curve_t curves[5];
+  const unsigned short *data[5];
+  unsigned short *node;
+  lut_t *lut = stpi_color_get_lut(vars);
+  int compute_saturation = ssat <= .99999 || ssat >= 1.00001;
+  int split_saturation = ssat > 1.4;
+  int bright_color_adjustment = 0;
+  int hue_only_color_adjustment = 0;
+  int do_user_adjustment = 0;
+
+  STP_SAFE_FREE(lut->color_lattice);
+  lut->lattice_size = 0;
+  if (size < 2)
+    return;
+  if (lut->color_correction->correction == COLOR_CORRECTION_BRIGHT)
+    bright_color_adjustment = 1;
+  if (lut->color_correction->correction == COLOR_CORRECTION_HUE)
+    hue_only_color_adjustment = 1;
+  if (sbright != 1)
+    do_user_adjustment = 1;
+  compute_saturation |= do_user_adjustment;
+
+  /*
+   * Work on copies of the curves: resampling the lut's own curves to a
+   * different size would invalidate the data cached by the row
+   * functions.
+   */
+  sources[0] = &(lut->channel_curves[CHANNEL_C]);
+  sources[1] = &(lut->channel_curves[CHANNEL_M]);
+  sources[2] = &(lut->channel_curves[CHANNEL_Y]);
+  sources[3] = &(lut->brightness_correction);
+  sources[4] = &(lut->contrast_correction);
+  memset(curves, 0, sizeof(curves));
+  for (i = 0; i < 5; i++)
+    {
+      stp_curve_cache_set_curve_copy
+	(&(curves[i]), stp_curve_cache_get_curve(sources[i]));
+      stp_curve_resample(stp_curve_cache_get_curve(&(curves[i])), 65536);
+      data[i] = stp_curve_cache_get_ushort_data(&(curves[i]));
+    }
+  (void) stp_curve_cache_get_double_data(&(lut->hue_map));
+  (void) stp_curve_cache_get_double_data(&(lut->lum_map));
+  (void) stp_curve_cache_get_double_data(&(lut->sat_map));
+
+  if (split_saturation)
+    ssat = sqrt(ssat);
+  if (ssat > 1)
+    isat = 1.0 / ssat;
+
+  node = stp_malloc(sizeof(unsigned short) * 3 * size * size * size);
+  lut->color_lattice = node;
+  for (r = 0; r < size; r++)
+    for (g = 0; g < size; g++)
+      for (b = 0; b < size; b++)
+	{
+	  node[0] = (r * 65535 + (size - 1) / 2) / (size - 1);
+	  node[1] = (g * 65535 + (size - 1) / 2) / (size - 1);
+	  node[2] = (b * 65535 + (size - 1) / 2) / (size - 1);
+	  lookup_rgb(lut, node, data[4], data[4], data[4], 65536);
+	  if (compute_saturation)
+	    update_saturation_from_rgb(node, data[3], ssat, isat,
+				       do_user_adjustment);
+	  adjust_hsl(node, lut, ssat, isat, split_saturation,
+		     hue_only_color_adjustment, bright_color_adjustment);
+	  lookup_rgb(lut, node, data[0], data[1], data[2], 65536);
+	  node += 3;
+	}
+  for (i = 0; i < 5; i++)
+    stp_curve_free_curve_cache(&(curves[i]));
+  lut->lattice_size = size;
+  stp_dprintf(STP_DBG_LUT, vars, "Computed %d^3 color lattice\n", size);
+}
+
 /*
  * 'rgb_to_rgb()' - Convert rgb image data to RGB.
  */
@@ -558,15 +994,15 @@ color_##bits##_to_color_fast(const stp_vars_t *vars, const unsigned char *in, \
   int nz1 = 0;								      \
   int nz2 = 0;								      \
   const T *s_in = (const T *) in;					      \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	      \
+  lut_t *lut = stpi_color_get_lut(vars);				      \
   const unsigned short *red;						      \
   const unsigned short *green;						      \
   const unsigned short *blue;						      \
   const unsigned short *brightness;					      \
   const unsigned short *contrast;					      \
   double isat = 1.0;							      \
-  double saturation = stp_get_float_parameter(vars, "Saturation");	      \
-  double sbright = stp_get_float_parameter(vars, "Brightness");		      \
+  double saturation = get_saturation(vars);				      \
+  double sbright = get_brightness(vars);				      \
   int compute_saturation = saturation <= .99999 || saturation >= 1.00001;     \
   int do_user_adjustment = 0;						      \
   if (sbright != 1)							      \
@@ -590,6 +1026,15 @@ color_##bits##_to_color_fast(const stp_vars_t *vars, const unsigned char *in, \
   contrast =								      \
     stp_curve_cache_get_ushort_data(&(lut->contrast_correction));	      \
 									      \
+  if (bits == 8 && !compute_saturation)					      \
+    {									      \
+      const unsigned short *maps[3];					      \
+      maps[0] = red;							      \
+      maps[1] = green;							      \
+      maps[2] = blue;							      \
+      return lut8_row(in, out, lut->image_width, 3, 0,			      \
+		      compose_lut8(lut, 3, maps, contrast, 1));		      \
+    }									      \
   if (saturation > 1)							      \
     isat = 1.0 / saturation;						      \
   for (i = 0; i < lut->image_width; i++)				      \
@@ -639,7 +1084,7 @@ color_##bits##_to_color_raw(const stp_vars_t *vars, const unsigned char *in,\
   int j;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   unsigned mask = 0;							    \
   if (lut->invert_output)						    \
     mask = 0xffff;							    \
@@ -681,7 +1126,7 @@ gray_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,	    \
   int nz1 = 0;								    \
   int nz2 = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   const unsigned short *red;						    \
   const unsigned short *green;						    \
   const unsigned short *blue;						    \
@@ -700,6 +1145,16 @@ gray_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,	    \
   user =								    \
     stp_curve_cache_get_ushort_data(&(lut->user_color_correction));	    \
 									    \
+  if (bits == 8)							    \
+    {									    \
+      const unsigned short *maps[3];					    \
+      const unsigned *tables;						    \
+      maps[0] = red;							    \
+      maps[1] = green;							    \
+      maps[2] = blue;							    \
+      tables = compose_lut8(lut, 3, maps, user, 1);			    \
+      return lut8_row(in, out, lut->image_width, 3, 1, tables);		    \
+    }									    \
   for (i = 0; i < lut->image_width; i++)				    \
     {									    \
       if (i0 == s_in[0])						    \
@@ -739,7 +1194,7 @@ gray_##bits##_to_color_raw(const stp_vars_t *vars, const unsigned char *in,\
   int i;								   \
   int nz = 7;								   \
   const T *s_in = (const T *) in;					   \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
+  lut_t *lut = stpi_color_get_lut(vars);				   \
   unsigned mask = 0;							   \
   if (lut->invert_output)						   \
     mask = 0xffff;							   \
@@ -767,7 +1222,7 @@ static unsigned								    \
 name##_##bits##_to_##name2(const stp_vars_t *vars, const unsigned char *in, \
 			   unsigned short *out)				    \
 {									    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   size_t real_steps = lut->steps;					    \
   unsigned status;							    \
   if (!lut->cmy_tmp)							    \
@@ -810,7 +1265,7 @@ name##_to_kcmy_threshold(const stp_vars_t *vars,			\
   int z = 15;								\
   const T *s_in = (const T *) in;					\
   unsigned high_bit = ((1 << ((sizeof(T) * 8) - 1)));			\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int width = lut->image_width;						\
   unsigned mask = 0;							\
   memset(out, 0, width * 4 * sizeof(unsigned short));			\
@@ -868,7 +1323,7 @@ name##_to_kcmy_threshold(const stp_vars_t *vars,			\
   const T *s_in = (const T *) in;					\
   unsigned desired_high_bit = 0;					\
   unsigned high_bit = 1 << ((sizeof(T) * 8) - 1);			\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int width = lut->image_width;						\
   memset(out, 0, width * 4 * sizeof(unsigned short));			\
   if (!lut->invert_output)						\
@@ -917,7 +1372,7 @@ name##_to_kcmy_threshold(const stp_vars_t *vars,			\
   const T *s_in = (const T *) in;					\
   unsigned desired_high_bit = 0;					\
   unsigned high_bit = 1 << ((sizeof(T) * 8) - 1);			\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int width = lut->image_width;						\
   memset(out, 0, width * 4 * sizeof(unsigned short));			\
   if (!lut->invert_output)						\
@@ -955,7 +1410,7 @@ gray_##bits##_to_##name##_threshold(const stp_vars_t *vars,		\
   int desired_high_bit = 0;						\
   unsigned high_bit = 1 << ((sizeof(T) * 8) - 1);			\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int width = lut->image_width;						\
   memset(out, 0, width * channels * sizeof(unsigned short));		\
   if (!lut->invert_output)						\
@@ -994,7 +1449,7 @@ name##_to_color_threshold(const stp_vars_t *vars,			\
   int desired_high_bit = 0;						\
   unsigned high_bit = ((1 << ((sizeof(T) * 8) - 1)) * 4);		\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int width = lut->image_width;						\
   memset(out, 0, width * 3 * sizeof(unsigned short));			\
   if (!lut->invert_output)						\
@@ -1036,7 +1491,7 @@ name##_to_gray_threshold(const stp_vars_t *vars,			\
   int desired_high_bit = 0;						\
   unsigned high_bit = ((1 << ((sizeof(T) * 8) - 1)));			\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int width = lut->image_width;						\
   memset(out, 0, width * sizeof(unsigned short));			\
   if (!lut->invert_output)						\
@@ -1081,7 +1536,7 @@ namein##_##bits##_to_##name2(const stp_vars_t *vars, const unsigned char *in, \
 			   unsigned short *out)				      \
 {									      \
   int i;								      \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	      \
+  lut_t *lut = stpi_color_get_lut(vars);				      \
   unsigned status;							      \
   size_t real_steps = lut->steps;					      \
   const T *s_in = (const T *) in;					      \
@@ -1157,7 +1612,7 @@ cmyk_##size##_to_kcmy(const stp_vars_t *vars,				    \
   int j;								    \
   int nz[4];								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   const unsigned short *user;						    \
   const unsigned short *maps[4];					    \
 									    \
@@ -1169,6 +1624,17 @@ cmyk_##size##_to_kcmy(const stp_vars_t *vars,				    \
   stp_curve_resample(lut->user_color_correction.curve, 1 << size);	    \
   user = stp_curve_cache_get_ushort_data(&(lut->user_color_correction));    \
 									    \
+  if (size == 8)							    \
+    {									    \
+      const unsigned short *in_maps[4];					    \
+      for (j = 0; j < 4; j++)						    \
+	in_maps[j] = maps[(j + 1) & 3];					    \
+      (void) lut8_row(in, out, lut->image_width, 4, 0,			    \
+		      compose_lut8(lut, 4, in_maps, user, 1));		    \
+      rotate_cmyk_row(out, lut->image_width);				    \
+      retval = input_zero_mask_8(in, lut->image_width, 4);		    \
+      return ((retval << 1) | (retval >> 3)) & 0xf;			    \
+    }									    \
   memset(nz, 0, sizeof(nz));						    \
 									    \
   for (i = 0; i < lut->image_width; i++, out += 4)			    \
@@ -1202,7 +1668,7 @@ kcmy_##size##_to_kcmy(const stp_vars_t *vars,				    \
   int j;								    \
   int nz[4];								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   const unsigned short *user;						    \
   const unsigned short *maps[4];					    \
 									    \
@@ -1214,6 +1680,12 @@ kcmy_##size##_to_kcmy(const stp_vars_t *vars,				    \
   stp_curve_resample(lut->user_color_correction.curve, 1 << size);	    \
   user = stp_curve_cache_get_ushort_data(&(lut->user_color_correction));    \
 									    \
+  if (size == 8)							    \
+    {									    \
+      (void) lut8_row(in, out, lut->image_width, 4, 0,			    \
+		      compose_lut8(lut, 4, maps, user, 1));		    \
+      return input_zero_mask_8(in, lut->image_width, 4);		    \
+    }									    \
   memset(nz, 0, sizeof(nz));						    \
 									    \
   for (i = 0; i < lut->image_width; i++, out += 4)			    \
@@ -1247,7 +1719,7 @@ gray_##bits##_to_gray(const stp_vars_t *vars,				   \
   int o0 = 0;								   \
   int nz = 0;								   \
   const T *s_in = (const T *) in;					   \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
+  lut_t *lut = stpi_color_get_lut(vars);				   \
   int width = lut->image_width;						   \
   const unsigned short *composite;					   \
   const unsigned short *user;						   \
@@ -1293,7 +1765,7 @@ color_##bits##_to_gray(const stp_vars_t *vars,				      \
   int o0 = 0;								      \
   int nz = 0;								      \
   const T *s_in = (const T *) in;					      \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	      \
+  lut_t *lut = stpi_color_get_lut(vars);				      \
   int l_red = LUM_RED;							      \
   int l_green = LUM_GREEN;						      \
   int l_blue = LUM_BLUE;						      \
@@ -1351,7 +1823,7 @@ cmyk_##bits##_to_gray(const stp_vars_t *vars,				    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1411,7 +1883,7 @@ kcmy_##bits##_to_gray(const stp_vars_t *vars,				    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1466,7 +1938,7 @@ gray_##bits##_to_gray_raw(const stp_vars_t *vars,			\
   int i;								\
   int nz = 0;								\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int width = lut->image_width;						\
   unsigned mask = 0;							\
   if (lut->invert_output)						\
@@ -1501,7 +1973,7 @@ color_##bits##_to_gray_##name2(const stp_vars_t *vars,			\
   int o0 = 0;								\
   int nz = 0;								\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int l_red = LUM_RED;							\
   int l_green = LUM_GREEN;						\
   int l_blue = LUM_BLUE;						\
@@ -1557,7 +2029,7 @@ cmyk_##bits##_to_gray_##name2(const stp_vars_t *vars,			    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1616,7 +2088,7 @@ kcmy_##bits##_to_gray_##name2(const stp_vars_t *vars,			    \
   int o0 = 0;								    \
   int nz = 0;								    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   int l_red = LUM_RED;							    \
   int l_green = LUM_GREEN;						    \
   int l_blue = LUM_BLUE;						    \
@@ -1672,7 +2144,7 @@ cmyk_##bits##_to_kcmy_raw(const stp_vars_t *vars,			\
   int nz[4];								\
   unsigned retval = 0;							\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
 									\
   memset(nz, 0, sizeof(nz));						\
   for (i = 0; i < lut->image_width; i++)				\
@@ -1707,7 +2179,7 @@ kcmy_##bits##_to_kcmy_raw(const stp_vars_t *vars,			\
   int nz[4];								\
   unsigned retval = 0;							\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
 									\
   memset(nz, 0, sizeof(nz));						\
   for (i = 0; i < lut->image_width; i++)				\
@@ -1736,7 +2208,7 @@ name##_##bits##_to_##name2##_desaturated(const stp_vars_t *vars,	   \
 				         const unsigned char *in,	   \
 				         unsigned short *out)		   \
 {									   \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
+  lut_t *lut = stpi_color_get_lut(vars);				   \
   size_t real_steps = lut->steps;					   \
   unsigned status;							   \
   if (!lut->gray_tmp)							   \
@@ -1774,7 +2246,7 @@ static unsigned								\
 CMYK_to_##name(const stp_vars_t *vars, const unsigned char *in,		\
 	       unsigned short *out)					\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   if (lut->input_color_description->color_id == COLOR_ID_CMYK)		\
     return cmyk_to_##name(vars, in, out);				\
   else if (lut->input_color_description->color_id == COLOR_ID_KCMY)	\
@@ -1808,7 +2280,7 @@ name##_to_raw_threshold(const stp_vars_t *vars,				\
 {									\
   int i;								\
   int j;								\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   unsigned nz[STP_CHANNEL_LIMIT];					\
   unsigned z = (1 << lut->out_channels) - 1;				\
   const T *s_in = (const T *) in;					\
@@ -1851,7 +2323,7 @@ raw_##size##_to_raw(const stp_vars_t *vars,				    \
   int j;								    \
   int nz[STP_CHANNEL_LIMIT];						    \
   const T *s_in = (const T *) in;					    \
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
+  lut_t *lut = stpi_color_get_lut(vars);				    \
   const unsigned short *maps[STP_CHANNEL_LIMIT];			    \
   const unsigned short *user;						    \
 									    \
@@ -1896,7 +2368,7 @@ raw_##bits##_to_raw_raw(const stp_vars_t *vars,				\
   int nz[STP_CHANNEL_LIMIT];						\
   unsigned retval = 0;							\
   const T *s_in = (const T *) in;					\
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(vars);				\
   int colors = lut->in_channels;					\
 									\
   memset(nz, 0, sizeof(nz));						\
@@ -1927,7 +2399,7 @@ generic_##from##_to_##to(const stp_vars_t *v,			\
 			 const unsigned char *in,		\
 			 unsigned short *out)			\
 {								\
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(v);				\
   switch (lut->color_correction->correction)			\
     {								\
     case COLOR_CORRECTION_UNCORRECTED:				\
@@ -1955,7 +2427,7 @@ generic_##from##_to_##to(const stp_vars_t *v,			\
 			 const unsigned char *in,		\
 			 unsigned short *out)			\
 {								\
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));	\
+  lut_t *lut = stpi_color_get_lut(v);				\
   switch (lut->color_correction->correction)			\
     {								\
     case COLOR_CORRECTION_UNCORRECTED:				\
@@ -1982,7 +2454,7 @@ generic_##from##_to_##to(const stp_vars_t *v,				\
 			 const unsigned char *in,			\
 			 unsigned short *out)				\
 {									\
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));		\
+  lut_t *lut = stpi_color_get_lut(v);					\
   switch (lut->color_correction->correction)				\
     {									\
     case COLOR_CORRECTION_UNCORRECTED:					\
@@ -2017,7 +2489,7 @@ stpi_color_convert_to_gray(const stp_vars_t *v,
 			   const unsigned char *in,
 			   unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   switch (lut->input_color_description->color_id)
     {
     case COLOR_ID_GRAY:
@@ -2039,7 +2511,7 @@ stpi_color_convert_to_color(const stp_vars_t *v,
 			    const unsigned char *in,
 			    unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   switch (lut->input_color_description->color_id)
     {
     case COLOR_ID_GRAY:
@@ -2061,7 +2533,7 @@ stpi_color_convert_to_kcmy(const stp_vars_t *v,
 			   const unsigned char *in,
 			   unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   switch (lut->input_color_description->color_id)
     {
     case COLOR_ID_GRAY:
@@ -2083,7 +2555,7 @@ stpi_color_convert_raw(const stp_vars_t *v,
 		       const unsigned char *in,
 		       unsigned short *out)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   switch (lut->color_correction->correction)
     {
     case COLOR_CORRECTION_THRESHOLD:
@@ -39,6 +39,18 @@ static const char* stpi_color_long_namefunc(const void *item);
 
 static stp_list_t *color_list = NULL;
 
+/*
+ * The band converters set with stpi_color_set_get_rows_func(), by color
+ * module name.
+ */
+typedef struct
+{
+  const char *name;
+  stpi_color_get_rows_func_t get_rows;
+} color_get_rows_t;
+
+static stp_list_t *get_rows_list = NULL;
+
 
 static int
 stpi_init_color_list(void)
@@ -191,6 +203,115 @@ stp_color_get_row(stp_vars_t *v,
   return colorfuncs->get_row(v, image, row, zero_mask);
 }
 
+/*
+ * Rows converted one at a time by stp_color_get_rows(), for color modules
+ * that cannot convert a band of rows themselves.
+ */
+typedef struct
+{
+  unsigned short *rows;
+  int count;
+  size_t row_size;
+} color_rows_t;
+
+static void
+free_color_rows(void *data)
+{
+  color_rows_t *cr = (color_rows_t *) data;
+  STP_SAFE_FREE(cr->rows);
+  stp_free(cr);
+}
+
+static const char *
+color_get_rows_namefunc(const void *item)
+{
+  return ((const color_get_rows_t *) item)->name;
+}
+
+void
+stpi_color_set_get_rows_func(const stp_color_t *color,
+			     stpi_color_get_rows_func_t func)
+{
+  stp_list_item_t *item;
+  color_get_rows_t *gr;
+  CHECK_COLOR(color);
+  if (!get_rows_list)
+    {
+      get_rows_list = stp_list_create();
+      stp_list_set_namefunc(get_rows_list, color_get_rows_namefunc);
+      stp_list_set_freefunc(get_rows_list, stp_list_node_free_data);
+    }
+  item = stp_list_get_item_by_name(get_rows_list, color->short_name);
+  if (item)
+    stp_list_item_destroy(get_rows_list, item);
+  if (func)
+    {
+      gr = stp_malloc(sizeof(color_get_rows_t));
+      gr->name = color->short_name;
+      gr->get_rows = func;
+      stp_list_item_create(get_rows_list, NULL, gr);
+    }
+}
+
+static stpi_color_get_rows_func_t
+color_get_rows_func(const stp_color_t *color)
+{
+  stp_list_item_t *item;
+  if (!get_rows_list)
+    return NULL;
+  item = stp_list_get_item_by_name(get_rows_list, color->short_name);
+  if (!item)
+    return NULL;
+  return ((const color_get_rows_t *) stp_list_item_get_data(item))->get_rows;
+}
+
+int
+stp_color_get_rows(stp_vars_t *v,
+		   stp_image_t *image,
+		   int row,
+		   int count,
+		   const unsigned short **outputs,
+		   unsigned *zero_masks)
+{
+  const stp_color_t *color =
+    stp_get_color_by_name(stp_get_color_conversion(v));
+  const stp_colorfuncs_t *colorfuncs = stpi_get_colorfuncs(color);
+  stpi_color_get_rows_func_t get_rows = color_get_rows_func(color);
+  color_rows_t *cr;
+  int i;
+  if (get_rows)
+    return get_rows(v, image, row, count, outputs, zero_masks);
+  cr = (color_rows_t *) stp_get_component_data(v, "ColorRows");
+  if (!cr)
+    {
+      cr = stp_zalloc(sizeof(color_rows_t));
+      stp_allocate_component_data(v, "ColorRows", NULL, free_color_rows, cr);
+    }
+  for (i = 0; i < count; i++)
+    {
+      size_t size;
+      if (colorfuncs->get_row(v, image, row + i,
+			      zero_masks ? &(zero_masks[i]) : NULL))
+	return 2;
+      /*
+       * The size of the converted rows is only known once the first
+       * one has been converted.
+       */
+      size = stpi_channel_get_output_size(v);
+      if (size != cr->row_size || count > cr->count)
+	{
+	  STP_SAFE_FREE(cr->rows);
+	  cr->rows = stp_malloc(size * count);
+	  cr->row_size = size;
+	  cr->count = count;
+	}
+      outputs[i] = cr->rows + i * (size / sizeof(unsigned short));
+      memcpy(cr->rows + i * (size / sizeof(unsigned short)),
+	     stp_channel_get_output(v), size);
+    }
+  return 0;
+}
+
 stp_parameter_list_t
 stp_color_list_parameters(const stp_vars_t *v)
 {
@@ -263,6 +384,7 @@ stp_color_unregister(const stp_color_t *color)
 	    (STP_DBG_COLORFUNC,
 	     "stpi_color_unregister(): unregistered colour module \"%s\"\n",
 	     color->short_name);
+	  stpi_color_set_get_rows_func(color, NULL);
 	  stp_list_item_destroy(color_list, color_item);
 	  break;
 	}
@@ -0,0 +1,504 @@
+/*
+ *
+ *   Blue noise threshold array dither algorithm
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ *
+ * The threshold array is generated with Ulichney's void-and-cluster
+ * method, using a Gaussian filter stretched to the aspect ratio of the
+ * pixels.  Each pixel is then dithered independently of all others, the
+ * same way as with the Ordered algorithm (including the choice between
+ * the drop sizes and inks of each segment of the range), so the result
+ * depends only on the input value and the threshold.  A row is dithered
+ * one channel at a time: the bits of each pixel are computed into a
+ * scratch row and then packed into the output.
+ *
+ * The array for each aspect ratio is generated the first time a process
+ * needs it (about 0.1 second) and kept until the process exits.  It is
+ * read from and saved to the binary cache only when STP_CACHE_PATH names
+ * a cache directory; otherwise every process generates it again.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(HAVE_PTHREAD) && defined(HAVE_PTHREAD_H)
+#define USE_BLUENOISE_LOCK 1
+#include <pthread.h>
+#endif
+#include "dither-impl.h"
+
+#define BLUENOISE_SIZE 128
+#define BLUENOISE_SIGMA 1.5
+#define BLUENOISE_SEED_DENSITY 10	/* Percent of pixels set initially */
+#define BLUENOISE_MAX_ASPECT 4
+
+#define BLUENOISE_CACHE_MAGIC "STPBLUE"
+
+typedef struct
+{
+  int size;
+  int rx;			/* Radius of the filter */
+  int ry;
+  double *filter;
+  double *energy;
+  unsigned char *pattern;
+  int *row_cluster;		/* Set pixel with the most energy in a row */
+  int *row_void;		/* Unset pixel with the least energy in a row */
+} bluenoise_state_t;
+
+typedef struct
+{
+  int *src_offset;		/* Input pixel for each output pixel */
+  unsigned char *bits;		/* Bits of each pixel of the current row */
+} stpi_bluenoise_t;
+
+/*
+ * Arrays generated so far, indexed by log2 of the aspect ratio.
+ */
+static unsigned short *bluenoise_arrays[3] = { NULL, NULL, NULL };
+#ifdef USE_BLUENOISE_LOCK
+static pthread_mutex_t bluenoise_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+update_row(bluenoise_state_t *bn, int y)
+{
+  const double *energy = bn->energy + y * bn->size;
+  const unsigned char *pattern = bn->pattern + y * bn->size;
+  int cluster = -1;
+  int hole = -1;
+  int x;
+  for (x = 0; x < bn->size; x++)
+    {
+      if (pattern[x])
+	{
+	  if (cluster < 0 || energy[x] > energy[cluster])
+	    cluster = x;
+	}
+      else if (hole < 0 || energy[x] < energy[hole])
+	hole = x;
+    }
+  bn->row_cluster[y] = cluster < 0 ? -1 : y * bn->size + cluster;
+  bn->row_void[y] = hole < 0 ? -1 : y * bn->size + hole;
+}
+
+/*
+ * Set or clear pixel P, and update the energy of its neighborhood.
+ */
+static void
+toggle_pixel(bluenoise_state_t *bn, int p)
+{
+  int size = bn->size;
+  int x0 = p % size;
+  int y0 = p / size;
+  double sign = bn->pattern[p] ? -1.0 : 1.0;
+  const double *filter = bn->filter;
+  int dx, dy;
+  bn->pattern[p] = !bn->pattern[p];
+  for (dy = -bn->ry; dy <= bn->ry; dy++)
+    {
+      double *energy = bn->energy + ((y0 + dy + size) % size) * size;
+      for (dx = -bn->rx; dx <= bn->rx; dx++)
+	energy[(x0 + dx + size) % size] += sign * *filter++;
+    }
+  for (dy = -bn->ry; dy <= bn->ry; dy++)
+    update_row(bn, (y0 + dy + size) % size);
+}
+
+static int
+find_cluster(const bluenoise_state_t *bn)
+{
+  int best = -1;
+  int y;
+  for (y = 0; y < bn->size; y++)
+    {
+      int p = bn->row_cluster[y];
+      if (p >= 0 && (best < 0 || bn->energy[p] > bn->energy[best]))
+	best = p;
+    }
+  return best;
+}
+
+static int
+find_void(const bluenoise_state_t *bn)
+{
+  int best = -1;
+  int y;
+  for (y = 0; y < bn->size; y++)
+    {
+      int p = bn->row_void[y];
+      if (p >= 0 && (best < 0 || bn->energy[p] < bn->energy[best]))
+	best = p;
+    }
+  return best;
+}
+
+/*
+ * Pixels are ASPECT times as tall as they are wide.
+ */
+static unsigned short *
+generate_bluenoise(int aspect)
+{
+  bluenoise_state_t bn;
+  int size = BLUENOISE_SIZE;
+  int total = size * size;
+  unsigned short *ranks = stp_malloc(sizeof(unsigned short) * total);
+  unsigned char *initial_pattern = stp_malloc(total);
+  double *initial_energy = stp_malloc(sizeof(double) * total);
+  unsigned seed = 1;
+  int ones = 0;
+  int rank;
+  int dx, dy;
+  int i;
+
+  bn.size = size;
+  bn.rx = ceil(3 * BLUENOISE_SIGMA);
+  bn.ry = ceil(3 * BLUENOISE_SIGMA / aspect);
+  bn.filter = stp_malloc(sizeof(double) * (2 * bn.rx + 1) * (2 * bn.ry + 1));
+  bn.energy = stp_zalloc(sizeof(double) * total);
+  bn.pattern = stp_zalloc(total);
+  bn.row_cluster = stp_malloc(sizeof(int) * size);
+  bn.row_void = stp_malloc(sizeof(int) * size);
+  i = 0;
+  for (dy = -bn.ry; dy <= bn.ry; dy++)
+    for (dx = -bn.rx; dx <= bn.rx; dx++)
+      {
+	double d2 = dx * dx + (dy * aspect) * (dy * aspect);
+	bn.filter[i++] = exp(-d2 / (2 * BLUENOISE_SIGMA * BLUENOISE_SIGMA));
+      }
+  for (i = 0; i < size; i++)
+    update_row(&bn, i);
+
+  /*
+   * Start with a random pattern (from a fixed seed, so that the array is
+   * always the same), and move the pixel in the tightest cluster into the
+   * largest void until that pixel is the one moved back.
+   */
+  for (i = 0; i < total; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      if ((seed >> 16) % 100 < BLUENOISE_SEED_DENSITY)
+	{
+	  toggle_pixel(&bn, i);
+	  ones++;
+	}
+    }
+  while (1)
+    {
+      int cluster = find_cluster(&bn);
+      int hole;
+      toggle_pixel(&bn, cluster);
+      hole = find_void(&bn);
+      toggle_pixel(&bn, hole);
+      if (hole == cluster)
+	break;
+    }
+  memcpy(initial_pattern, bn.pattern, total);
+  memcpy(initial_energy, bn.energy, sizeof(double) * total);
+
+  /*
+   * The initial pixels are ranked by removing the tightest cluster, and
+   * the rest by filling the largest void.  With a filter whose total does
+   * not depend on position, the largest void among the unset pixels is
+   * also the tightest cluster of unset pixels, so no second pass with the
+   * pattern inverted is needed.
+   */
+  for (rank = ones - 1; rank >= 0; rank--)
+    {
+      int cluster = find_cluster(&bn);
+      toggle_pixel(&bn, cluster);
+      ranks[cluster] = rank;
+    }
+  memcpy(bn.pattern, initial_pattern, total);
+  memcpy(bn.energy, initial_energy, sizeof(double) * total);
+  for (i = 0; i < size; i++)
+    update_row(&bn, i);
+  for (rank = ones; rank < total; rank++)
+    {
+      int hole = find_void(&bn);
+      toggle_pixel(&bn, hole);
+      ranks[hole] = rank;
+    }
+
+  stp_free(initial_pattern);
+  stp_free(initial_energy);
+  stp_free(bn.filter);
+  stp_free(bn.energy);
+  stp_free(bn.pattern);
+  stp_free(bn.row_cluster);
+  stp_free(bn.row_void);
+  return ranks;
+}
+
+static unsigned short *
+bluenoise_array_from_cache(int aspect)
+{
+  char buf[64];
+  stpi_binary_cache_t *cache;
+  const unsigned short *data;
+  unsigned short *ret = NULL;
+  size_t bytes;
+  (void) sprintf(buf, "bluenoise-%dx%d-%d.bin", aspect, 1, BLUENOISE_SIZE);
+  cache = stpi_binary_cache_open(buf, BLUENOISE_CACHE_MAGIC, NULL);
+  if (!cache)
+    return NULL;
+  data = stpi_binary_cache_get_data(cache, &bytes);
+  if (bytes == sizeof(unsigned short) * BLUENOISE_SIZE * BLUENOISE_SIZE)
+    {
+      ret = stp_malloc(bytes);
+      memcpy(ret, data, bytes);
+    }
+  stpi_binary_cache_close(cache);
+  return ret;
+}
+
+static const unsigned short *
+get_bluenoise_array(int aspect)
+{
+  int idx = aspect >= 4 ? 2 : aspect - 1;
+  const unsigned short *ret;
+  /*
+   * Dither threads of one job, or separate jobs, may ask for the same
+   * array at once; only one of them generates it.
+   */
+#ifdef USE_BLUENOISE_LOCK
+  pthread_mutex_lock(&bluenoise_lock);
+#endif
+  if (!bluenoise_arrays[idx])
+    {
+      unsigned short *ranks = bluenoise_array_from_cache(aspect);
+      if (!ranks)
+	{
+	  char buf[64];
+	  stp_deprintf(STP_DBG_INK, "Generating %dx1 blue noise array\n",
+		       aspect);
+	  ranks = generate_bluenoise(aspect);
+	  (void) sprintf(buf, "bluenoise-%dx%d-%d.bin", aspect, 1,
+			 BLUENOISE_SIZE);
+	  (void) stpi_binary_cache_write(buf, BLUENOISE_CACHE_MAGIC, NULL,
+					 ranks, (sizeof(unsigned short) *
+						 BLUENOISE_SIZE *
+						 BLUENOISE_SIZE));
+	}
+      bluenoise_arrays[idx] = ranks;
+    }
+  ret = bluenoise_arrays[idx];
+#ifdef USE_BLUENOISE_LOCK
+  pthread_mutex_unlock(&bluenoise_lock);
+#endif
+  return ret;
+}
+
+void
+stpi_dither_set_bluenoise_matrix(stp_vars_t *v)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  stp_dither_matrix_generic_t matrix;
+  int x_aspect = d->x_aspect;
+  int y_aspect = d->y_aspect;
+  int aspect = x_aspect > y_aspect ? x_aspect / y_aspect : y_aspect / x_aspect;
+  if (aspect >= BLUENOISE_MAX_ASPECT)
+    aspect = BLUENOISE_MAX_ASPECT;
+  else if (aspect >= 2)
+    aspect = 2;
+  else
+    aspect = 1;
+  matrix.x = BLUENOISE_SIZE;
+  matrix.y = BLUENOISE_SIZE;
+  matrix.bytes = 2;
+  matrix.prescaled = 0;
+  matrix.data = get_bluenoise_array(aspect);
+  stp_dither_set_matrix(v, &matrix, y_aspect < x_aspect, 0, 0);
+}
+
+static void
+free_dither_bluenoise(stpi_dither_t *d)
+{
+  stpi_bluenoise_t *bn = (stpi_bluenoise_t *) d->aux_data;
+  stp_free(bn->src_offset);
+  stp_free(bn->bits);
+  stp_free(bn);
+  d->aux_data = NULL;
+}
+
+static void
+init_dither_bluenoise(stpi_dither_t *d)
+{
+  stpi_bluenoise_t *bn = stp_malloc(sizeof(stpi_bluenoise_t));
+  int xstep = CHANNEL_COUNT(d) * (d->src_width / d->dst_width);
+  int xmod = d->src_width % d->dst_width;
+  int xerror = 0;
+  int offset = 0;
+  int x;
+  bn->src_offset = stp_malloc(sizeof(int) * d->dst_width);
+  bn->bits = stp_malloc(d->dst_width);
+  for (x = 0; x < d->dst_width; x++)
+    {
+      bn->src_offset[x] = offset;
+      offset += xstep;
+      xerror += xmod;
+      if (xerror >= d->dst_width)
+	{
+	  xerror -= d->dst_width;
+	  offset += CHANNEL_COUNT(d);
+	}
+    }
+  d->aux_data = bn;
+  d->aux_freefunc = &free_dither_bluenoise;
+}
+
+/*
+ * Compute the bits of each pixel of channel DC, and return whether any
+ * of them are non-zero.
+ */
+static int
+dither_channel_row(const stpi_dither_t *d, const stpi_dither_channel_t *dc,
+		   const unsigned short *raw, const stpi_bluenoise_t *bn,
+		   const unsigned char *mask)
+{
+  const stp_dither_matrix_impl_t *mat = &(dc->dithermat);
+  const unsigned *thresholds = mat->matrix + mat->last_y_mod;
+  const int *src_offset = bn->src_offset;
+  unsigned char *bits = bn->bits;
+  int t = mat->x_offset % mat->x_size;
+  int width = d->dst_width;
+  unsigned char any = 0;
+  int x;
+
+  if (dc->nlevels == 1)
+    {
+      /*
+       * With a single drop size and ink, there is no range to search.
+       */
+      const stpi_dither_segment_t *dd = &(dc->ranges[0]);
+      unsigned lower = dd->lower->value;
+      unsigned span = dd->value_span;
+      unsigned char lower_bits = dd->lower->bits;
+      unsigned char upper_bits = dd->upper->bits;
+      for (x = 0; x < width; x++)
+	{
+	  unsigned val = raw[src_offset[x]];
+	  unsigned rangepoint = val > lower ? val - lower : 0;
+	  unsigned char b = (rangepoint * 65535 >= thresholds[t] * span ?
+			     upper_bits : lower_bits);
+	  bits[x] = val > lower ? b : 0;
+	  any |= bits[x];
+	  if (++t == mat->x_size)
+	    t = 0;
+	}
+    }
+  else
+    {
+      for (x = 0; x < width; x++)
+	{
+	  unsigned val = raw[src_offset[x]];
+	  int i;
+	  bits[x] = 0;
+	  for (i = dc->nlevels - 1; i >= 0; i--)
+	    {
+	      const stpi_dither_segment_t *dd = &(dc->ranges[i]);
+	      if (val > dd->lower->value)
+		{
+		  unsigned rangepoint = val - dd->lower->value;
+		  if (rangepoint * 65535 >= thresholds[t] * dd->value_span)
+		    bits[x] = dd->upper->bits;
+		  else
+		    bits[x] = dd->lower->bits;
+		  break;
+		}
+	    }
+	  any |= bits[x];
+	  if (++t == mat->x_size)
+	    t = 0;
+	}
+    }
+  if (any && mask)
+    for (x = 0; x < width; x++)
+      if (!(mask[x >> 3] & (128 >> (x & 7))))
+	bits[x] = 0;
+  return any != 0;
+}
+
+static void
+pack_channel_row(const stpi_dither_t *d, stpi_dither_channel_t *dc,
+		 const unsigned char *bits)
+{
+  int width = d->dst_width;
+  int length = (width + 7) / 8;
+  int first, last;
+  int plane;
+  for (first = 0; first < width && !bits[first]; first++)
+    ;
+  if (first == width)
+    return;
+  for (last = width - 1; !bits[last]; last--)
+    ;
+  dc->row_ends[0] = first;
+  dc->row_ends[1] = last;
+  for (plane = 0; plane < dc->signif_bits; plane++)
+    {
+      unsigned char *tptr = dc->ptr + plane * length;
+      int x;
+      for (x = first & ~7; x <= last; x += 8)
+	{
+	  unsigned char byte = 0;
+	  int k;
+	  for (k = 0; k < 8 && x + k < width; k++)
+	    byte |= ((bits[x + k] >> plane) & 1) << (7 - k);
+	  tptr[x >> 3] |= byte;
+	}
+    }
+}
+
+void
+stpi_dither_bluenoise(stp_vars_t *v,
+		      int row,
+		      const unsigned short *raw,
+		      int duplicate_line,
+		      int zero_mask,
+		      const unsigned char *mask)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  stpi_bluenoise_t *bn;
+  int i;
+
+  if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) ==
+      ((1 << CHANNEL_COUNT(d)) - 1))
+    return;
+  if (!d->aux_data)
+    init_dither_bluenoise(d);
+  bn = (stpi_bluenoise_t *) d->aux_data;
+
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (!dc->ptr || (zero_mask & (1 << i)))
+	continue;
+      if (dither_channel_row(d, dc, raw + i, bn, mask))
+	pack_channel_row(d, dc, bn->bits);
+    }
+}
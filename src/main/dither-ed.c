@@ -121,7 +121,7 @@ update_dither(stpi_dither_t *d, int channel, int width,
 static inline int
 print_color(const stpi_dither_t *d, stpi_dither_channel_t *dc, int x, int y,
 	    unsigned char bit, int length, int dontprint, int stpi_dither_type,
-	    const unsigned char *mask)
+	    const unsigned char *mask, int ptr_offset)
 {
   int base = dc->b;
   int density = dc->o;
@@ -292,11 +292,11 @@ print_color(const stpi_dither_t *d, stpi_dither_channel_t *dc, int x, int y,
 		subc = lower;
 	    }
 	  v = subc->value;
-	  if (!mask || (*(mask + d->ptr_offset) & bit))
+	  if (!mask || (*(mask + ptr_offset) & bit))
 	    {
 	      if (dc->ptr)
 		{
-		  tptr = dc->ptr + d->ptr_offset;
+		  tptr = dc->ptr + ptr_offset;
 
 		  /*
 		   * Lay down all of the bits in the pixel.
@@ -330,6 +330,25 @@ print_color(const stpi_dither_t *d, stpi_dither_channel_t *dc, int x, int y,
   return adjusted;
 }
 
+/*
+ * Count the empty lines in a row.  After four of them the error is
+ * cleared, and later ones are not dithered at all.
+ */
+static void
+update_empty_lines(stpi_dither_t *d, int duplicate_line, int zero_mask)
+{
+  if (!duplicate_line)
+    {
+      if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) !=
+	  ((1 << CHANNEL_COUNT(d)) - 1))
+	d->last_line_was_empty = 0;
+      else
+	d->last_line_was_empty++;
+    }
+  else if (d->last_line_was_empty)
+    d->last_line_was_empty++;
+}
+
 static int
 shared_ed_initializer(stpi_dither_t *d,
 		      int row,
@@ -343,16 +362,7 @@ shared_ed_initializer(stpi_dither_t *d,
   int i, j;
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     CHANNEL(d, i).error_rows = 2;
-  if (!duplicate_line)
-    {
-      if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) !=
-	  ((1 << CHANNEL_COUNT(d)) - 1))
-	d->last_line_was_empty = 0;
-      else
-	d->last_line_was_empty++;
-    }
-  else if (d->last_line_was_empty)
-    d->last_line_was_empty++;
+  update_empty_lines(d, duplicate_line, zero_mask);
   if (d->last_line_was_empty >= 5)
     return 0;
   else if (d->last_line_was_empty == 4)
@@ -405,7 +415,7 @@ stpi_dither_ed(stp_vars_t *v,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int		x,
     		length;
   unsigned char	bit;
@@ -451,7 +461,7 @@ stpi_dither_ed(stp_vars_t *v,
 	      CHANNEL(d, i).v = UPDATE_COLOR(CHANNEL(d, i).v, ndither[i]);
 	      CHANNEL(d, i).v = print_color(d, &(CHANNEL(d, i)), x, row, bit,
 					    length, 0, d->stpi_dither_type,
-					    mask);
+					    mask, d->ptr_offset);
 	      ndither[i] = update_dither(d, i, d->src_width,
 					 direction, error[i][0], error[i][1]);
 	    }
@@ -463,3 +473,220 @@ stpi_dither_ed(stp_vars_t *v,
   if (direction == -1)
     stpi_dither_reverse_row_ends(d);
 }
+
+/*
+ * Band dithering.  The rows are scanned in alternate directions, so each
+ * row can only start once the previous one is finished, but the channels
+ * are independent of each other.  Each job dithers one channel through
+ * all of the rows of a band, which gives the same result as the serial
+ * code above.
+ */
+
+typedef struct
+{
+  stpi_thread_pool_t *pool;
+} ed_data_t;
+
+typedef struct
+{
+  stpi_dither_t *d;
+  int row;
+  int nrows;
+  stpi_dither_row_t *rows;
+  const int *empty;		/* Empty line count after each row */
+  const int *active;		/* Channels with output, in order */
+} ed_band_t;
+
+static void
+free_ed_data(stpi_dither_t *d)
+{
+  ed_data_t *ed = (ed_data_t *) d->aux_data;
+  stpi_thread_pool_destroy(ed->pool);
+  STP_SAFE_FREE(d->aux_data);
+}
+
+static void
+ed_dither_channel_row(stpi_dither_t *d, int channel, int row,
+		      const unsigned short *raw, const unsigned char *mask)
+{
+  stpi_dither_channel_t *dc = &(CHANNEL(d, channel));
+  int direction = row & 1 ? 1 : -1;
+  int length = (d->dst_width + 7) / 8;
+  int *error0 = stpi_dither_get_errline(d, row, channel);
+  int *error1 = stpi_dither_get_errline(d, row + 1, channel);
+  int ndither, x, terminate, ptr_offset;
+  unsigned char bit;
+  int xerror, xstep, xmod;
+
+  memset(error1, 0, d->dst_width * sizeof(int));
+  if (direction == 1)
+    {
+      x = 0;
+      ptr_offset = 0;
+      terminate = d->dst_width;
+    }
+  else
+    {
+      x = d->dst_width - 1;
+      ptr_offset = length - 1;
+      terminate = -1;
+      error0 += d->dst_width - 1;
+      error1 += d->dst_width - 1;
+      raw += CHANNEL_COUNT(d) * (d->src_width - 1);
+    }
+  ndither = error0[0];
+  bit = 1 << (7 - (x & 7));
+  xstep  = CHANNEL_COUNT(d) * (d->src_width / d->dst_width);
+  xmod   = d->src_width % d->dst_width;
+  xerror = (xmod * x) % d->dst_width;
+
+  for (; x != terminate; x += direction)
+    {
+      dc->v = raw[0];
+      dc->o = dc->v;
+      dc->b = dc->v;
+      dc->v = UPDATE_COLOR(dc->v, ndither);
+      dc->v = print_color(d, dc, x, row, bit, length, 0, d->stpi_dither_type,
+			  mask, ptr_offset);
+      ndither = update_dither(d, channel, d->src_width, direction,
+			      error0, error1);
+      error0 += direction;
+      error1 += direction;
+      if (direction == 1)
+	{
+	  bit >>= 1;
+	  if (bit == 0)
+	    {
+	      ptr_offset++;
+	      bit = 128;
+	    }
+	  raw += xstep;
+	  if (xmod)
+	    {
+	      xerror += xmod;
+	      if (xerror >= d->dst_width)
+		{
+		  xerror -= d->dst_width;
+		  raw += CHANNEL_COUNT(d);
+		}
+	    }
+	}
+      else
+	{
+	  if (bit == 128)
+	    {
+	      ptr_offset--;
+	      bit = 1;
+	    }
+	  else
+	    bit <<= 1;
+	  raw -= xstep;
+	  if (xmod)
+	    {
+	      xerror -= xmod;
+	      if (xerror < 0)
+		{
+		  xerror += d->dst_width;
+		  raw -= CHANNEL_COUNT(d);
+		}
+	    }
+	}
+    }
+  if (direction == -1)
+    {
+      int tmp = dc->row_ends[0];
+      dc->row_ends[0] = dc->row_ends[1];
+      dc->row_ends[1] = tmp;
+    }
+}
+
+static void
+ed_dither_channel_band(void *data, int job)
+{
+  ed_band_t *b = (ed_band_t *) data;
+  stpi_dither_t *d = b->d;
+  int channel = b->active[job];
+  stpi_dither_channel_t *dc = &(CHANNEL(d, channel));
+  int i, j;
+
+  for (i = 0; i < b->nrows; i++)
+    {
+      stpi_dither_row_t *r = &(b->rows[i]);
+      int row = b->row + i;
+      dc->ptr = r->outputs[channel];
+      memset(dc->ptr, 0, (d->dst_width + 7) / 8 * dc->signif_bits);
+      dc->row_ends[0] = -1;
+      dc->row_ends[1] = -1;
+      stp_dither_matrix_set_row(&(dc->dithermat), row);
+      stp_dither_matrix_set_row(&(dc->pick), row);
+      if (b->empty[i] == 4)
+	for (j = 0; j < d->error_rows; j++)
+	  memset(stpi_dither_get_errline(d, row + j, channel), 0,
+		 d->dst_width * sizeof(int));
+      else if (b->empty[i] < 4)
+	ed_dither_channel_row(d, channel, row, r->input + channel, r->mask);
+      r->row_ends[2 * channel] = dc->row_ends[0];
+      r->row_ends[2 * channel + 1] = dc->row_ends[1];
+    }
+}
+
+int
+stpi_dither_ed_band(stp_vars_t *v, int row, int nrows, stpi_dither_row_t *rows)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  ed_data_t *ed = (ed_data_t *) d->aux_data;
+  ed_band_t b;
+  int *empty;
+  int *active;
+  int nactive = 0;
+  int i, j;
+
+  if (d->stpi_dither_type & D_ADAPTIVE_BASE)
+    for (i = 0; i < CHANNEL_COUNT(d); i++)
+      if (CHANNEL(d, i).nlevels > 1)
+	return 0;
+  if (!ed)
+    {
+      ed = stp_zalloc(sizeof(ed_data_t));
+      ed->pool = stpi_thread_pool_create(USMIN(d->threads, CHANNEL_COUNT(d)));
+      d->aux_data = ed;
+      d->aux_freefunc = free_ed_data;
+    }
+  if (!ed->pool)
+    return 0;
+
+  /*
+   * Whether a row is dithered at all depends on the rows before it, so
+   * that is worked out first.
+   */
+  empty = stp_malloc(sizeof(int) * nrows);
+  for (i = 0; i < nrows; i++)
+    {
+      update_empty_lines(d, rows[i].duplicate_line, rows[i].zero_mask);
+      empty[i] = d->last_line_was_empty;
+    }
+  active = stp_malloc(sizeof(int) * CHANNEL_COUNT(d));
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      CHANNEL(d, i).error_rows = 2;
+      if (rows[0].outputs[i])
+	active[nactive++] = i;
+      else
+	for (j = 0; j < nrows; j++)
+	  {
+	    rows[j].row_ends[2 * i] = -1;
+	    rows[j].row_ends[2 * i + 1] = -1;
+	  }
+    }
+
+  b.d = d;
+  b.row = row;
+  b.nrows = nrows;
+  b.rows = rows;
+  b.empty = empty;
+  b.active = active;
+  stpi_thread_pool_run(ed->pool, nactive, ed_dither_channel_band, &b);
+  stp_free(active);
+  stp_free(empty);
+  return 1;
+}
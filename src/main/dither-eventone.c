@@ -56,6 +56,11 @@ typedef struct
   stpi_dither_channel_t *dummy_channel;
   double transition;		/* Exponential scaling for transition region */
   stp_dither_matrix_impl_t transition_matrix;
+  stpi_thread_pool_t *pool;	/* Workers for channel-parallel dithering */
+  stpi_thread_progress_t *progress; /* Pixels completed by each channel */
+  int *carry;			/* Point error handed between channels */
+  int *comparison;		/* Per-pixel threshold for hybrid dithering */
+  int *active;			/* Channels being printed in this row */
 } eventone_t;
 
 typedef struct shade_segment
@@ -98,6 +103,11 @@ free_eventone_data(stpi_dither_t *d)
     }
   if (d->stpi_dither_type & D_UNITONE)
     stp_dither_matrix_destroy(&(et->transition_matrix));
+  stpi_thread_pool_destroy(et->pool);
+  stpi_thread_progress_destroy(et->progress);
+  STP_SAFE_FREE(et->carry);
+  STP_SAFE_FREE(et->comparison);
+  STP_SAFE_FREE(et->active);
   STP_SAFE_FREE(et);
 }
 
@@ -180,6 +190,20 @@ et_setup(stpi_dither_t *d)
 
   et->diff_factor = diff_factors[et->physical_aspect];
 
+  /*
+   * UniTone couples all of the channels at each pixel, so only EvenTone
+   * can be split across threads.
+   */
+  if (!(d->stpi_dither_type & D_UNITONE) && CHANNEL_COUNT(d) > 1)
+    et->pool = stpi_thread_pool_create(USMIN(d->threads, CHANNEL_COUNT(d)));
+  if (et->pool)
+    {
+      et->progress = stpi_thread_progress_create(CHANNEL_COUNT(d));
+      et->carry = stp_malloc(sizeof(int) * d->dst_width);
+      et->comparison = stp_malloc(sizeof(int) * d->dst_width);
+      et->active = stp_malloc(sizeof(int) * CHANNEL_COUNT(d));
+    }
+
   d->aux_data = et;
   d->aux_freefunc = free_eventone_data;
 }
@@ -366,14 +390,14 @@ find_segment_and_ditherpoint(stpi_dither_channel_t *dc, unsigned inkval,
 }
 
 static inline void
-print_ink(stpi_dither_t *d, unsigned char *tptr, const stpi_ink_defn_t *ink,
+print_ink(int ptr_offset, unsigned char *tptr, const stpi_ink_defn_t *ink,
 	  unsigned char bit, int length)
 {
   int j;
 
   if (tptr != 0)
     {
-      tptr += d->ptr_offset;
+      tptr += ptr_offset;
       switch(ink->bits)
 	{
 	case 1:
@@ -397,6 +421,218 @@ print_ink(stpi_dither_t *d, unsigned char *tptr, const stpi_ink_defn_t *ink,
     }
 }
 
+/*
+ * Dither one channel at one pixel.  The point error is carried from
+ * one channel to the next within a pixel; the updated value is returned.
+ */
+static inline int
+et_dither_pixel(stpi_dither_channel_t *dc, eventone_t *et, unsigned rawval,
+		int x, int direction, int point_error, int comparison,
+		const unsigned char *mask, int ptr_offset, unsigned char bit,
+		int length)
+{
+  int inkspot;
+  int range_point;
+  shade_distance_t *sp = (shade_distance_t *) dc->aux_data;
+  stpi_ink_defn_t *inkp;
+  stpi_ink_defn_t lower, upper;
+
+  advance_eventone_pre(sp, et, x);
+
+  /*
+   * Find which are the two candidate dot sizes.
+   * Rather than use the absolute value of the point to compute
+   * the error, we will use the relative value of the point within
+   * the range to find the two candidate dot sizes.
+   */
+  range_point = find_segment_and_ditherpoint(dc, rawval, &lower, &upper);
+
+  /* Incorporate error data from previous line */
+  dc->v += 2 * range_point + (dc->errs[0][x + MAX_SPREAD] + 8) / 16;
+  inkspot = dc->v - range_point;
+
+  point_error += eventone_adjust(dc, et, inkspot, range_point);
+
+  /* Determine whether to print the larger or smaller dot */
+  inkp = &lower;
+  if (point_error >= comparison)
+    {
+      point_error -= 65535;
+      inkp = &upper;
+      dc->v -= 131070;
+      sp->dis = et->d_sq;
+    }
+
+  /* Adjust the error to reflect the dot choice */
+  if (inkp->bits)
+    {
+      if (!mask || (*(mask + ptr_offset) & bit))
+	{
+	  set_row_ends(dc, x);
+
+	  /* Do the printing */
+	  print_ink(ptr_offset, dc->ptr, inkp, bit, length);
+	}
+    }
+
+  /* Spread the error around to the adjacent dots */
+  eventone_update(dc, et, x, direction);
+  diffuse_error(dc, et, x, direction);
+  return point_error;
+}
+
+/*
+ * Channel-parallel EvenTone.  Each job dithers one channel across the
+ * whole row; because the point error flows from one channel to the next
+ * at each pixel, a job trails the job for the previous channel by at
+ * least one block of pixels.  The result is identical to the serial code.
+ */
+
+#define ET_BLOCK_SIZE 256
+
+typedef struct
+{
+  stpi_dither_t *d;
+  eventone_t *et;
+  const unsigned short *raw;
+  const unsigned char *mask;
+  int direction;
+  int length;
+  int *active;			/* Channels with output, in order */
+  int nactive;
+} et_row_t;
+
+static void
+et_dither_channel_row(void *data, int job)
+{
+  et_row_t *r = (et_row_t *) data;
+  stpi_dither_t *d = r->d;
+  eventone_t *et = r->et;
+  stpi_dither_channel_t *dc = &CHANNEL(d, r->active[job]);
+  int channel_count = CHANNEL_COUNT(d);
+  int direction = r->direction;
+  const unsigned short *raw = r->raw + r->active[job];
+  int *carry = et->carry;
+  int x, done, ptr_offset;
+  unsigned char bit;
+  int xerror, xstep, xmod;
+
+  if (direction == 1)
+    {
+      x = 0;
+      ptr_offset = 0;
+    }
+  else
+    {
+      x = d->dst_width - 1;
+      ptr_offset = r->length - 1;
+      raw += channel_count * (d->src_width - 1);
+    }
+  bit = 1 << (7 - (x & 7));
+  xstep  = channel_count * (d->src_width / d->dst_width);
+  xmod   = d->src_width % d->dst_width;
+  xerror = (xmod * x) % d->dst_width;
+
+  for (done = 0; done < d->dst_width; )
+    {
+      int block_end = done + ET_BLOCK_SIZE;
+      if (block_end > d->dst_width)
+	block_end = d->dst_width;
+      if (job > 0)
+	stpi_thread_progress_wait(et->progress, job - 1, block_end);
+      for (; done < block_end; done++, x += direction)
+	{
+	  int point_error = job > 0 ? carry[x] : 0;
+	  carry[x] = et_dither_pixel(dc, et, raw[0], x, direction, point_error,
+				     et->comparison[x], r->mask, ptr_offset,
+				     bit, r->length);
+	  if (direction == 1)
+	    {
+	      bit >>= 1;
+	      if (bit == 0)
+		{
+		  ptr_offset++;
+		  bit = 128;
+		}
+	      raw += xstep;
+	      if (xmod)
+		{
+		  xerror += xmod;
+		  if (xerror >= d->dst_width)
+		    {
+		      xerror -= d->dst_width;
+		      raw += channel_count;
+		    }
+		}
+	    }
+	  else
+	    {
+	      if (bit == 128)
+		{
+		  ptr_offset--;
+		  bit = 1;
+		}
+	      else
+		bit <<= 1;
+	      raw -= xstep;
+	      if (xmod)
+		{
+		  xerror -= xmod;
+		  if (xerror < 0)
+		    {
+		      xerror += d->dst_width;
+		      raw -= channel_count;
+		    }
+		}
+	    }
+	}
+      stpi_thread_progress_post(et->progress, job, block_end);
+    }
+}
+
+static int
+et_dither_row_parallel(stpi_dither_t *d, eventone_t *et,
+		       const unsigned short *raw, int row,
+		       const unsigned char *mask)
+{
+  et_row_t r;
+  int i, x;
+
+  r.active = et->active;
+  r.nactive = 0;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    if (CHANNEL(d, i).ptr)
+      r.active[r.nactive++] = i;
+  if (r.nactive < 2)
+    return 0;
+
+  r.d = d;
+  r.et = et;
+  r.raw = raw;
+  r.mask = mask;
+  r.length = (d->dst_width + 7) / 8;
+  r.direction = (row & 1) ? 1 : -1;
+
+  /*
+   * The threshold matrix is shared and caches its position, so the
+   * comparison points for the row are computed here, in the same order
+   * that the serial code uses.
+   */
+  for (i = 0; i < d->dst_width; i++)
+    {
+      x = r.direction == 1 ? i : d->dst_width - 1 - i;
+      et->comparison[x] = 32768;
+      if (d->stpi_dither_type & D_ORDERED_BASE)
+	et->comparison[x] += (ditherpoint(d, &(d->dither_matrix), x) / 16) - 2048;
+    }
+
+  stpi_thread_progress_reset(et->progress);
+  stpi_thread_pool_run(et->pool, r.nactive, et_dither_channel_row, &r);
+  if (r.direction == -1)
+    stpi_dither_reverse_row_ends(d);
+  return 1;
+}
+
 void
 stpi_dither_et(stp_vars_t *v,
 	       int row,
@@ -405,7 +641,7 @@ stpi_dither_et(stp_vars_t *v,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   eventone_t *et;
 
   int		x;
@@ -425,6 +661,9 @@ stpi_dither_et(stp_vars_t *v,
   if (d->stpi_dither_type & D_UNITONE)
     stp_dither_matrix_set_row(&(et->transition_matrix), row);
 
+  if (et->pool && et_dither_row_parallel(d, et, raw, row, mask))
+    return;
+
   length = (d->dst_width + 7) / 8;
 
   if (row & 1)
@@ -459,57 +698,10 @@ stpi_dither_et(stp_vars_t *v,
       for (i=0; i < channel_count; i++)
 	{
 	  if (CHANNEL(d, i).ptr)
-	    {
-	      int inkspot;
-	      int range_point;
-	      stpi_dither_channel_t *dc = &CHANNEL(d, i);
-	      shade_distance_t *sp = (shade_distance_t *) dc->aux_data;
-	      stpi_ink_defn_t *inkp;
-	      stpi_ink_defn_t lower, upper;
-
-	      advance_eventone_pre(sp, et, x);
-
-	      /*
-	       * Find which are the two candidate dot sizes.
-	       * Rather than use the absolute value of the point to compute
-	       * the error, we will use the relative value of the point within
-	       * the range to find the two candidate dot sizes.
-	       */
-	      range_point =
-		find_segment_and_ditherpoint(dc, raw[i], &lower, &upper);
-
-	      /* Incorporate error data from previous line */
-	      dc->v += 2 * range_point + (dc->errs[0][x + MAX_SPREAD] + 8) / 16;
-	      inkspot = dc->v - range_point;
-
-	      point_error += eventone_adjust(dc, et, inkspot, range_point);
-
-	      /* Determine whether to print the larger or smaller dot */
-	      inkp = &lower;
-	      if (point_error >= comparison)
-		{
-		  point_error -= 65535;
-		  inkp = &upper;
-		  dc->v -= 131070;
-		  sp->dis = et->d_sq;
-		}
-
-	      /* Adjust the error to reflect the dot choice */
-	      if (inkp->bits)
-		{
-		  if (!mask || (*(mask + d->ptr_offset) & bit))
-		    {
-		      set_row_ends(dc, x);
-
-		      /* Do the printing */
-		      print_ink(d, dc->ptr, inkp, bit, length);
-		    }
-		}
-
-	      /* Spread the error around to the adjacent dots */
-	      eventone_update(dc, et, x, direction);
-	      diffuse_error(dc, et, x, direction);
-	    }
+	    point_error =
+	      et_dither_pixel(&CHANNEL(d, i), et, raw[i], x, direction,
+			      point_error, comparison, mask, d->ptr_offset,
+			      bit, length);
 	}
       if (direction == 1)
 	ADVANCE_UNIDIRECTIONAL(d, bit, raw, channel_count, xerror, xstep, xmod);
@@ -528,7 +720,7 @@ stpi_dither_ut(stp_vars_t *v,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   eventone_t *et;
 
   int		x;
@@ -722,7 +914,7 @@ stpi_dither_ut(stp_vars_t *v,
 		      set_row_ends(dc, x);
 
 		      /* Do the printing */
-		      print_ink(d, dc->ptr, inkp, bit, length);
+		      print_ink(d->ptr_offset, dc->ptr, inkp, bit, length);
 		    }
 		}
 	    }
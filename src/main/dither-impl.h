@@ -59,6 +59,7 @@ extern "C" {
 #define D_ORDERED_NEW 512
 #define D_ORDERED_SEGMENTED 1024
 #define D_ORDERED_SEGMENTED_NEW (D_ORDERED_SEGMENTED | D_ORDERED_NEW)
+#define D_BLUENOISE 2048
 #define D_INVALID -2
 
 #define DITHER_FAST_STEPS (6)
@@ -77,6 +78,14 @@ typedef struct
 typedef void stpi_ditherfunc_t(stp_vars_t *, int, const unsigned short *, int,
 			       int, const unsigned char *);
 
+/*
+ * Dither a band of rows (see stpi_dither_band()).  Returns 0 if the rows
+ * must be dithered one at a time instead.
+ */
+typedef int stpi_ditherbandfunc_t(stp_vars_t *, int, int, stpi_dither_row_t *);
+
+#define DITHER_BAND_ROWS 8
+
 /*
  * An end of a dither segment, describing one ink
  */
@@ -129,6 +138,8 @@ typedef struct dither_channel
   stp_dither_matrix_impl_t dithermat;
   int row_ends[2];
   unsigned char *ptr;
+  int reported_row_ends[2];	/* Seen by the driver while pipelined */
+  unsigned char *reported_ptr;
   void *aux_data;		/* aux_freefunc for dither should free this */
 } stpi_dither_channel_t;
 
@@ -162,6 +173,9 @@ typedef struct dither
   int finalized;		/* When dither is first called, calculate
 				 * some things */
 
+  int threads;			/* Worker threads for parallel algorithms */
+  int pipelined;		/* Rows are dithered ahead of output */
+
   stp_dither_matrix_impl_t dither_matrix;
   stpi_dither_channel_t *channel;
   unsigned channel_count;
@@ -170,6 +184,8 @@ typedef struct dither
   unsigned *subchannel_count;
 
   stpi_ditherfunc_t *ditherfunc;
+  stpi_ditherbandfunc_t *bandfunc; /* NULL if rows are dithered singly */
+  void *row_levels;		/* Levels for the ordered row kernels */
   void *aux_data;
   void (*aux_freefunc)(struct dither *);
 } stpi_dither_t;
@@ -183,15 +199,19 @@ typedef struct dither
 extern stpi_ditherfunc_t stpi_dither_predithered;
 extern stpi_ditherfunc_t stpi_dither_very_fast;
 extern stpi_ditherfunc_t stpi_dither_ordered;
+extern stpi_ditherfunc_t stpi_dither_bluenoise;
 extern stpi_ditherfunc_t stpi_dither_ed;
+extern stpi_ditherbandfunc_t stpi_dither_ed_band;
 extern stpi_ditherfunc_t stpi_dither_et;
 extern stpi_ditherfunc_t stpi_dither_ut;
 
+extern stpi_dither_t *stpi_dither_get(const stp_vars_t *v);
 extern void stpi_dither_reverse_row_ends(stpi_dither_t *d);
 extern int stpi_dither_translate_channel(stp_vars_t *v, unsigned channel,
 					 unsigned subchannel);
 extern void stpi_dither_channel_destroy(stpi_dither_channel_t *channel);
 extern void stpi_dither_finalize(stp_vars_t *v);
+extern void stpi_dither_set_bluenoise_matrix(stp_vars_t *v);
 extern int *stpi_dither_get_errline(stpi_dither_t *d, int row, int color);
 
 
@@ -41,7 +41,7 @@ int
 stpi_dither_translate_channel(stp_vars_t *v, unsigned channel,
 			      unsigned subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   unsigned chan_idx;
   if (!d)
     return -1;
@@ -56,9 +56,11 @@ stpi_dither_translate_channel(stp_vars_t *v, unsigned channel,
 unsigned char *
 stp_dither_get_channel(stp_vars_t *v, unsigned channel, unsigned subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int place = stpi_dither_translate_channel(v, channel, subchannel);
-  if (place >= 0)
+  if (place >= 0 && d->pipelined)
+    return d->channel[place].reported_ptr;
+  else if (place >= 0)
     return d->channel[place].ptr;
   else
     return NULL;
@@ -104,7 +106,7 @@ stpi_dither_channel_destroy(stpi_dither_channel_t *channel)
 static void
 initialize_channel(stp_vars_t *v, int channel, int subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int idx = stpi_dither_translate_channel(v, channel, subchannel);
   stpi_dither_channel_t *dc = &(CHANNEL(d, idx));
   stp_shade_t shade;
@@ -162,7 +164,7 @@ insert_subchannel(stp_vars_t *v, stpi_dither_t *d, int channel, int subchannel)
 void
 stpi_dither_finalize(stp_vars_t *v)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   if (!d->finalized)
     {
       int i;
@@ -185,7 +187,7 @@ void
 stp_dither_add_channel(stp_vars_t *v, unsigned char *data,
 		       unsigned channel, unsigned subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int idx;
   if (channel >= d->channel_count)
     insert_channel(v, d, channel);
@@ -199,7 +201,7 @@ stp_dither_add_channel(stp_vars_t *v, unsigned char *data,
 static void
 stpi_dither_finalize_ranges(stp_vars_t *v, stpi_dither_channel_t *dc)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int i;
   unsigned lbit = dc->bit_max;
   dc->signif_bits = 0;
@@ -258,7 +260,7 @@ static void
 stpi_dither_set_ranges(stp_vars_t *v, int color, const stp_shade_t *shade,
 		       double density, double darkness)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   stpi_dither_channel_t *dc = &(CHANNEL(d, color));
   const stp_dotsize_t *ranges = shade->dot_sizes;
   int nlevels = shade->numsizes;
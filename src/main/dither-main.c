@@ -62,6 +62,7 @@ static const stpi_dither_algorithm_t dither_algos[] =
   { "Adaptive",	      N_ ("Adaptive Hybrid"),        D_ADAPTIVE_HYBRID },
   { "Ordered",	      N_ ("Ordered"),                D_ORDERED },
   { "OrderedNew",     N_ ("Ordered New"),            D_ORDERED_NEW },
+  { "BlueNoise",      N_ ("Blue Noise"),             D_BLUENOISE },
   { "Fast",	      N_ ("Fast"),                   D_FAST },
   { "VeryFast",	      N_ ("Very Fast"),              D_VERY_FAST },
   { "Floyd",	      N_ ("Hybrid Floyd-Steinberg"), D_FLOYD_HYBRID },
@@ -106,6 +107,14 @@ static const stp_parameter_t dither_parameters[] =
     STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_OUTPUT,
     STP_PARAMETER_LEVEL_ADVANCED, 1, 1, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "DitherThreads", N_("Dither Threads"), "Color=Yes,Category=Screening Adjustment",
+    N_("Number of threads to use for dithering algorithms that can "
+       "process channels in parallel.  Output is identical to "
+       "single-threaded dithering."),
+    STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_OUTPUT,
+    STP_PARAMETER_LEVEL_ADVANCED, 0, 1, STP_CHANNEL_NONE, 1, 0
+  },
 };
 
 static const int dither_parameter_count =
@@ -151,6 +160,13 @@ stp_dither_describe_parameter(const stp_vars_t *v, const char *name,
       description->deflt.str =
 	stp_string_list_param(description->bounds.str, 0)->name;
     }
+  else if (strcmp(name, "DitherThreads") == 0)
+    {
+      stp_fill_parameter_settings(description, &(dither_parameters[2]));
+      description->bounds.integer.lower = 1;
+      description->bounds.integer.upper = 16;
+      description->deflt.integer = 1;
+    }
   else
     return;
 }
@@ -169,7 +185,7 @@ stpi_set_dither_function(stp_vars_t *v)
   const char *image_type = stp_get_string_parameter(v, "ImageType");
   const char *color_correction = stp_get_string_parameter(v,"ColorCorrection");
   const char *algorithm = stp_get_string_parameter(v, "DitherAlgorithm");
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int i;
   d->stpi_dither_type = -1;
   if (stp_check_string_parameter(v, "Quality", STP_PARAMETER_ACTIVE))
@@ -267,6 +283,8 @@ stpi_set_dither_function(stp_vars_t *v)
     case D_ORDERED_SEGMENTED_NEW:
     case D_FAST:
       RETURN_DITHERFUNC(stpi_dither_ordered, v);
+    case D_BLUENOISE:
+      RETURN_DITHERFUNC(stpi_dither_bluenoise, v);
     case D_HYBRID_EVENTONE:
     case D_EVENTONE:
       RETURN_DITHERFUNC(stpi_dither_et, v);
@@ -278,17 +296,26 @@ stpi_set_dither_function(stp_vars_t *v)
     }
 }
 
+stpi_dither_t *
+stpi_dither_get(const stp_vars_t *v)
+{
+  static stp_parameter_handle_t dither_handle = NULL;
+  if (!dither_handle)
+    dither_handle = stp_component_data_handle("Dither");
+  return (stpi_dither_t *) stp_get_component_data_by_handle(v, dither_handle);
+}
+
 void
 stp_dither_set_adaptive_limit(stp_vars_t *v, double limit)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   d->adaptive_limit = limit;
 }
 
 void
 stp_dither_set_ink_spread(stp_vars_t *v, int spread)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   STP_SAFE_FREE(d->offset0_table);
   STP_SAFE_FREE(d->offset1_table);
   if (spread >= 16)
@@ -315,7 +342,7 @@ stp_dither_set_ink_spread(stp_vars_t *v, int spread)
 void
 stp_dither_set_randomizer(stp_vars_t *v, int i, double val)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   if (i < 0 || i >= CHANNEL_COUNT(d))
     return;
   CHANNEL(d, i).randomizer = val * 65535;
@@ -332,6 +359,7 @@ stpi_dither_free(void *vd)
     stpi_dither_channel_destroy(&(CHANNEL(d, j)));
   STP_SAFE_FREE(d->offset0_table);
   STP_SAFE_FREE(d->offset1_table);
+  STP_SAFE_FREE(d->row_levels);
   stp_dither_matrix_destroy(&(d->dither_matrix));
   stp_free(d->channel);
   stp_free(d->channel_index);
@@ -366,6 +394,15 @@ stp_dither_init(stp_vars_t *v, stp_image_t *image, int out_width,
     }
   d->ditherfunc = stpi_set_dither_function(v);
   d->adaptive_limit = .75 * 65535;
+  d->threads = 1;
+  if (stp_check_int_parameter(v, "DitherThreads", STP_PARAMETER_ACTIVE))
+    d->threads = stp_get_int_parameter(v, "DitherThreads");
+  /*
+   * Error diffusion can only split each row between the channels; it is
+   * worth doing so for a band of rows at a time.
+   */
+  if (d->threads > 1 && d->ditherfunc == stpi_dither_ed)
+    d->bandfunc = stpi_dither_ed_band;
 
   /*
    * For hybrid EvenTone we want to use the good matrix.  For regular
@@ -382,6 +419,8 @@ stp_dither_init(stp_vars_t *v, stp_image_t *image, int out_width,
       else
 	stp_dither_set_iterated_matrix(v, 2, DITHER_FAST_STEPS, sq2, 0, 2, 4);
     }
+  else if (d->stpi_dither_type == D_BLUENOISE)
+    stpi_dither_set_bluenoise_matrix(v);
   else if (stp_check_array_parameter(v, "DitherMatrix",
 				     STP_PARAMETER_ACTIVE) &&
 	   (stp_dither_matrix_validate_array
@@ -423,20 +462,24 @@ stpi_dither_reverse_row_ends(stpi_dither_t *d)
 int
 stp_dither_get_first_position(stp_vars_t *v, int color, int subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int channel = stpi_dither_translate_channel(v, color, subchannel);
   if (channel < 0)
     return -1;
+  if (d->pipelined)
+    return CHANNEL(d, channel).reported_row_ends[0];
   return CHANNEL(d, channel).row_ends[0];
 }
 
 int
 stp_dither_get_last_position(stp_vars_t *v, int color, int subchannel)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int channel = stpi_dither_translate_channel(v, color, subchannel);
   if (channel < 0)
     return -1;
+  if (d->pipelined)
+    return CHANNEL(d, channel).reported_row_ends[1];
   return CHANNEL(d, channel).row_ends[1];
 }
 
@@ -457,13 +500,30 @@ stpi_dither_get_errline(stpi_dither_t *d, int row, int color)
   return dc->errs[row % dc->error_rows] + MAX_SPREAD;
 }
 
+/*
+ * Bytes of output from dithering NROWS rows, for stage times.
+ */
+static size_t
+dither_output_bytes(const stpi_dither_t *d, int nrows)
+{
+  size_t bytes = 0;
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    bytes += (d->dst_width + 7) / 8 * CHANNEL(d, i).signif_bits;
+  return bytes * nrows;
+}
+
 void
 stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
 		    int duplicate_line, int zero_mask,
 		    const unsigned char *mask)
 {
   int i;
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
+  stpi_stage_times_t *times = stpi_stage_times(v);
+  stpi_stage_mark_t mark;
+  if (times)
+    stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
   stpi_dither_finalize(v);
   stp_dither_matrix_set_row(&(d->dither_matrix), row);
   for (i = 0; i < CHANNEL_COUNT(d); i++)
@@ -480,6 +540,9 @@ stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
     }
   d->ptr_offset = 0;
   (d->ditherfunc)(v, row, input, duplicate_line, zero_mask, mask);
+  if (times)
+    stpi_stage_end(times, &mark, STPI_STAGE_DITHER,
+		   dither_output_bytes(d, 1));
 }
 
 void
@@ -489,3 +552,147 @@ stp_dither(stp_vars_t *v, int row, int duplicate_line, int zero_mask,
   const unsigned short *input = stp_channel_get_output(v);
   stp_dither_internal(v, row, input, duplicate_line, zero_mask, mask);
 }
+
+/*
+ * Support for rendering pipelines (see render-pipeline.c).  While a
+ * pipeline is running, each row is dithered into buffers supplied by the
+ * pipeline and later copied into the buffers the driver registered by
+ * stpi_dither_publish_row(), so that the driver never sees a row that is
+ * still being dithered.
+ */
+
+int
+stpi_dither_get_channel_count(stp_vars_t *v)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  stpi_dither_finalize(v);
+  return CHANNEL_COUNT(d);
+}
+
+size_t
+stpi_dither_get_row_size(stp_vars_t *v, int channel)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  stpi_dither_finalize(v);
+  if (channel < 0 || channel >= CHANNEL_COUNT(d) || !CHANNEL(d, channel).ptr)
+    return 0;
+  return (d->dst_width + 7) / 8 * CHANNEL(d, channel).signif_bits;
+}
+
+void
+stpi_dither_set_pipelined(stp_vars_t *v, int pipelined)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  int i;
+  if (!pipelined == !d->pipelined)
+    return;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (pipelined)
+	{
+	  dc->reported_ptr = dc->ptr;
+	  dc->reported_row_ends[0] = dc->row_ends[0];
+	  dc->reported_row_ends[1] = dc->row_ends[1];
+	}
+      else
+	{
+	  dc->ptr = dc->reported_ptr;
+	  dc->row_ends[0] = dc->reported_row_ends[0];
+	  dc->row_ends[1] = dc->reported_row_ends[1];
+	  dc->reported_ptr = NULL;
+	}
+    }
+  d->pipelined = pipelined;
+}
+
+void
+stpi_dither_set_row_buffers(stp_vars_t *v, unsigned char *const *buffers)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    CHANNEL(d, i).ptr = buffers[i];
+}
+
+void
+stpi_dither_get_row_ends(stp_vars_t *v, int *row_ends)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      row_ends[2 * i] = CHANNEL(d, i).row_ends[0];
+      row_ends[2 * i + 1] = CHANNEL(d, i).row_ends[1];
+    }
+}
+
+void
+stpi_dither_publish_row(stp_vars_t *v, unsigned char *const *buffers,
+			const int *row_ends)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (dc->reported_ptr && buffers[i])
+	memcpy(dc->reported_ptr, buffers[i],
+	       (d->dst_width + 7) / 8 * dc->signif_bits);
+      dc->reported_row_ends[0] = row_ends[2 * i];
+      dc->reported_row_ends[1] = row_ends[2 * i + 1];
+    }
+}
+
+int
+stpi_dither_get_band_rows(stp_vars_t *v)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  return d->bandfunc ? DITHER_BAND_ROWS : 1;
+}
+
+size_t
+stpi_dither_get_mask_size(stp_vars_t *v)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  return (d->dst_width + 7) / 8;
+}
+
+void
+stpi_dither_band(stp_vars_t *v, int row, int nrows, stpi_dither_row_t *rows)
+{
+  stpi_dither_t *d = stpi_dither_get(v);
+  stpi_stage_times_t *times = stpi_stage_times(v);
+  stpi_stage_mark_t mark;
+  int i;
+  if (nrows <= 0)
+    return;
+  if (times)
+    stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+  stpi_dither_finalize(v);
+  if (d->bandfunc && (d->bandfunc)(v, row, nrows, rows))
+    {
+      /*
+       * Leave the last row where stp_dither_internal() would have.
+       */
+      stpi_dither_set_row_buffers(v, rows[nrows - 1].outputs);
+      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	{
+	  CHANNEL(d, i).row_ends[0] = rows[nrows - 1].row_ends[2 * i];
+	  CHANNEL(d, i).row_ends[1] = rows[nrows - 1].row_ends[2 * i + 1];
+	}
+      stp_dither_matrix_set_row(&(d->dither_matrix), row + nrows - 1);
+      if (times)
+	stpi_stage_end(times, &mark, STPI_STAGE_DITHER,
+		       dither_output_bytes(d, nrows));
+      return;
+    }
+  /* Each row is timed by stp_dither_internal() */
+  for (i = 0; i < nrows; i++)
+    {
+      stpi_dither_set_row_buffers(v, rows[i].outputs);
+      stp_dither_internal(v, row + i, rows[i].input, rows[i].duplicate_line,
+			  rows[i].zero_mask, rows[i].mask);
+      stpi_dither_get_row_ends(v, rows[i].row_ends);
+    }
+}
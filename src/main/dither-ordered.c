@@ -32,6 +32,9 @@
 #include <gutenprint/gutenprint-intl-internal.h>
 #include "dither-impl.h"
 #include "dither-inlined-functions.h"
+#ifdef STPI_X86_SIMD
+#include <immintrin.h>
+#endif
 
 
 typedef struct {
@@ -327,6 +330,273 @@ init_dither_ordered(stpi_dither_t *d, stp_vars_t *v)
     }
 }
 
+/*
+ * Row kernels.  When the input is not scaled horizontally and there is no
+ * mask, each channel can be dithered across the whole row at once, eight
+ * pixels at a time, comparing a span of thresholds from the matrix row
+ * with the input and emitting whole output bytes.  The drop size and ink
+ * of each pixel is chosen exactly as print_color_ordered() (or the one
+ * bit loop) chooses it:
+ *
+ *   rangepoint * 65535 / span >= threshold
+ *
+ * is the same as rangepoint * 65535 >= threshold * span, which needs no
+ * division.  Both products fit in 32 bits.
+ */
+
+#define ORDERED_ROW_MAX_LEVELS 4
+
+typedef struct
+{
+  int levels;
+  unsigned lower[ORDERED_ROW_MAX_LEVELS];
+  unsigned span[ORDERED_ROW_MAX_LEVELS];
+  unsigned lower_bits[ORDERED_ROW_MAX_LEVELS];
+  unsigned upper_bits[ORDERED_ROW_MAX_LEVELS];
+} ordered_row_levels_t;
+
+typedef void ordered_row_func_t(const stpi_dither_t *d,
+				stpi_dither_channel_t *dc,
+				const unsigned short *raw,
+				const ordered_row_levels_t *lv);
+
+/*
+ * Return 0 if the row kernels cannot reproduce the per-pixel code for
+ * this channel.
+ */
+static int
+init_row_levels(const stpi_dither_channel_t *dc, int one_bit_only,
+		ordered_row_levels_t *lv)
+{
+  int i;
+  if (one_bit_only)
+    {
+      lv->levels = 1;
+      lv->lower[0] = 0;
+      lv->span[0] = 65535;
+      lv->lower_bits[0] = 0;
+      lv->upper_bits[0] = 1;
+      return 1;
+    }
+  if (dc->nlevels < 1 || dc->nlevels > ORDERED_ROW_MAX_LEVELS)
+    return 0;
+  lv->levels = dc->nlevels;
+  for (i = 0; i < dc->nlevels; i++)
+    {
+      const stpi_dither_segment_t *dd = &(dc->ranges[i]);
+      if (dd->value_span == 0)
+	return 0;
+      lv->lower[i] = dd->lower->value;
+      lv->span[i] = dd->value_span < 65535 ? dd->value_span : 65535;
+      lv->lower_bits[i] = dd->lower->bits;
+      lv->upper_bits[i] = dd->upper->bits;
+    }
+  return 1;
+}
+
+/*
+ * The levels of each channel for the row kernels.  The ink ranges do not
+ * change once the first row is dithered, so they are computed then and
+ * kept for the rest of the job.  A channel with no levels cannot use the
+ * row kernels.
+ */
+static const ordered_row_levels_t *
+get_row_levels(stpi_dither_t *d, int one_bit_only)
+{
+  if (!d->row_levels)
+    {
+      ordered_row_levels_t *levels =
+	stp_malloc(sizeof(ordered_row_levels_t) * CHANNEL_COUNT(d));
+      int i;
+      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	if (!init_row_levels(&(CHANNEL(d, i)), one_bit_only, &(levels[i])))
+	  levels[i].levels = 0;
+      d->row_levels = levels;
+    }
+  return d->row_levels;
+}
+
+static inline unsigned
+ordered_row_pixel(const ordered_row_levels_t *lv, unsigned val,
+		  unsigned threshold)
+{
+  int i;
+  for (i = lv->levels - 1; i >= 0; i--)
+    if (val > lv->lower[i])
+      return ((val - lv->lower[i]) * 65535 >= threshold * lv->span[i] ?
+	      lv->upper_bits[i] : lv->lower_bits[i]);
+  return 0;
+}
+
+/*
+ * Dither pixels FIRST through the end of the row.
+ */
+static void
+ordered_row_tail(const stpi_dither_t *d, stpi_dither_channel_t *dc,
+		 const unsigned short *raw, const ordered_row_levels_t *lv,
+		 int first)
+{
+  const stp_dither_matrix_impl_t *mat = &(dc->dithermat);
+  const unsigned *thresholds = mat->matrix + mat->last_y_mod;
+  int stride = CHANNEL_COUNT(d);
+  int length = (d->dst_width + 7) / 8;
+  int t = (first + mat->x_offset) % mat->x_size;
+  int x;
+  for (x = first; x < d->dst_width; x++)
+    {
+      unsigned bits = ordered_row_pixel(lv, raw[x * stride], thresholds[t]);
+      if (bits)
+	{
+	  unsigned char *tptr = dc->ptr + (x >> 3);
+	  unsigned char bit = 128 >> (x & 7);
+	  int j;
+	  set_row_ends(dc, x);
+	  for (j = 1; j <= bits; j += j, tptr += length)
+	    if (j & bits)
+	      tptr[0] |= bit;
+	}
+      if (++t == mat->x_size)
+	t = 0;
+    }
+}
+
+static void
+ordered_row_scalar(const stpi_dither_t *d, stpi_dither_channel_t *dc,
+		   const unsigned short *raw, const ordered_row_levels_t *lv)
+{
+  ordered_row_tail(d, dc, raw, lv, 0);
+}
+
+#ifdef STPI_X86_SIMD
+STPI_TARGET_AVX2 static void
+ordered_row_avx2(const stpi_dither_t *d, stpi_dither_channel_t *dc,
+		 const unsigned short *raw, const ordered_row_levels_t *lv)
+{
+  const stp_dither_matrix_impl_t *mat = &(dc->dithermat);
+  const unsigned *thresholds = mat->matrix + mat->last_y_mod;
+  int stride = CHANNEL_COUNT(d);
+  int length = (d->dst_width + 7) / 8;
+  int t = mat->x_offset % mat->x_size;
+  const __m256i index = _mm256_mullo_epi32(_mm256_set1_epi32(stride),
+					   _mm256_setr_epi32(0, 1, 2, 3,
+							     4, 5, 6, 7));
+  const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256i low16 = _mm256_set1_epi32(0xffff);
+  const __m256i full = _mm256_set1_epi32(65535);
+  __m256i lower[ORDERED_ROW_MAX_LEVELS];
+  __m256i span[ORDERED_ROW_MAX_LEVELS];
+  __m256i lower_bits[ORDERED_ROW_MAX_LEVELS];
+  __m256i upper_bits[ORDERED_ROW_MAX_LEVELS];
+  int x, i;
+
+  for (i = 0; i < lv->levels; i++)
+    {
+      lower[i] = _mm256_set1_epi32(lv->lower[i]);
+      span[i] = _mm256_set1_epi32(lv->span[i]);
+      lower_bits[i] = _mm256_set1_epi32(lv->lower_bits[i]);
+      upper_bits[i] = _mm256_set1_epi32(lv->upper_bits[i]);
+    }
+  /*
+   * Each gather reads four bytes per sample, so the last pixel of the row
+   * is always left to the scalar code.
+   */
+  for (x = 0; x + 8 < d->dst_width; x += 8)
+    {
+      __m256i val = _mm256_and_si256
+	(_mm256_i32gather_epi32((const int *) (raw + x * stride), index, 2),
+	 low16);
+      __m256i thr;
+      __m256i active, lo, sp, lb, ub, lhs, rhs, bits;
+      unsigned nonzero;
+      if (t + 8 <= mat->x_size)
+	thr = _mm256_loadu_si256((const __m256i *) (thresholds + t));
+      else
+	{
+	  unsigned tmp[8];
+	  int k;
+	  for (k = 0; k < 8; k++)
+	    tmp[k] = thresholds[(t + k) % mat->x_size];
+	  thr = _mm256_loadu_si256((const __m256i *) tmp);
+	}
+      t = (t + 8) % mat->x_size;
+
+      active = _mm256_cmpgt_epi32(val, lower[0]);
+      lo = lower[0];
+      sp = span[0];
+      lb = lower_bits[0];
+      ub = upper_bits[0];
+      for (i = 1; i < lv->levels; i++)
+	{
+	  __m256i m = _mm256_cmpgt_epi32(val, lower[i]);
+	  active = _mm256_or_si256(active, m);
+	  lo = _mm256_blendv_epi8(lo, lower[i], m);
+	  sp = _mm256_blendv_epi8(sp, span[i], m);
+	  lb = _mm256_blendv_epi8(lb, lower_bits[i], m);
+	  ub = _mm256_blendv_epi8(ub, upper_bits[i], m);
+	}
+      lhs = _mm256_mullo_epi32(_mm256_sub_epi32(val, lo), full);
+      rhs = _mm256_mullo_epi32(thr, sp);
+      bits = _mm256_blendv_epi8
+	(lb, ub, _mm256_cmpeq_epi32(_mm256_max_epu32(lhs, rhs), lhs));
+      bits = _mm256_and_si256(bits, active);
+      bits = _mm256_permutevar8x32_epi32(bits, reverse);
+
+      nonzero = _mm256_movemask_ps(_mm256_castsi256_ps
+				   (_mm256_cmpgt_epi32(bits,
+						       _mm256_setzero_si256())));
+      if (nonzero)
+	{
+	  unsigned char *tptr = dc->ptr + (x >> 3);
+	  int plane;
+	  if (dc->row_ends[0] == -1)
+	    dc->row_ends[0] = x + 7 - (31 - __builtin_clz(nonzero));
+	  dc->row_ends[1] = x + 7 - __builtin_ctz(nonzero);
+	  for (plane = 0; plane < dc->signif_bits; plane++, tptr += length)
+	    {
+	      __m256i b = _mm256_slli_epi32(bits, 31 - plane);
+	      tptr[0] |= _mm256_movemask_ps(_mm256_castsi256_ps(b));
+	    }
+	}
+    }
+  ordered_row_tail(d, dc, raw, lv, x);
+}
+#endif
+
+/*
+ * Return 1 if the row was dithered by the row kernels.
+ */
+static int
+dither_ordered_rows(stpi_dither_t *d, const unsigned short *raw,
+		    int one_bit_only, const unsigned char *mask)
+{
+  static ordered_row_func_t *row_func = NULL;
+  const ordered_row_levels_t *levels;
+  int i;
+  if (mask || d->src_width != d->dst_width)
+    return 0;
+  levels = get_row_levels(d, one_bit_only);
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    if (CHANNEL(d, i).ptr && levels[i].levels == 0)
+      return 0;
+  if (!row_func)
+    {
+#ifdef STPI_X86_SIMD
+      if (STPI_CPU_HAS_AVX2())
+	row_func = ordered_row_avx2;
+      else
+#endif
+	row_func = ordered_row_scalar;
+    }
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (dc->ptr)
+	(row_func)(d, dc, raw + i, &(levels[i]));
+    }
+  d->ptr_offset = d->dst_width / 8;
+  return 1;
+}
+
 void
 stpi_dither_ordered(stp_vars_t *v,
 		    int row,
@@ -335,7 +605,7 @@ stpi_dither_ordered(stp_vars_t *v,
 		    int zero_mask,
 		    const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int		x,
 		length;
   unsigned char	bit;
@@ -368,6 +638,12 @@ stpi_dither_ordered(stp_vars_t *v,
       (d->stpi_dither_type & (D_ORDERED_SEGMENTED | D_ORDERED_NEW)))
     init_dither_ordered(d, v);
 
+  if ((one_bit_only ||
+       ((one_level_only || !(d->stpi_dither_type == D_ORDERED_NEW)) &&
+	!(d->stpi_dither_type & D_ORDERED_SEGMENTED))) &&
+      dither_ordered_rows(d, raw, one_bit_only, mask))
+    return;
+
   if (one_bit_only)
     {
       for (x = 0; x < d->dst_width; x ++)
@@ -59,7 +59,7 @@ stpi_dither_predithered(stp_vars_t *v,
 			int zero_mask,
 			const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int		x,
 		length;
   unsigned char	bit;
@@ -93,6 +93,18 @@ static const stp_parameter_t the_parameters[] =
     STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_CORE,
     STP_PARAMETER_LEVEL_INTERNAL, 1, 0, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "OutputBufferSize", N_("Output Buffer Size"), "Color=No,Category=Job Mode",
+    N_("Bytes of output collected before writing"),
+    STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_CORE,
+    STP_PARAMETER_LEVEL_INTERNAL, 1, 0, STP_CHANNEL_NONE, 1, 0
+  },
+  {
+    "StageTimes", N_("Report Stage Times"), "Color=No,Category=Job Mode",
+    N_("Report the time spent in each stage of printing at the end of the job"),
+    STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_CORE,
+    STP_PARAMETER_LEVEL_INTERNAL, 1, 0, STP_CHANNEL_NONE, 1, 0
+  },
 };
 
 static const int the_parameter_count =
@@ -274,4 +286,14 @@ stpi_describe_generic_parameter(const stp_vars_t *v, const char *name,
     {
       description->deflt.boolean = 0;
     }
+  else if (strcmp(name, "OutputBufferSize") == 0)
+    {
+      description->deflt.integer = 65536;
+      description->bounds.integer.lower = 0;
+      description->bounds.integer.upper = INT_MAX;
+    }
+  else if (strcmp(name, "StageTimes") == 0)
+    {
+      description->deflt.boolean = 0;
+    }
 }
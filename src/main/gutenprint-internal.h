@@ -55,6 +55,36 @@ extern void stpi_vars_print_error(const stp_vars_t *v, const char *prefix);
 #define BUFFER_FLAG_FLIP_X	0x1
 #define BUFFER_FLAG_FLIP_Y	0x2
 extern stp_image_t* stpi_buffer_image(stp_image_t* image, unsigned int flags);
+/*
+ * Returns a value that changes whenever nodes are added to or removed
+ * from the list, and that no other list has had.
+ */
+extern unsigned stpi_list_get_stamp(const stp_list_t *list);
+
+/*
+ * Converts a band of rows for stp_color_get_rows().  A color module that
+ * can do that itself sets one when it registers; the rows of other
+ * modules are converted one at a time with get_row().  It is kept out of
+ * stp_colorfuncs_t so that the layout of that stays as modules built
+ * against 5.2 expect it.
+ */
+typedef int (*stpi_color_get_rows_func_t)(stp_vars_t *v, stp_image_t *image,
+					  int row, int count,
+					  const unsigned short **outputs,
+					  unsigned *zero_masks);
+extern void stpi_color_set_get_rows_func(const stp_color_t *color,
+					 stpi_color_get_rows_func_t func);
+
+/*
+ * Output buffers (see print-util.c).  A buffer is shared by a vars and its
+ * copies; releasing it flushes it through the vars' output function.
+ */
+typedef struct stpi_output_buffer stpi_output_buffer_t;
+extern stpi_output_buffer_t *stpi_output_buffer_create(void);
+extern stpi_output_buffer_t *stpi_output_buffer_ref(stpi_output_buffer_t *buf);
+extern void stpi_output_buffer_release(const stp_vars_t *v,
+				       stpi_output_buffer_t *buf);
+extern stpi_output_buffer_t *stpi_vars_get_output_buffer(const stp_vars_t *v);
 
 #define STPI_ASSERT(x,v)						\
 do									\
@@ -74,6 +104,357 @@ do									\
 
 /** @} */
 
+/**
+ * Worker threads (internal).
+ *
+ * @defgroup thread_internal thread-internal
+ * @{
+ */
+
+typedef struct stpi_thread_pool stpi_thread_pool_t;
+typedef struct stpi_thread_progress stpi_thread_progress_t;
+
+/*
+ * A job function; called once for each job index 0..njobs-1.
+ */
+typedef void stpi_thread_func_t(void *data, int job);
+
+/*
+ * Returns NULL if nthreads <= 1 or threads are not available, in which
+ * case callers should use their serial code path.
+ */
+extern stpi_thread_pool_t *stpi_thread_pool_create(int nthreads);
+extern void stpi_thread_pool_destroy(stpi_thread_pool_t *pool);
+extern int stpi_thread_pool_size(const stpi_thread_pool_t *pool);
+/*
+ * Run njobs jobs on the pool (the calling thread participates) and wait
+ * for all of them to finish.  Jobs are started in increasing order.
+ */
+extern void stpi_thread_pool_run(stpi_thread_pool_t *pool, int njobs,
+				 stpi_thread_func_t *func, void *data);
+
+/*
+ * Monotonic progress counters used to order work between jobs.
+ */
+extern stpi_thread_progress_t *stpi_thread_progress_create(int count);
+extern void stpi_thread_progress_destroy(stpi_thread_progress_t *progress);
+extern void stpi_thread_progress_reset(stpi_thread_progress_t *progress);
+extern void stpi_thread_progress_post(stpi_thread_progress_t *progress,
+				      int which, int value);
+extern void stpi_thread_progress_wait(stpi_thread_progress_t *progress,
+				      int which, int value);
+
+/** @} */
+
+/**
+ * Stage times (internal).
+ *
+ * @defgroup stage_internal stage-internal
+ * @{
+ */
+
+/*
+ * Wall and CPU time spent in each stage of the print pipeline, and the
+ * bytes produced by it, are collected if the StageTimes parameter or the
+ * STP_STAGE_TIMES environment variable is set when a page is printed.
+ * They are shared by a vars and its copies, and reported and cleared by
+ * stp_end_job().  CPU time is that of the calling thread, so it does not
+ * include worker threads.
+ */
+typedef enum
+{
+  STPI_STAGE_IMAGE_READ,
+  STPI_STAGE_COLOR,
+  STPI_STAGE_CHANNEL,
+  STPI_STAGE_DITHER,
+  STPI_STAGE_WEAVE,
+  STPI_STAGE_OUTPUT,
+  STPI_STAGE_COUNT
+} stpi_stage_t;
+
+typedef struct stpi_stage_times stpi_stage_times_t;
+
+typedef struct
+{
+  double wall;
+  double cpu;
+  double inner_wall;		/* Already charged to the inner stage */
+  double inner_cpu;
+  int inner;
+} stpi_stage_mark_t;
+
+extern stpi_stage_times_t *stpi_stage_times_create(void);
+extern stpi_stage_times_t *stpi_stage_times_ref(stpi_stage_times_t *times);
+extern void stpi_stage_times_release(stpi_stage_times_t *times);
+extern stpi_stage_times_t *stpi_vars_get_stage_times(const stp_vars_t *v);
+
+/*
+ * Turn collection on or off for the job according to its settings.
+ */
+extern void stpi_stage_times_setup(const stp_vars_t *v);
+/*
+ * Report (with stp_eprintf()) and clear the totals.
+ */
+extern void stpi_stage_times_report(const stp_vars_t *v);
+
+/*
+ * Returns NULL unless times are being collected, in which case
+ *
+ *   stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+ *   ...
+ *   stpi_stage_end(times, &mark, STPI_STAGE_COLOR, bytes);
+ *
+ * charges the time in between to the stage.  If INNER is a stage, time
+ * charged to it in between (on this thread) is not charged again.
+ */
+extern stpi_stage_times_t *stpi_stage_times(const stp_vars_t *v);
+extern void stpi_stage_begin(const stpi_stage_times_t *times,
+			     stpi_stage_mark_t *mark, int inner);
+extern void stpi_stage_end(stpi_stage_times_t *times,
+			   const stpi_stage_mark_t *mark, stpi_stage_t stage,
+			   size_t bytes);
+
+/** @} */
+
+/**
+ * Row rendering (internal).
+ *
+ * @defgroup render_internal render-internal
+ * @{
+ */
+
+/*
+ * Return the mask (see stp_dither()) to use for output row ROW, or NULL.
+ */
+typedef const unsigned char *stpi_row_mask_func_t(stp_vars_t *v, int row,
+						  void *data);
+/*
+ * Write output row ROW, which has been dithered into the buffers
+ * registered with stp_dither_add_channel().
+ */
+typedef void stpi_row_write_func_t(stp_vars_t *v, int row, void *data);
+
+/*
+ * Convert, dither and write OUT_HEIGHT rows scaled from IMAGE.  MASK_FUNC
+ * may be NULL.  WRITE_FUNC is called for each row in order, but may be
+ * called on a different thread from MASK_FUNC if PipelinedRendering is
+ * set.  Returns 1 on success or 2 if the image could not be read.
+ */
+extern int stpi_render_rows(stp_vars_t *v, stp_image_t *image, int out_height,
+			    stpi_row_mask_func_t *mask_func,
+			    stpi_row_write_func_t *write_func, void *data);
+
+/*
+ * The parameters of stpi_render_rows(), which the drivers that use it
+ * list with their own.
+ */
+extern stp_parameter_list_t stpi_render_list_parameters(const stp_vars_t *v);
+extern void stpi_render_describe_parameter(const stp_vars_t *v,
+					   const char *name,
+					   stp_parameter_t *description);
+
+extern size_t stpi_channel_get_output_size(const stp_vars_t *v);
+
+/*
+ * While pipelined, the dither writes into the buffers given by
+ * stpi_dither_set_row_buffers(), and stp_dither_get_channel() and the row
+ * end functions report the rows published by stpi_dither_publish_row().
+ */
+extern int stpi_dither_get_channel_count(stp_vars_t *v);
+extern size_t stpi_dither_get_row_size(stp_vars_t *v, int channel);
+extern void stpi_dither_set_pipelined(stp_vars_t *v, int pipelined);
+extern void stpi_dither_set_row_buffers(stp_vars_t *v,
+					unsigned char *const *buffers);
+extern void stpi_dither_get_row_ends(stp_vars_t *v, int *row_ends);
+extern void stpi_dither_publish_row(stp_vars_t *v,
+				    unsigned char *const *buffers,
+				    const int *row_ends);
+
+/*
+ * One row of a band of rows passed to stpi_dither_band().
+ */
+typedef struct
+{
+  const unsigned short *input;	/* Converted row */
+  int duplicate_line;
+  unsigned zero_mask;
+  const unsigned char *mask;	/* May be NULL */
+  unsigned char **outputs;	/* One buffer per channel */
+  int *row_ends;		/* Filled in, two per channel */
+} stpi_dither_row_t;
+
+/*
+ * Dither NROWS consecutive rows, starting at ROW, with the same result
+ * as dithering them one at a time.  Some algorithms use several threads
+ * to do so; stpi_dither_get_band_rows() returns the number of rows such
+ * an algorithm would like to be given at once, or 1 if there is nothing
+ * to be gained from passing more than one row.  stpi_dither_get_mask_size()
+ * is the number of bytes of each mask that are used.
+ */
+extern int stpi_dither_get_band_rows(stp_vars_t *v);
+extern size_t stpi_dither_get_mask_size(stp_vars_t *v);
+extern void stpi_dither_band(stp_vars_t *v, int row, int nrows,
+			     stpi_dither_row_t *rows);
+
+/** @} */
+
+/**
+ * Binary caches of data derived from XML files (internal).
+ *
+ * @defgroup cache_internal cache-internal
+ * @{
+ */
+
+typedef struct stpi_binary_cache stpi_binary_cache_t;
+
+/*
+ * Open the cache file NAME if it was written with MAGIC by this version
+ * of the library and none of its source files has changed since.  If
+ * SOURCES (a list of file names) is not NULL, the cache must have been
+ * written from exactly those files.  Returns NULL if there is no valid
+ * cache.
+ */
+extern stpi_binary_cache_t *stpi_binary_cache_open(const char *name,
+						   const char *magic,
+						   const stp_list_t *sources);
+/*
+ * As stpi_binary_cache_open(), but FILENAME is a path rather than a
+ * name in the cache directory.
+ */
+extern stpi_binary_cache_t *
+stpi_binary_cache_open_file(const char *filename, const char *magic,
+			    const stp_list_t *sources);
+extern void stpi_binary_cache_close(stpi_binary_cache_t *cache);
+/*
+ * The payload is aligned to 8 bytes and remains valid until the cache
+ * is closed.
+ */
+extern const void *stpi_binary_cache_get_data(const stpi_binary_cache_t *cache,
+					      size_t *bytes);
+/*
+ * Replace the cache file NAME.  SOURCES may be NULL if the data does not
+ * depend on any file.  Returns 0 if there is no cache directory or the
+ * file cannot be written, which callers may ignore.
+ */
+extern int stpi_binary_cache_write(const char *name, const char *magic,
+				   const stp_list_t *sources,
+				   const void *data, size_t bytes);
+/*
+ * As stpi_binary_cache_write(), but FILENAME is a path rather than a
+ * name in the cache directory.
+ */
+extern int stpi_binary_cache_write_file(const char *filename,
+					const char *magic,
+					const stp_list_t *sources,
+					const void *data, size_t bytes);
+
+/*
+ * Return the tree of the XML file FILE from the compiled snapshot in its
+ * data directory, or NULL if there is no snapshot there, the snapshot
+ * does not contain the file, or the file has changed since.
+ */
+extern stp_mxml_node_t *stpi_xml_snapshot_load(const char *file);
+
+/*
+ * Load the processed data of the XML file FILE from the compiled
+ * snapshot in its data directory.  Returns 0, having loaded nothing, if
+ * the snapshot has no processed data for the file or the file has
+ * changed since.
+ */
+extern int stpi_xml_snapshot_process(const char *file);
+
+/*
+ * Parse every XML file under DIR (by default the first directory on
+ * the data path) and write the snapshot to FILE (by default
+ * xml-snapshot.bin in DIR).  Returns the number of files in the
+ * snapshot, or 0 on failure.
+ */
+extern int stpi_xml_write_snapshot(const char *dir, const char *file);
+
+typedef struct stpi_xml_snapshot_writer stpi_xml_snapshot_writer_t;
+typedef struct stpi_xml_snapshot_reader stpi_xml_snapshot_reader_t;
+
+/*
+ * A module that registers an XML parser for an element may also store
+ * the result of processing that element in the snapshot.  The write
+ * function appends records for NODE, returning 0 if it cannot
+ * represent the node (the file is then loaded from its tree).  The read
+ * function loads the records written for one element, which end when
+ * stpi_xml_snapshot_at_end() returns true.
+ */
+typedef int (*stpi_xml_snapshot_write_func)(stp_mxml_node_t *node,
+					    stpi_xml_snapshot_writer_t *w);
+typedef int (*stpi_xml_snapshot_read_func)(stpi_xml_snapshot_reader_t *r);
+
+/*
+ * Register the snapshot functions for the element NAME, which must
+ * already have a parser.
+ */
+extern void stpi_register_xml_snapshot(const char *name,
+				       stpi_xml_snapshot_write_func write_func,
+				       stpi_xml_snapshot_read_func read_func);
+/*
+ * Return 0 if no parser is registered for NAME; otherwise return 1 and
+ * set *WRITE_FUNC and *READ_FUNC (either of which may be NULL).
+ */
+extern int stpi_xml_get_snapshot_funcs(const char *name,
+				       stpi_xml_snapshot_write_func *write_func,
+				       stpi_xml_snapshot_read_func *read_func);
+
+extern void stpi_xml_snapshot_put_int(stpi_xml_snapshot_writer_t *w, int val);
+extern void stpi_xml_snapshot_put_double(stpi_xml_snapshot_writer_t *w,
+					 double val);
+/* STRING may be NULL */
+extern void stpi_xml_snapshot_put_string(stpi_xml_snapshot_writer_t *w,
+					 const char *string);
+
+/*
+ * Reading past the end of the records or a malformed string makes
+ * stpi_xml_snapshot_at_end() true and returns 0 or NULL.
+ */
+extern int stpi_xml_snapshot_get_int(stpi_xml_snapshot_reader_t *r);
+extern double stpi_xml_snapshot_get_double(stpi_xml_snapshot_reader_t *r);
+extern const char *stpi_xml_snapshot_get_string(stpi_xml_snapshot_reader_t *r);
+extern int stpi_xml_snapshot_at_end(const stpi_xml_snapshot_reader_t *r);
+/* Returns 0 if the records were malformed */
+extern int stpi_xml_snapshot_read_ok(const stpi_xml_snapshot_reader_t *r);
+
+/*
+ * Store the parameter settings that stp_vars_fill_from_xmltree() would
+ * make from PROP in the snapshot, and apply them to V (which may be NULL
+ * to skip them).  The write function returns 0 for settings other than
+ * simple parameters.
+ */
+extern int stpi_vars_snapshot_write(stp_mxml_node_t *prop,
+				    stpi_xml_snapshot_writer_t *w);
+extern void stpi_vars_snapshot_read(stpi_xml_snapshot_reader_t *r,
+				    stp_vars_t *v);
+
+/** @} */
+
+/*
+ * Vector kernels.  On x86_64 with a compiler that supports per-function
+ * target attributes, SSE2 code may be used unconditionally and AVX2 (or
+ * BMI2) code may be compiled with STPI_TARGET_AVX2 (STPI_TARGET_BMI2) and
+ * selected at run time with STPI_CPU_HAS_AVX2() (STPI_CPU_HAS_BMI2()).
+ * Every vector kernel must have a scalar fallback producing identical
+ * results.  Setting STP_NO_SIMD in the environment makes the run time
+ * checks fail, so that the fallbacks are used.
+ */
+#if defined(__x86_64__) && \
+  (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#include <stdlib.h>
+#define STPI_X86_SIMD 1
+#define STPI_TARGET_AVX2 __attribute__((target("avx2")))
+#define STPI_TARGET_BMI2 __attribute__((target("bmi2")))
+#define STPI_CPU_HAS_AVX2() \
+  (!getenv("STP_NO_SIMD") && \
+   (__builtin_cpu_init(), __builtin_cpu_supports("avx2")))
+#define STPI_CPU_HAS_BMI2() \
+  (!getenv("STP_NO_SIMD") && \
+   (__builtin_cpu_init(), __builtin_cpu_supports("bmi2")))
+#endif
+
 #define CAST_IS_SAFE GCC_DIAG_OFF(cast-qual)
 #define CAST_IS_UNSAFE GCC_DIAG_ON(cast-qual)
 
@@ -59,6 +59,24 @@ stp_image_get_row(stp_image_t *image, unsigned char *data,
   return image->get_row(image, data, byte_limit, row);
 }
 
+stp_image_status_t
+stp_image_get_rows(const stp_vars_t *v, stp_image_t *image,
+		   unsigned char *data, size_t byte_limit, int row, int count)
+{
+  stp_image_get_rows_func_t get_rows = stp_get_image_get_rows_func(v, image);
+  int i;
+  if (get_rows)
+    return get_rows(image, data, byte_limit, row, count);
+  for (i = 0; i < count; i++)
+    {
+      stp_image_status_t status =
+	image->get_row(image, data + i * byte_limit, byte_limit, row + i);
+      if (status != STP_IMAGE_STATUS_OK)
+	return status;
+    }
+  return STP_IMAGE_STATUS_OK;
+}
+
 const char *
 stp_image_get_appname(stp_image_t *image)
 {
@@ -2813,6 +2813,10 @@ canon_list_parameters(const stp_vars_t *v)
   stp_parameter_list_append(ret, tmp_list);
   stp_parameter_list_destroy(tmp_list);
 
+  tmp_list = stpi_render_list_parameters(v);
+  stp_parameter_list_append(ret, tmp_list);
+  stp_parameter_list_destroy(tmp_list);
+
   for (i = 0; i < the_parameter_count; i++)
     stp_parameter_list_add_param(ret, &(the_parameters[i]));
   for (i = 0; i < float_parameter_count; i++)
@@ -5833,6 +5837,59 @@ static void canon_set_curve_parameter(stp_vars_t *v,const char* type,stp_curve_c
   }
 }
 
+typedef struct
+{
+  canon_privdata_t *pd;
+  const canon_cap_t *caps;
+  unsigned char **weave_cols;
+  unsigned char *cd_mask;
+  double outer_r_sq;
+  double inner_r_sq;
+} canon_render_t;
+
+static const unsigned char *
+canon_cd_mask(stp_vars_t *v, int y, void *data)
+{
+  canon_render_t *render = (canon_render_t *) data;
+  canon_privdata_t *pd = render->pd;
+  unsigned char *cd_mask = render->cd_mask;
+  int x_center = pd->cd_outer_radius * pd->mode->xdpi / 72;
+  int y_distance_from_center =
+    pd->cd_outer_radius - (y * 72 / pd->mode->ydpi);
+  if (y_distance_from_center < 0)
+    y_distance_from_center = -y_distance_from_center;
+  memset(cd_mask, 0, (pd->out_width + 7) / 8);
+  if (y_distance_from_center < pd->cd_outer_radius)
+    {
+      double y_sq = (double) y_distance_from_center *
+	(double) y_distance_from_center;
+      int x_where = sqrt(render->outer_r_sq - y_sq) + .5;
+      int scaled_x_where = x_where * pd->mode->xdpi / 72;
+      set_mask(cd_mask, x_center, scaled_x_where,
+	       pd->out_width, 1, 0);
+      if (y_distance_from_center < pd->cd_inner_radius)
+	{
+	  x_where = sqrt(render->inner_r_sq - y_sq) + .5;
+	  scaled_x_where = x_where * pd->mode->ydpi / 72;
+	  set_mask(cd_mask, x_center, scaled_x_where,
+		   pd->out_width, 1, 1);
+	}
+    }
+  return cd_mask;
+}
+
+static void
+canon_write_row(stp_vars_t *v, int y, void *data)
+{
+  canon_render_t *render = (canon_render_t *) data;
+  if (render->pd->mode->flags & MODE_FLAG_WEAVE)
+    stp_write_weave(v, render->weave_cols);
+  else if (render->caps->features & CANON_CAP_I)
+    canon_write_multiraster(v, render->pd, y);
+  else
+    canon_printfunc(v);
+}
+
 /*
  * 'canon_print()' - Print an image to a CANON printer.
  */
@@ -5854,24 +5911,15 @@ canon_do_print(stp_vars_t *v, stp_image_t *image)
       int colcheck = 0; */
   int		x,y;		/* Looping vars */
   canon_privdata_t privdata;
-  int		errdiv,		/* Error dividend */
-		errmod,		/* Error modulus */
-		errval,		/* Current error value */
-		errline,	/* Current raster line */
-                errlast;	/* Last raster line loaded */
 #if 0
-		out_channels;	/* Output bytes per pixel */
+  int		out_channels;	/* Output bytes per pixel */
 #endif
-  unsigned	zero_mask;
   int           print_cd = (media_source && (!strcmp(media_source, "CD")));
-  int           image_height;
 #if 0
   int           image_width;
 #endif
   double        k_upper, k_lower;
-  unsigned char *cd_mask = NULL;
-  double outer_r_sq = 0;
-  double inner_r_sq = 0;
+  canon_render_t render;
   unsigned char* weave_cols[4] ; /* TODO clean up weaving code to be more generic */
 
   stp_dprintf(STP_DBG_CANON, v, "Entering canon_do_print\n");
@@ -6002,8 +6050,6 @@ canon_do_print(stp_vars_t *v, stp_image_t *image)
 
   setup_page(v,&privdata);
 
-  image_height = stp_image_height(image);
-
 #if 0
   image_width = stp_image_width(image);
 #endif
@@ -6233,12 +6279,6 @@ canon_do_print(stp_vars_t *v, stp_image_t *image)
   }
 
 
-  errdiv  = image_height / privdata.out_height;
-  errmod  = image_height % privdata.out_height;
-  errval  = 0;
-  errlast = -1;
-  errline  = 0;
-
   /* set Hue, Lum and Sat Maps */
   canon_set_curve_parameter(v,"HueMap",STP_CURVE_COMPOSE_ADD,caps->hue_adjustment,privdata.pt->hue_adjustment,privdata.mode->hue_adjustment);
   canon_set_curve_parameter(v,"LumMap",STP_CURVE_COMPOSE_MULTIPLY,caps->lum_adjustment,privdata.pt->lum_adjustment,privdata.mode->lum_adjustment);
@@ -6251,65 +6291,18 @@ canon_do_print(stp_vars_t *v, stp_image_t *image)
   stp_allocate_component_data(v, "Driver", NULL, NULL, &privdata);
 
   privdata.emptylines = 0;
+  memset(&render, 0, sizeof(render));
+  render.pd = &privdata;
+  render.caps = caps;
+  render.weave_cols = weave_cols;
   if (print_cd) {
-    cd_mask = stp_malloc(1 + (privdata.out_width + 7) / 8);
-    outer_r_sq = (double)privdata.cd_outer_radius * (double)privdata.cd_outer_radius;
-    inner_r_sq = (double)privdata.cd_inner_radius * (double)privdata.cd_inner_radius;
-  }
-  for (y = 0; y < privdata.out_height; y ++)
-  {
-    int duplicate_line = 1;
-
-    if (errline != errlast)
-    {
-      errlast = errline;
-      duplicate_line = 0;
-      if (stp_color_get_row(v, image, errline, &zero_mask))
-	{
-	  status = 2;
-	  break;
-	}
-    }
-    if (print_cd)
-      {
-	int x_center = privdata.cd_outer_radius * privdata.mode->xdpi / 72;
-	int y_distance_from_center =
-	  privdata.cd_outer_radius - (y * 72 / privdata.mode->ydpi);
-	if (y_distance_from_center < 0)
-	  y_distance_from_center = -y_distance_from_center;
-	memset(cd_mask, 0, (privdata.out_width + 7) / 8);
-	if (y_distance_from_center < privdata.cd_outer_radius)
-	  {
-	    double y_sq = (double) y_distance_from_center *
-	      (double) y_distance_from_center;
-	    int x_where = sqrt(outer_r_sq - y_sq) + .5;
-	    int scaled_x_where = x_where * privdata.mode->xdpi / 72;
-	    set_mask(cd_mask, x_center, scaled_x_where,
-		     privdata.out_width, 1, 0);
-	    if (y_distance_from_center < privdata.cd_inner_radius)
-	      {
-		x_where = sqrt(inner_r_sq - y_sq) + .5;
-		scaled_x_where = x_where * privdata.mode->ydpi / 72;
-		set_mask(cd_mask, x_center, scaled_x_where,
-			 privdata.out_width, 1, 1);
-	      }
-	  }
-      }
-    stp_dither(v, y, duplicate_line, zero_mask, cd_mask);
-    if ( privdata.mode->flags & MODE_FLAG_WEAVE )
-        stp_write_weave(v, weave_cols);
-    else if ( caps->features & CANON_CAP_I)
-        canon_write_multiraster(v,&privdata,y);
-    else
-        canon_printfunc(v);
-    errval += errmod;
-    errline += errdiv;
-    if (errval >= privdata.out_height)
-    {
-      errval -= privdata.out_height;
-      errline ++;
-    }
+    render.cd_mask = stp_malloc(1 + (privdata.out_width + 7) / 8);
+    render.outer_r_sq = (double)privdata.cd_outer_radius * (double)privdata.cd_outer_radius;
+    render.inner_r_sq = (double)privdata.cd_inner_radius * (double)privdata.cd_inner_radius;
   }
+  status = stpi_render_rows(v, image, privdata.out_height,
+			    print_cd ? canon_cd_mask : NULL, canon_write_row,
+			    &render);
 
   if ( privdata.mode->flags & MODE_FLAG_WEAVE )
   {
@@ -6344,8 +6337,8 @@ canon_do_print(stp_vars_t *v, stp_image_t *image)
   stp_free(privdata.fold_buf);
   stp_free(privdata.comp_buf);
 
-  if(cd_mask)
-      stp_free(cd_mask);
+  if(render.cd_mask)
+      stp_free(render.cd_mask);
 
 
   canon_deinit_printer(v, &privdata);
@@ -479,6 +479,15 @@ static const float_param_t float_parameters[] =
   RAW_GAMMA_CHANNEL(61),
   RAW_GAMMA_CHANNEL(62),
   RAW_GAMMA_CHANNEL(63),
+  {
+    {
+      "ColorLattice", N_("Color Lattice Size"), "Color=Yes,Category=Advanced Output Control",
+      N_("Approximate color correction by interpolating in a lattice "
+	 "with this many points per axis (0 to compute every pixel)"),
+      STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_OUTPUT,
+      STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, -1, 1, 0
+    }, 0.0, 65.0, 0.0, CMASK_CMY | CMASK_RGB, 1, -1
+  },
   {
     {
       "LUTDumpFile", N_("LUT dump file"), N_("Advanced Output Control"),
@@ -741,36 +750,125 @@ get_color_correction_by_tag(color_correction_enum_t correction)
   return NULL;
 }
 
+lut_t *
+stpi_color_get_lut(const stp_vars_t *v)
+{
+  static stp_parameter_handle_t color_handle = NULL;
+  if (!color_handle)
+    color_handle = stp_component_data_handle("Color");
+  return (lut_t *) stp_get_component_data_by_handle(v, color_handle);
+}
 
 static void
 initialize_channels(stp_vars_t *v, stp_image_t *image)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   if (stp_check_float_parameter(v, "InkLimit", STP_PARAMETER_ACTIVE))
     stp_channel_set_ink_limit(v, stp_get_float_parameter(v, "InkLimit"));
   stp_channel_initialize(v, image, lut->out_channels);
   lut->channels_are_initialized = 1;
 }
 
+/* Bytes of input to stp_channel_convert() */
+#define COLOR_OUTPUT_SIZE(lut) \
+  ((size_t) (lut)->image_width * (lut)->out_channels * sizeof(unsigned short))
+
 static int
 stpi_color_traditional_get_row(stp_vars_t *v,
 			       stp_image_t *image,
 			       int row,
 			       unsigned *zero_mask)
 {
-  const lut_t *lut = (const lut_t *)(stp_get_component_data(v, "Color"));
+  const lut_t *lut = stpi_color_get_lut(v);
+  size_t in_size =
+    lut->image_width * lut->in_channels * lut->channel_depth / 8;
+  stpi_stage_times_t *times = stpi_stage_times(v);
+  stpi_stage_mark_t mark;
   unsigned zero;
-  if (stp_image_get_row(image, lut->in_data,
-			lut->image_width * lut->in_channels * lut->channel_depth / 8, row)
+  if (times)
+    stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+  if (stp_image_get_row(image, lut->in_data, in_size, row)
       != STP_IMAGE_STATUS_OK)
     return 2;
+  if (times)
+    stpi_stage_end(times, &mark, STPI_STAGE_IMAGE_READ, in_size);
   if (!lut->channels_are_initialized)
     initialize_channels(v, image);
+  if (times)
+    stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
   zero = (lut->output_color_description->conversion_function)
     (v, lut->in_data, stp_channel_get_input(v));
   if (zero_mask)
     *zero_mask = zero;
+  if (times)
+    {
+      stpi_stage_end(times, &mark, STPI_STAGE_COLOR, COLOR_OUTPUT_SIZE(lut));
+      stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+    }
   stp_channel_convert(v, zero_mask);
+  if (times)
+    stpi_stage_end(times, &mark, STPI_STAGE_CHANNEL,
+		   stpi_channel_get_output_size(v));
+  return 0;
+}
+
+static int
+stpi_color_traditional_get_rows(stp_vars_t *v,
+				stp_image_t *image,
+				int row,
+				int count,
+				const unsigned short **outputs,
+				unsigned *zero_masks)
+{
+  lut_t *lut = stpi_color_get_lut(v);
+  size_t in_size =
+    lut->image_width * lut->in_channels * lut->channel_depth / 8;
+  size_t out_size;
+  stpi_stage_times_t *times = stpi_stage_times(v);
+  stpi_stage_mark_t mark;
+  int i;
+  if (count > lut->band_rows)
+    {
+      STP_SAFE_FREE(lut->in_band);
+      STP_SAFE_FREE(lut->out_band);
+      lut->in_band = stp_malloc(in_size * count);
+      lut->band_rows = count;
+    }
+  if (times)
+    stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+  if (stp_image_get_rows(v, image, lut->in_band, in_size, row, count)
+      != STP_IMAGE_STATUS_OK)
+    return 2;
+  if (times)
+    stpi_stage_end(times, &mark, STPI_STAGE_IMAGE_READ, in_size * count);
+  if (!lut->channels_are_initialized)
+    initialize_channels(v, image);
+  for (i = 0; i < count; i++)
+    {
+      unsigned zero;
+      unsigned *zero_mask = zero_masks ? &(zero_masks[i]) : NULL;
+      if (times)
+	stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+      zero = (lut->output_color_description->conversion_function)
+	(v, lut->in_band + i * in_size, stp_channel_get_input(v));
+      if (zero_mask)
+	*zero_mask = zero;
+      if (times)
+	{
+	  stpi_stage_end(times, &mark, STPI_STAGE_COLOR,
+			 COLOR_OUTPUT_SIZE(lut));
+	  stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+	}
+      stp_channel_convert(v, zero_mask);
+      out_size = stpi_channel_get_output_size(v);
+      if (times)
+	stpi_stage_end(times, &mark, STPI_STAGE_CHANNEL, out_size);
+      if (!lut->out_band)
+	lut->out_band = stp_malloc(out_size * lut->band_rows);
+      outputs[i] = lut->out_band + i * (out_size / sizeof(unsigned short));
+      memcpy(lut->out_band + i * (out_size / sizeof(unsigned short)),
+	     stp_channel_get_output(v), out_size);
+    }
   return 0;
 }
 
@@ -843,6 +941,16 @@ copy_lut(void *vlut)
   stp_curve_cache_copy(&(dest->sat_map), &(src->sat_map));
   /* Don't copy gray_tmp */
   /* Don't copy cmy_tmp */
+  /* Don't copy in_band or out_band */
+  /* Don't copy lut8; it refers to the source's curve data */
+  if (src->color_lattice)
+    {
+      size_t size = src->lattice_size;
+      size = sizeof(unsigned short) * 3 * size * size * size;
+      dest->color_lattice = stp_malloc(size);
+      memcpy(dest->color_lattice, src->color_lattice, size);
+      dest->lattice_size = src->lattice_size;
+    }
   if (src->in_data)
     {
       dest->in_data = stp_malloc(src->image_width * src->in_channels);
@@ -865,6 +973,10 @@ free_lut(void *vlut)
   STP_SAFE_FREE(lut->gray_tmp);
   STP_SAFE_FREE(lut->cmy_tmp);
   STP_SAFE_FREE(lut->in_data);
+  STP_SAFE_FREE(lut->in_band);
+  STP_SAFE_FREE(lut->out_band);
+  STP_SAFE_FREE(lut->lut8);
+  STP_SAFE_FREE(lut->color_lattice);
   memset(lut, 0, sizeof(lut_t));
   stp_free(lut);
 }
@@ -873,7 +985,7 @@ static stp_curve_t *
 compute_gcr_curve(const stp_vars_t *vars)
 {
   stp_curve_t *curve;
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));
+  lut_t *lut = stpi_color_get_lut(vars);
   double k_lower = 0.0;
   double k_upper = 1.0;
   double k_trans = 1.0;
@@ -934,7 +1046,7 @@ compute_gcr_curve(const stp_vars_t *vars)
 static void
 initialize_gcr_curve(stp_vars_t *vars)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));
+  lut_t *lut = stpi_color_get_lut(vars);
   stp_curve_t *curve = NULL;
   if (stp_check_curve_parameter(vars, "GCRCurve", STP_PARAMETER_DEFAULTED))
     {
@@ -1303,7 +1415,7 @@ compute_one_lut(lut_t *lut, int i)
 static void
 setup_channel(stp_vars_t *v, int i, const channel_param_t *p)
 {
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   const char *gamma_name =
     (lut->output_color_description->color_model == COLOR_BLACK ?
      p->gamma_name : p->rgb_gamma_name);
@@ -1346,7 +1458,7 @@ static void
 stpi_do_dump_lut_to_file(stp_vars_t *v, FILE *fp)
 {
   int i;
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   const stp_curve_t *curve;
   fprintf(fp, "Gutenprint LUT dump version 0\n\n");
   fprintf(fp, "Input color description: '%s'\n", lut->input_color_description->name);
@@ -1391,7 +1503,7 @@ static void
 stpi_compute_lut(stp_vars_t *v)
 {
   int i;
-  lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
+  lut_t *lut = stpi_color_get_lut(v);
   stp_curve_t *curve;
   stp_dprintf(STP_DBG_LUT, v, "stpi_compute_lut\n");
 
@@ -1561,6 +1673,13 @@ stpi_color_traditional_init(stp_vars_t *v,
        (lut->output_color_description->default_correction));
 
   stpi_compute_lut(v);
+  if ((lut->input_color_description->color_id == COLOR_ID_RGB ||
+       lut->input_color_description->color_id == COLOR_ID_CMY) &&
+      (lut->color_correction->correction == COLOR_CORRECTION_ACCURATE ||
+       lut->color_correction->correction == COLOR_CORRECTION_BRIGHT ||
+       lut->color_correction->correction == COLOR_CORRECTION_HUE) &&
+      stp_check_int_parameter(v, "ColorLattice", STP_PARAMETER_ACTIVE))
+    stpi_color_compute_lattice(v, stp_get_int_parameter(v, "ColorLattice"));
 
   lut->image_width = stp_image_width(image);
   total_channel_bits = lut->in_channels * lut->channel_depth;
@@ -1840,7 +1959,10 @@ static stp_color_t stpi_color_traditional_module_data =
 static int
 color_traditional_module_init(void)
 {
-  return stp_color_register(&stpi_color_traditional_module_data);
+  int status = stp_color_register(&stpi_color_traditional_module_data);
+  stpi_color_set_get_rows_func(&stpi_color_traditional_module_data,
+			       stpi_color_traditional_get_rows);
+  return status;
 }
 
 
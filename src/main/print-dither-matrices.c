@@ -351,7 +351,7 @@ stp_dither_matrix_set_row(stp_dither_matrix_impl_t *mat, int y)
 static void
 preinit_matrix(stp_vars_t *v)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int i;
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     stp_dither_matrix_destroy(&(CHANNEL(d, i).dithermat));
@@ -361,7 +361,7 @@ preinit_matrix(stp_vars_t *v)
 static void
 postinit_matrix(stp_vars_t *v, int x_shear, int y_shear)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   unsigned rc = 1 + (unsigned) ceil(sqrt(CHANNEL_COUNT(d)));
   int i, j;
   int color = 0;
@@ -385,7 +385,7 @@ stp_dither_set_iterated_matrix(stp_vars_t *v, size_t edge, size_t iterations,
 			       const unsigned *data, int prescaled,
 			       int x_shear, int y_shear)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   preinit_matrix(v);
   stp_dither_matrix_iterated_init(&(d->dither_matrix), edge, iterations, data);
   postinit_matrix(v, x_shear, y_shear);
@@ -395,7 +395,7 @@ void
 stp_dither_set_matrix(stp_vars_t *v, const stp_dither_matrix_generic_t *matrix,
 		      int transposed, int x_shear, int y_shear)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   int x = transposed ? matrix->y : matrix->x;
   int y = transposed ? matrix->x : matrix->y;
   preinit_matrix(v);
@@ -415,7 +415,7 @@ stp_dither_set_matrix_from_dither_array(stp_vars_t *v,
 					const stp_array_t *array,
 					int transpose)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   preinit_matrix(v);
   stp_dither_matrix_init_from_dither_array(&(d->dither_matrix), array, transpose);
   postinit_matrix(v, 0, 0);
@@ -424,7 +424,7 @@ stp_dither_set_matrix_from_dither_array(stp_vars_t *v,
 void
 stp_dither_set_transition(stp_vars_t *v, double exponent)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_t *d = stpi_dither_get(v);
   unsigned rc = 1 + (unsigned) ceil(sqrt(CHANNEL_COUNT(d)));
   int i, j;
   int color = 0;
@@ -652,11 +652,95 @@ stpi_dither_array_create_from_file(const char* file, int x, int y)
   return ret;
 }
 
+/*
+ * Binary cache of dither arrays, so that processes need not parse the
+ * (large) dither matrix XML files each time they start.  The payload is
+ * a dither_cache_header_t followed by the array as unsigned shorts.
+ */
+
+#define DITHER_CACHE_MAGIC "STPDITH"
+
+typedef struct
+{
+  int x_size;
+  int y_size;
+  double low;
+  double high;
+} dither_cache_header_t;
+
+static stp_array_t *
+dither_array_create_from_cache(int x, int y, const stp_list_t *sources)
+{
+  char buf[64];
+  stpi_binary_cache_t *cache;
+  const dither_cache_header_t *header;
+  stp_array_t *ret = NULL;
+  size_t bytes;
+
+  (void) sprintf(buf, "dither-matrix-%dx%d.bin", x, y);
+  cache = stpi_binary_cache_open(buf, DITHER_CACHE_MAGIC, sources);
+  if (!cache)
+    return NULL;
+  header = stpi_binary_cache_get_data(cache, &bytes);
+  if (bytes >= sizeof(dither_cache_header_t) &&
+      header->x_size > 0 && header->y_size > 0 &&
+      bytes == (sizeof(dither_cache_header_t) + sizeof(unsigned short) *
+		header->x_size * header->y_size))
+    {
+      stp_sequence_t *seq;
+      ret = stp_array_create(header->x_size, header->y_size);
+      seq = stpi_cast_safe(stp_array_get_sequence(ret));
+      if (!stp_sequence_set_bounds(seq, header->low, header->high) ||
+	  !stp_sequence_set_ushort_data
+	  (seq, header->x_size * header->y_size,
+	   (const unsigned short *) (header + 1)))
+	{
+	  stp_array_destroy(ret);
+	  ret = NULL;
+	}
+    }
+  stpi_binary_cache_close(cache);
+  return ret;
+}
+
+static void
+dither_array_write_cache(int x, int y, const stp_list_t *sources,
+			 const stp_array_t *array)
+{
+  char buf[64];
+  const stp_sequence_t *seq = stp_array_get_sequence(array);
+  const unsigned short *vec;
+  const double *data;
+  dither_cache_header_t *header;
+  size_t count;
+  size_t i;
+
+  vec = stp_sequence_get_ushort_data(seq, &count);
+  stp_sequence_get_data(seq, &count, &data);
+  if (!vec)
+    return;
+  for (i = 0; i < count; i++)
+    if (data[i] != (double) vec[i])
+      return;			/* Not representable exactly */
+
+  header = stp_zalloc(sizeof(dither_cache_header_t) +
+		      sizeof(unsigned short) * count);
+  stp_array_get_size(array, &(header->x_size), &(header->y_size));
+  stp_sequence_get_bounds(seq, &(header->low), &(header->high));
+  memcpy(header + 1, vec, sizeof(unsigned short) * count);
+  (void) sprintf(buf, "dither-matrix-%dx%d.bin", x, y);
+  (void) stpi_binary_cache_write(buf, DITHER_CACHE_MAGIC, sources, header,
+				 (sizeof(dither_cache_header_t) +
+				  sizeof(unsigned short) * count));
+  stp_free(header);
+}
+
 static stp_array_t *
 stp_xml_get_dither_array(int x, int y)
 {
   stp_xml_dither_cache_t *cachedval;
   stp_array_t *ret;
+  stp_list_t *sources = NULL;
 
   cachedval = stp_xml_dither_cache_get(x, y);
 
@@ -667,15 +751,35 @@ stp_xml_get_dither_array(int x, int y)
     {
       char buf[1024];
       (void) sprintf(buf, "dither-matrix-%dx%d.xml", x, y);
+      sources = stpi_list_files_on_data_path(buf);
+      if (sources && stp_list_get_length(sources) > 0)
+	{
+	  ret = dither_array_create_from_cache(x, y, sources);
+	  if (ret)
+	    {
+	      stp_xml_dither_cache_set
+		(x, y, stp_list_item_get_data(stp_list_get_start(sources)));
+	      stp_list_destroy(sources);
+	      cachedval = stp_xml_dither_cache_get(x, y);
+	      cachedval->dither_array = ret;
+	      return stp_array_create_copy(ret);
+	    }
+	}
       stp_xml_parse_file_named(buf);
       cachedval = stp_xml_dither_cache_get(x, y);
       if (cachedval == NULL || cachedval->filename == NULL)
 	{
+	  if (sources)
+	    stp_list_destroy(sources);
 	  return NULL;
 	}
     }
 
   ret = stpi_dither_array_create_from_file(cachedval->filename, x, y);
+  if (ret && sources && stp_list_get_length(sources) > 0)
+    dither_array_write_cache(x, y, sources, ret);
+  if (sources)
+    stp_list_destroy(sources);
 
   cachedval->dither_array = ret;
   return stp_array_create_copy(ret);
@@ -1784,6 +1784,10 @@ escp2_list_parameters(const stp_vars_t *v)
   stp_parameter_list_append(ret, tmp_list);
   stp_parameter_list_destroy(tmp_list);
 
+  tmp_list = stpi_render_list_parameters(v);
+  stp_parameter_list_append(ret, tmp_list);
+  stp_parameter_list_destroy(tmp_list);
+
   for (i = 0; i < the_parameter_count; i++)
     stp_parameter_list_add_param(ret, &(the_parameters[i]));
   for (i = 0; i < float_parameter_count; i++)
@@ -4269,80 +4273,75 @@ set_mask(unsigned char *cd_mask, int x_center, int scaled_x_where,
     }
 }
 
+typedef struct
+{
+  unsigned char *cd_mask;
+  double outer_r_sq;
+  double inner_r_sq;
+  int x_center;
+} escp2_cd_mask_t;
+
+static const unsigned char *
+escp2_cd_mask(stp_vars_t *v, int y, void *data)
+{
+  escp2_privdata_t *pd = get_privdata(v);
+  escp2_cd_mask_t *cd = (escp2_cd_mask_t *) data;
+  unsigned char *cd_mask = cd->cd_mask;
+  int y_distance_from_center;
+  if (!cd_mask)
+    return NULL;
+  y_distance_from_center =
+    pd->cd_outer_radius -
+    ((y + pd->cd_y_offset) * pd->micro_units / pd->res->printed_vres);
+  if (y_distance_from_center < 0)
+    y_distance_from_center = -y_distance_from_center;
+  memset(cd_mask, 0, (pd->image_printed_width + 7) / 8);
+  if (y_distance_from_center < pd->cd_outer_radius)
+    {
+      double y_sq = (double) y_distance_from_center *
+	(double) y_distance_from_center;
+      int x_where = sqrt(cd->outer_r_sq - y_sq) + .5;
+      int scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
+      set_mask(cd_mask, cd->x_center, scaled_x_where,
+	       pd->image_printed_width, 1, 0);
+      if (y_distance_from_center < pd->cd_inner_radius)
+	{
+	  x_where = sqrt(cd->inner_r_sq - y_sq) + .5;
+	  scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
+	  set_mask(cd_mask, cd->x_center, scaled_x_where,
+		   pd->image_printed_width, 1, 1);
+	}
+    }
+  return cd_mask;
+}
+
+static void
+escp2_write_row(stp_vars_t *v, int y, void *data)
+{
+  escp2_privdata_t *pd = get_privdata(v);
+  stp_write_weave(v, pd->cols);
+}
+
 static int
 escp2_print_data(stp_vars_t *v, stp_image_t *image)
 {
   escp2_privdata_t *pd = get_privdata(v);
-  int errdiv  = stp_image_height(image) / pd->image_printed_height;
-  int errmod  = stp_image_height(image) % pd->image_printed_height;
-  int errval  = 0;
-  int errlast = -1;
-  int errline  = 0;
-  int y;
-  double outer_r_sq = 0;
-  double inner_r_sq = 0;
-  int x_center = pd->cd_x_offset * pd->res->printed_hres / pd->micro_units;
-  unsigned char *cd_mask = NULL;
+  escp2_cd_mask_t cd;
+  int status;
+  memset(&cd, 0, sizeof(cd));
   if (pd->cd_outer_radius > 0)
     {
-      cd_mask = stp_malloc(1 + (pd->image_printed_width + 7) / 8);
-      outer_r_sq = (double) pd->cd_outer_radius * (double) pd->cd_outer_radius;
-      inner_r_sq = (double) pd->cd_inner_radius * (double) pd->cd_inner_radius;
+      cd.cd_mask = stp_malloc(1 + (pd->image_printed_width + 7) / 8);
+      cd.outer_r_sq = (double) pd->cd_outer_radius * (double) pd->cd_outer_radius;
+      cd.inner_r_sq = (double) pd->cd_inner_radius * (double) pd->cd_inner_radius;
+      cd.x_center = pd->cd_x_offset * pd->res->printed_hres / pd->micro_units;
     }
 
-  for (y = 0; y < pd->image_printed_height; y ++)
-    {
-      int duplicate_line = 1;
-      unsigned zero_mask;
-
-      if (errline != errlast)
-	{
-	  errlast = errline;
-	  duplicate_line = 0;
-	  if (stp_color_get_row(v, image, errline, &zero_mask))
-	    return 2;
-	}
-
-      if (cd_mask)
-	{
-	  int y_distance_from_center =
-	    pd->cd_outer_radius -
-	    ((y + pd->cd_y_offset) * pd->micro_units / pd->res->printed_vres);
-	  if (y_distance_from_center < 0)
-	    y_distance_from_center = -y_distance_from_center;
-	  memset(cd_mask, 0, (pd->image_printed_width + 7) / 8);
-	  if (y_distance_from_center < pd->cd_outer_radius)
-	    {
-	      double y_sq = (double) y_distance_from_center *
-		(double) y_distance_from_center;
-	      int x_where = sqrt(outer_r_sq - y_sq) + .5;
-	      int scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
-	      set_mask(cd_mask, x_center, scaled_x_where,
-		       pd->image_printed_width, 1, 0);
-	      if (y_distance_from_center < pd->cd_inner_radius)
-		{
-		  x_where = sqrt(inner_r_sq - y_sq) + .5;
-		  scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
-		  set_mask(cd_mask, x_center, scaled_x_where,
-			   pd->image_printed_width, 1, 1);
-		}
-	    }
-	}
-
-      stp_dither(v, y, duplicate_line, zero_mask, cd_mask);
-
-      stp_write_weave(v, pd->cols);
-      errval += errmod;
-      errline += errdiv;
-      if (errval >= pd->image_printed_height)
-	{
-	  errval -= pd->image_printed_height;
-	  errline ++;
-	}
-    }
-  if (cd_mask)
-    stp_free(cd_mask);
-  return 1;
+  status = stpi_render_rows(v, image, pd->image_printed_height,
+			    escp2_cd_mask, escp2_write_row, &cd);
+  if (cd.cd_mask)
+    stp_free(cd.cd_mask);
+  return status;
 }
 
 static int
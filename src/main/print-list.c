@@ -36,6 +36,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#if defined(HAVE_PTHREAD) && defined(HAVE_PTHREAD_H)
+#define USE_INDEX_LOCK 1
+#include <pthread.h>
+#if defined(__ATOMIC_ACQUIRE) && defined(__ATOMIC_RELEASE)
+#define USE_INDEX_ATOMICS 1
+#endif
+#endif
 
 /** The internal representation of an stp_list_item_t list node. */
 struct stp_list_item
@@ -43,8 +50,34 @@ struct stp_list_item
   void *data;			/*!< Data		*/
   struct stp_list_item *prev;	/*!< Previous node	*/
   struct stp_list_item *next;	/*!< Next node		*/
+  struct stp_list *list;	/*!< List containing the node	*/
 };
 
+/** An entry in a list index. */
+typedef struct
+{
+  unsigned hash;			/*!< Hash of the node name		*/
+  struct stp_list_item *node;		/*!< Node, or NULL if the slot is empty	*/
+} list_index_entry_t;
+
+/**
+ * A hash index of the nodes of a list by name or long name, mapping
+ * each name to the first node having it.  Indexes are built the first
+ * time a long enough list is searched, kept up to date as nodes are
+ * appended or removed, and simply discarded when that cannot be done
+ * cheaply.
+ */
+typedef struct
+{
+  list_index_entry_t *entries;		/*!< Open-addressed hash table		*/
+  int size;				/*!< Number of slots (a power of 2)	*/
+  int count;				/*!< Number of names in the index	*/
+  int has_duplicates;			/*!< Some name has more than one node	*/
+} list_index_t;
+
+/** Lists shorter than this are searched linearly. */
+#define LIST_INDEX_MIN_LENGTH 8
+
 /** The internal representation of an stp_list_t list. */
 struct stp_list
 {
@@ -58,48 +91,250 @@ struct stp_list
   stp_node_namefunc namefunc;			/*!< Callback to get node name		*/
   stp_node_namefunc long_namefunc;		/*!< Callback to get node long name	*/
   stp_node_sortfunc sortfunc;			/*!< Callback to compare (sort) nodes	*/
-  char *name_cache;				/*!< Cached name			*/
   struct stp_list_item *name_cache_node;	/*!< Cached node (for name)		*/
-  char *long_name_cache;			/*!< Cached long name			*/
   struct stp_list_item *long_name_cache_node;	/*!< Cached node (for long name)	*/
+  list_index_t *name_index;			/*!< Index by name			*/
+  list_index_t *long_name_index;		/*!< Index by long name			*/
+  unsigned stamp;				/*!< Changes when the list does		*/
+#ifdef USE_INDEX_LOCK
+  pthread_mutex_t index_lock;			/*!< Guards the indexes			*/
+#endif
 };
 
+static unsigned list_stamp = 0;
+#ifdef USE_INDEX_LOCK
+static pthread_mutex_t stamp_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /**
- * Cache a list node by its short name.
- * @param list the list to use.
- * @param name the short name.
- * @param cache the node to cache.
+ * Give a list a new stamp, distinct from that of any list before.
+ * Lists may be changed on several threads at once (each changing a list
+ * of its own), so the counter is only touched under a lock.
+ * @param list the list that has changed.
+ */
+static inline void
+touch_list(stp_list_t *list)
+{
+#ifdef USE_INDEX_LOCK
+  pthread_mutex_lock(&stamp_lock);
+#endif
+  if (++list_stamp == 0)
+    ++list_stamp;
+  list->stamp = list_stamp;
+#ifdef USE_INDEX_LOCK
+  pthread_mutex_unlock(&stamp_lock);
+#endif
+}
+
+unsigned
+stpi_list_get_stamp(const stp_list_t *list)
+{
+  return list->stamp;
+}
+
+static unsigned
+list_hash(const char *name)
+{
+  unsigned hash = 2166136261u;
+  while (*name)
+    hash = (hash ^ (unsigned char) *name++) * 16777619u;
+  return hash;
+}
+
+/*
+ * Lookups by name do not otherwise change the list, so several threads
+ * may look up names in the same list at once, and the first of them to
+ * need an index builds it.  An index is built, changed and discarded only
+ * with the index lock of its list held, and is published with a release
+ * store, so a thread that finds an index without taking the lock sees it
+ * complete.  Nodes are added and removed with the lock held as well, so
+ * that an index is never built from a list in the middle of a change.
+ * As for the nodes themselves, a list must still not be changed while
+ * another thread is reading it.
+ */
+static inline void
+lock_indexes(const stp_list_t *list)
+{
+#ifdef USE_INDEX_LOCK
+  pthread_mutex_lock(&(((stp_list_t *) list)->index_lock));
+#endif
+}
+
+static inline void
+unlock_indexes(const stp_list_t *list)
+{
+#ifdef USE_INDEX_LOCK
+  pthread_mutex_unlock(&(((stp_list_t *) list)->index_lock));
+#endif
+}
+
+static inline void
+index_publish(list_index_t **pidx, list_index_t *idx)
+{
+#ifdef USE_INDEX_ATOMICS
+  __atomic_store_n(pidx, idx, __ATOMIC_RELEASE);
+#else
+  *pidx = idx;
+#endif
+}
+
+/**
+ * Discard an index.  The index lock of its list must be held.
  */
 static void
-set_name_cache(stp_list_t *list,
-	       const char *name,
-	       stp_list_item_t *cache)
+index_destroy(list_index_t **pidx)
 {
-  if (list->name_cache)
-    stp_free(list->name_cache);
-  list->name_cache = NULL;
-  if (name)
-    list->name_cache = stp_strdup(name);
-  list->name_cache_node = cache;
+  list_index_t *idx = *pidx;
+  if (idx)
+    {
+      index_publish(pidx, NULL);
+      stp_free(idx->entries);
+      stp_free(idx);
+    }
 }
 
 /**
- * Cache a list node by its long name.
- * @param list the list to use.
- * @param long_name the long name.
- * @param cache the node to cache.
+ * Find the slot holding name, or the empty slot where it would go.
+ */
+static list_index_entry_t *
+index_find(const list_index_t *idx, stp_node_namefunc namefunc,
+	   const char *name, unsigned hash)
+{
+  int mask = idx->size - 1;
+  int i = hash & mask;
+  while (idx->entries[i].node &&
+	 (idx->entries[i].hash != hash ||
+	  strcmp(name, namefunc(idx->entries[i].node->data)) != 0))
+    i = (i + 1) & mask;
+  return idx->entries + i;
+}
+
+static void
+index_resize(list_index_t *idx, int size)
+{
+  list_index_entry_t *old_entries = idx->entries;
+  int old_size = idx->size;
+  int i;
+  idx->entries = stp_zalloc(sizeof(list_index_entry_t) * size);
+  idx->size = size;
+  for (i = 0; i < old_size; i++)
+    if (old_entries[i].node)
+      {
+	int j = old_entries[i].hash & (size - 1);
+	while (idx->entries[j].node)
+	  j = (j + 1) & (size - 1);
+	idx->entries[j] = old_entries[i];
+      }
+  STP_SAFE_FREE(old_entries);
+}
+
+/**
+ * Add a node to an index.
+ * @param at_end whether the node was appended to the list.
+ * @returns 0 if the index can no longer be used, because the node
+ * might now be the first of several with its name.
+ */
+static int
+index_add(list_index_t *idx, stp_node_namefunc namefunc,
+	  stp_list_item_t *node, int at_end)
+{
+  const char *name = namefunc(node->data);
+  unsigned hash = list_hash(name);
+  list_index_entry_t *slot = index_find(idx, namefunc, name, hash);
+  if (slot->node)
+    {
+      idx->has_duplicates = 1;
+      return at_end;
+    }
+  slot->hash = hash;
+  slot->node = node;
+  idx->count++;
+  if (2 * idx->count > idx->size)
+    index_resize(idx, 2 * idx->size);
+  return 1;
+}
+
+/**
+ * Remove a node from an index.
+ * @returns 0 if the index can no longer be used.
+ */
+static int
+index_remove(list_index_t *idx, stp_node_namefunc namefunc,
+	     const stp_list_item_t *node)
+{
+  const char *name = namefunc(node->data);
+  list_index_entry_t *slot = index_find(idx, namefunc, name, list_hash(name));
+  int mask = idx->size - 1;
+  int i, j;
+  if (slot->node != node)
+    /* A later node with a duplicate name */
+    return slot->node != NULL;
+  if (idx->has_duplicates)
+    return 0;
+  /* Shift back any entries that were displaced past this slot */
+  i = j = slot - idx->entries;
+  for (;;)
+    {
+      int k;
+      j = (j + 1) & mask;
+      if (!idx->entries[j].node)
+	break;
+      k = idx->entries[j].hash & mask;
+      if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+	{
+	  idx->entries[i] = idx->entries[j];
+	  i = j;
+	}
+    }
+  idx->entries[i].node = NULL;
+  idx->count--;
+  return 1;
+}
+
+static list_index_t *
+index_build(const stp_list_t *list, stp_node_namefunc namefunc)
+{
+  list_index_t *idx = stp_zalloc(sizeof(list_index_t));
+  stp_list_item_t *node;
+  int size = 16;
+  while (size < 2 * list->length)
+    size *= 2;
+  index_resize(idx, size);
+  for (node = list->start; node; node = node->next)
+    (void) index_add(idx, namefunc, node, 1);
+  stp_deprintf(STP_DBG_LIST, "stp_list index built (%d names, %d nodes)\n",
+	       idx->count, list->length);
+  return idx;
+}
+
+/**
+ * Keep the indexes of a list up to date when a node is added.  The index
+ * lock of the list must be held.
  */
 static void
-set_long_name_cache(stp_list_t *list,
-		    const char *long_name,
-		    stp_list_item_t *cache)
+index_node_added(stp_list_t *list, stp_list_item_t *node, int at_end)
 {
-  if (list->long_name_cache)
-    stp_free(list->long_name_cache);
-  list->long_name_cache = NULL;
-  if (long_name)
-    list->long_name_cache = stp_strdup(long_name);
-  list->long_name_cache_node = cache;
+  if (list->name_index &&
+      !index_add(list->name_index, list->namefunc, node, at_end))
+    index_destroy(&list->name_index);
+  if (list->long_name_index &&
+      !index_add(list->long_name_index, list->long_namefunc, node, at_end))
+    index_destroy(&list->long_name_index);
+}
+
+/**
+ * Keep the indexes of a list up to date when a node is removed.  The
+ * index lock of the list must be held.
+ */
+static void
+index_node_removed(stp_list_t *list, const stp_list_item_t *node)
+{
+  if (list->name_index &&
+      !index_remove(list->name_index, list->namefunc, node))
+    index_destroy(&list->name_index);
+  if (list->long_name_index &&
+      !index_remove(list->long_name_index, list->long_namefunc, node))
+    index_destroy(&list->long_name_index);
 }
 
 /**
@@ -111,8 +346,33 @@ clear_cache(stp_list_t *list)
 {
   list->index_cache = 0;
   list->index_cache_node = NULL;
-  set_name_cache(list, NULL, NULL);
-  set_long_name_cache(list, NULL, NULL);
+  list->name_cache_node = NULL;
+  list->long_name_cache_node = NULL;
+}
+
+/*
+ * Return the index *PINDEX of LIST, building it if there is none yet.
+ * The name caches hold only a node, whose name is checked on use.
+ */
+static list_index_t *
+get_index(const stp_list_t *list, list_index_t **pindex,
+	  stp_node_namefunc namefunc)
+{
+  list_index_t *index;
+#ifdef USE_INDEX_ATOMICS
+  index = __atomic_load_n(pindex, __ATOMIC_ACQUIRE);
+  if (index)
+    return index;
+#endif
+  lock_indexes(list);
+  index = *pindex;
+  if (!index)
+    {
+      index = index_build(list, namefunc);
+      index_publish(pindex, index);
+    }
+  unlock_indexes(list);
+  return index;
 }
 
 void
@@ -147,10 +407,14 @@ stp_list_create(void)
   list->long_namefunc = NULL;
   list->sortfunc = NULL;
   list->copyfunc = NULL;
-  list->name_cache = NULL;
   list->name_cache_node = NULL;
-  list->long_name_cache = NULL;
   list->long_name_cache_node = NULL;
+  list->name_index = NULL;
+  list->long_name_index = NULL;
+#ifdef USE_INDEX_LOCK
+  pthread_mutex_init(&(list->index_lock), NULL);
+#endif
+  touch_list(list);
 
   stp_deprintf(STP_DBG_LIST, "stp_list_head constructor\n");
   return list;
@@ -194,6 +458,10 @@ stp_list_destroy(stp_list_t *list)
 
   check_list(list);
   clear_cache(list);
+  lock_indexes(list);
+  index_destroy(&list->name_index);
+  index_destroy(&list->long_name_index);
+  unlock_indexes(list);
   cur = list->start;
   while(cur)
     {
@@ -202,6 +470,9 @@ stp_list_destroy(stp_list_t *list)
       cur = next;
     }
   stp_deprintf(STP_DBG_LIST, "stp_list_head destructor\n");
+#ifdef USE_INDEX_LOCK
+  pthread_mutex_destroy(&(list->index_lock));
+#endif
   stp_free(list);
 
   return 0;
@@ -348,13 +619,19 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
   if (!list->namefunc || !name)
     return NULL;
 
-  if (list->name_cache && list->name_cache_node)
+  if (list->length >= LIST_INDEX_MIN_LENGTH)
+    {
+      list_index_t *index =
+	get_index(list, &(ulist->name_index), list->namefunc);
+      return index_find(index, list->namefunc, name, list_hash(name))->node;
+    }
+
+  node = list->name_cache_node;
+  if (node)
     {
       const char *new_name;
-      node = list->name_cache_node;
       /* Is this the item we've cached? */
-      if (strcmp(name, list->name_cache) == 0 &&
-	  strcmp(name, list->namefunc(node->data)) == 0)
+      if (strcmp(name, list->namefunc(node->data)) == 0)
 	return node;
 
       /* If not, check the next item in case we're searching the list */
@@ -364,7 +641,7 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
 	  new_name = list->namefunc(node->data);
 	  if (strcmp(name, new_name) == 0)
 	    {
-	      set_name_cache(ulist, new_name, node);
+	      ulist->name_cache_node = node;
 	      return node;
 	    }
 	}
@@ -375,7 +652,7 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
 	  new_name = list->namefunc(node->data);
 	  if (strcmp(name, new_name) == 0)
 	    {
-	      set_name_cache(ulist, new_name, node);
+	      ulist->name_cache_node = node;
 	      return node;
 	    }
 	}
@@ -384,7 +661,7 @@ stp_list_get_item_by_name(const stp_list_t *list, const char *name)
   node = stp_list_get_item_by_name_internal(list, name);
 
   if (node)
-    set_name_cache(ulist, name, node);
+    ulist->name_cache_node = node;
 
   return node;
 }
@@ -422,13 +699,20 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
   if (!list->long_namefunc || !long_name)
     return NULL;
 
-  if (list->long_name_cache && list->long_name_cache_node)
+  if (list->length >= LIST_INDEX_MIN_LENGTH)
+    {
+      list_index_t *index =
+	get_index(list, &(ulist->long_name_index), list->long_namefunc);
+      return index_find(index, list->long_namefunc, long_name,
+			list_hash(long_name))->node;
+    }
+
+  node = list->long_name_cache_node;
+  if (node)
     {
       const char *new_long_name;
-      node = list->long_name_cache_node;
       /* Is this the item we've cached? */
-      if (strcmp(long_name, list->long_name_cache) == 0 &&
-	  strcmp(long_name, list->long_namefunc(node->data)) == 0)
+      if (strcmp(long_name, list->long_namefunc(node->data)) == 0)
 	return node;
 
       /* If not, check the next item in case we're searching the list */
@@ -438,7 +722,7 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
 	  new_long_name = list->long_namefunc(node->data);
 	  if (strcmp(long_name, new_long_name) == 0)
 	    {
-	      set_long_name_cache(ulist, new_long_name, node);
+	      ulist->long_name_cache_node = node;
 	      return node;
 	    }
 	}
@@ -449,7 +733,7 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
 	  new_long_name = list->long_namefunc(node->data);
 	  if (strcmp(long_name, new_long_name) == 0)
 	    {
-	      set_long_name_cache(ulist, new_long_name, node);
+	      ulist->long_name_cache_node = node;
 	      return node;
 	    }
 	}
@@ -458,7 +742,7 @@ stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
   node = stp_list_get_item_by_long_name_internal(list, long_name);
 
   if (node)
-    set_long_name_cache(ulist, long_name, node);
+    ulist->long_name_cache_node = node;
 
   return node;
 }
@@ -499,6 +783,10 @@ void
 stp_list_set_namefunc(stp_list_t *list, stp_node_namefunc namefunc)
 {
   check_list(list);
+  lock_indexes(list);
+  index_destroy(&list->name_index);
+  unlock_indexes(list);
+  touch_list(list);
   list->namefunc = namefunc;
 }
 
@@ -514,6 +802,9 @@ void
 stp_list_set_long_namefunc(stp_list_t *list, stp_node_namefunc long_namefunc)
 {
   check_list(list);
+  lock_indexes(list);
+  index_destroy(&list->long_name_index);
+  unlock_indexes(list);
   list->long_namefunc = long_namefunc;
 }
 
@@ -611,6 +902,7 @@ stp_list_item_create(stp_list_t *list,
     lnn = next;
 
   /* got lnp; now insert the new ln */
+  lock_indexes(list);
 
   /* set next */
   ln->next = lnn;
@@ -645,6 +937,11 @@ stp_list_item_create(stp_list_t *list,
   /* increment reference count */
   list->length++;
 
+  ln->list = list;
+  index_node_added(list, ln, !list->sortfunc && !lnn);
+  unlock_indexes(list);
+  touch_list(list);
+
   stp_deprintf(STP_DBG_LIST, "stp_list_node constructor\n");
   return 0;
 }
@@ -656,11 +953,11 @@ stp_list_item_destroy(stp_list_t *list, stp_list_item_t *item)
   check_list(list);
 
   clear_cache(list);
+  lock_indexes(list);
+  index_node_removed(list, item);
   /* decrement reference count */
   list->length--;
 
-  if (list->freefunc)
-    list->freefunc((void *) item->data);
   if (item->prev)
     item->prev->next = item->next;
   else
@@ -669,6 +966,10 @@ stp_list_item_destroy(stp_list_t *list, stp_list_item_t *item)
     item->next->prev = item->prev;
   else
     list->end = item->prev;
+  unlock_indexes(list);
+  touch_list(list);
+  if (list->freefunc)
+    list->freefunc((void *) item->data);
   stp_free(item);
 
   stp_deprintf(STP_DBG_LIST, "stp_list_node destructor\n");
@@ -702,6 +1003,12 @@ stp_list_item_set_data(stp_list_item_t *item, void *data)
 {
   if (data)
     {
+      /* The name of the node may have changed */
+      lock_indexes(item->list);
+      index_destroy(&item->list->name_index);
+      index_destroy(&item->list->long_name_index);
+      unlock_indexes(item->list);
+      touch_list(item->list);
       item->data = data;
       return 0;
     }
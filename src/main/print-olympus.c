@@ -37,7 +37,11 @@
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <math.h>
 #include <time.h>  /* For strftime() and localtime_r() */
+#ifdef STPI_X86_SIMD
+#include <immintrin.h>
+#endif
 #ifdef __GNUC__
 #define inline __inline__
 #endif
@@ -262,7 +266,43 @@ typedef struct
   } privdata;
 } dyesub_privdata_t;
 
+/*
+ * Resampling of the image to the output size.  For each output pixel
+ * (or row), TAPS source columns (or rows) are weighted in fixed point,
+ * the weights adding up to 1 << DYESUB_WEIGHT_BITS.
+ */
+#define DYESUB_WEIGHT_BITS	14
+
+typedef enum {
+  DYESUB_RESAMPLE_POINT,
+  DYESUB_RESAMPLE_BOX,
+  DYESUB_RESAMPLE_BILINEAR,
+  DYESUB_RESAMPLE_BICUBIC,
+  DYESUB_RESAMPLE_LANCZOS
+} dyesub_resample_t;
+
+typedef struct {
+  int taps;
+  int *index;		/* taps source indices per output pixel */
+  int *weight;		/* taps weights per output pixel */
+} dyesub_scale_t;
+
+/* Working storage for dyesub_resample_row() */
 typedef struct {
+  int *acc;
+  unsigned short *line;		/* Image after the vertical pass */
+  unsigned short *row;		/* Image after both passes */
+  int row_number;		/* Output row in row, or -1 */
+} dyesub_resample_buf_t;
+
+typedef struct dyesub_print_vars dyesub_print_vars_t;
+
+/* Render a resampled row; see dyesub_select_row_func() */
+typedef void dyesub_row_func_t(const dyesub_print_vars_t *pv,
+			       const unsigned short *src,
+			       unsigned char *dest, int plane);
+
+struct dyesub_print_vars {
   int out_channels;
   int ink_channels;
   const char *ink_order;
@@ -272,14 +312,26 @@ typedef struct {
   int plane_interlacing;
   int row_interlacing;
   unsigned char empty_byte[MAX_INK_CHANNELS];  /* one for each color plane */
-  unsigned short **image_data;
+  unsigned char *image_buffer;	/* See dyesub_image_row() */
+  size_t image_row_size;
+  int image_row_values;
+  int image_8bit;
+  int image_window;
+  int image_failed;
+  stp_image_t *image;
   int outh_px, outw_px, outt_px, outb_px, outl_px, outr_px;
   int imgh_px, imgw_px;
   int prnh_px, prnw_px, prnt_px, prnb_px, prnl_px, prnr_px;
   int print_mode;	/* portrait or landscape */
   int image_rows;
   int plane_lefttoright;
-} dyesub_print_vars_t;
+  dyesub_scale_t hscale, vscale;
+  dyesub_resample_buf_t resample;
+  int ycbcr;				/* Convert RGB to YCbCr */
+  dyesub_row_func_t *render_row;
+  unsigned char *planes[MAX_INK_CHANNELS];  /* See dyesub_render_planes() */
+  size_t plane_row_size;
+};
 
 typedef struct /* printer specific parameters */
 {
@@ -310,6 +362,19 @@ typedef struct /* printer specific parameters */
 
 static const dyesub_cap_t* dyesub_get_model_capabilities(int model);
 static const laminate_t* dyesub_get_laminate_pattern(stp_vars_t *v);
+/*
+ * Matte lamination planes made of random 16-bit values.  Each xrand()
+ * value masked with MASK picks the first value[i] with limit[i] above it.
+ */
+typedef struct {
+  int mask;
+  int count;
+  int limit[4];
+  unsigned short value[4];
+} dyesub_laminate_pattern_t;
+static void dyesub_write_laminate_plane(stp_vars_t *v,
+					const dyesub_laminate_pattern_t *pattern,
+					size_t count);
 static const dyesub_media_t* dyesub_get_mediatype(stp_vars_t *v);
 static void  dyesub_nputc(stp_vars_t *v, char byte, int count);
 static void  dyesub_adjust_curve(stp_vars_t *v,
@@ -4330,6 +4395,15 @@ static void mitsu_cp9800_printer_init(stp_vars_t *v)
   mitsu_cp98xx_printer_init(v, 0x10);
 }
 
+/* The Windows drivers generate a lamination pattern consisting of
+   four values: 0x0202, 0x01f1, 0x0808, 0x0737 in roughly a 16:10:4:1
+   ratio.
+
+   There seem to be some patterns but more analysis is needed.
+*/
+static const dyesub_laminate_pattern_t mitsu_cp9810_matte =
+  { 0x1f, 4, { 16, 26, 30, 32 }, { 0x0202, 0x01f1, 0x0808, 0x0737 } };
+
 static void mitsu_cp9810_printer_end(stp_vars_t *v)
 {
   dyesub_privdata_t *pd = get_privdata(v);
@@ -4344,33 +4418,11 @@ static void mitsu_cp9810_printer_end(stp_vars_t *v)
       *((const char*)((pd->laminate->seq).data)) == 0x01) {
 
     /* Generate a full plane of lamination data */
-
-    /* The Windows drivers generate a lamination pattern consisting of
-       four values: 0x0202, 0x01f1, 0x0808, 0x0737 in roughly a 16:10:4:1
-       ratio.
-
-       There seem to be some patterns but more analysis is needed.
-    */
-
-    int r, c;
-    unsigned long seed = 1;
-
     mitsu_cp3020da_plane_init(v); /* First generate plane header */
 
     /* Now generate lamination pattern */
-    for (c = 0 ; c < pd->w_size ; c++) {
-      for (r = 0 ; r < pd->h_size ; r++) {
-	int i = xrand(&seed) & 0x1f;
-	if (i < 16)
-	  stp_put16_be(0x0202, v);
-	else if (i < 26)
-	  stp_put16_be(0x01f1, v);
-	else if (i < 30)
-	  stp_put16_be(0x0808, v);
-	else
-	  stp_put16_be(0x0737, v);
-      }
-    }
+    dyesub_write_laminate_plane(v, &mitsu_cp9810_matte,
+				(size_t) pd->w_size * pd->h_size);
 
     /* Lamination Footer */
     stp_putc(0x1b, v);
@@ -4633,6 +4685,13 @@ static void mitsu_cpd70x_printer_init(stp_vars_t *v)
 }
 
 #ifndef MITSU70X_8BPP
+/* D70x uses 0x384b, 0x286a, 0x6c22 */
+static const dyesub_laminate_pattern_t mitsu_cpd70x_matte =
+  { 0x3f, 3, { 42, 62, 64 }, { 0xe84b, 0x286a, 0x6c22 } };
+/* K60 and EK305 use 0x9d00, 0x6500, 0x2900 */
+static const dyesub_laminate_pattern_t mitsu_cpk60_matte =
+  { 0x3f, 3, { 42, 62, 64 }, { 0x9d00, 0x2900, 0x6500 } };
+
 static void mitsu_cpd70x_printer_end(stp_vars_t *v)
 {
   dyesub_privdata_t *pd = get_privdata(v);
@@ -4640,30 +4699,11 @@ static void mitsu_cpd70x_printer_end(stp_vars_t *v)
   /* If Matte lamination is enabled, generate a lamination plane */
   if (*((const char*)((pd->laminate->seq).data)) != 0x00) {
 
-    int r, c;
-    unsigned long seed = 1;
-
     /* Now generate lamination pattern */
-    for (c = 0 ; c < pd->w_size ; c++) {
-      for (r = 0 ; r < pd->h_size + pd->privdata.m70x.laminate_offset ; r++) {
-	int i = xrand(&seed) & 0x3f;
-	if (pd->privdata.m70x.laminate_offset) { /* D70x uses 0x384b, 0x286a, 0x6c22 */
-	  if (i < 42)
-	    stp_put16_be(0xe84b, v);
-	  else if (i < 62)
-	    stp_put16_be(0x286a, v);
-	  else
-	    stp_put16_be(0x6c22, v);
-        } else { /* K60 and EK305 use 0x9d00, 0x6500, 0x2900 */
-	  if (i < 42)
-	    stp_put16_be(0x9d00, v);
-	  else if (i < 62)
-	    stp_put16_be(0x2900, v);
-	  else
-	    stp_put16_be(0x6500, v);
-	}
-      }
-    }
+    dyesub_write_laminate_plane(v, (pd->privdata.m70x.laminate_offset ?
+				    &mitsu_cpd70x_matte : &mitsu_cpk60_matte),
+				(size_t) pd->w_size *
+				(pd->h_size + pd->privdata.m70x.laminate_offset));
     /* Pad up to a 512-byte block */
     dyesub_nputc(v, 0x00, 512 - ((pd->w_size * (pd->h_size + pd->privdata.m70x.laminate_offset) * 2) % 512));
   }
@@ -8108,6 +8148,20 @@ static const stp_parameter_t the_parameters[] =
     STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_FEATURE,
     STP_PARAMETER_LEVEL_BASIC, 1, 1, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "Resampling", N_("Image Resampling"), "Color=No,Category=Advanced Printer Setup",
+    N_("Filter used to scale the image to the print size"),
+    STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_FEATURE,
+    STP_PARAMETER_LEVEL_ADVANCED, 1, 1, STP_CHANNEL_NONE, 1, 0
+  },
+  {
+    "PlaneThreads", N_("Plane Rendering Threads"), "Color=No,Category=Advanced Printer Setup",
+    N_("Number of threads used to render all planes of printers that "
+       "are sent one plane at a time before sending the first one.  "
+       "0 renders each plane as it is sent.  Output is the same either way."),
+    STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_FEATURE,
+    STP_PARAMETER_LEVEL_ADVANCED, 0, 1, STP_CHANNEL_NONE, 1, 0
+  },
   {
     "NativeCopies", N_("Printer Generates Copies Natively"), "Color=No,Category=Job Mode",
     N_("Printer Generates Copies"),
@@ -8181,6 +8235,20 @@ static const stp_param_string_t duplex_types[] =
 };
 #define NUM_DUPLEX (sizeof (duplex_types) / sizeof (stp_param_string_t))
 
+/*
+ * Resampling filters.  The internal names are used by dyesub_do_print().
+ */
+
+static const stp_param_string_t resample_types[] =
+{
+  { "Point",            N_ ("Nearest Neighbor") },
+  { "Box",              N_ ("Area Average") },
+  { "Bilinear",         N_ ("Bilinear") },
+  { "Bicubic",          N_ ("Bicubic") },
+  { "Lanczos",          N_ ("Lanczos") }
+};
+#define NUM_RESAMPLE (sizeof (resample_types) / sizeof (stp_param_string_t))
+
 static const dyesub_cap_t* dyesub_get_model_capabilities(int model)
 {
   int i;
@@ -8214,6 +8282,52 @@ static const laminate_t* dyesub_get_laminate_pattern(stp_vars_t *v)
   return l;
 }
 
+static unsigned short
+dyesub_laminate_value(const dyesub_laminate_pattern_t *pattern,
+		      unsigned long *seed)
+{
+  int r = xrand(seed) & pattern->mask;
+  int i;
+  for (i = 0; i < pattern->count - 1; i++)
+    if (r < pattern->limit[i])
+      break;
+  return pattern->value[i];
+}
+
+/*
+ * Write COUNT values of PATTERN, big-endian.  A plane is several
+ * megabytes and is written only once per page, so the values are
+ * generated into a fixed buffer and written a buffer at a time rather
+ * than kept.
+ */
+#define LAMINATE_BUFFER_VALUES (32768)
+
+static void
+dyesub_write_laminate_plane(stp_vars_t *v,
+			    const dyesub_laminate_pattern_t *pattern,
+			    size_t count)
+{
+  unsigned char *buf = stp_malloc(LAMINATE_BUFFER_VALUES * 2);
+  unsigned long seed = 1;
+
+  while (count > 0)
+    {
+      size_t n = count;
+      size_t i;
+      if (n > LAMINATE_BUFFER_VALUES)
+	n = LAMINATE_BUFFER_VALUES;
+      for (i = 0; i < n; i++)
+	{
+	  unsigned short val = dyesub_laminate_value(pattern, &seed);
+	  buf[2 * i] = val >> 8;
+	  buf[2 * i + 1] = val & 0xff;
+	}
+      stp_zfwrite((const char *) buf, n * 2, 1, v);
+      count -= n;
+    }
+  stp_free(buf);
+}
+
 static const dyesub_media_t* dyesub_get_mediatype(stp_vars_t *v)
 {
   const char *mpar = stp_get_string_parameter(v, "MediaType");
@@ -8457,6 +8571,23 @@ dyesub_parameters(const stp_vars_t *v, const char *name,
       else
         description->is_active = 0;
     }
+  else if (strcmp(name, "Resampling") == 0)
+    {
+      description->bounds.str = stp_string_list_create();
+      for (i = 0; i < NUM_RESAMPLE; i++)
+	stp_string_list_add_string(description->bounds.str,
+				   resample_types[i].name,
+				   gettext(resample_types[i].text));
+      description->deflt.str = resample_types[0].name;
+    }
+  else if (strcmp(name, "PlaneThreads") == 0)
+    {
+      description->bounds.integer.lower = 0;
+      description->bounds.integer.upper = MAX_INK_CHANNELS;
+      description->deflt.integer = 0;
+      if (!dyesub_feature(caps, DYESUB_FEATURE_PLANE_INTERLACE))
+	description->is_active = 0;
+    }
   else
     description->is_active = 0;
 }
@@ -8671,14 +8802,6 @@ dyesub_swap_ints(int *a, int *b)
   *b = t;
 }
 
-static void
-dyesub_swap_doubles(double *a, double *b)
-{
-  double t = *a;
-  *a = *b;
-  *b = t;
-}
-
 static void
 dyesub_adjust_curve(stp_vars_t *v,
 		const char *color_adj,
@@ -8729,66 +8852,476 @@ dyesub_interpolate(int oldval, int oldsize, int newsize)
   return ((double)oldval * (double)newsize / (double)oldsize);
 }
 
+#define DYESUB_PI 3.14159265358979323846
+
+static double
+dyesub_filter_support(dyesub_resample_t filter)
+{
+  switch (filter)
+    {
+    case DYESUB_RESAMPLE_BOX:
+      return 0.5;
+    case DYESUB_RESAMPLE_BILINEAR:
+      return 1.0;
+    case DYESUB_RESAMPLE_BICUBIC:
+      return 2.0;
+    case DYESUB_RESAMPLE_LANCZOS:
+      return 3.0;
+    default:
+      return 0.0;
+    }
+}
+
+static double
+dyesub_filter(dyesub_resample_t filter, double x)
+{
+  x = fabs(x);
+  switch (filter)
+    {
+    case DYESUB_RESAMPLE_BOX:
+      return x <= 0.5 ? 1.0 : 0.0;
+    case DYESUB_RESAMPLE_BILINEAR:
+      return x < 1.0 ? 1.0 - x : 0.0;
+    case DYESUB_RESAMPLE_BICUBIC:	/* Keys, a = -0.5 */
+      if (x < 1.0)
+	return (1.5 * x - 2.5) * x * x + 1.0;
+      else if (x < 2.0)
+	return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+      return 0.0;
+    case DYESUB_RESAMPLE_LANCZOS:	/* Three lobes */
+      if (x < 1e-8)
+	return 1.0;
+      else if (x < 3.0)
+	return 3.0 * sin(DYESUB_PI * x) * sin(DYESUB_PI * x / 3.0) /
+	  (DYESUB_PI * DYESUB_PI * x * x);
+      return 0.0;
+    default:
+      return 0.0;
+    }
+}
+
+static int
+dyesub_scale_alloc(dyesub_scale_t *s, int taps, int outsize)
+{
+  s->taps = taps;
+  s->index = stp_malloc(sizeof(int) * taps * outsize);
+  s->weight = stp_malloc(sizeof(int) * taps * outsize);
+  return s->index && s->weight;
+}
+
 static void
-dyesub_free_image(dyesub_print_vars_t *pv, stp_image_t *image)
+dyesub_scale_free(dyesub_scale_t *s)
+{
+  STP_SAFE_FREE(s->index);
+  STP_SAFE_FREE(s->weight);
+}
+
+/*
+ * Sample INSIZE pixels to OUTSIZE pixels with FILTER, widened to cover
+ * all of the source pixels when reducing.  Pixels past the edges repeat
+ * the edge pixels.  If FLIP is set, the source is indexed from the end.
+ */
+static int
+dyesub_scale_init(dyesub_scale_t *s, dyesub_resample_t filter,
+		  int outsize, int insize, int flip)
+{
+  double scale = (double) insize / (double) outsize;
+  double fscale = scale > 1.0 ? scale : 1.0;
+  double support = dyesub_filter_support(filter) * fscale;
+  double *w;
+  int o, t;
+
+  if (insize == outsize)
+    {
+      if (!dyesub_scale_alloc(s, 1, outsize))
+	return 0;
+      for (o = 0; o < outsize; o++)
+	{
+	  s->index[o] = flip ? insize - 1 - o : o;
+	  s->weight[o] = 1 << DYESUB_WEIGHT_BITS;
+	}
+      return 1;
+    }
+
+  if (!dyesub_scale_alloc(s, (int) ceil(2.0 * support) + 1, outsize))
+    return 0;
+  w = stp_malloc(sizeof(double) * s->taps);
+  for (o = 0; o < outsize; o++)
+    {
+      double center = (o + 0.5) * scale;
+      int first = (int) ceil(center - support - 0.5);
+      int *index = s->index + o * s->taps;
+      int *weight = s->weight + o * s->taps;
+      double total = 0.0;
+      int sum = 0;
+      int biggest = 0;
+
+      for (t = 0; t < s->taps; t++)
+	{
+	  w[t] = dyesub_filter(filter, (first + t + 0.5 - center) / fscale);
+	  total += w[t];
+	}
+      for (t = 0; t < s->taps; t++)
+	{
+	  int x = first + t;
+	  if (x < 0)
+	    x = 0;
+	  else if (x >= insize)
+	    x = insize - 1;
+	  index[t] = flip ? insize - 1 - x : x;
+	  weight[t] = (int) floor(w[t] / total * (1 << DYESUB_WEIGHT_BITS) + 0.5);
+	  sum += weight[t];
+	  if (weight[t] > weight[biggest])
+	    biggest = t;
+	}
+      /* Make the weights add up exactly */
+      weight[biggest] += (1 << DYESUB_WEIGHT_BITS) - sum;
+    }
+  stp_free(w);
+  return 1;
+}
+
+static int
+dyesub_resample_buf_init(const dyesub_print_vars_t *pv,
+			 dyesub_resample_buf_t *buf)
+{
+  size_t line_size = (size_t) pv->imgw_px * pv->out_channels;
+  buf->acc = stp_malloc(sizeof(int) * line_size);
+  buf->line = stp_malloc(sizeof(unsigned short) * line_size);
+  buf->row = stp_malloc(sizeof(unsigned short) *
+			pv->outw_px * pv->out_channels);
+  buf->row_number = -1;
+  return buf->acc && buf->line && buf->row;
+}
+
+static void
+dyesub_resample_buf_free(dyesub_resample_buf_t *buf)
+{
+  STP_SAFE_FREE(buf->acc);
+  STP_SAFE_FREE(buf->line);
+  STP_SAFE_FREE(buf->row);
+}
+
+static void
+dyesub_resample_free(dyesub_print_vars_t *pv)
+{
+  dyesub_scale_free(&pv->hscale);
+  dyesub_scale_free(&pv->vscale);
+  dyesub_resample_buf_free(&pv->resample);
+}
+
+/*
+ * Build the tables mapping the output area to the image, after the
+ * dimensions have been swapped for landscape printing.  In landscape
+ * mode output rows run along image columns, and output columns along
+ * image rows from the bottom up, so the vertical table indexes image
+ * columns and the horizontal table image rows.
+ */
+static int
+dyesub_resample_init(dyesub_print_vars_t *pv, dyesub_resample_t filter)
+{
+  int landscape = (pv->print_mode == DYESUB_LANDSCAPE);
+  int i;
+
+  if (filter == DYESUB_RESAMPLE_POINT)
+    {
+      /* Pick the same single pixel that earlier releases did */
+      if (!dyesub_scale_alloc(&pv->vscale, 1, pv->outh_px) ||
+	  !dyesub_scale_alloc(&pv->hscale, 1, pv->outw_px))
+	return 0;
+      for (i = 0; i < pv->outh_px; i++)
+	{
+	  pv->vscale.index[i] =
+	    (int) dyesub_interpolate(i, pv->outh_px, pv->imgh_px);
+	  pv->vscale.weight[i] = 1 << DYESUB_WEIGHT_BITS;
+	}
+      for (i = 0; i < pv->outw_px; i++)
+	{
+	  double col = dyesub_interpolate(i, pv->outw_px, pv->imgw_px);
+	  if (pv->plane_lefttoright)
+	    col = pv->imgw_px - col - 1;
+	  if (landscape)
+	    col = (pv->imgw_px - 1) - col;
+	  pv->hscale.index[i] = (int) col;
+	  pv->hscale.weight[i] = 1 << DYESUB_WEIGHT_BITS;
+	}
+    }
+  else if (!dyesub_scale_init(&pv->vscale, filter, pv->outh_px,
+			      pv->imgh_px, 0) ||
+	   !dyesub_scale_init(&pv->hscale, filter, pv->outw_px,
+			      pv->imgw_px, landscape != pv->plane_lefttoright))
+    return 0;
+
+  return dyesub_resample_buf_init(pv, &pv->resample);
+}
+
+/*
+ * The image is kept in one buffer of image_row_size bytes per row,
+ * with 8 bits per channel (the value divided by 257) if image_8bit is
+ * set.  When streaming, the buffer holds only the last image_window
+ * rows read, and rows are read as dyesub_stream_image() needs them.
+ */
+static inline const void *
+dyesub_image_row(const dyesub_print_vars_t *pv, int row)
 {
-  unsigned short** image_data = pv->image_data;
-  int image_px_height = pv->image_rows;
+  if (pv->image_window)
+    row %= pv->image_window;
+  return pv->image_buffer + (size_t) row * pv->image_row_size;
+}
+
+/* Return image row ROW with 16 bits per channel, widened into BUF if need be */
+static const unsigned short *
+dyesub_image_row16(const dyesub_print_vars_t *pv, int row, unsigned short *buf)
+{
+  const unsigned char *data = dyesub_image_row(pv, row);
   int i;
 
-  for (i = 0; i< image_px_height; i++)
-    if (image_data[i])
-      stp_free(image_data[i]);
-  if (image_data)
-    stp_free(image_data);
+  if (!pv->image_8bit)
+    return (const unsigned short *) data;
+  for (i = 0; i < pv->image_row_values; i++)
+    buf[i] = data[i] * 257;
+  return buf;
+}
+
+static void
+dyesub_free_image(dyesub_print_vars_t *pv, stp_image_t *image)
+{
+  STP_SAFE_FREE(pv->image_buffer);
+}
+
+static int
+dyesub_alloc_image(dyesub_print_vars_t *pv, stp_image_t *image, int rows)
+{
+  pv->image_row_values = stp_image_width(image) * pv->ink_channels;
+  pv->image_row_size = pv->image_row_values *
+    (pv->image_8bit ? sizeof(char) : sizeof(short));
+  pv->image_rows = 0;
+  pv->image_buffer = stp_malloc(pv->image_row_size * rows);
+  return pv->image_buffer != NULL;
+}
+
+static int
+dyesub_read_row(stp_vars_t *v,
+		dyesub_print_vars_t *pv,
+		stp_image_t *image)
+{
+  unsigned int zero_mask;
+  int row = pv->image_rows;
+  unsigned char *dest;
+
+  if (stp_color_get_row(v, image, row, &zero_mask))
+    {
+      stp_deprintf(STP_DBG_DYESUB,
+		   "dyesub_read_image: "
+		   "stp_color_get_row(..., %d, ...) == 0\n", row);
+      return 0;
+    }
+  dest = (unsigned char *) dyesub_image_row(pv, row);
+  if (pv->image_8bit)
+    {
+      const unsigned short *src = stp_channel_get_output(v);
+      int i;
+      for (i = 0; i < pv->image_row_values; i++)
+	dest[i] = src[i] / 257;
+    }
+  else
+    memcpy(dest, stp_channel_get_output(v), pv->image_row_size);
+  pv->image_rows = row + 1;
+  return 1;
 }
 
-static unsigned short **
+static int
 dyesub_read_image(stp_vars_t *v,
 		dyesub_print_vars_t *pv,
 		stp_image_t *image)
 {
-  int image_px_width  = stp_image_width(image);
   int image_px_height = stp_image_height(image);
-  int row_size = image_px_width * pv->ink_channels * sizeof(short);
-  unsigned short **image_data;
-  unsigned int zero_mask;
   int i;
 
-  image_data = stp_zalloc(image_px_height * sizeof(unsigned short *));
-  pv->image_rows = 0;
-  if (!image_data)
-    return NULL;	/* ? out of memory ? */
-
+  if (!dyesub_alloc_image(pv, image, image_px_height))
+    {
+      stp_deprintf(STP_DBG_DYESUB,
+		   "dyesub_read_image: cannot allocate %d rows\n",
+		   image_px_height);
+      return 0;	/* ? out of memory ? */
+    }
   for (i = 0; i < image_px_height; i++)
+    if (!dyesub_read_row(v, pv, image))
+      {
+	dyesub_free_image(pv, image);
+	return 0;
+      }
+  return 1;
+}
+
+/*
+ * Set up to read the image while printing, keeping only as many rows as
+ * any output row is scaled from.  The rows for each output row follow
+ * (or overlap) those for the row before it.
+ */
+static int
+dyesub_stream_init(dyesub_print_vars_t *pv, stp_image_t *image)
+{
+  int window = 1;
+  int o, t;
+
+  for (o = 0; o < pv->outh_px; o++)
     {
-      if (stp_color_get_row(v, image, i, &zero_mask))
-        {
-	  stp_deprintf(STP_DBG_DYESUB,
-	  	"dyesub_read_image: "
-		"stp_color_get_row(..., %d, ...) == 0\n", i);
-	  dyesub_free_image(pv, image);
-	  return NULL;
+      const int *index = pv->vscale.index + o * pv->vscale.taps;
+      int lo = index[0], hi = index[0];
+      for (t = 1; t < pv->vscale.taps; t++)
+	{
+	  if (index[t] < lo)
+	    lo = index[t];
+	  if (index[t] > hi)
+	    hi = index[t];
 	}
-      image_data[i] = stp_malloc(row_size);
-      pv->image_rows = i+1;
-      if (!image_data[i])
-        {
-	  stp_deprintf(STP_DBG_DYESUB,
-	  	"dyesub_read_image: "
-		"(image_data[%d] = stp_malloc()) == NULL\n", i);
-	  dyesub_free_image(pv, image);
-	  return NULL;
+      if (hi - lo + 1 > window)
+	window = hi - lo + 1;
+    }
+  stp_deprintf(STP_DBG_DYESUB, "dyesub: streaming, %d row window\n", window);
+  pv->image_window = window;
+  return dyesub_alloc_image(pv, image, window);
+}
+
+/* Read the image rows needed for output row OUT_ROW */
+static int
+dyesub_stream_image(stp_vars_t *v, dyesub_print_vars_t *pv, int out_row)
+{
+  const int *index = pv->vscale.index + out_row * pv->vscale.taps;
+  int last = index[0];
+  int t;
+
+  for (t = 1; t < pv->vscale.taps; t++)
+    if (index[t] > last)
+      last = index[t];
+  while (pv->image_rows <= last)
+    if (!dyesub_read_row(v, pv, pv->image))
+      return 0;
+  return 1;
+}
+
+static inline unsigned short
+dyesub_resample_value(int sum)
+{
+  if (sum <= 0)
+    return 0;
+  sum = (sum + (1 << (DYESUB_WEIGHT_BITS - 1))) >> DYESUB_WEIGHT_BITS;
+  return sum > 65535 ? 65535 : sum;
+}
+
+/*
+ * Return output row OUT_ROW (counted from the top of the image area)
+ * scaled from the image, with out_channels values per pixel.  The image
+ * is filtered vertically into BUF->line, and that horizontally.
+ */
+static const unsigned short *
+dyesub_resample_row(const dyesub_print_vars_t *pv, dyesub_resample_buf_t *buf,
+		    int out_row)
+{
+  int ch = pv->out_channels;
+  int vtaps = pv->vscale.taps;
+  int htaps = pv->hscale.taps;
+  const int *vindex = pv->vscale.index + out_row * vtaps;
+  const int *vweight = pv->vscale.weight + out_row * vtaps;
+  const unsigned short *line = buf->line;
+  unsigned short *out = buf->row;
+  int i, k, t;
+
+  if (out_row == buf->row_number)
+    return out;
+
+  if (pv->print_mode == DYESUB_LANDSCAPE)
+    {
+      for (i = 0; i < pv->imgw_px; i++)
+	{
+	  const unsigned short *src = dyesub_image_row(pv, i);
+	  const unsigned char *src8 = dyesub_image_row(pv, i);
+	  for (k = 0; k < ch; k++)
+	    {
+	      int sum = 0;
+	      if (pv->image_8bit)
+		for (t = 0; t < vtaps; t++)
+		  sum += vweight[t] * 257 * src8[vindex[t] * ch + k];
+	      else
+		for (t = 0; t < vtaps; t++)
+		  sum += vweight[t] * src[vindex[t] * ch + k];
+	      buf->line[i * ch + k] = dyesub_resample_value(sum);
+	    }
+	}
+    }
+  else if (vtaps == 1)
+    line = dyesub_image_row16(pv, vindex[0], buf->line);
+  else
+    {
+      int width = pv->imgw_px * ch;
+      int *acc = buf->acc;
+      memset(acc, 0, sizeof(int) * width);
+      for (t = 0; t < vtaps; t++)
+	{
+	  const unsigned short *src;
+	  int weight = vweight[t];
+	  if (weight == 0)
+	    continue;
+	  src = dyesub_image_row16(pv, vindex[t], buf->line);
+	  for (i = 0; i < width; i++)
+	    acc[i] += weight * src[i];
+	}
+      for (i = 0; i < width; i++)
+	buf->line[i] = dyesub_resample_value(acc[i]);
+    }
+
+  if (htaps == 1)
+    {
+      for (i = 0; i < pv->outw_px; i++)
+	for (k = 0; k < ch; k++)
+	  out[i * ch + k] = line[pv->hscale.index[i] * ch + k];
+    }
+  else
+    {
+      for (i = 0; i < pv->outw_px; i++)
+	{
+	  const int *hindex = pv->hscale.index + i * htaps;
+	  const int *hweight = pv->hscale.weight + i * htaps;
+	  for (k = 0; k < ch; k++)
+	    {
+	      int sum = 0;
+	      for (t = 0; t < htaps; t++)
+		sum += hweight[t] * line[hindex[t] * ch + k];
+	      out[i * ch + k] = dyesub_resample_value(sum);
+	    }
 	}
-      memcpy(image_data[i], stp_channel_get_output(v), row_size);
     }
-  return image_data;
+  buf->row_number = out_row;
+  return out;
+}
+
+/*
+ * RGB -> YCbCr (JPEG YCbCr444 coefficients), 16 bits per channel.  The
+ * coefficients are exact in millionths, so a neutral gray keeps its
+ * value in Y.
+ */
+static inline unsigned short
+dyesub_rgb_to_y(long long R, long long G, long long B)
+{
+  return (299 * R + 587 * G + 114 * B) / 1000;
+}
+
+static inline unsigned short
+dyesub_rgb_to_cb(long long R, long long G, long long B)
+{
+  return (-168736 * R - 331264 * G + 500000 * B + 32768000000LL) / 1000000;
+}
+
+static inline unsigned short
+dyesub_rgb_to_cr(long long R, long long G, long long B)
+{
+  return (500000 * R - 418688 * G - 81312 * B + 32768000000LL) / 1000000;
 }
 
 static void
-dyesub_render_pixel(unsigned short *src, char *dest,
-		    dyesub_print_vars_t *pv,
-		    const dyesub_cap_t *caps,
+dyesub_render_pixel(const unsigned short *src, char *dest,
+		    const dyesub_print_vars_t *pv,
 		    int plane)
 {
   unsigned short ink[MAX_INK_CHANNELS]; /* What is sent to printer */
@@ -8812,20 +9345,14 @@ dyesub_render_pixel(unsigned short *src, char *dest,
   for (i = start; i < end; i++)
     {
 #ifndef CANONSELPHYNEO_CMY
-      if (dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR))
+      if (pv->ycbcr)
         {
-	  /* Convert RGB -> YCbCr (JPEG YCbCr444 coefficients) */
-	  double R, G, B;
-	  R = src[0];
-	  G = src[1];
-	  B = src[2];
-
 	  if (i == 0) /* Y */
-	    ink[i] = R * 0.299 + G * 0.587 + B * 0.114;
+	    ink[i] = dyesub_rgb_to_y(src[0], src[1], src[2]);
 	  else if (i == 1) /* Cb */
-	    ink[i] = R * -0.168736 + G * -0.331264 + B * 0.5 + (1 << (16 -1)); // Math is 16bpp here.
+	    ink[i] = dyesub_rgb_to_cb(src[0], src[1], src[2]);
 	  else if (i == 2) /* Cr */
-	    ink[i] = R * 0.5 + G * -0.418688 + B * -0.081312 + (1 << (16 -1)); // Math is 16bpp here.
+	    ink[i] = dyesub_rgb_to_cr(src[0], src[1], src[2]);
 	    /* FIXME:  Natively support YCbCr "inks" in the
 	       Gutenprint core and allow that as an input
 	       into the dyesub driver. */
@@ -8843,7 +9370,7 @@ dyesub_render_pixel(unsigned short *src, char *dest,
 #ifndef CANONSELPHYNEO_CMY
 #if 0
 	  /* FIXME:  Do we want to round? */
-          if (dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR))
+          if (pv->ycbcr)
             ink_u8[i] = ink[i] >> 8;
 	  else
 #endif
@@ -8873,38 +9400,380 @@ dyesub_render_pixel(unsigned short *src, char *dest,
 	     pv->bytes_per_ink_channel);
 }
 
+/*
+ * Row kernels.  Each renders the outw_px pixels of a resampled row (see
+ * dyesub_resample_row()) into the printer's format; PLANE is the ink
+ * channel to render when planes or rows are interlaced.  One is picked
+ * for the job by dyesub_select_row_func(); dyesub_row_generic() handles
+ * any combination that has no kernel of its own.
+ */
+
+static void
+dyesub_row_generic(const dyesub_print_vars_t *pv, const unsigned short *src,
+		   unsigned char *dest, int plane)
+{
+  int bpp = ((pv->plane_interlacing || pv->row_interlacing) ? 1 :
+	     pv->ink_channels) * pv->bytes_per_ink_channel;
+  int w;
+
+  for (w = 0; w < pv->outw_px; w++)
+    dyesub_render_pixel(src + w * pv->out_channels, (char *) dest + w * bpp,
+			pv, plane);
+}
+
+static void
+dyesub_row_plane_8(const dyesub_print_vars_t *pv, const unsigned short *src,
+		   unsigned char *dest, int plane)
+{
+  int ch = pv->out_channels;
+  int w;
+
+  src += plane;
+  for (w = 0; w < pv->outw_px; w++)
+    dest[w] = src[w * ch] / 257;
+}
+
+static void
+dyesub_row_plane_16(const dyesub_print_vars_t *pv, const unsigned short *src,
+		    unsigned char *dest, int plane)
+{
+  int ch = pv->out_channels;
+  int shift = 16 - pv->bits_per_ink_channel;
+  int w;
+
+  src += plane;
+  for (w = 0; w < pv->outw_px; w++)
+    {
+      unsigned short ink = src[w * ch] >> shift;
+      memcpy(dest + 2 * w, &ink, 2);
+    }
+}
+
+static void
+dyesub_row_plane_16_swapped(const dyesub_print_vars_t *pv,
+			    const unsigned short *src,
+			    unsigned char *dest, int plane)
+{
+  int ch = pv->out_channels;
+  int shift = 16 - pv->bits_per_ink_channel;
+  int w;
+
+  src += plane;
+  for (w = 0; w < pv->outw_px; w++)
+    {
+      unsigned short ink = src[w * ch] >> shift;
+      ink = ((ink >> 8) & 0xff) | ((ink & 0xff) << 8);
+      memcpy(dest + 2 * w, &ink, 2);
+    }
+}
+
+/* Inks in the same order as the channels, so the row is one run */
+static void
+dyesub_row_direct_8(const dyesub_print_vars_t *pv, const unsigned short *src,
+		    unsigned char *dest, int plane)
+{
+  int count = pv->outw_px * pv->out_channels;
+  int i;
+
+  for (i = 0; i < count; i++)
+    dest[i] = src[i] / 257;
+}
+
+static void
+dyesub_row_packed_8(const dyesub_print_vars_t *pv, const unsigned short *src,
+		    unsigned char *dest, int plane)
+{
+  int ch = pv->out_channels;
+  int w, i;
+
+  for (w = 0; w < pv->outw_px; w++)
+    for (i = 0; i < ch; i++)
+      dest[w * ch + i] = src[w * ch + pv->ink_order[i] - 1] / 257;
+}
+
+static void
+dyesub_row_packed_16(const dyesub_print_vars_t *pv, const unsigned short *src,
+		     unsigned char *dest, int plane)
+{
+  int ch = pv->out_channels;
+  int shift = 16 - pv->bits_per_ink_channel;
+  int w, i;
+
+  for (w = 0; w < pv->outw_px; w++)
+    for (i = 0; i < ch; i++)
+      {
+	unsigned short ink = src[w * ch + pv->ink_order[i] - 1] >> shift;
+	if (pv->byteswap)
+	  ink = ((ink >> 8) & 0xff) | ((ink & 0xff) << 8);
+	memcpy(dest + 2 * (w * ch + i), &ink, 2);
+      }
+}
+
+#ifndef CANONSELPHYNEO_CMY
+static void
+dyesub_row_ycbcr_8(const dyesub_print_vars_t *pv, const unsigned short *src,
+		   unsigned char *dest, int plane)
+{
+  int ch = pv->out_channels;
+  int w;
+
+  if (plane == 0)
+    for (w = 0; w < pv->outw_px; w++, src += ch)
+      dest[w] = dyesub_rgb_to_y(src[0], src[1], src[2]) / 257;
+  else if (plane == 1)
+    for (w = 0; w < pv->outw_px; w++, src += ch)
+      dest[w] = dyesub_rgb_to_cb(src[0], src[1], src[2]) / 257;
+  else
+    for (w = 0; w < pv->outw_px; w++, src += ch)
+      dest[w] = dyesub_rgb_to_cr(src[0], src[1], src[2]) / 257;
+}
+#endif
+
+#ifdef STPI_X86_SIMD
+/*
+ * v / 257 for 16 bit v is (v * 65281) >> 24.
+ */
+STPI_TARGET_AVX2 static inline __m128i
+dyesub_scale_8_avx2(__m256i v)
+{
+  v = _mm256_srli_epi16(_mm256_mulhi_epu16(v, _mm256_set1_epi16((short) 65281)),
+			8);
+  v = _mm256_packus_epi16(v, v);
+  return _mm256_castsi256_si128(_mm256_permute4x64_epi64(v, 0x08));
+}
+
+STPI_TARGET_AVX2 static void
+dyesub_row_plane_8_avx2(const dyesub_print_vars_t *pv,
+			const unsigned short *src,
+			unsigned char *dest, int plane)
+{
+  int ch = pv->out_channels;
+  int width = pv->outw_px;
+  __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+				     _mm256_set1_epi32(ch));
+  __m256i mask = _mm256_set1_epi32(0xffff);
+  int w = 0;
+
+  src += plane;
+  /* Each gather loads 32 bits, so stay clear of the end of the row */
+  for (; w + 16 <= width && (w + 15) * ch + plane + 1 < width * ch; w += 16)
+    {
+      __m256i lo = _mm256_i32gather_epi32((const int *) (src + w * ch),
+					  index, 2);
+      __m256i hi = _mm256_i32gather_epi32((const int *) (src + (w + 8) * ch),
+					  index, 2);
+      __m256i v = _mm256_packus_epi32(_mm256_and_si256(lo, mask),
+				      _mm256_and_si256(hi, mask));
+      v = _mm256_permute4x64_epi64(v, 0xd8);
+      _mm_storeu_si128((__m128i *) (dest + w), dyesub_scale_8_avx2(v));
+    }
+  for (; w < width; w++)
+    dest[w] = src[w * ch] / 257;
+}
+
+STPI_TARGET_AVX2 static void
+dyesub_row_direct_8_avx2(const dyesub_print_vars_t *pv,
+			 const unsigned short *src,
+			 unsigned char *dest, int plane)
+{
+  int count = pv->outw_px * pv->out_channels;
+  int i = 0;
+
+  for (; i + 16 <= count; i += 16)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+      _mm_storeu_si128((__m128i *) (dest + i), dyesub_scale_8_avx2(v));
+    }
+  for (; i < count; i++)
+    dest[i] = src[i] / 257;
+}
+#endif
+
+static void
+dyesub_select_row_func(dyesub_print_vars_t *pv)
+{
+  int interlaced = pv->plane_interlacing || pv->row_interlacing;
+  int direct = 1;
+  int i;
+
+  for (i = 0; i < pv->ink_channels; i++)
+    if (pv->ink_order[i] != i + 1)
+      direct = 0;
+
+  pv->render_row = dyesub_row_generic;
+  if (pv->out_channels != pv->ink_channels)
+    return;
+#ifndef CANONSELPHYNEO_CMY
+  if (pv->ycbcr)
+    {
+      if (interlaced && pv->bytes_per_ink_channel == 1 &&
+	  pv->out_channels >= 3)
+	pv->render_row = dyesub_row_ycbcr_8;
+    }
+  else
+#endif
+  if (interlaced && pv->bytes_per_ink_channel == 1)
+    {
+      pv->render_row = dyesub_row_plane_8;
+#ifdef STPI_X86_SIMD
+      if (STPI_CPU_HAS_AVX2())
+	pv->render_row = dyesub_row_plane_8_avx2;
+#endif
+    }
+  else if (interlaced)
+    pv->render_row = (pv->byteswap ? dyesub_row_plane_16_swapped :
+		      dyesub_row_plane_16);
+  else if (pv->bytes_per_ink_channel == 1 && direct)
+    {
+      pv->render_row = dyesub_row_direct_8;
+#ifdef STPI_X86_SIMD
+      if (STPI_CPU_HAS_AVX2())
+	pv->render_row = dyesub_row_direct_8_avx2;
+#endif
+    }
+  else if (pv->bytes_per_ink_channel == 1)
+    pv->render_row = dyesub_row_packed_8;
+  else
+    pv->render_row = dyesub_row_packed_16;
+}
+
 static void
 dyesub_render_row(stp_vars_t *v,
 		  dyesub_print_vars_t *pv,
-		  const dyesub_cap_t *caps,
-		  double in_row,
+		  int out_row,
 		  char *dest,
-		  int bytes_per_pixel,
 		  int plane)
 {
-  int w;
-  unsigned short *src;
+  if (pv->image_window && !pv->image_failed &&
+      !dyesub_stream_image(v, pv, out_row))
+    pv->image_failed = 1;
+  if (pv->image_failed)
+    {
+      /* Leave the rest of the page blank */
+      int bpp = ((pv->plane_interlacing || pv->row_interlacing) ? 1 :
+		 pv->ink_channels) * pv->bytes_per_ink_channel;
+      memset(dest, pv->empty_byte[plane], pv->outw_px * bpp);
+      return;
+    }
+  (*pv->render_row)(pv, dyesub_resample_row(pv, &pv->resample, out_row),
+		    (unsigned char *) dest, plane);
+}
 
-  for (w = 0; w < pv->outw_px; w++)
+/*
+ * Rendering of all planes before the first one is sent, for printers
+ * that take one plane at a time.  Each job renders a band of image rows
+ * into every plane, so each row is resampled only once.
+ */
+typedef struct {
+  const dyesub_print_vars_t *pv;
+  dyesub_resample_buf_t *bufs;	/* One per job */
+  int njobs;
+} dyesub_plane_job_t;
+
+static void
+dyesub_render_plane_band(void *data, int job)
+{
+  const dyesub_plane_job_t *j = (const dyesub_plane_job_t *) data;
+  const dyesub_print_vars_t *pv = j->pv;
+  int bpp = pv->bytes_per_ink_channel;
+  size_t rowlen = pv->plane_row_size;
+  size_t right = bpp * (pv->prnw_px - pv->outr_px);
+  int first = (int) ((long long) pv->outh_px * job / j->njobs);
+  int last = (int) ((long long) pv->outh_px * (job + 1) / j->njobs);
+  int row, plane;
+
+  for (row = first; row < last; row++)
     {
-      double row = in_row;
-      double col = dyesub_interpolate(w, pv->outw_px, pv->imgw_px);
-      if (pv->plane_lefttoright)
-	col = pv->imgw_px - col - 1;
-      if (pv->print_mode == DYESUB_LANDSCAPE)
-        { /* "rotate" image */
-          dyesub_swap_doubles(&col, &row);
-          row = (pv->imgw_px - 1) - row;
-        }
-      // XXX FIXME:  This is "point" interpolation.  Be smarter!
-      // eg:  Average  (average all pixels that touch this one)
-      //      BiLinear (scale based on linear interpolation)
-      //      BiCubic  (scale based on weighted average, based on proximity)
-      //      Lanczos  (awesome!! but slow)
-      src = &(pv->image_data[(int)row][(int)col * pv->out_channels]);
-
-      dyesub_render_pixel(src, dest + w*bytes_per_pixel,
-			  pv, caps, plane);
+      const unsigned short *src =
+	dyesub_resample_row(pv, &(j->bufs[job]), row);
+      for (plane = 0; plane < pv->ink_channels; plane++)
+	{
+	  unsigned char *dest = pv->planes[plane] + rowlen * row;
+	  if (pv->outl_px > 0)
+	    memset(dest, pv->empty_byte[plane], bpp * pv->outl_px);
+	  if (pv->outr_px < pv->prnw_px)
+	    memset(dest + rowlen - right, pv->empty_byte[plane], right);
+	  (*pv->render_row)(pv, src, dest + bpp * pv->outl_px, plane);
+	}
+    }
+}
+
+static void
+dyesub_free_planes(dyesub_print_vars_t *pv)
+{
+  int i;
+  for (i = 0; i < MAX_INK_CHANNELS; i++)
+    STP_SAFE_FREE(pv->planes[i]);
+}
+
+/*
+ * Render the image rows of every plane with THREADS threads.  Returns 0,
+ * leaving the planes to be rendered as they are printed, if there is not
+ * enough memory.
+ */
+static int
+dyesub_render_planes(dyesub_print_vars_t *pv, int threads)
+{
+  stpi_thread_pool_t *pool = stpi_thread_pool_create(threads);
+  dyesub_plane_job_t job;
+  int status = 1;
+  int i;
+
+  job.pv = pv;
+  job.njobs = pool ? stpi_thread_pool_size(pool) : 1;
+  if (job.njobs > pv->outh_px)
+    job.njobs = pv->outh_px > 0 ? pv->outh_px : 1;
+  job.bufs = stp_zalloc(sizeof(dyesub_resample_buf_t) * job.njobs);
+  pv->plane_row_size = (size_t) pv->prnw_px * pv->bytes_per_ink_channel;
+  for (i = 0; i < pv->ink_channels; i++)
+    if (!(pv->planes[i] = stp_malloc(pv->plane_row_size * pv->outh_px + 1)))
+      status = 0;
+  for (i = 0; i < job.njobs && status; i++)
+    if (!dyesub_resample_buf_init(pv, &(job.bufs[i])))
+      status = 0;
+
+  if (status)
+    stpi_thread_pool_run(pool, job.njobs, dyesub_render_plane_band, &job);
+  else
+    {
+      stp_deprintf(STP_DBG_DYESUB, "dyesub: cannot allocate plane buffers\n");
+      dyesub_free_planes(pv);
+    }
+  for (i = 0; i < job.njobs; i++)
+    dyesub_resample_buf_free(&(job.bufs[i]));
+  stp_free(job.bufs);
+  stpi_thread_pool_destroy(pool);
+  return status;
+}
+
+/*
+ * Rows outside the image area are the same for a whole plane; they are
+ * prepared once, up to DYESUB_BLANK_BYTES worth of them, and runs of them
+ * are sent in as few writes as possible.
+ */
+#define DYESUB_BLANK_BYTES	(65536)
+
+static void
+dyesub_write_blank_rows(stp_vars_t *v,
+			const dyesub_print_vars_t *pv,
+			const char *blank,
+			int blank_rows,
+			size_t rowlen,
+			int plane,
+			int *pending)
+{
+  int count = *pending;
+  *pending = 0;
+  if (!blank)
+    {
+      dyesub_nputc(v, pv->empty_byte[plane], (int) rowlen * count);
+      return;
+    }
+  while (count > 0)
+    {
+      int n = MIN(count, blank_rows);
+      stp_zfwrite(blank, rowlen, n, v);
+      count -= n;
     }
 }
 
@@ -8919,10 +9788,25 @@ dyesub_print_plane(stp_vars_t *v,
   int bpp = ((pv->plane_interlacing || pv->row_interlacing) ? 1 : pv->ink_channels)
   					* pv->bytes_per_ink_channel;
   size_t rowlen = pv->prnw_px * bpp;
+  int passes = pv->row_interlacing ? pv->ink_channels : 1;
+  int blank_rows = ((pv->outt_px - pv->prnt_px) +
+		    (pv->prnb_px + 1 - pv->outb_px)) * passes;
+  int pending = 0;	/* Blank rows not yet sent */
+  char *blank = NULL;
   char *destrow = stp_malloc(rowlen); /* Allocate a buffer for the rendered rows */
   if (!destrow)
     return 0;  /* ? out of memory ? */
 
+  if (blank_rows > 0)
+    {
+      /* FIXME: This is also broken for bpp != 1 and packed data  */
+      if (rowlen * blank_rows > DYESUB_BLANK_BYTES)
+	blank_rows = MAX(1, (int) (DYESUB_BLANK_BYTES / rowlen));
+      blank = stp_malloc(rowlen * blank_rows);
+      if (blank)
+	memset(blank, pv->empty_byte[plane], rowlen * blank_rows);
+    }
+
   /* Pre-Fill in the blank bits of the row. */
   if (dyesub_feature(caps, DYESUB_FEATURE_FULL_WIDTH))
     {
@@ -8944,12 +9828,15 @@ dyesub_print_plane(stp_vars_t *v,
   for (h = 0; h <= pv->prnb_px - pv->prnt_px; h++)
     {
       int p = pv->row_interlacing ? 0 : plane;
-      double row;
+      int row;
 
       do {
 
       if (h % caps->block_size == 0)
         { /* block init */
+	  if (pending)
+	    dyesub_write_blank_rows(v, pv, blank, blank_rows, rowlen, plane,
+				    &pending);
 	  pd->block_min_h = h + pv->prnt_px;
 	  pd->block_min_w = pv->prnl_px;
 	  pd->block_max_h = MIN(h + pv->prnt_px + caps->block_size - 1,
@@ -8961,32 +9848,45 @@ dyesub_print_plane(stp_vars_t *v,
 
       /* Generate a single row */
       if (h + pv->prnt_px < pv->outt_px || h + pv->prnt_px >= pv->outb_px)
-        { /* empty part above or below image area */
-	  memset(destrow, pv->empty_byte[plane], rowlen);
-	  /* FIXME: This is also broken for bpp != 1 and packed data  */
-	  /* FIXME: Also this is inefficient; it won't change once generated.. */
+        { /* empty part above or below image area; sent later */
+	  pending++;
 	}
       else
         {
-	  row = dyesub_interpolate(h + pv->prnt_px - pv->outt_px,
-				   pv->outh_px, pv->imgh_px);
-
-	  stp_deprintf(STP_DBG_DYESUB,
-		       "dyesub_print_plane: h = %d, row = %f\n", h, row);
+	  const char *out = destrow;
+	  row = h + pv->prnt_px - pv->outt_px;
+
+	  if (pending)
+	    dyesub_write_blank_rows(v, pv, blank, blank_rows, rowlen, plane,
+				    &pending);
+	  if (pv->planes[plane])
+	    /* already rendered by dyesub_render_planes() */
+	    out = (char *) pv->planes[plane] + rowlen * row;
+	  else
+	    {
+	      stp_deprintf(STP_DBG_DYESUB,
+			   "dyesub_print_plane: h = %d, row = %d\n", h, row);
 
-	  dyesub_render_row(v, pv, caps, row, destrow + bpp * pv->outl_px, bpp, p);
+	      dyesub_render_row(v, pv, row, destrow + bpp * pv->outl_px, p);
+	    }
+	  /* And send it out */
+	  stp_zfwrite(out, rowlen, 1, v);
 	}
-      /* And send it out */
-      stp_zfwrite(destrow, rowlen, 1, v);
 
       if (h + pv->prnt_px == pd->block_max_h)
         { /* block end */
+	  if (pending)
+	    dyesub_write_blank_rows(v, pv, blank, blank_rows, rowlen, plane,
+				    &pending);
 	  dyesub_exec(v, caps->block_end_func, "caps->block_end");
 	}
 
       } while (pv->row_interlacing && ++p < pv->ink_channels);
     }
+  if (pending)
+    dyesub_write_blank_rows(v, pv, blank, blank_rows, rowlen, plane, &pending);
 
+  STP_SAFE_FREE(blank);
   stp_free(destrow);
   return 1;
 }
@@ -9022,6 +9922,9 @@ dyesub_do_print(stp_vars_t *v, stp_image_t *image)
   int page_pt_top = 0;
   int page_pt_bottom = 0;
   int page_mode;
+  const char *resampling;
+  dyesub_resample_t filter = DYESUB_RESAMPLE_POINT;
+  int streaming;
 
   int pl;
 
@@ -9169,7 +10072,36 @@ dyesub_do_print(stp_vars_t *v, stp_image_t *image)
 #endif
   }
 
-  pv.image_data = dyesub_read_image(v, &pv, image);
+  pv.plane_interlacing = dyesub_feature(caps, DYESUB_FEATURE_PLANE_INTERLACE);
+  pv.row_interlacing = dyesub_feature(caps, DYESUB_FEATURE_ROW_INTERLACE);
+  pv.plane_lefttoright = dyesub_feature(caps, DYESUB_FEATURE_PLANE_LEFTTORIGHT);
+#ifndef CANONSELPHYNEO_CMY
+  pv.ycbcr = dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR);
+#endif
+  pv.print_mode = page_mode;
+
+  resampling = stp_get_string_parameter(v, "Resampling");
+  if (resampling)
+    for (i = 0; i < NUM_RESAMPLE; i++)
+      if (strcmp(resampling, resample_types[i].name) == 0)
+	filter = (dyesub_resample_t) i;
+
+  /*
+   * Nearest neighbor sampling gives the same 8-bit inks whether the
+   * image is kept with 8 or 16 bits per channel.  Portrait pages that
+   * are not printed a plane at a time are scaled and printed from the
+   * top down, so they can be read as they are printed.
+   */
+  pv.image_8bit = (pv.bytes_per_ink_channel == 1 && !pv.ycbcr &&
+		   filter == DYESUB_RESAMPLE_POINT);
+  pv.image = image;
+  streaming = (pv.print_mode != DYESUB_LANDSCAPE && !pv.plane_interlacing);
+  if (!streaming && !dyesub_read_image(v, &pv, image))
+    {
+      stp_image_conclude(image);
+      stp_free(pd);
+      return 2;
+    }
   if (ink_type) {
 #ifndef CANONSELPHYNEO_CMY
 	  if (dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR)) {
@@ -9195,16 +10127,7 @@ dyesub_do_print(stp_vars_t *v, stp_image_t *image)
 	  pv.empty_byte[2] = 0x0;
   }
 
-  pv.plane_interlacing = dyesub_feature(caps, DYESUB_FEATURE_PLANE_INTERLACE);
-  pv.row_interlacing = dyesub_feature(caps, DYESUB_FEATURE_ROW_INTERLACE);
-  pv.plane_lefttoright = dyesub_feature(caps, DYESUB_FEATURE_PLANE_LEFTTORIGHT);
-  pv.print_mode = page_mode;
-  if (!pv.image_data)
-    {
-      stp_image_conclude(image);
-      stp_free(pd);
-      return 2;
-    }
+  dyesub_select_row_func(&pv);
   /* /FIXME */
 
   /* FIXME:  Provide a way of disabling/altering these curves */
@@ -9262,6 +10185,26 @@ dyesub_do_print(stp_vars_t *v, stp_image_t *image)
   pd->print_mode = pv.print_mode;
   pd->bpp = pv.bits_per_ink_channel;
 
+  if (!dyesub_resample_init(&pv, filter) ||
+      (streaming && !dyesub_stream_init(&pv, image)))
+    {
+      stp_deprintf(STP_DBG_DYESUB, "dyesub: cannot allocate image buffers\n");
+      dyesub_resample_free(&pv);
+      dyesub_free_image(&pv, image);
+      stp_image_conclude(image);
+      stp_free(pd);
+      return 2;
+    }
+
+  /*
+   * Planes sent one at a time may all be rendered first, on several
+   * threads if asked to.
+   */
+  if (pv.plane_interlacing && !pv.row_interlacing &&
+      stp_check_int_parameter(v, "PlaneThreads", STP_PARAMETER_ACTIVE) &&
+      stp_get_int_parameter(v, "PlaneThreads") > 0)
+    dyesub_render_planes(&pv, stp_get_int_parameter(v, "PlaneThreads"));
+
   /* printer init */
   dyesub_exec(v, caps->printer_init_func, "caps->printer_init");
 
@@ -9282,9 +10225,11 @@ dyesub_do_print(stp_vars_t *v, stp_image_t *image)
   /* printer end */
   dyesub_exec(v, caps->printer_end_func, "caps->printer_end");
 
-  if (pv.image_data) {
-    dyesub_free_image(&pv, image);
-  }
+  dyesub_free_planes(&pv);
+  dyesub_free_image(&pv, image);
+  dyesub_resample_free(&pv);
+  if (pv.image_failed)
+    status = 2;
 
   stp_image_conclude(image);
   stp_free(pd);
@@ -428,8 +428,76 @@ stp_xml_process_paperdef(stp_mxml_node_t *paperdef, const char *file) /* The pap
   return 1;
 }
 
+/*
+ * Each processed paper in the XML snapshot is stored as its name, text,
+ * comment, width, height, left, right, bottom, top, unit and type.
+ */
+static int
+stp_paperdef_snapshot_write(stp_mxml_node_t *paperdef,
+			    stpi_xml_snapshot_writer_t *w)
+{
+  stp_mxml_node_t *paper;
+
+  for (paper = paperdef->child; paper; paper = paper->next)
+    if (paper->type == STP_MXML_ELEMENT &&
+	!strcmp(paper->value.element.name, "paper"))
+      {
+	stp_papersize_t *outpaper = stp_xml_process_paper(paper);
+	if (!outpaper)
+	  continue;
+	stpi_xml_snapshot_put_string(w, outpaper->name);
+	stpi_xml_snapshot_put_string(w, outpaper->text);
+	stpi_xml_snapshot_put_string(w, outpaper->comment);
+	stpi_xml_snapshot_put_int(w, outpaper->width);
+	stpi_xml_snapshot_put_int(w, outpaper->height);
+	stpi_xml_snapshot_put_int(w, outpaper->left);
+	stpi_xml_snapshot_put_int(w, outpaper->right);
+	stpi_xml_snapshot_put_int(w, outpaper->bottom);
+	stpi_xml_snapshot_put_int(w, outpaper->top);
+	stpi_xml_snapshot_put_int(w, outpaper->paper_unit);
+	stpi_xml_snapshot_put_int(w, outpaper->paper_size_type);
+	stpi_paper_freefunc(outpaper);
+      }
+  return 1;
+}
+
+static int
+stp_paperdef_snapshot_read(stpi_xml_snapshot_reader_t *r)
+{
+  while (!stpi_xml_snapshot_at_end(r))
+    {
+      const char *name = stpi_xml_snapshot_get_string(r);
+      const char *text = stpi_xml_snapshot_get_string(r);
+      const char *comment = stpi_xml_snapshot_get_string(r);
+      stp_papersize_t *outpaper = stp_zalloc(sizeof(stp_papersize_t));
+      outpaper->width = stpi_xml_snapshot_get_int(r);
+      outpaper->height = stpi_xml_snapshot_get_int(r);
+      outpaper->left = stpi_xml_snapshot_get_int(r);
+      outpaper->right = stpi_xml_snapshot_get_int(r);
+      outpaper->bottom = stpi_xml_snapshot_get_int(r);
+      outpaper->top = stpi_xml_snapshot_get_int(r);
+      outpaper->paper_unit =
+	(stp_papersize_unit_t) stpi_xml_snapshot_get_int(r);
+      outpaper->paper_size_type =
+	(stp_papersize_type_t) stpi_xml_snapshot_get_int(r);
+      if (!name || !text || !stpi_xml_snapshot_read_ok(r))
+	{
+	  stp_free(outpaper);
+	  return 0;
+	}
+      outpaper->name = stp_strdup(name);
+      outpaper->text = stp_strdup(text);
+      if (comment)
+	outpaper->comment = stp_strdup(comment);
+      stpi_paper_create(outpaper);
+    }
+  return 1;
+}
+
 void
 stpi_init_paper(void)
 {
   stp_register_xml_parser("paperdef", stp_xml_process_paperdef);
+  stpi_register_xml_snapshot("paperdef", stp_paperdef_snapshot_write,
+			     stp_paperdef_snapshot_read);
 }
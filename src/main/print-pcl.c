@@ -1964,6 +1964,10 @@ pcl_list_parameters(const stp_vars_t *v)
   stp_parameter_list_append(ret, tmp_list);
   stp_parameter_list_destroy(tmp_list);
 
+  tmp_list = stpi_render_list_parameters(v);
+  stp_parameter_list_append(ret, tmp_list);
+  stp_parameter_list_destroy(tmp_list);
+
   for (i = 0; i < the_parameter_count; i++)
     stp_parameter_list_add_param(ret, &(the_parameters[i]));
   for (i = 0; i < float_parameter_count; i++)
@@ -2513,6 +2517,13 @@ get_double_param(stp_vars_t *v, const char *param)
     return 1.0;
 }
 
+static void
+pcl_write_row(stp_vars_t *v, int y, void *data)
+{
+  pcl_printfunc(v);
+  stp_deprintf(STP_DBG_PCL, "pcl_print: y = %d\n", y);
+}
+
 static int
 pcl_do_print(stp_vars_t *v, stp_image_t *image)
 {
@@ -2533,7 +2544,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
   int		printing_color = 0;
   int		top = stp_get_top(v);
   int		left = stp_get_left(v);
-  int		y;		/* Looping vars */
   int		xdpi, ydpi;	/* Resolution */
   unsigned char *black,		/* Black bitmap data */
 		*cyan,		/* Cyan bitmap data */
@@ -2546,14 +2556,7 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
 		page_right,
 		page_bottom,
 		out_width,	/* Width of image on page */
-		out_height,	/* Height of image on page */
-		errdiv,		/* Error dividend */
-		errmod,		/* Error modulus */
-		errval,		/* Current error value */
-		errline,	/* Current raster line */
-		errlast;	/* Last raster line loaded */
-  unsigned	zero_mask;
-  int           image_height;
+		out_height;	/* Height of image on page */
   const pcl_cap_t *caps;		/* Printer capabilities */
   int		planes = 3;	/* # of output planes */
   int		pcl_media_size; /* PCL media size code */
@@ -2581,7 +2584,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
   */
 
   stp_image_init(image);
-  image_height = stp_image_height(image);
 
  /*
   * Figure out the output resolution...
@@ -2641,8 +2643,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
   left -= page_left;
   top -= page_top;
 
-  image_height = stp_image_height(image);
-
  /*
   * Set media size here because it is needed by the margin calculation code.
   */
@@ -3250,11 +3250,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
 
   (void) stp_color_init(v, image, 65536);
 
-  errdiv  = image_height / out_height;
-  errmod  = image_height % out_height;
-  errval  = 0;
-  errlast = -1;
-  errline  = 0;
   privdata.blank_lines = 0;
 #ifndef PCL_DEBUG_DISABLE_BLANKLINE_REMOVAL
   privdata.do_blank = ((caps->stp_printer_type & PCL_PRINTER_BLANKLINE) ==
@@ -3264,31 +3259,7 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
 #endif
   stp_allocate_component_data(v, "Driver", NULL, NULL, &privdata);
 
-  for (y = 0; y < out_height; y ++)
-  {
-    int duplicate_line = 1;
-    if (errline != errlast)
-    {
-      errlast = errline;
-      duplicate_line = 0;
-      if (stp_color_get_row(v, image, errline, &zero_mask))
-	{
-	  status = 2;
-	  break;
-	}
-    }
-    stp_dither(v, y, duplicate_line, zero_mask, NULL);
-    pcl_printfunc(v);
-    stp_deprintf(STP_DBG_PCL,"pcl_print: y = %d, line = %d, val = %d, mod = %d, height = %d\n",
-		  y, errline, errval, errmod, out_height);
-    errval += errmod;
-    errline += errdiv;
-    if (errval >= out_height)
-    {
-      errval -= out_height;
-      errline ++;
-    }
-  }
+  status = stpi_render_rows(v, image, out_height, NULL, pcl_write_row, NULL);
 
 /* Output trailing blank lines (may not be required?) */
 
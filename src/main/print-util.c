@@ -85,13 +85,160 @@ typedef struct
     }									\
 }
 
+/*
+ * Output is collected in a buffer shared by a vars and its copies (drivers
+ * usually print through a copy of the vars they are given) and passed to
+ * the output function when the buffer fills, when it is flushed, and when
+ * the last vars using it is destroyed or changes its output function.
+ */
+
+#define DEFAULT_OUTPUT_BUFFER_SIZE 65536
+
+struct stpi_output_buffer
+{
+  char *data;
+  size_t size;			/* 0 until the first write */
+  size_t bytes;
+  int refcount;
+  int unbuffered;
+};
+
+/*
+ * Pass output to the vars' output function, timing it if asked to.
+ */
+static void
+call_outfunc(const stp_vars_t *v, const char *data, size_t bytes)
+{
+  stpi_stage_times_t *times = stpi_stage_times(v);
+  stpi_stage_mark_t mark;
+  if (!times)
+    {
+      (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), data, bytes);
+      return;
+    }
+  stpi_stage_begin(times, &mark, STPI_STAGE_COUNT);
+  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), data, bytes);
+  stpi_stage_end(times, &mark, STPI_STAGE_OUTPUT, bytes);
+}
+
+stpi_output_buffer_t *
+stpi_output_buffer_create(void)
+{
+  stpi_output_buffer_t *buf = stp_zalloc(sizeof(stpi_output_buffer_t));
+  buf->refcount = 1;
+  return buf;
+}
+
+stpi_output_buffer_t *
+stpi_output_buffer_ref(stpi_output_buffer_t *buf)
+{
+  if (buf)
+    buf->refcount++;
+  return buf;
+}
+
+void
+stpi_output_buffer_release(const stp_vars_t *v, stpi_output_buffer_t *buf)
+{
+  if (!buf)
+    return;
+  if (buf->bytes > 0 && stp_get_outfunc(v))
+    call_outfunc(v, buf->data, buf->bytes);
+  buf->bytes = 0;
+  if (--buf->refcount == 0)
+    {
+      STP_SAFE_FREE(buf->data);
+      stp_free(buf);
+    }
+}
+
+static stpi_output_buffer_t *
+get_output_buffer(const stp_vars_t *v)
+{
+  stpi_output_buffer_t *buf = stpi_vars_get_output_buffer(v);
+  if (buf && buf->size == 0 && !buf->unbuffered)
+    {
+      int size = DEFAULT_OUTPUT_BUFFER_SIZE;
+      if (stp_check_int_parameter(v, "OutputBufferSize", STP_PARAMETER_ACTIVE))
+	size = stp_get_int_parameter(v, "OutputBufferSize");
+      if (size <= 0)
+	buf->unbuffered = 1;
+      else
+	{
+	  buf->size = size;
+	  buf->data = stp_malloc(size);
+	}
+    }
+  if (buf && buf->unbuffered)
+    return NULL;
+  return buf;
+}
+
+void
+stp_flush_output(const stp_vars_t *v)
+{
+  stpi_output_buffer_t *buf = stpi_vars_get_output_buffer(v);
+  if (buf && buf->bytes > 0)
+    {
+      call_outfunc(v, buf->data, buf->bytes);
+      buf->bytes = 0;
+    }
+}
+
+static void
+write_output(const stp_vars_t *v, const char *data, size_t bytes)
+{
+  stpi_output_buffer_t *buf = get_output_buffer(v);
+  if (!buf)
+    {
+      call_outfunc(v, data, bytes);
+      return;
+    }
+  if (bytes > buf->size - buf->bytes)
+    {
+      stp_flush_output(v);
+      if (bytes >= buf->size)
+	{
+	  call_outfunc(v, data, bytes);
+	  return;
+	}
+    }
+  memcpy(buf->data + buf->bytes, data, bytes);
+  buf->bytes += bytes;
+}
+
 void
 stp_zprintf(const stp_vars_t *v, const char *format, ...)
 {
+  stpi_output_buffer_t *buf = get_output_buffer(v);
   char *result;
   int bytes;
+  if (buf)
+    {
+      /*
+       * Format directly into the buffer if the result fits, flushing it
+       * first if need be.
+       */
+      int pass;
+      for (pass = 0; pass < 2; pass++)
+	{
+	  size_t avail = buf->size - buf->bytes;
+	  va_list args;
+	  va_start(args, format);
+	  bytes = vsnprintf(buf->data + buf->bytes, avail, format, args);
+	  va_end(args);
+	  if (bytes >= 0 && (size_t) bytes < avail)
+	    {
+	      buf->bytes += bytes;
+	      return;
+	    }
+	  if (bytes < 0 || (size_t) bytes >= buf->size || buf->bytes == 0)
+	    break;
+	  stp_flush_output(v);
+	}
+    }
   STPI_VASPRINTF(result, bytes, format);
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), result, bytes);
+  write_output(v, result, bytes);
   stp_free(result);
 }
 
@@ -120,20 +267,30 @@ stp_catprintf(char **strp, const char *format, ...)
 void
 stp_zfwrite(const char *buf, size_t bytes, size_t nitems, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), buf, bytes * nitems);
+  write_output(v, buf, bytes * nitems);
 }
 
 void
 stp_write_raw(const stp_raw_t *raw, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), raw->data, raw->bytes);
+  write_output(v, raw->data, raw->bytes);
 }
 
 void
 stp_putc(int ch, const stp_vars_t *v)
 {
-  unsigned char a = (unsigned char) ch;
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), (char *) &a, 1);
+  stpi_output_buffer_t *buf = get_output_buffer(v);
+  if (buf)
+    {
+      if (buf->bytes == buf->size)
+	stp_flush_output(v);
+      buf->data[buf->bytes++] = (char) ch;
+    }
+  else
+    {
+      unsigned char a = (unsigned char) ch;
+      call_outfunc(v, (char *) &a, 1);
+    }
 }
 
 #define BYTE(expr, byteno) (((expr) >> (8 * byteno)) & 0xff)
@@ -173,13 +330,13 @@ stp_put32_be(unsigned int in, const stp_vars_t *v)
 void
 stp_puts(const char *s, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), s, strlen(s));
+  write_output(v, s, strlen(s));
 }
 
 void
 stp_putraw(const stp_raw_t *r, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), r->data, r->bytes);
+  write_output(v, r->data, r->bytes);
 }
 
 void
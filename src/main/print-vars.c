@@ -33,6 +33,10 @@
 #include <limits.h>
 #endif
 #include <string.h>
+#if defined(HAVE_PTHREAD) && defined(HAVE_PTHREAD_H)
+#define USE_HANDLE_LOCK 1
+#include <pthread.h>
+#endif
 #include <gutenprint/gutenprint.h>
 #include "gutenprint-internal.h"
 #include <gutenprint/gutenprint-intl-internal.h>
@@ -62,6 +66,29 @@ struct stp_compdata
   void *data;
 };
 
+struct stp_parameter_handle
+{
+  char *name;
+  stp_parameter_type_t type;	/* STP_PARAMETER_TYPE_INVALID for compdata */
+  int index;
+};
+
+/*
+ * Each vars remembers where the values of the first HANDLE_CACHE_SIZE
+ * handles were found.  An entry is valid as long as the stamp of the list
+ * it was found in has not changed.  Several threads may look parameters
+ * up in the same vars at once (see render-pipeline.c), so the stamp and
+ * the data of an entry are only read and written together, under the
+ * vars' handle_cache_lock.
+ */
+#define HANDLE_CACHE_SIZE 64
+
+typedef struct
+{
+  unsigned stamp;
+  void *data;			/* value_t or compdata_t */
+} handle_cache_t;
+
 struct stp_vars			/* Plug-in variables */
 {
   char *driver;			/* Name of printer "driver" */
@@ -78,7 +105,15 @@ struct stp_vars			/* Plug-in variables */
   void *outdata;
   void (*errfunc)(void *data, const char *buffer, size_t bytes);
   void *errdata;
+  stp_image_get_rows_func_t image_get_rows_func;
+  const stp_image_t *image_get_rows_image; /* The image it reads */
   int verified;			/* Ensure that params are OK! */
+  handle_cache_t *handle_cache;	/* Values found by handle */
+#ifdef USE_HANDLE_LOCK
+  pthread_mutex_t handle_cache_lock;
+#endif
+  stpi_output_buffer_t *outbuf;	/* Shared with copies of this vars */
+  stpi_stage_times_t *times;	/* Likewise */
 };
 
 static int standard_vars_initialized = 0;
@@ -340,6 +375,12 @@ stp_vars_create(void)
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     retval->params[i] = create_vars_list();
   retval->internal_data = create_compdata_list();
+  retval->handle_cache = stp_zalloc(sizeof(handle_cache_t) * HANDLE_CACHE_SIZE);
+#ifdef USE_HANDLE_LOCK
+  pthread_mutex_init(&(retval->handle_cache_lock), NULL);
+#endif
+  retval->outbuf = stpi_output_buffer_create();
+  retval->times = stpi_stage_times_create();
   stp_vars_copy(retval, (stp_vars_t *)&default_vars);
   return (retval);
 }
@@ -349,11 +390,20 @@ stp_vars_destroy(stp_vars_t *v)
 {
   int i;
   CHECK_VARS(v);
+  stpi_output_buffer_release(v, v->outbuf);
+  stpi_stage_times_release(v->times);
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     stp_list_destroy(v->params[i]);
   stp_list_destroy(v->internal_data);
   STP_SAFE_FREE(v->driver);
   STP_SAFE_FREE(v->color_conversion);
+  if (v->handle_cache)
+    {
+#ifdef USE_HANDLE_LOCK
+      pthread_mutex_destroy(&(v->handle_cache_lock));
+#endif
+      stp_free(v->handle_cache);
+    }
   stp_free(v);
 }
 
@@ -417,11 +467,75 @@ DEF_FUNCS(width, int, stp)
 DEF_FUNCS(height, int, stp)
 DEF_FUNCS(page_width, int, stp)
 DEF_FUNCS(page_height, int, stp)
-DEF_FUNCS(outdata, void *, stp)
 DEF_FUNCS(errdata, void *, stp)
-DEF_FUNCS(outfunc, stp_outfunc_t, stp)
 DEF_FUNCS(errfunc, stp_outfunc_t, stp)
 
+/*
+ * Output already buffered belongs to the old destination, so it is
+ * flushed and the vars gets a buffer of its own.
+ */
+#define DEF_OUTPUT_FUNCS(s, t, pre)			\
+void							\
+pre##_set_##s(stp_vars_t *v, t val)			\
+{							\
+  CHECK_VARS(v);					\
+  v->verified = 0;					\
+  if (v->s == val)					\
+    return;						\
+  if (v->outbuf)					\
+    {							\
+      stpi_output_buffer_release(v, v->outbuf);		\
+      v->outbuf = stpi_output_buffer_create();		\
+    }							\
+  v->s = val;						\
+}							\
+							\
+t							\
+pre##_get_##s(const stp_vars_t *v)			\
+{							\
+  CHECK_VARS(v);					\
+  return v->s;						\
+}
+
+DEF_OUTPUT_FUNCS(outdata, void *, stp)
+DEF_OUTPUT_FUNCS(outfunc, stp_outfunc_t, stp)
+
+/*
+ * This is only a way of reading the image, so changing it does not
+ * need the vars to be verified again.
+ */
+void
+stp_set_image_get_rows_func(stp_vars_t *v, stp_image_t *image,
+			    stp_image_get_rows_func_t val)
+{
+  CHECK_VARS(v);
+  v->image_get_rows_func = val;
+  v->image_get_rows_image = val ? image : NULL;
+}
+
+stp_image_get_rows_func_t
+stp_get_image_get_rows_func(const stp_vars_t *v, const stp_image_t *image)
+{
+  CHECK_VARS(v);
+  if (image && image == v->image_get_rows_image)
+    return v->image_get_rows_func;
+  return NULL;
+}
+
+stpi_output_buffer_t *
+stpi_vars_get_output_buffer(const stp_vars_t *v)
+{
+  CHECK_VARS(v);
+  return v->outbuf;
+}
+
+stpi_stage_times_t *
+stpi_vars_get_stage_times(const stp_vars_t *v)
+{
+  CHECK_VARS(v);
+  return v->times;
+}
+
 void
 stp_set_verified(stp_vars_t *v, int val)
 {
@@ -1327,6 +1441,185 @@ LIST_FUNCTION(curve, STP_PARAMETER_TYPE_CURVE)
 LIST_FUNCTION(array, STP_PARAMETER_TYPE_ARRAY)
 LIST_FUNCTION(raw, STP_PARAMETER_TYPE_RAW)
 
+static stp_parameter_handle_t *handles = NULL;
+static int handle_count = 0;
+static int handle_space = 0;
+#ifdef USE_HANDLE_LOCK
+static pthread_mutex_t handle_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static stp_parameter_handle_t
+get_handle(const char *name, stp_parameter_type_t type)
+{
+  stp_parameter_handle_t handle = NULL;
+  int i;
+#ifdef USE_HANDLE_LOCK
+  pthread_mutex_lock(&handle_lock);
+#endif
+  for (i = 0; i < handle_count; i++)
+    if (handles[i]->type == type && strcmp(handles[i]->name, name) == 0)
+      {
+	handle = handles[i];
+	break;
+      }
+  if (!handle)
+    {
+      if (handle_count == handle_space)
+	{
+	  handle_space = handle_space ? handle_space * 2 : 32;
+	  handles = stp_realloc(handles,
+				sizeof(stp_parameter_handle_t) * handle_space);
+	}
+      handle = stp_malloc(sizeof(struct stp_parameter_handle));
+      handle->name = stp_strdup(name);
+      handle->type = type;
+      handle->index = handle_count;
+      handles[handle_count++] = handle;
+      stp_deprintf(STP_DBG_VARS, "parameter handle %d for %s (type %d)\n",
+		   handle->index, name, type);
+    }
+#ifdef USE_HANDLE_LOCK
+  pthread_mutex_unlock(&handle_lock);
+#endif
+  return handle;
+}
+
+stp_parameter_handle_t
+stp_parameter_handle(const char *name, stp_parameter_type_t type)
+{
+  STPI_ASSERT(type >= STP_PARAMETER_TYPE_STRING_LIST &&
+	      type < STP_PARAMETER_TYPE_INVALID, NULL);
+  return get_handle(name, type);
+}
+
+stp_parameter_handle_t
+stp_component_data_handle(const char *name)
+{
+  return get_handle(name, STP_PARAMETER_TYPE_INVALID);
+}
+
+/*
+ * Return the value_t (or compdata_t) named by the handle, or NULL if
+ * the vars has none.
+ */
+static void *
+find_by_handle(const stp_vars_t *v, stp_parameter_handle_t handle)
+{
+  const stp_list_t *list;
+  const stp_list_item_t *item;
+  handle_cache_t *entry = NULL;
+#ifdef USE_HANDLE_LOCK
+  pthread_mutex_t *lock = (pthread_mutex_t *) &(v->handle_cache_lock);
+#endif
+  unsigned stamp;
+  void *data;
+  CHECK_VARS(v);
+  if (handle->type == STP_PARAMETER_TYPE_INVALID)
+    list = v->internal_data;
+  else
+    list = v->params[handle->type];
+  stamp = stpi_list_get_stamp(list);
+  if (v->handle_cache && handle->index < HANDLE_CACHE_SIZE)
+    {
+      int found;
+      entry = &(v->handle_cache[handle->index]);
+#ifdef USE_HANDLE_LOCK
+      pthread_mutex_lock(lock);
+#endif
+      found = entry->stamp == stamp;
+      data = entry->data;
+#ifdef USE_HANDLE_LOCK
+      pthread_mutex_unlock(lock);
+#endif
+      if (found)
+	return data;
+    }
+  item = stp_list_get_item_by_name(list, handle->name);
+  data = item ? stp_list_item_get_data(item) : NULL;
+  if (entry)
+    {
+#ifdef USE_HANDLE_LOCK
+      pthread_mutex_lock(lock);
+#endif
+      entry->data = data;
+      entry->stamp = stamp;
+#ifdef USE_HANDLE_LOCK
+      pthread_mutex_unlock(lock);
+#endif
+    }
+  return data;
+}
+
+double
+stp_get_float_parameter_by_handle(const stp_vars_t *v,
+				  stp_parameter_handle_t handle)
+{
+  const value_t *val = find_by_handle(v, handle);
+  if (val)
+    return val->value.dval;
+  else
+    return stp_get_float_parameter(v, handle->name);
+}
+
+int
+stp_get_int_parameter_by_handle(const stp_vars_t *v,
+				stp_parameter_handle_t handle)
+{
+  const value_t *val = find_by_handle(v, handle);
+  if (val)
+    return val->value.ival;
+  else
+    return stp_get_int_parameter(v, handle->name);
+}
+
+int
+stp_get_boolean_parameter_by_handle(const stp_vars_t *v,
+				    stp_parameter_handle_t handle)
+{
+  const value_t *val = find_by_handle(v, handle);
+  if (val)
+    return val->value.ival;
+  else
+    return stp_get_boolean_parameter(v, handle->name);
+}
+
+const char *
+stp_get_string_parameter_by_handle(const stp_vars_t *v,
+				   stp_parameter_handle_t handle)
+{
+  const value_t *val = find_by_handle(v, handle);
+  if (val)
+    return val->value.rval.data;
+  else
+    return NULL;
+}
+
+int
+stp_check_parameter_by_handle(const stp_vars_t *v,
+			      stp_parameter_handle_t handle,
+			      stp_parameter_activity_t active)
+{
+  const value_t *val;
+  if (handle->type == STP_PARAMETER_TYPE_INVALID)
+    return 0;
+  val = find_by_handle(v, handle);
+  if (val && active <= val->active)
+    return 1;
+  else
+    return 0;
+}
+
+void *
+stp_get_component_data_by_handle(const stp_vars_t *v,
+				 stp_parameter_handle_t handle)
+{
+  const compdata_t *cd = find_by_handle(v, handle);
+  if (cd)
+    return cd->data;
+  else
+    return NULL;
+}
+
 stp_parameter_activity_t
 stp_get_parameter_active(const stp_vars_t *v, const char *parameter,
 			 stp_parameter_type_t p_type)
@@ -1442,6 +1735,18 @@ stp_vars_copy(stp_vars_t *vd, const stp_vars_t *vs)
   stp_set_errdata(vd, stp_get_errdata(vs));
   stp_set_outfunc(vd, stp_get_outfunc(vs));
   stp_set_errfunc(vd, stp_get_errfunc(vs));
+  vd->image_get_rows_func = vs->image_get_rows_func;
+  vd->image_get_rows_image = vs->image_get_rows_image;
+  if (vs->outbuf && vd->outbuf != vs->outbuf)
+    {
+      stpi_output_buffer_release(vd, vd->outbuf);
+      vd->outbuf = stpi_output_buffer_ref(vs->outbuf);
+    }
+  if (vs->times && vd->times != vs->times)
+    {
+      stpi_stage_times_release(vd->times);
+      vd->times = stpi_stage_times_ref(vs->times);
+    }
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     {
       stp_list_destroy(vd->params[i]);
@@ -1701,6 +2006,12 @@ stp_describe_parameter(const stp_vars_t *v, const char *name,
       debug_print_parameter_description(description, "dither", v);
       return;
     }
+  stpi_render_describe_parameter(v, name, description);
+  if (description->p_type != STP_PARAMETER_TYPE_INVALID)
+    {
+      debug_print_parameter_description(description, "render", v);
+      return;
+    }
   stpi_describe_generic_parameter(v, name, description);
   if (description->p_type != STP_PARAMETER_TYPE_INVALID)
     debug_print_parameter_description(description, "generic", v);
@@ -2179,6 +2490,125 @@ stp_vars_create_from_xmltree_ref(stp_mxml_node_t *da, stp_mxml_node_t *root)
   return v;
 }
 
+/*
+ * Parameter settings in the XML snapshot, each followed by its name,
+ * value and activity (or -1).
+ */
+typedef enum
+{
+  VARS_SNAPSHOT_END,
+  VARS_SNAPSHOT_FLOAT,
+  VARS_SNAPSHOT_INTEGER,
+  VARS_SNAPSHOT_DIMENSION,
+  VARS_SNAPSHOT_BOOLEAN,
+  VARS_SNAPSHOT_STRING
+} vars_snapshot_setting_t;
+
+int
+stpi_vars_snapshot_write(stp_mxml_node_t *prop, stpi_xml_snapshot_writer_t *w)
+{
+  for (; prop; prop = prop->next)
+    {
+      const char *p_type = NULL;
+      const char *p_name = NULL;
+      const char *active;
+      const char *text;
+      if (prop->type != STP_MXML_ELEMENT ||
+	  (!prop->child && !stp_mxmlElementGetAttr(prop, "name")))
+	continue;
+      if (strcmp(prop->value.element.name, "parameter") != 0 ||
+	  !(p_type = stp_mxmlElementGetAttr(prop, "type")) ||
+	  !(p_name = stp_mxmlElementGetAttr(prop, "name")) || !prop->child)
+	return 0;
+      if (prop->child->type != STP_MXML_TEXT)
+	continue;
+      text = prop->child->value.text.string;
+      if (strcmp(p_type, "float") == 0)
+	{
+	  stpi_xml_snapshot_put_int(w, VARS_SNAPSHOT_FLOAT);
+	  stpi_xml_snapshot_put_string(w, p_name);
+	  stpi_xml_snapshot_put_double(w, stp_xmlstrtod(text));
+	}
+      else if (strcmp(p_type, "string") == 0)
+	{
+	  stpi_xml_snapshot_put_int(w, VARS_SNAPSHOT_STRING);
+	  stpi_xml_snapshot_put_string(w, p_name);
+	  stpi_xml_snapshot_put_string(w, text);
+	}
+      else
+	{
+	  if (strcmp(p_type, "integer") == 0)
+	    stpi_xml_snapshot_put_int(w, VARS_SNAPSHOT_INTEGER);
+	  else if (strcmp(p_type, "dimension") == 0)
+	    stpi_xml_snapshot_put_int(w, VARS_SNAPSHOT_DIMENSION);
+	  else if (strcmp(p_type, "boolean") == 0)
+	    stpi_xml_snapshot_put_int(w, VARS_SNAPSHOT_BOOLEAN);
+	  else
+	    return 0;
+	  stpi_xml_snapshot_put_string(w, p_name);
+	  stpi_xml_snapshot_put_int(w, (int) stp_xmlstrtol(text));
+	}
+      active = stp_mxmlElementGetAttr(prop, "active");
+      if (active && strcmp(active, "active") == 0)
+	stpi_xml_snapshot_put_int(w, STP_PARAMETER_ACTIVE);
+      else if (active && strcmp(active, "inactive") == 0)
+	stpi_xml_snapshot_put_int(w, STP_PARAMETER_INACTIVE);
+      else if (active && strcmp(active, "default") == 0)
+	stpi_xml_snapshot_put_int(w, STP_PARAMETER_DEFAULTED);
+      else
+	stpi_xml_snapshot_put_int(w, -1);
+    }
+  stpi_xml_snapshot_put_int(w, VARS_SNAPSHOT_END);
+  return 1;
+}
+
+void
+stpi_vars_snapshot_read(stpi_xml_snapshot_reader_t *r, stp_vars_t *v)
+{
+  int setting;
+  while ((setting = stpi_xml_snapshot_get_int(r)) != VARS_SNAPSHOT_END)
+    {
+      const char *p_name = stpi_xml_snapshot_get_string(r);
+      const char *sval = NULL;
+      double dval = 0;
+      int ival = 0;
+      int active;
+      if (setting == VARS_SNAPSHOT_FLOAT)
+	dval = stpi_xml_snapshot_get_double(r);
+      else if (setting == VARS_SNAPSHOT_STRING)
+	sval = stpi_xml_snapshot_get_string(r);
+      else
+	ival = stpi_xml_snapshot_get_int(r);
+      active = stpi_xml_snapshot_get_int(r);
+      if (!v || !p_name || !stpi_xml_snapshot_read_ok(r))
+	continue;
+      switch (setting)
+	{
+	case VARS_SNAPSHOT_FLOAT:
+	  stp_set_float_parameter(v, p_name, dval);
+	  break;
+	case VARS_SNAPSHOT_INTEGER:
+	  stp_set_int_parameter(v, p_name, ival);
+	  break;
+	case VARS_SNAPSHOT_DIMENSION:
+	  stp_set_dimension_parameter(v, p_name, ival);
+	  break;
+	case VARS_SNAPSHOT_BOOLEAN:
+	  stp_set_boolean_parameter(v, p_name, ival);
+	  break;
+	case VARS_SNAPSHOT_STRING:
+	  stp_set_string_parameter(v, p_name, sval);
+	  break;
+	default:
+	  continue;
+	}
+      /* As fill_vars_from_xmltree() does, whatever the parameter type */
+      if (active >= 0)
+	stp_set_parameter_active(v, p_name, (stp_parameter_activity_t) active,
+				 STP_PARAMETER_TYPE_DOUBLE);
+    }
+}
+
 static void
 add_text_node(stp_mxml_node_t *node, const char *element, const char *value)
 {
@@ -1560,6 +1560,7 @@ stpi_flush_passes(stp_vars_t *v, int flushall)
       if (pass->pass < 0 || (!flushall && pass->physpassend >= sw->lineno))
 	return;
       (sw->flushfunc)(v, pass->pass, pass->subpass);
+      stp_flush_output(v);
       sw->last_pass = pass->pass;
       pass->pass = -1;
     }
@@ -1599,8 +1600,8 @@ finalize_row(stp_vars_t *v, int row)
     }
 }
 
-void
-stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
+static void
+write_weave(stp_vars_t *v, unsigned char *const cols[])
 {
   stpi_softweave_t *sw = get_sw(v);
   int length = (sw->linewidth + 7) / 8;
@@ -1692,6 +1693,28 @@ stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
     }
 }
 
+void
+stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
+{
+  stpi_stage_times_t *times = stpi_stage_times(v);
+  stpi_stage_mark_t mark;
+  stpi_softweave_t *sw;
+  size_t bytes = 0;
+  int j;
+  if (!times)
+    {
+      write_weave(v, cols);
+      return;
+    }
+  stpi_stage_begin(times, &mark, STPI_STAGE_OUTPUT);
+  write_weave(v, cols);
+  sw = get_sw(v);
+  for (j = 0; j < sw->ncolors; j++)
+    if (cols[j])
+      bytes += (sw->linewidth + 7) / 8 * sw->bitwidth;
+  stpi_stage_end(times, &mark, STPI_STAGE_WEAVE, bytes);
+}
+
 #if 0
 #define TEST_RAW
 #endif
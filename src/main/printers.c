@@ -521,7 +521,11 @@ stp_print(const stp_vars_t *v, stp_image_t *image)
 {
   const stp_printfuncs_t *printfuncs =
     stpi_get_printfuncs(stp_get_printer(v));
-  return (printfuncs->print)(v, image);
+  int status;
+  stpi_stage_times_setup(v);
+  status = (printfuncs->print)(v, image);
+  stp_flush_output(v);
+  return status;
 }
 
 int
@@ -533,7 +537,11 @@ stp_start_job(const stp_vars_t *v, stp_image_t *image)
       strcmp(stp_get_string_parameter(v, "JobMode"), "Page") == 0)
     return 1;
   if (printfuncs->start_job)
-    return (printfuncs->start_job)(v, image);
+    {
+      int status = (printfuncs->start_job)(v, image);
+      stp_flush_output(v);
+      return status;
+    }
   else
     return 1;
 }
@@ -543,13 +551,16 @@ stp_end_job(const stp_vars_t *v, stp_image_t *image)
 {
   const stp_printfuncs_t *printfuncs =
     stpi_get_printfuncs(stp_get_printer(v));
-  if (!stp_get_string_parameter(v, "JobMode") ||
-      strcmp(stp_get_string_parameter(v, "JobMode"), "Page") == 0)
-    return 1;
-  if (printfuncs->end_job)
-    return (printfuncs->end_job)(v, image);
-  else
-    return 1;
+  int status = 1;
+  if (stp_get_string_parameter(v, "JobMode") &&
+      strcmp(stp_get_string_parameter(v, "JobMode"), "Page") != 0 &&
+      printfuncs->end_job)
+    {
+      status = (printfuncs->end_job)(v, image);
+      stp_flush_output(v);
+    }
+  stpi_stage_times_report(v);
+  return status;
 }
 
 stp_string_list_t *
@@ -1019,12 +1030,12 @@ stp_family_unregister(stp_list_t *family)
   return 0;
 }
 
+/*
+ * Create the (empty) parameter set name of family.
+ */
 static stp_printvars_t *
-stp_printvars_create_from_xmltree(stp_mxml_node_t *printer,
-				  const char *family)
+stp_printvars_create(const char *name, const char *family)
 {
-  stp_mxml_node_t *prop;	/* Temporary node pointer */
-  const char *stmp;		/* Temporary string */
   char *sbuf;
   stp_printvars_t *outprintvars;
   outprintvars = stp_zalloc(sizeof(stp_printvars_t));
@@ -1036,18 +1047,27 @@ stp_printvars_create_from_xmltree(stp_mxml_node_t *printer,
       stp_free(outprintvars);
       return NULL;
     }
-  stmp = stp_mxmlElementGetAttr(printer, "name");
-  if (!stmp)
-    {
-      stp_vars_destroy(outprintvars->printvars);
-      stp_free(outprintvars);
-      return NULL;
-    }
-  sbuf = stp_malloc(strlen(family) + strlen("::") + strlen(stmp) + 1);
+  sbuf = stp_malloc(strlen(family) + strlen("::") + strlen(name) + 1);
   strcpy(sbuf, family);
   strcat(sbuf, "::");
-  strcat(sbuf, stmp);
+  strcat(sbuf, name);
   outprintvars->name = sbuf;
+  return outprintvars;
+}
+
+static stp_printvars_t *
+stp_printvars_create_from_xmltree(stp_mxml_node_t *printer,
+				  const char *family)
+{
+  stp_mxml_node_t *prop;	/* Temporary node pointer */
+  const char *stmp;		/* Temporary string */
+  stp_printvars_t *outprintvars;
+  stmp = stp_mxmlElementGetAttr(printer, "name");
+  if (!stmp)
+    return NULL;
+  outprintvars = stp_printvars_create(stmp, family);
+  if (!outprintvars)
+    return NULL;
   prop = printer->child;
   stp_deprintf(STP_DBG_XML, ">>stp_printvars_create_from_xmltree: %p, %s\n",
 	       (void *) (outprintvars->printvars), outprintvars->name);
@@ -1059,33 +1079,32 @@ stp_printvars_create_from_xmltree(stp_mxml_node_t *printer,
 
 
 /*
- * Parse the printer node, and return the generated printer.  Returns
- * NULL on failure.
+ * Create a printer of family from its attributes, with the settings of
+ * its parameter set.  Returns NULL if the printer is incomplete.
  */
-static stp_printer_t*
-stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
-				const char *family,       /* Family name */
-				const stp_printfuncs_t *printfuncs)
-                                                       /* Family printfuncs */
+static stp_printer_t *
+stp_printer_create(const char *family,
+		   const char *parameters,
+		   const char *driver,
+		   const char *long_name,
+		   const char *manufacturer,
+		   int model,
+		   const char *device_id,
+		   const stp_printfuncs_t *printfuncs)
 {
-  stp_mxml_node_t *prop;	/* Temporary node pointer */
-  stp_mxml_node_t *child;
-  const char *stmp;		/* Temporary string */
   stp_printer_t *outprinter;	/* Generated printer */
-  size_t slen = 0;
-  int
-    driver = 0,			/* Check driver */
-    long_name = 0;
 
+  if (!driver || !long_name || !printfuncs)
+    return NULL;
   outprinter = stp_zalloc(sizeof(stp_printer_t));
   if (!outprinter)
     return NULL;
-  stmp = stp_mxmlElementGetAttr(printer, "parameters");
-  if (stmp && !stp_find_params(stmp, family))
+  if (parameters && !stp_find_params(parameters, family))
     stp_erprintf("stp_printer_create_from_xmltree: cannot find parameters %s::%s\n",
-		 family, stmp);
-  if (stmp && stp_find_params(stmp, family))
-    outprinter->printvars = stp_vars_create_copy(stp_find_params(stmp, family));
+		 family, parameters);
+  if (parameters && stp_find_params(parameters, family))
+    outprinter->printvars =
+      stp_vars_create_copy(stp_find_params(parameters, family));
   else
     outprinter->printvars = stp_vars_create();
   if (outprinter->printvars == NULL)
@@ -1094,86 +1113,103 @@ stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
       return NULL;
     }
 
-  stmp = stp_mxmlElementGetAttr(printer, "driver");
-  stp_set_driver(outprinter->printvars, (const char *) stmp);
+  stp_set_driver(outprinter->printvars, driver);
 
-  outprinter->long_name = stp_strdup(stp_mxmlElementGetAttr(printer, "name"));
-  outprinter->manufacturer = stp_strdup(stp_mxmlElementGetAttr(printer, "manufacturer"));
-  outprinter->model = stp_xmlstrtol(stp_mxmlElementGetAttr(printer, "model"));
-  outprinter->family = stp_strdup((const char *) family);
-  stmp = stp_mxmlElementGetAttr(printer, "deviceid");
-  if (stmp)
-    outprinter->device_id = stp_strdup(stmp);
+  outprinter->long_name = stp_strdup(long_name);
+  outprinter->manufacturer = stp_strdup(manufacturer);
+  outprinter->model = model;
+  outprinter->family = stp_strdup(family);
+  if (device_id)
+    outprinter->device_id = stp_strdup(device_id);
+  outprinter->printfuncs = printfuncs;
+  return outprinter;
+}
+
+/*
+ * Return the comment of the printer node (its text, joined with
+ * spaces), or NULL if it has none.
+ */
+static char *
+stp_printer_comment_from_xmltree(stp_mxml_node_t *printer)
+{
+  stp_mxml_node_t *child;
+  char *comment = NULL;
+  size_t slen = 0;
 
   child = printer->child;
   while (child)
     {
       if (child->type == STP_MXML_TEXT)
 	{
-	  if (outprinter->comment)
+	  if (comment)
 	    {
 	      size_t oslen = slen;
 	      slen += strlen(child->value.text.string);
 	      if (child->value.text.whitespace)
 		slen += 1;
-	      outprinter->comment = stp_realloc(outprinter->comment, slen + 1);
-	      (void) memset(outprinter->comment + oslen, 0, slen - oslen);
+	      comment = stp_realloc(comment, slen + 1);
+	      (void) memset(comment + oslen, 0, slen - oslen);
 	      if (child->value.text.whitespace)
-		  outprinter->comment[oslen++] = ' ';
-	      strncat(outprinter->comment + oslen,
-		      child->value.text.string, slen - oslen);
+		  comment[oslen++] = ' ';
+	      strncat(comment + oslen, child->value.text.string, slen - oslen);
 	    }
 	  else
 	    {
-	      outprinter->comment = stp_strdup(child->value.text.string);
-	      slen = strlen(outprinter->comment);
+	      comment = stp_strdup(child->value.text.string);
+	      slen = strlen(comment);
 	    }
 	}
       child = child->next;
     }
+  return comment;
+}
 
-  if (stp_get_driver(outprinter->printvars))
-    driver = 1;
-  if (outprinter->long_name)
-    long_name = 1;
-
-  outprinter->printfuncs = printfuncs;
-
-  prop = printer->child;
-  stp_vars_fill_from_xmltree(prop, outprinter->printvars);
-  if (driver && long_name && printfuncs)
-    {
-      if (stp_get_debug_level() & STP_DBG_XML)
-	{
-	  stmp = stp_mxmlElementGetAttr(printer, "driver");
-	  stp_erprintf("stp_printer_create_from_xmltree: printer: %s\n", stmp);
-	}
-      outprinter->driver = stp_get_driver(outprinter->printvars);
-      return outprinter;
-    }
-  stp_free(outprinter);
-  return NULL;
+/*
+ * Parse the printer node, and return the generated printer.  Returns
+ * NULL on failure.
+ */
+static stp_printer_t*
+stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
+				const char *family,       /* Family name */
+				const stp_printfuncs_t *printfuncs)
+                                                       /* Family printfuncs */
+{
+  stp_printer_t *outprinter =	/* Generated printer */
+    stp_printer_create(family,
+		       stp_mxmlElementGetAttr(printer, "parameters"),
+		       stp_mxmlElementGetAttr(printer, "driver"),
+		       stp_mxmlElementGetAttr(printer, "name"),
+		       stp_mxmlElementGetAttr(printer, "manufacturer"),
+		       stp_xmlstrtol(stp_mxmlElementGetAttr(printer, "model")),
+		       stp_mxmlElementGetAttr(printer, "deviceid"),
+		       printfuncs);
+  if (!outprinter)
+    return NULL;
+  outprinter->comment = stp_printer_comment_from_xmltree(printer);
+  stp_vars_fill_from_xmltree(printer->child, outprinter->printvars);
+  if (stp_get_debug_level() & STP_DBG_XML)
+    stp_erprintf("stp_printer_create_from_xmltree: printer: %s\n",
+		 stp_mxmlElementGetAttr(printer, "driver"));
+  outprinter->driver = stp_get_driver(outprinter->printvars);
+  return outprinter;
 }
 
 /*
- * Parse the <family> node.
+ * Return the family module data for family_name, or NULL if there is
+ * no such family.
  */
-static void
-stpi_xml_process_family(stp_mxml_node_t *family)     /* The family node */
+static stp_family_t *
+stpi_find_family(const char *family_name)
 {
   stp_list_t *family_module_list = NULL;      /* List of valid families */
   stp_list_item_t *family_module_item;        /* Current family */
-  const char *family_name;                       /* Name of family */
-  stp_mxml_node_t *printer;                         /* printer child node */
   stp_module_t *family_module_data;           /* Family module data */
   stp_family_t *family_data = NULL;  /* Family data */
-  int family_valid = 0;                       /* Is family valid? */
 
   family_module_list = stp_module_get_class(STP_MODULE_CLASS_FAMILY);
   if (!family_module_list)
-    return;
+    return NULL;
 
-  family_name = stp_mxmlElementGetAttr(family, "name");
   family_module_item = stp_list_get_start(family_module_list);
   while (family_module_item)
     {
@@ -1187,13 +1223,29 @@ stpi_xml_process_family(stp_mxml_node_t *family)     /* The family node */
 	  family_data = family_module_data->syms;
 	  if (family_data->printer_list == NULL)
 	    family_data->printer_list = stp_list_create();
-	  family_valid = 1;
 	}
       family_module_item = stp_list_item_next(family_module_item);
     }
 
+  stp_list_destroy(family_module_list);
+  return family_data;
+}
+
+/*
+ * Parse the <family> node.
+ */
+static void
+stpi_xml_process_family(stp_mxml_node_t *family)     /* The family node */
+{
+  const char *family_name;                       /* Name of family */
+  stp_mxml_node_t *printer;                         /* printer child node */
+  stp_family_t *family_data;  /* Family data */
+
+  family_name = stp_mxmlElementGetAttr(family, "name");
+  family_data = stpi_find_family(family_name);
+
   printer = family->child;
-  while (family_valid && printer)
+  while (family_data && printer)
     {
       if (printer->type == STP_MXML_ELEMENT)
 	{
@@ -1220,9 +1272,6 @@ stpi_xml_process_family(stp_mxml_node_t *family)     /* The family node */
 	}
       printer = printer->next;
     }
-
-  stp_list_destroy(family_module_list);
-  return;
 }
 
 /*
@@ -1249,9 +1298,140 @@ stpi_xml_process_printdef(stp_mxml_node_t *printdef, const char *file) /* The pr
   return 1;
 }
 
+/*
+ * Records of the processed <printdef> node in the XML snapshot.  A
+ * family is followed by its parameter sets and printers:
+ *
+ *   PRINTDEF_SNAPSHOT_FAMILY, name
+ *   PRINTDEF_SNAPSHOT_PARAMETERS, name, settings
+ *   PRINTDEF_SNAPSHOT_PRINTER, parameters, driver, name, manufacturer,
+ *     model, device ID, comment, settings
+ */
+typedef enum
+{
+  PRINTDEF_SNAPSHOT_FAMILY = 1,
+  PRINTDEF_SNAPSHOT_PARAMETERS,
+  PRINTDEF_SNAPSHOT_PRINTER
+} printdef_snapshot_record_t;
+
+static int
+stpi_printdef_snapshot_write(stp_mxml_node_t *printdef,
+			     stpi_xml_snapshot_writer_t *w)
+{
+  stp_mxml_node_t *family;
+  stp_mxml_node_t *printer;
+
+  for (family = printdef->child; family; family = family->next)
+    {
+      if (family->type != STP_MXML_ELEMENT ||
+	  strcmp(family->value.element.name, "family") != 0)
+	continue;
+      stpi_xml_snapshot_put_int(w, PRINTDEF_SNAPSHOT_FAMILY);
+      stpi_xml_snapshot_put_string(w, stp_mxmlElementGetAttr(family, "name"));
+      for (printer = family->child; printer; printer = printer->next)
+	{
+	  if (printer->type != STP_MXML_ELEMENT)
+	    continue;
+	  if (!strcmp(printer->value.element.name, "printer"))
+	    {
+	      char *comment = stp_printer_comment_from_xmltree(printer);
+	      stpi_xml_snapshot_put_int(w, PRINTDEF_SNAPSHOT_PRINTER);
+	      stpi_xml_snapshot_put_string
+		(w, stp_mxmlElementGetAttr(printer, "parameters"));
+	      stpi_xml_snapshot_put_string
+		(w, stp_mxmlElementGetAttr(printer, "driver"));
+	      stpi_xml_snapshot_put_string
+		(w, stp_mxmlElementGetAttr(printer, "name"));
+	      stpi_xml_snapshot_put_string
+		(w, stp_mxmlElementGetAttr(printer, "manufacturer"));
+	      stpi_xml_snapshot_put_int
+		(w, stp_xmlstrtol(stp_mxmlElementGetAttr(printer, "model")));
+	      stpi_xml_snapshot_put_string
+		(w, stp_mxmlElementGetAttr(printer, "deviceid"));
+	      stpi_xml_snapshot_put_string(w, comment);
+	      STP_SAFE_FREE(comment);
+	    }
+	  else if (!strcmp(printer->value.element.name, "parameters"))
+	    {
+	      stpi_xml_snapshot_put_int(w, PRINTDEF_SNAPSHOT_PARAMETERS);
+	      stpi_xml_snapshot_put_string
+		(w, stp_mxmlElementGetAttr(printer, "name"));
+	    }
+	  else
+	    continue;
+	  if (!stpi_vars_snapshot_write(printer->child, w))
+	    return 0;
+	}
+    }
+  return 1;
+}
+
+static int
+stpi_printdef_snapshot_read(stpi_xml_snapshot_reader_t *r)
+{
+  const char *family_name = NULL;
+  stp_family_t *family_data = NULL;
+
+  while (!stpi_xml_snapshot_at_end(r))
+    {
+      switch (stpi_xml_snapshot_get_int(r))
+	{
+	case PRINTDEF_SNAPSHOT_FAMILY:
+	  family_name = stpi_xml_snapshot_get_string(r);
+	  family_data = family_name ? stpi_find_family(family_name) : NULL;
+	  break;
+	case PRINTDEF_SNAPSHOT_PARAMETERS:
+	  {
+	    const char *name = stpi_xml_snapshot_get_string(r);
+	    stp_printvars_t *printvars = NULL;
+	    if (family_data && name)
+	      printvars = stp_printvars_create(name, family_name);
+	    stpi_vars_snapshot_read(r, printvars ? printvars->printvars : NULL);
+	    if (printvars)
+	      {
+		stpi_init_printvars_list();
+		stp_list_item_create(printvars_list, NULL, printvars);
+	      }
+	  }
+	  break;
+	case PRINTDEF_SNAPSHOT_PRINTER:
+	  {
+	    const char *parameters = stpi_xml_snapshot_get_string(r);
+	    const char *driver = stpi_xml_snapshot_get_string(r);
+	    const char *long_name = stpi_xml_snapshot_get_string(r);
+	    const char *manufacturer = stpi_xml_snapshot_get_string(r);
+	    int model = stpi_xml_snapshot_get_int(r);
+	    const char *device_id = stpi_xml_snapshot_get_string(r);
+	    const char *comment = stpi_xml_snapshot_get_string(r);
+	    stp_printer_t *outprinter = NULL;
+	    if (family_data && stpi_xml_snapshot_read_ok(r))
+	      outprinter = stp_printer_create(family_name, parameters, driver,
+					      long_name, manufacturer, model,
+					      device_id,
+					      family_data->printfuncs);
+	    stpi_vars_snapshot_read(r, outprinter ? outprinter->printvars : NULL);
+	    if (outprinter)
+	      {
+		if (comment)
+		  outprinter->comment = stp_strdup(comment);
+		outprinter->driver = stp_get_driver(outprinter->printvars);
+		stp_list_item_create(family_data->printer_list, NULL,
+				     outprinter);
+	      }
+	  }
+	  break;
+	default:
+	  return 0;
+	}
+    }
+  return 1;
+}
+
 void
 stpi_init_printer(void)
 {
   stp_register_xml_parser("printdef", stpi_xml_process_printdef);
+  stpi_register_xml_snapshot("printdef", stpi_printdef_snapshot_write,
+			     stpi_printdef_snapshot_read);
   stp_register_xml_preload("printers.xml");
 }
@@ -0,0 +1,610 @@
+/*
+ *
+ *   Row rendering loop shared by the raster drivers.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ *
+ * Each output row is converted (stp_color_get_row), dithered (stp_dither)
+ * and handed to the driver.  When PipelinedRendering is set, these three
+ * stages run on separate threads: while row N is being dithered, row N+1
+ * is being converted and row N-1 is being written.  The stages pass rows
+ * through a ring of PIPELINE_DEPTH slots, each holding a copy of the
+ * converted row and of the dithered row, and the driver's write function
+ * is still called once per row, in order, on a single thread.  The output
+ * is identical to that of the serial loop.
+ *
+ * Otherwise, if the dither algorithm can make use of a band of rows at a
+ * time (stpi_dither_get_band_rows()), or the image can deliver a band of
+ * rows at a time (stp_set_image_get_rows_func()), that many rows are
+ * converted (stp_color_get_rows), then dithered together, and then
+ * written one at a time.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <limits.h>
+#include <string.h>
+
+#define PIPELINE_DEPTH 8
+
+#define RENDER_BAND_ROWS 16
+
+#define STAGE_COLOR  0
+#define STAGE_DITHER 1
+#define STAGE_WRITE  2
+#define STAGE_COUNT  3
+
+static const stp_parameter_t render_parameters[] =
+{
+  {
+    "PipelinedRendering", N_("Pipelined Rendering"), "Color=No,Category=Advanced Output Control",
+    N_("Convert, dither and output rows on separate threads.  "
+       "Output is the same either way."),
+    STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_OUTPUT,
+    STP_PARAMETER_LEVEL_ADVANCED, 0, 1, STP_CHANNEL_NONE, 1, 0
+  },
+};
+
+static const int render_parameter_count =
+sizeof(render_parameters) / sizeof(const stp_parameter_t);
+
+typedef struct
+{
+  unsigned short *input;	/* Converted row */
+  unsigned zero_mask;
+  int duplicate_line;
+  unsigned char **outputs;	/* Dithered row, one buffer per channel */
+  int *row_ends;
+} pipeline_slot_t;
+
+typedef struct
+{
+  stp_vars_t *v;
+  stp_image_t *image;
+  int out_height;
+  stpi_row_mask_func_t *mask_func;
+  stpi_row_write_func_t *write_func;
+  void *data;
+  size_t input_size;		/* Bytes in a converted row */
+  int channels;
+  stpi_thread_progress_t *progress;
+  int row_limit;		/* Rows that will be written */
+  int status;
+  pipeline_slot_t slots[PIPELINE_DEPTH];
+} pipeline_t;
+
+typedef struct
+{
+  stp_vars_t *v;
+  stp_image_t *image;
+  int out_height;
+  int errdiv;
+  int errmod;
+  int errval;
+  int errlast;
+  int errline;
+  int consecutive;		/* No image rows are skipped */
+  unsigned zero_mask;
+  size_t input_size;		/* Bytes in a converted row */
+  stpi_dither_row_t *rows;
+  int *image_rows;		/* Image row of each row of the band */
+  const unsigned short **converted; /* From stp_color_get_rows() */
+  unsigned *zero_masks;
+  unsigned short **inputs;	/* Copies of rows converted singly */
+  unsigned char **masks;
+  const unsigned short *last_input;
+  unsigned short *carry;	/* Last row of the previous band */
+  int status;
+} banded_t;
+
+static int
+render_rows_serial(stp_vars_t *v, stp_image_t *image, int out_height,
+		   stpi_row_mask_func_t *mask_func,
+		   stpi_row_write_func_t *write_func, void *data)
+{
+  int errdiv  = stp_image_height(image) / out_height;
+  int errmod  = stp_image_height(image) % out_height;
+  int errval  = 0;
+  int errlast = -1;
+  int errline  = 0;
+  unsigned zero_mask = 0;
+  int y;
+
+  for (y = 0; y < out_height; y++)
+    {
+      int duplicate_line = 1;
+      const unsigned char *mask = NULL;
+
+      if (errline != errlast)
+	{
+	  errlast = errline;
+	  duplicate_line = 0;
+	  if (stp_color_get_row(v, image, errline, &zero_mask))
+	    return 2;
+	}
+      if (mask_func)
+	mask = (mask_func)(v, y, data);
+      stp_dither(v, y, duplicate_line, zero_mask, mask);
+      (write_func)(v, y, data);
+      errval += errmod;
+      errline += errdiv;
+      if (errval >= out_height)
+	{
+	  errval -= out_height;
+	  errline++;
+	}
+    }
+  return 1;
+}
+
+/*
+ * Convert the rows of a band that are not duplicates of the row before
+ * them.  If no image rows are skipped, the rows that are needed are
+ * consecutive and are converted with a single call.  Returns the number
+ * of rows of the band that can be dithered.
+ */
+static int
+convert_band(banded_t *b, int nrows)
+{
+  stp_vars_t *v = b->v;
+  int i;
+  int first = -1;
+  int count = 0;
+
+  for (i = 0; i < nrows; i++)
+    {
+      stpi_dither_row_t *r = &(b->rows[i]);
+      r->duplicate_line = 1;
+      if (b->errline != b->errlast)
+	{
+	  b->errlast = b->errline;
+	  r->duplicate_line = 0;
+	  if (first < 0)
+	    first = b->errline;
+	  count++;
+	}
+      b->image_rows[i] = b->errline;
+      b->errval += b->errmod;
+      b->errline += b->errdiv;
+      if (b->errval >= b->out_height)
+	{
+	  b->errval -= b->out_height;
+	  b->errline++;
+	}
+    }
+  /*
+   * The last row of the previous band is overwritten by the conversion,
+   * so it must be kept if this band starts by repeating it.
+   */
+  if (b->rows[0].duplicate_line && b->last_input &&
+      b->last_input != b->carry)
+    {
+      if (!b->carry)
+	b->carry = stp_malloc(b->input_size);
+      memcpy(b->carry, b->last_input, b->input_size);
+      b->last_input = b->carry;
+    }
+
+  if (b->consecutive && count > 0)
+    {
+      if (stp_color_get_rows(v, b->image, first, count, b->converted,
+			     b->zero_masks))
+	{
+	  b->status = 2;
+	  return 0;
+	}
+      for (i = 0; i < nrows; i++)
+	{
+	  stpi_dither_row_t *r = &(b->rows[i]);
+	  if (!r->duplicate_line)
+	    {
+	      b->last_input = b->converted[b->image_rows[i] - first];
+	      b->zero_mask = b->zero_masks[b->image_rows[i] - first];
+	    }
+	  r->input = b->last_input;
+	  r->zero_mask = b->zero_mask;
+	}
+      b->input_size = stpi_channel_get_output_size(v);
+      return nrows;
+    }
+
+  for (i = 0; i < nrows; i++)
+    {
+      stpi_dither_row_t *r = &(b->rows[i]);
+      if (!r->duplicate_line)
+	{
+	  if (stp_color_get_row(v, b->image, b->image_rows[i], &(b->zero_mask)))
+	    {
+	      /*
+	       * The rows before this one are still printed.
+	       */
+	      b->status = 2;
+	      return i;
+	    }
+	  if (!b->inputs[i])
+	    {
+	      b->input_size = stpi_channel_get_output_size(v);
+	      b->inputs[i] = stp_malloc(b->input_size);
+	    }
+	  memcpy(b->inputs[i], stp_channel_get_output(v), b->input_size);
+	  b->last_input = b->inputs[i];
+	}
+      r->input = b->last_input;
+      r->zero_mask = b->zero_mask;
+    }
+  return nrows;
+}
+
+static int
+render_rows_banded(stp_vars_t *v, stp_image_t *image, int out_height,
+		   stpi_row_mask_func_t *mask_func,
+		   stpi_row_write_func_t *write_func, void *data,
+		   int band_rows)
+{
+  banded_t b;
+  int channels = stpi_dither_get_channel_count(v);
+  size_t mask_size = stpi_dither_get_mask_size(v);
+  int y, i, j;
+
+  memset(&b, 0, sizeof(banded_t));
+  b.v = v;
+  b.image = image;
+  b.out_height = out_height;
+  b.errdiv = stp_image_height(image) / out_height;
+  b.errmod = stp_image_height(image) % out_height;
+  b.errlast = -1;
+  b.consecutive = stp_image_height(image) <= out_height;
+  b.status = 1;
+  b.rows = stp_zalloc(sizeof(stpi_dither_row_t) * band_rows);
+  b.image_rows = stp_zalloc(sizeof(int) * band_rows);
+  b.converted = stp_zalloc(sizeof(unsigned short *) * band_rows);
+  b.zero_masks = stp_zalloc(sizeof(unsigned) * band_rows);
+  b.inputs = stp_zalloc(sizeof(unsigned short *) * band_rows);
+  b.masks = stp_zalloc(sizeof(unsigned char *) * band_rows);
+  for (i = 0; i < band_rows; i++)
+    {
+      b.rows[i].outputs = stp_zalloc(sizeof(unsigned char *) * (channels + 1));
+      b.rows[i].row_ends = stp_zalloc(sizeof(int) * 2 * (channels + 1));
+      for (j = 0; j < channels; j++)
+	{
+	  size_t size = stpi_dither_get_row_size(v, j);
+	  if (size > 0)
+	    b.rows[i].outputs[j] = stp_zalloc(size);
+	}
+    }
+  stpi_dither_set_pipelined(v, 1);
+  for (y = 0; y < out_height && b.status == 1; y += band_rows)
+    {
+      int nrows = out_height - y;
+      if (nrows > band_rows)
+	nrows = band_rows;
+      nrows = convert_band(&b, nrows);
+      /*
+       * The mask function may reuse its buffer for the next row.
+       */
+      for (i = 0; i < nrows; i++)
+	{
+	  const unsigned char *mask = mask_func ? (mask_func)(v, y + i, data) : NULL;
+	  b.rows[i].mask = NULL;
+	  if (mask)
+	    {
+	      if (!b.masks[i])
+		b.masks[i] = stp_malloc(mask_size);
+	      memcpy(b.masks[i], mask, mask_size);
+	      b.rows[i].mask = b.masks[i];
+	    }
+	}
+      stpi_dither_band(v, y, nrows, b.rows);
+      for (i = 0; i < nrows; i++)
+	{
+	  stpi_dither_publish_row(v, b.rows[i].outputs, b.rows[i].row_ends);
+	  (write_func)(v, y + i, data);
+	}
+    }
+  stpi_dither_set_pipelined(v, 0);
+
+  for (i = 0; i < band_rows; i++)
+    {
+      for (j = 0; j < channels; j++)
+	STP_SAFE_FREE(b.rows[i].outputs[j]);
+      stp_free(b.rows[i].outputs);
+      stp_free(b.rows[i].row_ends);
+      STP_SAFE_FREE(b.inputs[i]);
+      STP_SAFE_FREE(b.masks[i]);
+    }
+  stp_free(b.rows);
+  stp_free(b.image_rows);
+  stp_free(b.converted);
+  stp_free(b.zero_masks);
+  stp_free(b.inputs);
+  stp_free(b.masks);
+  STP_SAFE_FREE(b.carry);
+  return b.status;
+}
+
+/*
+ * Wait until row Y may be processed by STAGE, or return 0 if it will
+ * never be.  Each stage also waits for the stage after it to be done
+ * with the slot that row Y will use.
+ */
+static int
+stage_wait(pipeline_t *p, int stage, int y)
+{
+  if (stage > STAGE_COLOR)
+    stpi_thread_progress_wait(p->progress, stage - 1, y + 1);
+  if (stage == STAGE_COLOR && y >= PIPELINE_DEPTH)
+    stpi_thread_progress_wait(p->progress, STAGE_WRITE,
+			      y + 1 - PIPELINE_DEPTH);
+  return y < p->row_limit;
+}
+
+static void
+color_stage(pipeline_t *p)
+{
+  stp_vars_t *v = p->v;
+  int errdiv  = stp_image_height(p->image) / p->out_height;
+  int errmod  = stp_image_height(p->image) % p->out_height;
+  int errval  = 0;
+  int errlast = -1;
+  int errline  = 0;
+  unsigned zero_mask = 0;
+  int y;
+
+  for (y = 0; y < p->out_height; y++)
+    {
+      pipeline_slot_t *slot = &(p->slots[y % PIPELINE_DEPTH]);
+      stage_wait(p, STAGE_COLOR, y);
+      slot->duplicate_line = 1;
+      if (errline != errlast)
+	{
+	  errlast = errline;
+	  slot->duplicate_line = 0;
+	  if (stp_color_get_row(v, p->image, errline, &zero_mask))
+	    {
+	      /*
+	       * The stages after this one check the row limit only after
+	       * waiting for this stage, so it must be set first.
+	       */
+	      p->status = 2;
+	      p->row_limit = y;
+	      stpi_thread_progress_post(p->progress, STAGE_COLOR, INT_MAX);
+	      return;
+	    }
+	}
+      /*
+       * The channels are set up by the first conversion, so the slots
+       * cannot be allocated any earlier.
+       */
+      if (!slot->input)
+	{
+	  p->input_size = stpi_channel_get_output_size(v);
+	  slot->input = stp_malloc(p->input_size);
+	}
+      slot->zero_mask = zero_mask;
+      memcpy(slot->input, stp_channel_get_output(v), p->input_size);
+      stpi_thread_progress_post(p->progress, STAGE_COLOR, y + 1);
+      errval += errmod;
+      errline += errdiv;
+      if (errval >= p->out_height)
+	{
+	  errval -= p->out_height;
+	  errline++;
+	}
+    }
+}
+
+static void
+dither_stage(pipeline_t *p)
+{
+  stp_vars_t *v = p->v;
+  int y;
+
+  for (y = 0; y < p->out_height; y++)
+    {
+      pipeline_slot_t *slot = &(p->slots[y % PIPELINE_DEPTH]);
+      const unsigned char *mask = NULL;
+      if (!stage_wait(p, STAGE_DITHER, y))
+	break;
+      if (p->mask_func)
+	mask = (p->mask_func)(v, y, p->data);
+      stpi_dither_set_row_buffers(v, slot->outputs);
+      stp_dither_internal(v, y, slot->input, slot->duplicate_line,
+			  slot->zero_mask, mask);
+      stpi_dither_get_row_ends(v, slot->row_ends);
+      stpi_thread_progress_post(p->progress, STAGE_DITHER, y + 1);
+    }
+  stpi_thread_progress_post(p->progress, STAGE_DITHER, INT_MAX);
+}
+
+static void
+write_stage(pipeline_t *p)
+{
+  stp_vars_t *v = p->v;
+  int y;
+
+  for (y = 0; y < p->out_height; y++)
+    {
+      pipeline_slot_t *slot = &(p->slots[y % PIPELINE_DEPTH]);
+      if (!stage_wait(p, STAGE_WRITE, y))
+	break;
+      stpi_dither_publish_row(v, slot->outputs, slot->row_ends);
+      (p->write_func)(v, y, p->data);
+      stpi_thread_progress_post(p->progress, STAGE_WRITE, y + 1);
+    }
+  stpi_thread_progress_post(p->progress, STAGE_WRITE, INT_MAX);
+}
+
+static void
+run_stage(void *data, int stage)
+{
+  pipeline_t *p = (pipeline_t *) data;
+  switch (stage)
+    {
+    case STAGE_COLOR:
+      color_stage(p);
+      break;
+    case STAGE_DITHER:
+      dither_stage(p);
+      break;
+    case STAGE_WRITE:
+      write_stage(p);
+      break;
+    }
+}
+
+static void
+free_slots(pipeline_t *p)
+{
+  int i, j;
+  for (i = 0; i < PIPELINE_DEPTH; i++)
+    {
+      pipeline_slot_t *slot = &(p->slots[i]);
+      STP_SAFE_FREE(slot->input);
+      if (slot->outputs)
+	{
+	  for (j = 0; j < p->channels; j++)
+	    STP_SAFE_FREE(slot->outputs[j]);
+	  stp_free(slot->outputs);
+	  slot->outputs = NULL;
+	}
+      STP_SAFE_FREE(slot->row_ends);
+    }
+}
+
+static int
+render_rows_pipelined(stp_vars_t *v, stp_image_t *image, int out_height,
+		      stpi_row_mask_func_t *mask_func,
+		      stpi_row_write_func_t *write_func, void *data,
+		      stpi_thread_pool_t *pool)
+{
+  pipeline_t p;
+  int i, j;
+
+  memset(&p, 0, sizeof(pipeline_t));
+  p.v = v;
+  p.image = image;
+  p.out_height = out_height;
+  p.mask_func = mask_func;
+  p.write_func = write_func;
+  p.data = data;
+  p.channels = stpi_dither_get_channel_count(v);
+  p.row_limit = out_height;
+  p.status = 1;
+  for (i = 0; i < PIPELINE_DEPTH; i++)
+    {
+      pipeline_slot_t *slot = &(p.slots[i]);
+      slot->outputs = stp_zalloc(sizeof(unsigned char *) * (p.channels + 1));
+      slot->row_ends = stp_zalloc(sizeof(int) * 2 * (p.channels + 1));
+      for (j = 0; j < p.channels; j++)
+	{
+	  size_t size = stpi_dither_get_row_size(v, j);
+	  if (size > 0)
+	    slot->outputs[j] = stp_zalloc(size);
+	}
+    }
+  p.progress = stpi_thread_progress_create(STAGE_COUNT);
+
+  stpi_dither_set_pipelined(v, 1);
+  stpi_thread_pool_run(pool, STAGE_COUNT, run_stage, &p);
+  stpi_dither_set_pipelined(v, 0);
+
+  stpi_thread_progress_destroy(p.progress);
+  free_slots(&p);
+  return p.status;
+}
+
+/*
+ * Only the drivers that print through stpi_render_rows() list these
+ * parameters.
+ */
+stp_parameter_list_t
+stpi_render_list_parameters(const stp_vars_t *v)
+{
+  stp_parameter_list_t *ret = stp_parameter_list_create();
+  int i;
+  for (i = 0; i < render_parameter_count; i++)
+    stp_parameter_list_add_param(ret, &(render_parameters[i]));
+  return ret;
+}
+
+void
+stpi_render_describe_parameter(const stp_vars_t *v, const char *name,
+			       stp_parameter_t *description)
+{
+  description->p_type = STP_PARAMETER_TYPE_INVALID;
+  if (name == NULL)
+    return;
+  description->deflt.str = NULL;
+  if (strcmp(name, "PipelinedRendering") == 0)
+    {
+      stp_fill_parameter_settings(description, &(render_parameters[0]));
+      description->deflt.boolean = 0;
+    }
+}
+
+int
+stpi_render_rows(stp_vars_t *v, stp_image_t *image, int out_height,
+		 stpi_row_mask_func_t *mask_func,
+		 stpi_row_write_func_t *write_func, void *data)
+{
+  stpi_thread_pool_t *pool = NULL;
+  int status;
+
+  if (out_height <= 0)
+    return 1;
+  /*
+   * All three stages must run at once, since each of them waits for the
+   * others; a pool that could not start enough threads is no use.
+   */
+  if (stp_check_boolean_parameter(v, "PipelinedRendering",
+				  STP_PARAMETER_ACTIVE) &&
+      stp_get_boolean_parameter(v, "PipelinedRendering") &&
+      (pool = stpi_thread_pool_create(STAGE_COUNT)) != NULL &&
+      stpi_thread_pool_size(pool) < STAGE_COUNT)
+    {
+      stpi_thread_pool_destroy(pool);
+      pool = NULL;
+    }
+  if (!pool)
+    {
+      int band_rows = stpi_dither_get_band_rows(v);
+      if (band_rows == 1 && stp_get_image_get_rows_func(v, image))
+	band_rows = RENDER_BAND_ROWS;
+      if (band_rows > 1)
+	{
+	  stp_deprintf(STP_DBG_INK, "Rendering %d rows in bands of %d\n",
+		       out_height, band_rows);
+	  return render_rows_banded(v, image, out_height, mask_func,
+				    write_func, data, band_rows);
+	}
+      return render_rows_serial(v, image, out_height, mask_func, write_func,
+				data);
+    }
+  stp_deprintf(STP_DBG_INK, "Rendering %d rows in a pipeline\n",
+	       out_height);
+  status = render_rows_pipelined(v, image, out_height, mask_func,
+				 write_func, data, pool);
+  stpi_thread_pool_destroy(pool);
+  return status;
+}
@@ -0,0 +1,193 @@
+/*
+ *
+ *   Time spent in each stage of the print pipeline.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ *
+ * Each stage is only ever timed on one thread at a time (the pipeline in
+ * render-pipeline.c runs each stage on a thread of its own), so the totals
+ * need no locking.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+typedef struct
+{
+  double wall;
+  double cpu;
+  unsigned long calls;
+  double bytes;
+} stage_total_t;
+
+struct stpi_stage_times
+{
+  int refcount;
+  int enabled;
+  stage_total_t totals[STPI_STAGE_COUNT];
+};
+
+static const char *const stage_names[STPI_STAGE_COUNT] =
+{
+  "image-read",
+  "color",
+  "channel",
+  "dither",
+  "weave",
+  "output",
+};
+
+stpi_stage_times_t *
+stpi_stage_times_create(void)
+{
+  stpi_stage_times_t *times = stp_zalloc(sizeof(stpi_stage_times_t));
+  times->refcount = 1;
+  return times;
+}
+
+stpi_stage_times_t *
+stpi_stage_times_ref(stpi_stage_times_t *times)
+{
+  if (times)
+    times->refcount++;
+  return times;
+}
+
+void
+stpi_stage_times_release(stpi_stage_times_t *times)
+{
+  if (times && --times->refcount == 0)
+    stp_free(times);
+}
+
+static double
+wall_time(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+#ifdef HAVE_SYS_TIME_H
+  {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+  }
+#else
+  return (double) time(NULL);
+#endif
+}
+
+static double
+cpu_time(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+  return (double) clock() / CLOCKS_PER_SEC;
+}
+
+void
+stpi_stage_times_setup(const stp_vars_t *v)
+{
+  stpi_stage_times_t *times = stpi_vars_get_stage_times(v);
+  const char *env = getenv("STP_STAGE_TIMES");
+  if (!times)
+    return;
+  times->enabled =
+    ((env && *env && strcmp(env, "0") != 0) ||
+     (stp_check_boolean_parameter(v, "StageTimes", STP_PARAMETER_ACTIVE) &&
+      stp_get_boolean_parameter(v, "StageTimes")));
+}
+
+stpi_stage_times_t *
+stpi_stage_times(const stp_vars_t *v)
+{
+  stpi_stage_times_t *times = stpi_vars_get_stage_times(v);
+  if (times && times->enabled)
+    return times;
+  return NULL;
+}
+
+void
+stpi_stage_begin(const stpi_stage_times_t *times, stpi_stage_mark_t *mark,
+		 int inner)
+{
+  mark->inner = inner;
+  if (inner >= 0 && inner < STPI_STAGE_COUNT)
+    {
+      mark->inner_wall = times->totals[inner].wall;
+      mark->inner_cpu = times->totals[inner].cpu;
+    }
+  mark->cpu = cpu_time();
+  mark->wall = wall_time();
+}
+
+void
+stpi_stage_end(stpi_stage_times_t *times, const stpi_stage_mark_t *mark,
+	       stpi_stage_t stage, size_t bytes)
+{
+  double wall = wall_time() - mark->wall;
+  double cpu = cpu_time() - mark->cpu;
+  stage_total_t *total = &(times->totals[stage]);
+  if (mark->inner >= 0 && mark->inner < STPI_STAGE_COUNT)
+    {
+      wall -= times->totals[mark->inner].wall - mark->inner_wall;
+      cpu -= times->totals[mark->inner].cpu - mark->inner_cpu;
+    }
+  total->wall += wall;
+  total->cpu += cpu;
+  total->calls++;
+  total->bytes += bytes;
+}
+
+void
+stpi_stage_times_report(const stp_vars_t *v)
+{
+  stpi_stage_times_t *times = stpi_stage_times(v);
+  int i;
+  if (!times)
+    return;
+  for (i = 0; i < STPI_STAGE_COUNT; i++)
+    {
+      const stage_total_t *total = &(times->totals[i]);
+      if (total->calls == 0)
+	continue;
+      stp_eprintf(v, "stage-times: %s calls=%lu bytes=%.0f wall=%.6f "
+		  "cpu=%.6f MB/s=%.1f\n",
+		  stage_names[i], total->calls, total->bytes,
+		  total->wall, total->cpu,
+		  total->wall > 0 ? total->bytes / total->wall / 1000000.0 : 0.0);
+    }
+  memset(times->totals, 0, sizeof(times->totals));
+}
@@ -0,0 +1,317 @@
+/*
+ *
+ *   Worker thread pool for parallel stages of the print pipeline.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ *
+ * When POSIX threads are not available, stpi_thread_pool_create() always
+ * returns NULL and callers are expected to use their serial code path.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <string.h>
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_PTHREAD_H)
+#define STPI_USE_THREADS 1
+#include <pthread.h>
+#endif
+
+#define STPI_MAX_THREADS 64
+
+#ifdef STPI_USE_THREADS
+
+struct stpi_thread_pool
+{
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;	/* Signalled when new work is posted */
+  pthread_cond_t done_cond;	/* Signalled when the last job finishes */
+  pthread_t *threads;
+  int nthreads;			/* Including the calling thread */
+  int generation;		/* Incremented each time work is posted */
+  int shutdown;
+  stpi_thread_func_t *func;
+  void *data;
+  int njobs;
+  int next_job;
+  int jobs_done;
+};
+
+struct stpi_thread_progress
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int count;
+  int *values;
+};
+
+/*
+ * Jobs are handed out strictly in increasing order, so a job that waits
+ * on a lower-numbered job never waits on one that has not been started.
+ */
+static void
+run_jobs(stpi_thread_pool_t *pool)
+{
+  while (pool->next_job < pool->njobs)
+    {
+      int job = pool->next_job++;
+      pthread_mutex_unlock(&(pool->lock));
+      (pool->func)(pool->data, job);
+      pthread_mutex_lock(&(pool->lock));
+      pool->jobs_done++;
+      if (pool->jobs_done == pool->njobs)
+	pthread_cond_broadcast(&(pool->done_cond));
+    }
+}
+
+static void *
+worker_thread(void *arg)
+{
+  stpi_thread_pool_t *pool = (stpi_thread_pool_t *) arg;
+  int generation = 0;
+  pthread_mutex_lock(&(pool->lock));
+  while (1)
+    {
+      while (!pool->shutdown && generation == pool->generation)
+	pthread_cond_wait(&(pool->work_cond), &(pool->lock));
+      if (pool->shutdown)
+	break;
+      generation = pool->generation;
+      run_jobs(pool);
+    }
+  pthread_mutex_unlock(&(pool->lock));
+  return NULL;
+}
+
+stpi_thread_pool_t *
+stpi_thread_pool_create(int nthreads)
+{
+  stpi_thread_pool_t *pool;
+  int i;
+  if (nthreads > STPI_MAX_THREADS)
+    nthreads = STPI_MAX_THREADS;
+  if (nthreads <= 1)
+    return NULL;
+  pool = stp_zalloc(sizeof(stpi_thread_pool_t));
+  pthread_mutex_init(&(pool->lock), NULL);
+  pthread_cond_init(&(pool->work_cond), NULL);
+  pthread_cond_init(&(pool->done_cond), NULL);
+  pool->threads = stp_zalloc(sizeof(pthread_t) * (nthreads - 1));
+  pool->nthreads = 1;
+  for (i = 0; i < nthreads - 1; i++)
+    {
+      if (pthread_create(&(pool->threads[i]), NULL, worker_thread, pool) != 0)
+	break;
+      pool->nthreads++;
+    }
+  if (pool->nthreads == 1)
+    {
+      stpi_thread_pool_destroy(pool);
+      return NULL;
+    }
+  stp_deprintf(STP_DBG_COLORFUNC, "Created thread pool with %d threads\n",
+	       pool->nthreads);
+  return pool;
+}
+
+void
+stpi_thread_pool_destroy(stpi_thread_pool_t *pool)
+{
+  int i;
+  if (!pool)
+    return;
+  pthread_mutex_lock(&(pool->lock));
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&(pool->work_cond));
+  pthread_mutex_unlock(&(pool->lock));
+  for (i = 0; i < pool->nthreads - 1; i++)
+    pthread_join(pool->threads[i], NULL);
+  pthread_cond_destroy(&(pool->done_cond));
+  pthread_cond_destroy(&(pool->work_cond));
+  pthread_mutex_destroy(&(pool->lock));
+  stp_free(pool->threads);
+  stp_free(pool);
+}
+
+int
+stpi_thread_pool_size(const stpi_thread_pool_t *pool)
+{
+  return pool ? pool->nthreads : 1;
+}
+
+void
+stpi_thread_pool_run(stpi_thread_pool_t *pool, int njobs,
+		     stpi_thread_func_t *func, void *data)
+{
+  int i;
+  if (!pool || njobs <= 1)
+    {
+      for (i = 0; i < njobs; i++)
+	(func)(data, i);
+      return;
+    }
+  pthread_mutex_lock(&(pool->lock));
+  pool->func = func;
+  pool->data = data;
+  pool->njobs = njobs;
+  pool->next_job = 0;
+  pool->jobs_done = 0;
+  pool->generation++;
+  pthread_cond_broadcast(&(pool->work_cond));
+  run_jobs(pool);
+  while (pool->jobs_done < pool->njobs)
+    pthread_cond_wait(&(pool->done_cond), &(pool->lock));
+  pool->func = NULL;
+  pool->data = NULL;
+  pool->njobs = 0;
+  pthread_mutex_unlock(&(pool->lock));
+}
+
+stpi_thread_progress_t *
+stpi_thread_progress_create(int count)
+{
+  stpi_thread_progress_t *progress = stp_zalloc(sizeof(stpi_thread_progress_t));
+  pthread_mutex_init(&(progress->lock), NULL);
+  pthread_cond_init(&(progress->cond), NULL);
+  progress->count = count;
+  progress->values = stp_zalloc(sizeof(int) * count);
+  return progress;
+}
+
+void
+stpi_thread_progress_destroy(stpi_thread_progress_t *progress)
+{
+  if (!progress)
+    return;
+  pthread_cond_destroy(&(progress->cond));
+  pthread_mutex_destroy(&(progress->lock));
+  stp_free(progress->values);
+  stp_free(progress);
+}
+
+void
+stpi_thread_progress_reset(stpi_thread_progress_t *progress)
+{
+  pthread_mutex_lock(&(progress->lock));
+  memset(progress->values, 0, sizeof(int) * progress->count);
+  pthread_mutex_unlock(&(progress->lock));
+}
+
+void
+stpi_thread_progress_post(stpi_thread_progress_t *progress, int which,
+			  int value)
+{
+  pthread_mutex_lock(&(progress->lock));
+  progress->values[which] = value;
+  pthread_cond_broadcast(&(progress->cond));
+  pthread_mutex_unlock(&(progress->lock));
+}
+
+void
+stpi_thread_progress_wait(stpi_thread_progress_t *progress, int which,
+			  int value)
+{
+  pthread_mutex_lock(&(progress->lock));
+  while (progress->values[which] < value)
+    pthread_cond_wait(&(progress->cond), &(progress->lock));
+  pthread_mutex_unlock(&(progress->lock));
+}
+
+#else /* !STPI_USE_THREADS */
+
+/*
+ * Without threads the progress counters are never contended; jobs run
+ * to completion in order, so every wait is already satisfied.
+ */
+
+struct stpi_thread_progress
+{
+  int count;
+  int *values;
+};
+
+stpi_thread_pool_t *
+stpi_thread_pool_create(int nthreads)
+{
+  return NULL;
+}
+
+void
+stpi_thread_pool_destroy(stpi_thread_pool_t *pool)
+{
+}
+
+int
+stpi_thread_pool_size(const stpi_thread_pool_t *pool)
+{
+  return 1;
+}
+
+void
+stpi_thread_pool_run(stpi_thread_pool_t *pool, int njobs,
+		     stpi_thread_func_t *func, void *data)
+{
+  int i;
+  for (i = 0; i < njobs; i++)
+    (func)(data, i);
+}
+
+stpi_thread_progress_t *
+stpi_thread_progress_create(int count)
+{
+  stpi_thread_progress_t *progress = stp_zalloc(sizeof(stpi_thread_progress_t));
+  progress->count = count;
+  progress->values = stp_zalloc(sizeof(int) * count);
+  return progress;
+}
+
+void
+stpi_thread_progress_destroy(stpi_thread_progress_t *progress)
+{
+  if (!progress)
+    return;
+  stp_free(progress->values);
+  stp_free(progress);
+}
+
+void
+stpi_thread_progress_reset(stpi_thread_progress_t *progress)
+{
+  memset(progress->values, 0, sizeof(int) * progress->count);
+}
+
+void
+stpi_thread_progress_post(stpi_thread_progress_t *progress, int which,
+			  int value)
+{
+  progress->values[which] = value;
+}
+
+void
+stpi_thread_progress_wait(stpi_thread_progress_t *progress, int which,
+			  int value)
+{
+}
+
+#endif /* STPI_USE_THREADS */
@@ -0,0 +1,817 @@
+/*
+ *
+ *   Compiled snapshot of the XML printer database.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ *
+ * The snapshot holds the XML files of a data directory (other than the
+ * dither matrices, which have their own cache) in a binary file kept in
+ * that directory.  For a file whose elements are all handled by parsers
+ * that registered snapshot functions, such as printers.xml and
+ * papers.xml, it also holds the result of processing them, and
+ * stp_xml_parse_file() loads that rather than building and walking a
+ * tree.  The other files, such as the escp2 model data, are stored as
+ * their node trees, which stp_xml_load_file() rebuilds without running
+ * the XML parser.  The snapshot is written by stpi_xml_write_snapshot()
+ * (see the gutenprint-compile-xml tool), normally when the data files
+ * are installed.
+ *
+ * Each file is recorded with its size and modification time, and a file
+ * that no longer matches is parsed as usual.
+ *
+ * The payload is an array of 32-bit words:
+ *
+ *   file count, string pool offset, string pool size (in bytes)
+ *   one (name, root node, processed data, size, mtime low, mtime high)
+ *     entry per file, sorted by name
+ *   node records and processed data
+ *   string pool
+ *
+ * File names are relative to the data directory.  Names and strings
+ * are byte offsets into the string pool; root nodes and processed data
+ * are word offsets into the payload (0 if the file has no processed
+ * data).  A node record is either
+ *
+ *   STP_MXML_ELEMENT, name, attribute count, child count,
+ *     (attribute name, attribute value) for each attribute,
+ *     followed by the child records
+ *
+ * or
+ *
+ *   STP_MXML_TEXT, whitespace, string
+ *
+ * The processed data of a file is a section count followed by one
+ * (element name, word count, records) section for each element, in the
+ * order of the file.  The records belong to the module that registered
+ * the element; a string in them is SNAPSHOT_NULL or a string offset.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_NAME "xml-snapshot.bin"
+#define SNAPSHOT_MAGIC "STPXML"
+#define SNAPSHOT_HEADER_WORDS 3
+#define SNAPSHOT_ENTRY_WORDS 6
+#define SNAPSHOT_SIGNATURE_WORDS 3
+#define SNAPSHOT_NULL 0xffffffffu
+
+typedef unsigned int snapshot_word_t;
+
+static unsigned
+hash_bytes(unsigned h, const char *s, size_t bytes)
+{
+  while (bytes-- > 0)
+    h = (h ^ (unsigned char) *s++) * 16777619u;
+  return h;
+}
+
+/*
+ * Compute the size and modification time recorded for file.  Returns 0
+ * if the file does not exist.
+ */
+static int
+file_signature(const char *file, snapshot_word_t *signature)
+{
+  struct stat st;
+  unsigned long long mtime;
+  if (stat(file, &st) != 0)
+    return 0;
+  mtime = (unsigned long long) st.st_mtime;
+  signature[0] = (snapshot_word_t) st.st_size;
+  signature[1] = (snapshot_word_t) mtime;
+  signature[2] = (snapshot_word_t) (mtime >> 32);
+  return 1;
+}
+
+/*
+ * Return the <gutenprint> element of doc, or NULL if there is none.
+ */
+static stp_mxml_node_t *
+snapshot_root(stp_mxml_node_t *doc)
+{
+  stp_mxml_node_t *cur = doc->child;
+  while (cur &&
+	 (cur->type != STP_MXML_ELEMENT ||
+	  (strcmp(cur->value.element.name, "gutenprint") != 0 &&
+	   strcmp(cur->value.element.name, "gimp-print") != 0)))
+    cur = cur->next;
+  return cur;
+}
+
+/*
+ * Reading the snapshot
+ */
+
+typedef struct
+{
+  char *dir;
+  stpi_binary_cache_t *cache;
+  const snapshot_word_t *words;
+  size_t word_count;
+  const char *strings;
+  size_t string_bytes;
+  unsigned file_count;
+} snapshot_t;
+
+static snapshot_t *snapshots;
+static int snapshot_count;
+static int snapshots_checked;
+
+static int
+snapshot_open(snapshot_t *snap, const char *filename)
+{
+  const snapshot_word_t *words;
+  size_t bytes;
+  snap->cache = stpi_binary_cache_open_file(filename, SNAPSHOT_MAGIC, NULL);
+  if (!snap->cache)
+    return 0;
+  words = stpi_binary_cache_get_data(snap->cache, &bytes);
+  if (bytes < SNAPSHOT_HEADER_WORDS * sizeof(snapshot_word_t) ||
+      words[1] < SNAPSHOT_HEADER_WORDS * sizeof(snapshot_word_t) ||
+      words[1] > bytes || words[2] > bytes - words[1] ||
+      (words[2] > 0 && (((const char *) words)[words[1] + words[2] - 1]
+			!= '\0')) ||
+      words[0] > (words[1] / sizeof(snapshot_word_t) -
+		  SNAPSHOT_HEADER_WORDS) / SNAPSHOT_ENTRY_WORDS)
+    {
+      stp_deprintf(STP_DBG_XML, "stp_xml_load_file: bad XML snapshot %s\n",
+		   filename);
+      stpi_binary_cache_close(snap->cache);
+      snap->cache = NULL;
+      return 0;
+    }
+  snap->words = words;
+  snap->file_count = words[0];
+  snap->word_count = words[1] / sizeof(snapshot_word_t);
+  snap->strings = (const char *) words + words[1];
+  snap->string_bytes = words[2];
+  return 1;
+}
+
+/*
+ * Open the snapshot in each data directory that has one.
+ */
+static void
+snapshot_open_all(void)
+{
+  stp_list_t *dir_list = stpi_data_path();
+  stp_list_item_t *item;
+  snapshots_checked = 1;
+  snapshots = stp_zalloc(sizeof(snapshot_t) *
+			 (stp_list_get_length(dir_list) + 1));
+  for (item = stp_list_get_start(dir_list); item;
+       item = stp_list_item_next(item))
+    {
+      const char *dir = (const char *) stp_list_item_get_data(item);
+      char *filename = stpi_path_merge(dir, SNAPSHOT_NAME);
+      if (snapshot_open(snapshots + snapshot_count, filename))
+	snapshots[snapshot_count++].dir = stp_strdup(dir);
+      stp_free(filename);
+    }
+  stp_list_destroy(dir_list);
+}
+
+static const char *
+snapshot_string(const snapshot_t *snap, snapshot_word_t offset)
+{
+  return offset < snap->string_bytes ? snap->strings + offset : NULL;
+}
+
+/*
+ * Rebuild the node at *pos (and its children) under parent.  Returns
+ * NULL if the record is malformed.
+ */
+static stp_mxml_node_t *
+snapshot_read_node(const snapshot_t *snap, stp_mxml_node_t *parent,
+		   size_t *pos)
+{
+  const snapshot_word_t *w = snap->words + *pos;
+  stp_mxml_node_t *node;
+  const char *name;
+  unsigned i;
+
+  if (*pos + 3 > snap->word_count)
+    return NULL;
+  if (w[0] == STP_MXML_TEXT)
+    {
+      name = snapshot_string(snap, w[2]);
+      *pos += 3;
+      return name ? stp_mxmlNewText(parent, w[1], name) : NULL;
+    }
+  if (w[0] != STP_MXML_ELEMENT || *pos + 4 + 2 * (size_t) w[2] >
+      snap->word_count || !(name = snapshot_string(snap, w[1])))
+    return NULL;
+  node = stp_mxmlNewElement(parent, name);
+  for (i = 0; i < w[2]; i++)
+    {
+      const char *attr = snapshot_string(snap, w[4 + 2 * i]);
+      const char *value = snapshot_string(snap, w[5 + 2 * i]);
+      if (!attr || !value)
+	{
+	  stp_mxmlDelete(node);
+	  return NULL;
+	}
+      stp_mxmlElementSetAttr(node, attr, value);
+    }
+  *pos += 4 + 2 * (size_t) w[2];
+  for (i = 0; i < w[3]; i++)
+    if (!snapshot_read_node(snap, node, pos))
+      {
+	stp_mxmlDelete(node);
+	return NULL;
+      }
+  return node;
+}
+
+/*
+ * Return the table entry for name, or NULL if the snapshot does not
+ * contain it.
+ */
+static const snapshot_word_t *
+snapshot_find(const snapshot_t *snap, const char *name)
+{
+  const snapshot_word_t *table = snap->words + SNAPSHOT_HEADER_WORDS;
+  size_t low = 0;
+  size_t high = snap->file_count;
+  while (low < high)
+    {
+      size_t mid = (low + high) / 2;
+      const snapshot_word_t *entry = table + mid * SNAPSHOT_ENTRY_WORDS;
+      const char *entry_name = snapshot_string(snap, entry[0]);
+      int cmp = strcmp(name, entry_name ? entry_name : "");
+      if (cmp == 0)
+	return entry;
+      else if (cmp < 0)
+	high = mid;
+      else
+	low = mid + 1;
+    }
+  return NULL;
+}
+
+/*
+ * Return the table entry for file in the snapshot of its data
+ * directory (setting *snap), or NULL if there is no usable entry for
+ * it.
+ */
+static const snapshot_word_t *
+snapshot_lookup(const char *file, const snapshot_t **snap)
+{
+  int i;
+
+  if (!snapshots_checked)
+    snapshot_open_all();
+  for (i = 0; i < snapshot_count; i++)
+    {
+      size_t length = strlen(snapshots[i].dir);
+      const char *name = file + length;
+      const snapshot_word_t *entry;
+      snapshot_word_t signature[SNAPSHOT_SIGNATURE_WORDS];
+
+      if (strncmp(file, snapshots[i].dir, length) != 0 || name[0] != '/')
+	continue;
+      while (name[0] == '/')
+	name++;
+      entry = snapshot_find(snapshots + i, name);
+      if (!entry)
+	continue;
+      if (!file_signature(file, signature) ||
+	  memcmp(signature, entry + 3, sizeof(signature)) != 0)
+	{
+	  stp_deprintf(STP_DBG_XML,
+		       "XML snapshot: `%s' has changed\n", file);
+	  return NULL;
+	}
+      *snap = snapshots + i;
+      return entry;
+    }
+  return NULL;
+}
+
+stp_mxml_node_t *
+stpi_xml_snapshot_load(const char *file)
+{
+  const snapshot_t *snap;
+  const snapshot_word_t *entry = snapshot_lookup(file, &snap);
+  stp_mxml_node_t *doc;
+  size_t pos;
+
+  if (!entry)
+    return NULL;
+  pos = entry[1];
+  doc = snapshot_read_node(snap, STP_MXML_NO_PARENT, &pos);
+  if (!doc)
+    {
+      stp_erprintf("stp_xml_load_file: %s: bad XML snapshot entry\n", file);
+      return NULL;
+    }
+  stp_deprintf(STP_DBG_XML, "stp_xml_load_file: `%s' from snapshot\n", file);
+  return doc;
+}
+
+struct stpi_xml_snapshot_reader
+{
+  const snapshot_t *snap;
+  size_t pos;
+  size_t end;
+  int failed;
+};
+
+static void
+reader_fail(stpi_xml_snapshot_reader_t *r)
+{
+  r->pos = r->end;
+  r->failed = 1;
+}
+
+int
+stpi_xml_snapshot_get_int(stpi_xml_snapshot_reader_t *r)
+{
+  if (r->pos >= r->end)
+    {
+      reader_fail(r);
+      return 0;
+    }
+  return (int) r->snap->words[r->pos++];
+}
+
+double
+stpi_xml_snapshot_get_double(stpi_xml_snapshot_reader_t *r)
+{
+  double val;
+  if (r->pos + sizeof(double) / sizeof(snapshot_word_t) > r->end)
+    {
+      reader_fail(r);
+      return 0;
+    }
+  memcpy(&val, r->snap->words + r->pos, sizeof(double));
+  r->pos += sizeof(double) / sizeof(snapshot_word_t);
+  return val;
+}
+
+const char *
+stpi_xml_snapshot_get_string(stpi_xml_snapshot_reader_t *r)
+{
+  const char *string;
+  if (r->pos >= r->end)
+    {
+      reader_fail(r);
+      return NULL;
+    }
+  if (r->snap->words[r->pos] == SNAPSHOT_NULL)
+    {
+      r->pos++;
+      return NULL;
+    }
+  string = snapshot_string(r->snap, r->snap->words[r->pos++]);
+  if (!string)
+    reader_fail(r);
+  return string;
+}
+
+int
+stpi_xml_snapshot_at_end(const stpi_xml_snapshot_reader_t *r)
+{
+  return r->pos >= r->end;
+}
+
+int
+stpi_xml_snapshot_read_ok(const stpi_xml_snapshot_reader_t *r)
+{
+  return !r->failed;
+}
+
+int
+stpi_xml_snapshot_process(const char *file)
+{
+  const snapshot_t *snap;
+  const snapshot_word_t *entry = snapshot_lookup(file, &snap);
+  stpi_xml_snapshot_write_func write_func;
+  stpi_xml_snapshot_read_func read_func;
+  size_t sections;
+  size_t start;
+  size_t pos;
+  size_t i;
+
+  if (!entry || entry[2] == 0 || entry[2] >= snap->word_count)
+    return 0;
+
+  /*
+   * Check every section before loading any, so that a file is either
+   * loaded from the snapshot or parsed, never both.
+   */
+  sections = snap->words[entry[2]];
+  start = entry[2] + 1;
+  for (i = 0, pos = start; i < sections; i++)
+    {
+      const char *name;
+      if (pos + 2 > snap->word_count ||
+	  snap->words[pos + 1] > snap->word_count - pos - 2 ||
+	  !(name = snapshot_string(snap, snap->words[pos])) ||
+	  !stpi_xml_get_snapshot_funcs(name, &write_func, &read_func) ||
+	  !read_func)
+	return 0;
+      pos += 2 + snap->words[pos + 1];
+    }
+
+  for (i = 0, pos = start; i < sections; i++)
+    {
+      stpi_xml_snapshot_reader_t r;
+      stpi_xml_get_snapshot_funcs(snapshot_string(snap, snap->words[pos]),
+				  &write_func, &read_func);
+      r.snap = snap;
+      r.pos = pos + 2;
+      r.end = r.pos + snap->words[pos + 1];
+      r.failed = 0;
+      if (!(read_func)(&r) || !stpi_xml_snapshot_read_ok(&r))
+	stp_erprintf("stp_xml_parse_file: %s: bad XML snapshot entry\n",
+		     file);
+      pos = r.end;
+    }
+  stp_deprintf(STP_DBG_XML, "stp_xml_parse_file: `%s' from snapshot\n",
+	       file);
+  return 1;
+}
+
+/*
+ * Writing the snapshot
+ */
+
+struct stpi_xml_snapshot_writer
+{
+  snapshot_word_t *words;
+  size_t count;
+  size_t size;
+  char *strings;
+  size_t string_bytes;
+  size_t string_size;
+  snapshot_word_t *hash;	/* String offset + 1, or 0 if empty */
+  size_t hash_size;
+  size_t hash_count;
+};
+
+static void
+writer_add_word(stpi_xml_snapshot_writer_t *w, snapshot_word_t word)
+{
+  if (w->count == w->size)
+    {
+      w->size = w->size ? w->size * 2 : 65536;
+      w->words = stp_realloc(w->words, w->size * sizeof(snapshot_word_t));
+    }
+  w->words[w->count++] = word;
+}
+
+static unsigned
+string_hash(const char *s)
+{
+  return hash_bytes(2166136261u, s, strlen(s));
+}
+
+static void
+writer_rehash(stpi_xml_snapshot_writer_t *w)
+{
+  size_t old_size = w->hash_size;
+  snapshot_word_t *old_hash = w->hash;
+  size_t i;
+  w->hash_size = old_size ? old_size * 2 : 4096;
+  w->hash = stp_zalloc(w->hash_size * sizeof(snapshot_word_t));
+  for (i = 0; i < old_size; i++)
+    if (old_hash[i])
+      {
+	size_t j = string_hash(w->strings + old_hash[i] - 1) &
+	  (w->hash_size - 1);
+	while (w->hash[j])
+	  j = (j + 1) & (w->hash_size - 1);
+	w->hash[j] = old_hash[i];
+      }
+  STP_SAFE_FREE(old_hash);
+}
+
+/*
+ * Return the offset of string in the string pool, adding it if it is
+ * not there already.
+ */
+static snapshot_word_t
+writer_add_string(stpi_xml_snapshot_writer_t *w, const char *s)
+{
+  size_t length = strlen(s) + 1;
+  size_t j;
+  if (2 * (w->hash_count + 1) > w->hash_size)
+    writer_rehash(w);
+  j = string_hash(s) & (w->hash_size - 1);
+  while (w->hash[j])
+    {
+      if (strcmp(w->strings + w->hash[j] - 1, s) == 0)
+	return w->hash[j] - 1;
+      j = (j + 1) & (w->hash_size - 1);
+    }
+  if (w->string_bytes + length > w->string_size)
+    {
+      while (w->string_bytes + length > w->string_size)
+	w->string_size = w->string_size ? w->string_size * 2 : 65536;
+      w->strings = stp_realloc(w->strings, w->string_size);
+    }
+  memcpy(w->strings + w->string_bytes, s, length);
+  w->hash[j] = w->string_bytes + 1;
+  w->hash_count++;
+  w->string_bytes += length;
+  return w->hash[j] - 1;
+}
+
+/*
+ * Append the records for node and its children.  Returns 0 if the tree
+ * contains nodes other than elements and text, which the XML parser
+ * does not create for our files.
+ */
+static int
+writer_add_tree(stpi_xml_snapshot_writer_t *w, stp_mxml_node_t *node)
+{
+  size_t start = w->count;
+  stp_mxml_node_t *child;
+  int i;
+  if (node->type == STP_MXML_TEXT)
+    {
+      writer_add_word(w, STP_MXML_TEXT);
+      writer_add_word(w, node->value.text.whitespace);
+      writer_add_word(w, writer_add_string(w, node->value.text.string));
+      return 1;
+    }
+  if (node->type != STP_MXML_ELEMENT)
+    return 0;
+  writer_add_word(w, STP_MXML_ELEMENT);
+  writer_add_word(w, writer_add_string(w, node->value.element.name));
+  writer_add_word(w, node->value.element.num_attrs);
+  writer_add_word(w, 0);
+  for (i = 0; i < node->value.element.num_attrs; i++)
+    {
+      stp_mxml_attr_t *attr = node->value.element.attrs + i;
+      if (!attr->value)
+	return 0;
+      writer_add_word(w, writer_add_string(w, attr->name));
+      writer_add_word(w, writer_add_string(w, attr->value));
+    }
+  for (child = node->child; child; child = child->next)
+    {
+      if (!writer_add_tree(w, child))
+	return 0;
+      w->words[start + 3]++;
+    }
+  return 1;
+}
+
+void
+stpi_xml_snapshot_put_int(stpi_xml_snapshot_writer_t *w, int val)
+{
+  writer_add_word(w, (snapshot_word_t) val);
+}
+
+void
+stpi_xml_snapshot_put_double(stpi_xml_snapshot_writer_t *w, double val)
+{
+  snapshot_word_t words[sizeof(double) / sizeof(snapshot_word_t)];
+  size_t i;
+  memcpy(words, &val, sizeof(double));
+  for (i = 0; i < sizeof(double) / sizeof(snapshot_word_t); i++)
+    writer_add_word(w, words[i]);
+}
+
+void
+stpi_xml_snapshot_put_string(stpi_xml_snapshot_writer_t *w,
+			     const char *string)
+{
+  writer_add_word(w, string ? writer_add_string(w, string) : SNAPSHOT_NULL);
+}
+
+/*
+ * Append the processed data of doc and return its offset, or return 0
+ * if it has no element that is processed when it is parsed, or one
+ * whose parser cannot store it in the snapshot.
+ */
+static size_t
+writer_add_processed(stpi_xml_snapshot_writer_t *w, stp_mxml_node_t *doc)
+{
+  stp_mxml_node_t *root = snapshot_root(doc);
+  stp_mxml_node_t *child;
+  size_t start = w->count;
+
+  if (!root)
+    return 0;
+  writer_add_word(w, 0);
+  for (child = root->child; child; child = child->next)
+    {
+      stpi_xml_snapshot_write_func write_func;
+      stpi_xml_snapshot_read_func read_func;
+      size_t section = w->count;
+      if (child->type != STP_MXML_ELEMENT ||
+	  !stpi_xml_get_snapshot_funcs(child->value.element.name,
+				       &write_func, &read_func))
+	continue;
+      if (!write_func || !read_func)
+	break;
+      writer_add_word(w, writer_add_string(w, child->value.element.name));
+      writer_add_word(w, 0);
+      if (!(write_func)(child, w))
+	break;
+      w->words[section + 1] = w->count - section - 2;
+      w->words[start]++;
+    }
+  if (!child && w->words[start] > 0)
+    return start;
+  w->count = start;
+  return 0;
+}
+
+static const char *
+file_namefunc(const void *item)
+{
+  return (const char *) item;
+}
+
+static int
+file_compare(const void *a, const void *b)
+{
+  return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+/*
+ * Add every XML file under dir to files.
+ */
+static void
+snapshot_scan_directory(stp_list_t *files, const char *dir)
+{
+  DIR *dp = opendir(dir);
+  struct dirent *d;
+  if (!dp)
+    return;
+  while ((d = readdir(dp)) != NULL)
+    {
+      struct stat st;
+      size_t length = strlen(d->d_name);
+      char *name;
+      if (d->d_name[0] == '.')
+	continue;
+      name = stpi_path_merge(dir, d->d_name);
+      if (stat(name, &st) != 0)
+	stp_free(name);
+      else if (S_ISDIR(st.st_mode))
+	{
+	  snapshot_scan_directory(files, name);
+	  stp_free(name);
+	}
+      else if (S_ISREG(st.st_mode) && length > 4 &&
+	       strcmp(d->d_name + length - 4, ".xml") == 0 &&
+	       strncmp(d->d_name, "dither-matrix-", 14) != 0 &&
+	       !stp_list_get_item_by_name(files, name))
+	stp_list_item_create(files, NULL, name);
+      else
+	stp_free(name);
+    }
+  closedir(dp);
+}
+
+int
+stpi_xml_write_snapshot(const char *dir, const char *file)
+{
+  stpi_xml_snapshot_writer_t w;
+  stp_list_t *dir_list = NULL;
+  stp_list_t *files = stp_list_create();
+  stp_list_item_t *item;
+  char *filename;
+  const char **names;
+  size_t prefix;
+  int file_count;
+  snapshot_word_t header[SNAPSHOT_HEADER_WORDS];
+  snapshot_word_t *table;
+  size_t table_words;
+  int nfiles = 0;
+  int status;
+  int i;
+  char *data;
+  size_t bytes;
+
+  if (!dir)
+    {
+      dir_list = stpi_data_path();
+      item = stp_list_get_start(dir_list);
+      if (!item)
+	{
+	  stp_list_destroy(dir_list);
+	  stp_list_destroy(files);
+	  return 0;
+	}
+      dir = (const char *) stp_list_item_get_data(item);
+    }
+  filename = file ? stp_strdup(file) : stpi_path_merge(dir, SNAPSHOT_NAME);
+  stp_list_set_freefunc(files, stp_list_node_free_data);
+  stp_list_set_namefunc(files, file_namefunc);
+  snapshot_scan_directory(files, dir);
+
+  /*
+   * The file table is searched by name relative to dir.  Every path
+   * starts with dir and a slash, so sorting the full paths sorts the
+   * relative names.
+   */
+  prefix = strlen(dir) + 1;
+  file_count = stp_list_get_length(files);
+  names = stp_malloc(sizeof(const char *) * (file_count + 1));
+  for (i = 0, item = stp_list_get_start(files); item;
+       i++, item = stp_list_item_next(item))
+    names[i] = (const char *) stp_list_item_get_data(item);
+  qsort(names, file_count, sizeof(const char *), file_compare);
+
+  memset(&w, 0, sizeof(w));
+  table = stp_malloc(SNAPSHOT_ENTRY_WORDS * sizeof(snapshot_word_t) *
+		     (file_count + 1));
+  stp_xml_init();
+  for (i = 0; i < file_count; i++)
+    {
+      const char *name = names[i];
+      snapshot_word_t *entry = table + SNAPSHOT_ENTRY_WORDS * nfiles;
+      stp_mxml_node_t *doc = NULL;
+      size_t start = w.count;
+      if (file_signature(name, entry + 3))
+	doc = stp_mxmlLoadFromFile(NULL, name, STP_MXML_NO_CALLBACK);
+      if (doc && writer_add_tree(&w, doc))
+	{
+	  const char *relative = name + prefix;
+	  while (relative[0] == '/')
+	    relative++;
+	  entry[0] = writer_add_string(&w, relative);
+	  entry[1] = start;
+	  entry[2] = writer_add_processed(&w, doc);
+	  nfiles++;
+	}
+      else
+	{
+	  stp_erprintf("stpi_xml_write_snapshot: cannot use %s\n", name);
+	  w.count = start;
+	}
+      if (doc)
+	stp_mxmlDelete(doc);
+    }
+  stp_xml_exit();
+
+  /* Node and processed data offsets are relative to the start of the payload */
+  table_words = SNAPSHOT_HEADER_WORDS + SNAPSHOT_ENTRY_WORDS * nfiles;
+  for (i = 0; i < nfiles; i++)
+    {
+      table[SNAPSHOT_ENTRY_WORDS * i + 1] += table_words;
+      if (table[SNAPSHOT_ENTRY_WORDS * i + 2])
+	table[SNAPSHOT_ENTRY_WORDS * i + 2] += table_words;
+    }
+  header[0] = nfiles;
+  header[1] = (table_words + w.count) * sizeof(snapshot_word_t);
+  header[2] = w.string_bytes;
+
+  bytes = header[1] + w.string_bytes;
+  data = stp_malloc(bytes);
+  memcpy(data, header, sizeof(header));
+  memcpy(data + sizeof(header), table,
+	 SNAPSHOT_ENTRY_WORDS * nfiles * sizeof(snapshot_word_t));
+  memcpy(data + table_words * sizeof(snapshot_word_t), w.words,
+	 w.count * sizeof(snapshot_word_t));
+  memcpy(data + header[1], w.strings, w.string_bytes);
+  status = stpi_binary_cache_write_file(filename, SNAPSHOT_MAGIC, NULL,
+					data, bytes);
+  if (!status)
+    stp_erprintf("stpi_xml_write_snapshot: cannot write %s\n", filename);
+  stp_free(data);
+  stp_free(table);
+  stp_free(names);
+  stp_free(filename);
+  STP_SAFE_FREE(w.words);
+  STP_SAFE_FREE(w.strings);
+  STP_SAFE_FREE(w.hash);
+  stp_list_destroy(files);
+  if (dir_list)
+    stp_list_destroy(dir_list);
+  return status ? nfiles : 0;
+}
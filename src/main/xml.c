@@ -45,6 +45,8 @@ typedef struct
 {
   char *name;
   stp_xml_parse_func parse_func;
+  stpi_xml_snapshot_write_func snapshot_write_func;
+  stpi_xml_snapshot_read_func snapshot_read_func;
 } stpi_xml_parse_registry;
 
 static stp_list_t *stpi_xml_registry;
@@ -92,6 +94,8 @@ stp_register_xml_parser(const char *name, stp_xml_parse_func parse_func)
       stp_list_item_create(stpi_xml_registry, NULL, xmlp);
     }
   xmlp->parse_func = parse_func;
+  xmlp->snapshot_write_func = NULL;
+  xmlp->snapshot_read_func = NULL;
 }
 
 void
@@ -102,6 +106,36 @@ stp_unregister_xml_parser(const char *name)
     stp_list_item_destroy(stpi_xml_registry, item);
 }
 
+void
+stpi_register_xml_snapshot(const char *name,
+			   stpi_xml_snapshot_write_func write_func,
+			   stpi_xml_snapshot_read_func read_func)
+{
+  stp_list_item_t *item = stp_list_get_item_by_name(stpi_xml_registry, name);
+  if (item)
+    {
+      stpi_xml_parse_registry *xmlp =
+	(stpi_xml_parse_registry *) stp_list_item_get_data(item);
+      xmlp->snapshot_write_func = write_func;
+      xmlp->snapshot_read_func = read_func;
+    }
+}
+
+int
+stpi_xml_get_snapshot_funcs(const char *name,
+			    stpi_xml_snapshot_write_func *write_func,
+			    stpi_xml_snapshot_read_func *read_func)
+{
+  stp_list_item_t *item = stp_list_get_item_by_name(stpi_xml_registry, name);
+  const stpi_xml_parse_registry *xmlp;
+  if (!item)
+    return 0;
+  xmlp = (const stpi_xml_parse_registry *) stp_list_item_get_data(item);
+  *write_func = xmlp->snapshot_write_func;
+  *read_func = xmlp->snapshot_read_func;
+  return 1;
+}
+
 void
 stp_register_xml_preload(const char *filename)
 {
@@ -240,6 +274,19 @@ stp_xml_init_defaults(void)
 }
 
 
+/*
+ * Load the tree of a single XML file, from the compiled snapshot if it
+ * is there.  Returns NULL if the file cannot be read.
+ */
+stp_mxml_node_t *
+stp_xml_load_file(const char *file) /* File to load */
+{
+  stp_mxml_node_t *doc = stpi_xml_snapshot_load(file);
+  if (!doc)
+    doc = stp_mxmlLoadFromFile(NULL, file, STP_MXML_NO_CALLBACK);
+  return doc;
+}
+
 /*
  * Parse a single XML file.
  */
@@ -252,18 +299,31 @@ stp_xml_parse_file(const char *file) /* File to parse */
 
   stp_deprintf(STP_DBG_XML, "stp_xml_parse_file: reading  `%s'...\n", file);
 
-  fp = fopen(file, "r");
-  if (!fp)
-    {
-      stp_erprintf("stp_xml_parse_file: unable to open %s: %s\n", file,
-		   strerror(errno));
-      return 1;
-    }
+  if (stpi_xml_snapshot_process(file))
+    return 0;
 
   stp_xml_init();
 
-  doc = stp_mxmlLoadFile(NULL, fp, STP_MXML_NO_CALLBACK);
-  fclose(fp);
+  doc = stpi_xml_snapshot_load(file);
+  if (!doc)
+    {
+      fp = fopen(file, "r");
+      if (!fp)
+	{
+	  stp_erprintf("stp_xml_parse_file: unable to open %s: %s\n", file,
+		       strerror(errno));
+	  stp_xml_exit();
+	  return 1;
+	}
+      doc = stp_mxmlLoadFile(NULL, fp, STP_MXML_NO_CALLBACK);
+      fclose(fp);
+      if (!doc)
+	{
+	  stp_erprintf("stp_xml_parse_file: unable to parse %s\n", file);
+	  stp_xml_exit();
+	  return 1;
+	}
+    }
 
   cur = doc->child;
   while (cur &&
@@ -0,0 +1,80 @@
+/*
+ * Compile the XML printer database into a binary snapshot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The snapshot holds the XML files under one data directory, by
+ * default the first directory on the data path (STP_DATA_PATH or the
+ * installed data directory), and the printer and paper data processed
+ * from them.  It is written to xml-snapshot.bin in that directory
+ * unless -o names another file.  The library looks for the snapshot in
+ * each data directory, and parses any file that has changed since the
+ * snapshot was written as usual.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <gutenprint/gutenprint.h>
+#include "../main/gutenprint-internal.h"
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-o output-file] [data-directory]\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *output = NULL;
+  const char *dir = NULL;
+  int count;
+  int c;
+  while ((c = getopt(argc, argv, "o:")) != -1)
+    {
+      switch (c)
+	{
+	case 'o':
+	  output = optarg;
+	  break;
+	default:
+	  usage(argv[0]);
+	  return 2;
+	}
+    }
+  if (argc - optind > 1)
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  if (optind < argc)
+    dir = argv[optind];
+  stp_init();
+  count = stpi_xml_write_snapshot(dir, output);
+  if (count == 0)
+    {
+      fprintf(stderr, "%s: cannot write the XML snapshot\n", argv[0]);
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ *   Benchmark for the bit shuffling routines used by the weave code.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * stp_fold() and stp_unpack() select vector code the first time they are
+ * called, so the scalar code is timed in a child process run with
+ * STP_NO_SIMD set.  The child sends its checksums back to the parent,
+ * which reports any difference in the results.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include <gutenprint/gutenprint-module.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define LINE_LENGTH	1440	/* 8in * 1440dpi at 1 bit, 4in at 2 bits */
+#define PASSES		20000
+
+typedef struct
+{
+  const char *name;
+  int bits;			/* 0 for stp_fold */
+  int n;
+} bench_t;
+
+static const bench_t benches[] =
+{
+  { "fold",       0, 2 },
+  { "unpack 1x2", 1, 2 },
+  { "unpack 1x4", 1, 4 },
+  { "unpack 1x8", 1, 8 },
+  { "unpack 2x2", 2, 2 },
+  { "unpack 2x4", 2, 4 },
+  { "unpack 2x8", 2, 8 },
+};
+
+#define BENCH_COUNT ((int) (sizeof(benches) / sizeof(bench_t)))
+
+static unsigned char in[LINE_LENGTH * 2];
+static unsigned char out[8][LINE_LENGTH * 2];
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static unsigned
+checksum(int n, int bytes)
+{
+  unsigned sum = 2166136261u;
+  int i, j;
+  for (i = 0; i < n; i++)
+    for (j = 0; j < bytes; j++)
+      sum = (sum ^ out[i][j]) * 16777619u;
+  return sum;
+}
+
+static void
+run_benches(double *times, unsigned *sums)
+{
+  int b, pass;
+  for (b = 0; b < BENCH_COUNT; b++)
+    {
+      const bench_t *bench = &(benches[b]);
+      unsigned char *outs[8];
+      double start;
+      int i;
+      for (i = 0; i < 8; i++)
+	outs[i] = out[i];
+      memset(out, 0, sizeof(out));
+      start = now();
+      for (pass = 0; pass < PASSES; pass++)
+	{
+	  if (bench->bits == 0)
+	    stp_fold(in, LINE_LENGTH, out[0]);
+	  else
+	    stp_unpack(LINE_LENGTH, bench->bits, bench->n, in, outs);
+	}
+      times[b] = now() - start;
+      if (bench->bits == 0)
+	sums[b] = checksum(1, LINE_LENGTH * 2);
+      else
+	sums[b] = checksum(bench->n, LINE_LENGTH * 2 / bench->n);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+  double scalar_times[BENCH_COUNT], times[BENCH_COUNT];
+  unsigned scalar_sums[BENCH_COUNT], sums[BENCH_COUNT];
+  int fds[2];
+  pid_t pid;
+  int status = 0;
+  int b;
+
+  srand(1);
+  for (b = 0; b < (int) sizeof(in); b++)
+    in[b] = (rand() % 3) ? rand() : 0;
+
+  stp_init();
+  if (pipe(fds) != 0)
+    {
+      perror("pipe");
+      return 1;
+    }
+  pid = fork();
+  if (pid < 0)
+    {
+      perror("fork");
+      return 1;
+    }
+  if (pid == 0)
+    {
+      setenv("STP_NO_SIMD", "1", 1);
+      run_benches(scalar_times, scalar_sums);
+      if (write(fds[1], scalar_times, sizeof(scalar_times)) < 0 ||
+	  write(fds[1], scalar_sums, sizeof(scalar_sums)) < 0)
+	_exit(1);
+      _exit(0);
+    }
+  waitpid(pid, NULL, 0);
+  if (read(fds[0], scalar_times, sizeof(scalar_times)) !=
+      sizeof(scalar_times) ||
+      read(fds[0], scalar_sums, sizeof(scalar_sums)) != sizeof(scalar_sums))
+    {
+      fprintf(stderr, "Scalar benchmark failed\n");
+      return 1;
+    }
+  run_benches(times, sums);
+
+  printf("%-12s %10s %10s %8s\n", "", "scalar MB/s", "MB/s", "speedup");
+  for (b = 0; b < BENCH_COUNT; b++)
+    {
+      double mb = (double) LINE_LENGTH * (benches[b].bits ? benches[b].bits : 2)
+	* PASSES / 1000000.0;
+      printf("%-12s %10.0f %10.0f %7.2fx%s\n", benches[b].name,
+	     mb / scalar_times[b], mb / times[b], scalar_times[b] / times[b],
+	     scalar_sums[b] == sums[b] ? "" : "  MISMATCH");
+      if (scalar_sums[b] != sums[b])
+	status = 1;
+    }
+  return status;
+}
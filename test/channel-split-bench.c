@@ -0,0 +1,270 @@
+/*
+ *   Check and benchmark for the splitting of channels into light and dark
+ *   inks.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Every value of a split channel is converted and compared with a table
+ * built the way stp_channel_initialize() used to build it, with one entry
+ * for each value and subchannel.  Each amount must be the same as in the
+ * table.  Unless -c is given, the conversion of rows of random values is
+ * then timed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include <gutenprint/gutenprint-module.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define VALUES		65536
+#define BENCH_WIDTH	5760	/* 8in * 720dpi */
+#define BENCH_ROWS	2000
+
+typedef struct
+{
+  const char *name;
+  int count;
+  double shades[6];		/* Darkest first, as in the ink files */
+  double cutoffs[6];		/* In the same order as the shades */
+} inkset_t;
+
+static const inkset_t inksets[] =
+{
+  { "2 shades 0.25",        2, { 1.0, 0.25 }, { 0.75, 0.75 } },
+  { "2 shades 0.34",        2, { 1.0, 0.34 }, { 0.75, 0.75 } },
+  { "2 shades 0.33 cut .5", 2, { 1.0, 0.33 }, { 0.5, 0.5 } },
+  { "3 shades",             3, { 1.0, 0.48, 0.16 }, { 0.75, 0.75, 0.75 } },
+  { "3 shades 0.278",       3, { 1.0, 0.278, 0.093 }, { 0.75, 0.75, 0.75 } },
+  { "4 shades",             4, { 1.0, 0.75, 0.5, 0.25 },
+    { 0.75, 0.75, 0.75, 0.75 } },
+  { "6 shades",             6, { 1.0, 0.75, 0.5, 0.45, 0.25, 0.15 },
+    { 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 } },
+  { "2 shades uneven",      2, { 1.0, 0.25 }, { 1.0, 0.5 } },
+  { "3 shades uneven",      3, { 1.0, 0.48, 0.16 }, { 1.0, 0.9, 0.4 } },
+  { "4 shades uneven",      4, { 1.0, 0.75, 0.5, 0.25 },
+    { 0.9, 0.6, 0.8, 0.5 } },
+  { "6 shades uneven",      6, { 1.0, 0.75, 0.5, 0.45, 0.25, 0.15 },
+    { 1.0, 0.7, 0.95, 0.6, 0.85, 0.3 } },
+};
+
+#define INKSET_COUNT ((int) (sizeof(inksets) / sizeof(inkset_t)))
+
+static int image_width = VALUES;
+
+static int
+bench_width(stp_image_t *image)
+{
+  return image_width;
+}
+
+static stp_image_t bench_image =
+{
+  NULL, NULL, bench_width
+};
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Subchannel K of the channel is shades[count - K - 1], lightest first.
+ * The breakpoint between two subchannels uses the geometric mean of
+ * their cutoffs.
+ */
+static unsigned short *
+build_table(const inkset_t *ink)
+{
+  int sc = ink->count;
+  double value[6];
+  double cutoff[6];
+  unsigned short *lut;
+  int val = 0;
+  int next_breakpoint;
+  int k;
+  if (sc < 2 || sc > 6)
+    return NULL;
+  lut = calloc(sizeof(unsigned short), sc * VALUES);
+  for (k = 0; k < sc; k++)
+    {
+      value[k] = ink->shades[sc - k - 1];
+      cutoff[k] = ink->cutoffs[sc - k - 1];
+    }
+  next_breakpoint = value[0] * 65535 * cutoff[0];
+  if (next_breakpoint > 65535)
+    next_breakpoint = 65535;
+  while (val <= next_breakpoint)
+    {
+      lut[val * sc + sc - 1] = (int) ((double) val / value[0]);
+      val++;
+    }
+  for (k = 0; k < sc - 1; k++)
+    {
+      int range;
+      int base = val;
+      next_breakpoint =
+	value[k + 1] * 65535 * sqrt(cutoff[k] * cutoff[k + 1]);
+      if (next_breakpoint > 65535)
+	next_breakpoint = 65535;
+      range = next_breakpoint - val;
+      while (val <= next_breakpoint)
+	{
+	  double where = ((double) val - base) / (double) range;
+	  double lower_val = base * (1.0 - where);
+	  double lower_amount = lower_val / value[k];
+	  double upper_amount = (val - lower_val) / value[k + 1];
+	  if (lower_amount > 65535.0)
+	    lower_amount = 65535.0;
+	  lut[val * sc + sc - k - 2] = upper_amount;
+	  lut[val * sc + sc - k - 1] = lower_amount;
+	  val++;
+	}
+    }
+  while (val <= 65535)
+    {
+      lut[val * sc] = val / value[sc - 1];
+      val++;
+    }
+  return lut;
+}
+
+/*
+ * Channel 0 is black and channel 2 yellow, both left empty so that the
+ * value of channel 1 is split as it is.
+ */
+static stp_vars_t *
+setup(const inkset_t *ink, int width)
+{
+  stp_vars_t *v = stp_vars_create();
+  int k;
+  stp_channel_add(v, 0, 0, 1.0);
+  for (k = 0; k < ink->count; k++)
+    {
+      stp_channel_add(v, 1, k, ink->shades[ink->count - k - 1]);
+      stp_channel_set_cutoff_adjustment(v, 1, k,
+					ink->cutoffs[ink->count - k - 1]);
+    }
+  stp_channel_add(v, 2, 0, 1.0);
+  stp_channel_set_black_channel(v, 0);
+  image_width = width;
+  stp_channel_initialize(v, &bench_image, 3);
+  return v;
+}
+
+static int
+check(const inkset_t *ink, int *max_diff)
+{
+  stp_vars_t *v = setup(ink, VALUES);
+  unsigned short *lut = build_table(ink);
+  unsigned short *input = stp_channel_get_input(v);
+  const unsigned short *output;
+  int sc = ink->count;
+  int mismatches = 0;
+  int i, k;
+  *max_diff = 65535;
+  if (!lut)
+    {
+      stp_vars_destroy(v);
+      return VALUES * sc;
+    }
+  for (i = 0; i < VALUES; i++)
+    {
+      input[i * 3] = 0;
+      input[i * 3 + 1] = i;
+      input[i * 3 + 2] = 0;
+    }
+  stp_channel_convert(v, NULL);
+  output = stp_channel_get_output(v);
+  *max_diff = 0;
+  for (i = 0; i < VALUES; i++)
+    for (k = 0; k < sc; k++)
+      {
+	int diff = abs((int) output[i * (sc + 2) + 1 + k] - lut[i * sc + k]);
+	if (diff > *max_diff)
+	  *max_diff = diff;
+	if (diff)
+	  mismatches++;
+      }
+  free(lut);
+  stp_vars_destroy(v);
+  return mismatches;
+}
+
+static double
+bench(const inkset_t *ink)
+{
+  stp_vars_t *v = setup(ink, BENCH_WIDTH);
+  unsigned short *row = malloc(sizeof(unsigned short) * 3 * BENCH_WIDTH);
+  double start;
+  int i;
+  for (i = 0; i < BENCH_WIDTH; i++)
+    {
+      row[i * 3] = rand() & 0x3fff;
+      row[i * 3 + 1] = rand() & 0xffff;
+      row[i * 3 + 2] = rand() & 0x3fff;
+    }
+  start = now();
+  for (i = 0; i < BENCH_ROWS; i++)
+    {
+      memcpy(stp_channel_get_input(v), row,
+	     sizeof(unsigned short) * 3 * BENCH_WIDTH);
+      stp_channel_convert(v, NULL);
+    }
+  start = now() - start;
+  free(row);
+  stp_vars_destroy(v);
+  return start;
+}
+
+int
+main(int argc, char **argv)
+{
+  int check_only = 0;
+  int status = 0;
+  int i;
+
+  if (argc > 1 && strcmp(argv[1], "-c") == 0)
+    check_only = 1;
+  srand(1);
+  stp_init();
+  printf("%-22s %10s %8s %12s\n", "", "mismatches", "max diff",
+	 check_only ? "" : "Mpixels/s");
+  for (i = 0; i < INKSET_COUNT; i++)
+    {
+      int max_diff;
+      int mismatches = check(&(inksets[i]), &max_diff);
+      printf("%-22s %10d %8d", inksets[i].name, mismatches, max_diff);
+      if (!check_only)
+	{
+	  double t = bench(&(inksets[i]));
+	  printf(" %12.1f", (double) BENCH_WIDTH * BENCH_ROWS / t / 1000000.0);
+	}
+      printf("%s\n", mismatches ? "  FAILED" : "");
+      if (mismatches)
+	status = 1;
+    }
+  return status;
+}
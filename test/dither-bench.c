@@ -0,0 +1,422 @@
+/*
+ *   Benchmark for the dithering algorithms.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Every dither algorithm is timed for each combination of ink set, bit
+ * depth, row width, aspect ratio and content, set up the way testdither
+ * sets them up.  The input rows are generated from a fixed seed, so that
+ * every run (and every algorithm within a run) dithers the same data.
+ * One line is printed for each combination:
+ *
+ *   dither-bench: algorithm=A inks=I channels=N bits=B width=W aspect=X:Y
+ *     content=C rows=R pixels=P seconds=S rows/s=RS pixels/s=PS
+ *
+ * Arguments of the form name=value restrict the runs to the given
+ * algorithm, inks, bits, width, aspect and content (each may be given
+ * more than once); pixels=N sets the number of pixels dithered by each
+ * run, and repeat=N times each run N times and reports the fastest.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "../src/main/gutenprint-internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_WIDTH	5760	/* 8in * 720dpi */
+#define SOURCE_ROWS	32	/* Distinct rows of input, used in turn */
+#define BENCH_PIXELS	1000000
+#define BENCH_SEED	1
+#define MAX_FILTERS	16
+
+#define SHADE(density, name)					\
+{  density, sizeof(name)/sizeof(stp_dotsize_t), name  }
+
+static const stp_dotsize_t single_dotsize[] =
+{
+  { 0x1, 1.0 }
+};
+
+static const stp_dotsize_t variable_dotsizes[] =
+{
+  { 0x1, 0.28 },
+  { 0x2, 0.58 },
+  { 0x3, 1.0  }
+};
+
+static const stp_shade_t normal_1bit_shades[] =
+{
+  SHADE(1.0, single_dotsize)
+};
+
+static const stp_shade_t photo_1bit_shades[] =
+{
+  SHADE(0.33, single_dotsize),
+  SHADE(1.0, single_dotsize)
+};
+
+static const stp_shade_t normal_2bit_shades[] =
+{
+  SHADE(1.0, variable_dotsizes)
+};
+
+static const stp_shade_t photo_2bit_shades[] =
+{
+  SHADE(0.33, variable_dotsizes),
+  SHADE(1.0, variable_dotsizes)
+};
+
+typedef struct
+{
+  const char *name;
+  const char *input_type;
+  int colors;			/* Bitmask of STP_ECOLOR_* */
+  int photo;			/* Light cyan and magenta */
+} inkset_t;
+
+static const inkset_t inksets[] =
+{
+  { "gray",      "Grayscale", 1 << STP_ECOLOR_K, 0 },
+  { "cmy",       "RGB",       (1 << STP_ECOLOR_C) | (1 << STP_ECOLOR_M) |
+			      (1 << STP_ECOLOR_Y), 0 },
+  { "cmyk",      "CMYK",      (1 << STP_ECOLOR_C) | (1 << STP_ECOLOR_M) |
+			      (1 << STP_ECOLOR_Y) | (1 << STP_ECOLOR_K), 0 },
+  { "photocmyk", "CMYK",      (1 << STP_ECOLOR_C) | (1 << STP_ECOLOR_M) |
+			      (1 << STP_ECOLOR_Y) | (1 << STP_ECOLOR_K), 1 },
+};
+
+typedef struct
+{
+  const char *name;
+  int xdpi;
+  int ydpi;
+} aspect_t;
+
+static const aspect_t aspects[] =
+{
+  { "1:1", 720, 720 },
+  { "2:1", 1440, 720 },
+  { "1:2", 720, 1440 },
+};
+
+typedef enum
+{
+  CONTENT_FLAT,
+  CONTENT_GRADIENT,
+  CONTENT_PHOTO
+} content_t;
+
+static const char *const contents[] =
+{
+  "flat",
+  "gradient",
+  "photo",
+};
+
+static const int widths[] = { 720, 2880, MAX_WIDTH };
+static const int bit_depths[] = { 1, 2 };
+
+#define COUNT(x) ((int) (sizeof(x) / sizeof(x[0])))
+
+static const char *filters[MAX_FILTERS][2];
+static int filter_count = 0;
+static int bench_pixels = BENCH_PIXELS;
+static int bench_repeat = 1;
+
+static int image_width = MAX_WIDTH;
+
+static int
+bench_width(stp_image_t *image)
+{
+  return image_width;
+}
+
+static stp_image_t bench_image =
+{
+  NULL, NULL, bench_width
+};
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * rand() differs between C libraries; use our own generator so that the
+ * input is the same everywhere.
+ */
+static unsigned
+next_random(unsigned *seed)
+{
+  *seed = *seed * 1103515245u + 12345u;
+  return (*seed >> 16) & 0x7fff;
+}
+
+static int
+selected(const char *name, const char *value)
+{
+  int found = 0;
+  int i;
+  for (i = 0; i < filter_count; i++)
+    if (strcmp(filters[i][0], name) == 0)
+      {
+	if (strcmp(filters[i][1], value) == 0)
+	  return 1;
+	found = 1;
+      }
+  return !found;
+}
+
+static int
+selected_int(const char *name, int value)
+{
+  char buf[32];
+  sprintf(buf, "%d", value);
+  return selected(name, buf);
+}
+
+/*
+ * SOURCE_ROWS rows of COUNT channels each, in the order the dither
+ * expects them.
+ */
+static unsigned short *
+make_input(content_t content, int width, int count)
+{
+  unsigned short *input =
+    malloc(sizeof(unsigned short) * SOURCE_ROWS * width * count);
+  unsigned seed = BENCH_SEED;
+  double phase[2 * (STP_NCOLORS + 2)];
+  int row, x, k;
+  for (k = 0; k < 2 * count; k++)
+    phase[k] = next_random(&seed) / 32768.0;
+  for (row = 0; row < SOURCE_ROWS; row++)
+    for (x = 0; x < width; x++)
+      for (k = 0; k < count; k++)
+	{
+	  unsigned short *out = input + (row * width + x) * count + k;
+	  double val;
+	  switch (content)
+	    {
+	    case CONTENT_FLAT:
+	      *out = 65535 / 4;
+	      break;
+	    case CONTENT_GRADIENT:
+	      *out = ((x * 65535 / (width - 1)) + k * 65536 / count) & 65535;
+	      break;
+	    case CONTENT_PHOTO:
+	    default:
+	      /*
+	       * Smooth tones with some noise on top.
+	       */
+	      val = .4 +
+		.25 * sin(2 * M_PI * ((double) x / (width / 3) + phase[k])) *
+		cos(2 * M_PI * ((double) row / SOURCE_ROWS + phase[k + count])) +
+		.05 * ((next_random(&seed) / 16384.0) - 1.0);
+	      if (val < 0)
+		val = 0;
+	      else if (val > 1)
+		val = 1;
+	      *out = val * 65535;
+	      break;
+	    }
+	}
+  return input;
+}
+
+static void
+set_inks(stp_vars_t *v, const inkset_t *ink, int bits)
+{
+  const stp_shade_t *normal =
+    bits == 1 ? normal_1bit_shades : normal_2bit_shades;
+  const stp_shade_t *photo =
+    bits == 1 ? photo_1bit_shades : photo_2bit_shades;
+  if (bits == 2)
+    stp_dither_set_transition(v, ink->photo ? 0.7 : 0.5);
+  if (ink->colors & (1 << STP_ECOLOR_C))
+    {
+      if (ink->photo)
+	stp_dither_set_inks_full(v, STP_ECOLOR_C, 2, photo, 1.0, 0.65);
+      else
+	stp_dither_set_inks_full(v, STP_ECOLOR_C, 1, normal, 1.0, 0.65);
+    }
+  if (ink->colors & (1 << STP_ECOLOR_M))
+    {
+      if (ink->photo)
+	stp_dither_set_inks_full(v, STP_ECOLOR_M, 2, photo, 1.0, 0.6);
+      else
+	stp_dither_set_inks_full(v, STP_ECOLOR_M, 1, normal, 1.0, 0.6);
+    }
+  if (ink->colors & (1 << STP_ECOLOR_Y))
+    stp_dither_set_inks_full(v, STP_ECOLOR_Y, 1, normal, 1.0, 0.08);
+  if (ink->colors & (1 << STP_ECOLOR_K))
+    stp_dither_set_inks_full(v, STP_ECOLOR_K, 1, normal, 1.0, 1.0);
+}
+
+static void
+bench(const char *algorithm, const inkset_t *ink, int bits, int width,
+      const aspect_t *aspect, content_t content)
+{
+  stp_vars_t *v = stp_vars_create();
+  unsigned char *buffers[STP_NCOLORS][2];
+  size_t buffer_size = (width + 7) / 8 * 2;
+  unsigned short *input;
+  int rows = (bench_pixels + width - 1) / width;
+  double best = -1;
+  int count;
+  int color, i, r;
+
+  stp_set_string_parameter(v, "DitherAlgorithm", algorithm);
+  stp_set_string_parameter(v, "ChannelBitDepth", "8");
+  stp_set_string_parameter(v, "PrintingMode",
+			   ink->colors == (1 << STP_ECOLOR_K) ? "BW" : "Color");
+  stp_set_string_parameter(v, "InputImageType", ink->input_type);
+  image_width = width;
+  stp_dither_init(v, &bench_image, width, aspect->xdpi, aspect->ydpi);
+
+  memset(buffers, 0, sizeof(buffers));
+  for (color = 0; color < COUNT(buffers); color++)
+    if (ink->colors & (1 << color))
+      {
+	int subchannels =
+	  (ink->photo && (color == STP_ECOLOR_C || color == STP_ECOLOR_M)) ?
+	  2 : 1;
+	for (i = 0; i < subchannels; i++)
+	  {
+	    buffers[color][i] = malloc(buffer_size);
+	    stp_dither_add_channel(v, buffers[color][i], color, i);
+	  }
+      }
+
+  if (ink->photo)
+    stp_set_float_parameter(v, "GCRLower", 0.4 / bits + 0.1);
+  else
+    stp_set_float_parameter(v, "GCRLower", 0.25 / bits);
+  stp_set_float_parameter(v, "GCRUpper", .5);
+  set_inks(v, ink, bits);
+  stp_dither_set_ink_spread(v, 12 + bits);
+
+  count = stpi_dither_get_channel_count(v);
+  input = make_input(content, width, count);
+
+  for (r = 0; r < bench_repeat; r++)
+    {
+      double start = now();
+      for (i = 0; i < rows; i++)
+	stp_dither_internal(v, i, input + (i % SOURCE_ROWS) * width * count,
+			    0, 0, NULL);
+      start = now() - start;
+      if (best < 0 || start < best)
+	best = start;
+    }
+
+  printf("dither-bench: algorithm=%s inks=%s channels=%d bits=%d width=%d "
+	 "aspect=%s content=%s rows=%d pixels=%.0f seconds=%.6f "
+	 "rows/s=%.1f pixels/s=%.0f\n",
+	 algorithm, ink->name, count, bits, width, aspect->name,
+	 contents[content], rows, (double) rows * width, best,
+	 best > 0 ? rows / best : 0.0,
+	 best > 0 ? (double) rows * width / best : 0.0);
+  fflush(stdout);
+
+  free(input);
+  stp_vars_destroy(v);
+  for (color = 0; color < COUNT(buffers); color++)
+    for (i = 0; i < 2; i++)
+      free(buffers[color][i]);
+}
+
+int
+main(int argc, char **argv)
+{
+  stp_vars_t *v;
+  stp_parameter_t desc;
+  int a, n, b, w, s, c;
+
+  for (a = 1; a < argc; a++)
+    {
+      char *eq = strchr(argv[a], '=');
+      if (!eq || eq == argv[a])
+	{
+	  fprintf(stderr, "Usage: %s [name=value...]\n", argv[0]);
+	  return 1;
+	}
+      *eq = '\0';
+      if (strcmp(argv[a], "pixels") == 0)
+	bench_pixels = atoi(eq + 1);
+      else if (strcmp(argv[a], "repeat") == 0)
+	bench_repeat = atoi(eq + 1);
+      else if (filter_count < MAX_FILTERS)
+	{
+	  filters[filter_count][0] = argv[a];
+	  filters[filter_count][1] = eq + 1;
+	  filter_count++;
+	}
+    }
+  if (bench_pixels < 1)
+    bench_pixels = 1;
+  if (bench_repeat < 1)
+    bench_repeat = 1;
+
+  stp_init();
+  v = stp_vars_create();
+  stp_set_driver(v, "escp2-ex");
+  stp_describe_parameter(v, "DitherAlgorithm", &desc);
+
+  for (a = 0; a < stp_string_list_count(desc.bounds.str); a++)
+    {
+      const char *algorithm = stp_string_list_param(desc.bounds.str, a)->name;
+      if (strcmp(algorithm, "None") == 0 || !selected("algorithm", algorithm))
+	continue;
+      for (n = 0; n < COUNT(inksets); n++)
+	{
+	  if (!selected("inks", inksets[n].name))
+	    continue;
+	  for (b = 0; b < COUNT(bit_depths); b++)
+	    {
+	      if (!selected_int("bits", bit_depths[b]))
+		continue;
+	      for (w = 0; w < COUNT(widths); w++)
+		{
+		  if (!selected_int("width", widths[w]))
+		    continue;
+		  for (s = 0; s < COUNT(aspects); s++)
+		    {
+		      if (!selected("aspect", aspects[s].name))
+			continue;
+		      for (c = 0; c < COUNT(contents); c++)
+			if (selected("content", contents[c]))
+			  bench(algorithm, &(inksets[n]), bit_depths[b],
+				widths[w], &(aspects[s]), c);
+		    }
+		}
+	    }
+	}
+    }
+
+  stp_parameter_description_destroy(&desc);
+  stp_vars_destroy(v);
+  return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ *   Check that the threaded and banded rendering paths print the same
+ *   bytes as the serial one.
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Each job is printed once with the default settings, which render each
+ * row serially on one thread, and then once for each variant, such as
+ * PipelinedRendering, DitherThreads, PlaneThreads or an image that
+ * delivers a band of rows at a time.  The output of every variant must
+ * be byte for byte the same as the serial output.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_WIDTH	257
+#define IMAGE_HEIGHT	160
+
+/*
+ * A setting is "Name=value" for a string parameter, "b:Name=value",
+ * "i:Name=value" for boolean and integer parameters, or "GetRows" to
+ * give the image a get_rows function.
+ */
+typedef struct
+{
+  const char *printer;
+  const char *settings[3];
+} render_job_t;
+
+static const char *render_variants[][3] =
+{
+  { "i:DitherThreads=1" },
+  { "i:DitherThreads=4" },
+  { "b:PipelinedRendering=1" },
+  { "b:PipelinedRendering=1", "i:DitherThreads=4" },
+  { "GetRows" },
+  { "GetRows", "i:DitherThreads=4" },
+};
+
+static const char *plane_variants[][3] =
+{
+  { "i:PlaneThreads=1" },
+  { "i:PlaneThreads=3" },
+};
+
+static const render_job_t render_jobs[] =
+{
+  { "escp2-r800", { "DitherAlgorithm=Adaptive" } },
+  { "escp2-r800", { "DitherAlgorithm=Ordered" } },
+  { "escp2-r800", { "DitherAlgorithm=EvenTone" } },
+  { "bjc-iP4000", { "DitherAlgorithm=Adaptive" } },
+  { "pcl-550",    { "DitherAlgorithm=Adaptive" } },
+};
+
+static const render_job_t plane_jobs[] =
+{
+  { "canon-cp100", { NULL } },
+};
+
+typedef struct
+{
+  unsigned long long hash;
+  size_t bytes;
+} output_t;
+
+static output_t output;
+
+static void
+writefunc(void *data, const char *buf, size_t bytes)
+{
+  size_t i;
+  for (i = 0; i < bytes; i++)
+    {
+      output.hash ^= (unsigned char) buf[i];
+      output.hash *= 1099511628211ull;
+    }
+  output.bytes += bytes;
+}
+
+static void
+errfunc(void *data, const char *buf, size_t bytes)
+{
+  fwrite(buf, 1, bytes, stderr);
+}
+
+static void
+image_init(stp_image_t *image)
+{
+}
+
+static void
+image_reset(stp_image_t *image)
+{
+}
+
+static int
+image_width(stp_image_t *image)
+{
+  return IMAGE_WIDTH;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return IMAGE_HEIGHT;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "render-check";
+}
+
+static void
+image_conclude(stp_image_t *image)
+{
+}
+
+/*
+ * Gradients, flat areas and blank rows, so that both the dither and
+ * the blank row handling of each path are used.
+ */
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t limit, int row)
+{
+  int channels = limit / IMAGE_WIDTH;
+  int x, c;
+  for (x = 0; x < IMAGE_WIDTH; x++)
+    for (c = 0; c < channels; c++)
+      {
+	unsigned val;
+	if (row % 17 == 3)
+	  val = 0;
+	else if (row % 13 == 5 && c == 0)
+	  val = 0;
+	else if ((x / 9) % 5 == 2)
+	  val = row * 7;
+	else
+	  val = x * (c + 3) + row * (5 - c) + ((x * row) >> (c + 2));
+	data[x * channels + c] = val & 255;
+      }
+  return STP_IMAGE_STATUS_OK;
+}
+
+static stp_image_status_t
+image_get_rows(stp_image_t *image, unsigned char *data, size_t limit,
+	       int row, int count)
+{
+  int i;
+  for (i = 0; i < count; i++)
+    image_get_row(image, data + i * limit, limit, row + i);
+  return STP_IMAGE_STATUS_OK;
+}
+
+static stp_image_t the_image =
+{
+  image_init,
+  image_reset,
+  image_width,
+  image_height,
+  image_get_row,
+  image_get_appname,
+  image_conclude,
+  NULL
+};
+
+/*
+ * Apply setting to v.  Returns 0 if the printer does not list the
+ * parameter or it is inactive, since the variant would then not test
+ * anything.
+ */
+static int
+apply_setting(stp_vars_t *v, const char *setting, int *get_rows)
+{
+  char name[64];
+  const char *eq = strchr(setting, '=');
+  const char *start = setting;
+  stp_parameter_list_t params;
+  stp_parameter_t desc;
+  int active = 0;
+
+  if (strcmp(setting, "GetRows") == 0)
+    {
+      *get_rows = 1;
+      return 1;
+    }
+  if (setting[0] && setting[1] == ':')
+    start += 2;
+  if (!eq || eq - start >= (int) sizeof(name))
+    return 0;
+  memcpy(name, start, eq - start);
+  name[eq - start] = '\0';
+  if (setting[0] == 'b' && setting[1] == ':')
+    stp_set_boolean_parameter(v, name, atoi(eq + 1));
+  else if (setting[0] == 'i' && setting[1] == ':')
+    stp_set_int_parameter(v, name, atoi(eq + 1));
+  else
+    stp_set_string_parameter(v, name, eq + 1);
+  params = stp_get_parameter_list(v);
+  if (stp_parameter_find(params, name))
+    {
+      stp_describe_parameter(v, name, &desc);
+      active = desc.is_active;
+      stp_parameter_description_destroy(&desc);
+    }
+  stp_parameter_list_destroy(params);
+  return active;
+}
+
+/*
+ * Print job with the settings of variant (which may be NULL) added.
+ */
+static int
+print_job(const render_job_t *job, const char *const *variant,
+	  output_t *result)
+{
+  const stp_printer_t *printer = stp_get_printer_by_driver(job->printer);
+  stp_vars_t *v;
+  int get_rows = 0;
+  int left, right, bottom, top;
+  int status = 1;
+  int i;
+
+  if (!printer)
+    {
+      fprintf(stderr, "render-check: no printer %s\n", job->printer);
+      return 0;
+    }
+  v = stp_vars_create();
+  stp_set_printer_defaults(v, printer);
+  stp_set_driver(v, job->printer);
+  stp_set_outfunc(v, writefunc);
+  stp_set_errfunc(v, errfunc);
+  for (i = 0; i < 3 && job->settings[i]; i++)
+    apply_setting(v, job->settings[i], &get_rows);
+  for (i = 0; variant && i < 3 && variant[i]; i++)
+    if (!apply_setting(v, variant[i], &get_rows))
+      {
+	fprintf(stderr, "render-check: %s does not offer %s\n",
+		job->printer, variant[i]);
+	status = 0;
+      }
+  stp_get_imageable_area(v, &left, &right, &bottom, &top);
+  stp_set_left(v, left);
+  stp_set_top(v, top);
+  stp_set_width(v, right - left < 216 ? right - left : 216);
+  stp_set_height(v, bottom - top < 144 ? bottom - top : 144);
+
+  output.hash = 1469598103934665603ull;
+  output.bytes = 0;
+  if (status && stp_verify(v))
+    {
+      stp_start_job(v, &the_image);
+      if (get_rows)
+	stp_set_image_get_rows_func(v, &the_image, image_get_rows);
+      status = stp_print(v, &the_image) == 1;
+      stp_end_job(v, &the_image);
+    }
+  else
+    status = 0;
+  stp_vars_destroy(v);
+  *result = output;
+  return status && output.bytes > 0;
+}
+
+static int
+check_jobs(const render_job_t *jobs, int job_count,
+	   const char *const (*variants)[3], int variant_count)
+{
+  int failures = 0;
+  int i, j;
+  for (i = 0; i < job_count; i++)
+    {
+      output_t serial, result;
+      if (!print_job(jobs + i, NULL, &serial))
+	{
+	  fprintf(stderr, "render-check: cannot print %s\n", jobs[i].printer);
+	  failures++;
+	  continue;
+	}
+      for (j = 0; j < variant_count; j++)
+	{
+	  int k;
+	  int ok = print_job(jobs + i, variants[j], &result) &&
+	    result.bytes == serial.bytes && result.hash == serial.hash;
+	  printf("%s %s %s", ok ? "PASS" : "FAIL", jobs[i].printer,
+		 jobs[i].settings[0] ? jobs[i].settings[0] : "");
+	  for (k = 0; k < 3 && variants[j][k]; k++)
+	    printf(" %s", variants[j][k]);
+	  printf("\n");
+	  if (!ok)
+	    failures++;
+	}
+    }
+  return failures;
+}
+
+int
+main(int argc, char **argv)
+{
+  int failures;
+
+  stp_init();
+  failures =
+    check_jobs(render_jobs, sizeof(render_jobs) / sizeof(render_job_t),
+	       render_variants,
+	       sizeof(render_variants) / sizeof(render_variants[0]));
+  failures +=
+    check_jobs(plane_jobs, sizeof(plane_jobs) / sizeof(render_job_t),
+	       plane_variants,
+	       sizeof(plane_variants) / sizeof(plane_variants[0]));
+  if (failures)
+    {
+      fprintf(stderr, "render-check: %d failures\n", failures);
+      return 1;
+    }
+  return 0;
+}